@@ -0,0 +1,210 @@
+/*
+* MIT License
+* 
+* Copyright (c) 2020 ibaylov@gmail.com
+* 
+* Permission is hereby granted, free of charge, to any person obtaining a copy
+* of this software and associated documentation files (the "Software"), to deal
+* in the Software without restriction, including without limitation the rights
+* to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+* copies of the Software, and to permit persons to whom the Software is
+* furnished to do so, subject to the following conditions:
+* 
+* The above copyright notice and this permission notice shall be included in all
+* copies or substantial portions of the Software.
+* 
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+* AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+* OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+* SOFTWARE.
+*/
+#include "arena.hh"
+#include <new>
+
+namespace utl
+{
+
+///////////////////////////////////////////////////////////////////////////////
+// cArena implementation
+
+////////////////////////////////////////////////////
+/// \brief RoundUp - rounds a size up to the allocation alignment
+///
+inline size_t RoundUp( size_t nBytes )
+{
+    return ( nBytes + gnAllocAlign - 1 ) & ~( gnAllocAlign - 1 );
+}
+
+cArena::cArena( size_t nBlockSize )
+    : m_pFirst( nullptr ), m_pCurrent( nullptr ), m_pCursor( nullptr ), m_pEnd( nullptr ),
+      m_nBlockSize( RoundUp( nBlockSize ) ), m_nReserved( 0 )
+{
+}
+
+cArena::~cArena()
+{
+    Release();
+}
+
+char*
+cArena::BlockData( Block* pBlock )
+{
+    // the block header is padded to the alignment so the data starts aligned
+    return reinterpret_cast<char*>( pBlock ) + RoundUp( sizeof( Block ) );
+}
+
+void*
+cArena::Allocate( size_t nBytes )
+{
+    nBytes = RoundUp( nBytes );
+    if( m_pCursor + nBytes > m_pEnd ) // also true for the empty arena, where both are null
+        Advance( nBytes );
+    void* pRV = m_pCursor;
+    m_pCursor += nBytes;
+    return pRV;
+}
+
+void
+cArena::Advance( size_t nBytes )
+{
+    Block* pNext = m_pCurrent ? m_pCurrent->m_pNext : m_pFirst;
+    if( ! pNext || pNext->m_nSize < nBytes )
+    {
+        // no suitable block kept from the previous round; we link a new one right after the current
+        size_t nSize = nBytes > m_nBlockSize ? nBytes : m_nBlockSize;
+        Block* pBlock = static_cast<Block*>( ::operator new( RoundUp( sizeof( Block ) ) + nSize ));
+        pBlock->m_nSize = nSize;
+        pBlock->m_pNext = pNext;
+        if( m_pCurrent )
+            m_pCurrent->m_pNext = pBlock;
+        else
+            m_pFirst = pBlock;
+        m_nReserved += nSize;
+        pNext = pBlock;
+    }
+    m_pCurrent = pNext;
+    m_pCursor = BlockData( m_pCurrent );
+    m_pEnd = m_pCursor + m_pCurrent->m_nSize;
+}
+
+void
+cArena::Reset()
+{
+    // we simply rewind to the chain start; Allocate() will walk the kept blocks again
+    m_pCurrent = nullptr;
+    m_pCursor = nullptr;
+    m_pEnd = nullptr;
+}
+
+void
+cArena::Release()
+{
+    while( m_pFirst )
+    {
+        Block* pNext = m_pFirst->m_pNext;
+        ::operator delete( m_pFirst );
+        m_pFirst = pNext;
+    }
+    m_nReserved = 0;
+    Reset();
+}
+
+size_t
+cArena::GetReservedBytes() const
+{
+    return m_nReserved;
+}
+
+bool
+cArena::IsEmpty() const
+{
+    return ! m_pCurrent;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// cSlabPool implementation
+
+cSlabPool::cSlabPool( size_t nObjectSize, size_t nObjectsPerSlab )
+    : m_pSlabs( nullptr ), m_pFree( nullptr ),
+      m_nObjectSize( RoundUp( nObjectSize < sizeof( FreeItem ) ? sizeof( FreeItem ) : nObjectSize ) ),
+      m_nObjectsPerSlab( nObjectsPerSlab ), m_nInUse( 0 ), m_nReserved( 0 )
+{
+    _ASSERT( m_nObjectsPerSlab > 0 );
+}
+
+cSlabPool::~cSlabPool()
+{
+    Release();
+}
+
+void*
+cSlabPool::Allocate()
+{
+    if( ! m_pFree )
+        Grow();
+    FreeItem* pItem = m_pFree;
+    m_pFree = pItem->m_pNext;
+    m_nInUse ++;
+    return pItem;
+}
+
+void
+cSlabPool::Free( void* pObject )
+{
+    _ASSERT( pObject && m_nInUse > 0 );
+    FreeItem* pItem = static_cast<FreeItem*>( pObject );
+    pItem->m_pNext = m_pFree;
+    m_pFree = pItem;
+    m_nInUse --;
+}
+
+void
+cSlabPool::Grow()
+{
+    size_t nSlabBytes = RoundUp( sizeof( Slab )) + m_nObjectSize * m_nObjectsPerSlab;
+    Slab* pSlab = static_cast<Slab*>( ::operator new( nSlabBytes ));
+    pSlab->m_pNext = m_pSlabs;
+    m_pSlabs = pSlab;
+    m_nReserved += nSlabBytes;
+
+    // thread the objects on the free list backwards, so they are handed out in address order
+    char* pData = reinterpret_cast<char*>( pSlab ) + RoundUp( sizeof( Slab ));
+    size_t cObj;
+    for( cObj = m_nObjectsPerSlab; cObj > 0; cObj -- )
+    {
+        FreeItem* pItem = reinterpret_cast<FreeItem*>( pData + ( cObj - 1 ) * m_nObjectSize );
+        pItem->m_pNext = m_pFree;
+        m_pFree = pItem;
+    }
+}
+
+void
+cSlabPool::Release()
+{
+    while( m_pSlabs )
+    {
+        Slab* pNext = m_pSlabs->m_pNext;
+        ::operator delete( m_pSlabs );
+        m_pSlabs = pNext;
+    }
+    m_pFree = nullptr;
+    m_nInUse = 0;
+    m_nReserved = 0;
+}
+
+size_t
+cSlabPool::GetInUse() const
+{
+    return m_nInUse;
+}
+
+size_t
+cSlabPool::GetReservedBytes() const
+{
+    return m_nReserved;
+}
+
+} // NS end
@@ -0,0 +1,119 @@
+/*
+* MIT License
+* 
+* Copyright (c) 2020 ibaylov@gmail.com
+* 
+* Permission is hereby granted, free of charge, to any person obtaining a copy
+* of this software and associated documentation files (the "Software"), to deal
+* in the Software without restriction, including without limitation the rights
+* to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+* copies of the Software, and to permit persons to whom the Software is
+* furnished to do so, subject to the following conditions:
+* 
+* The above copyright notice and this permission notice shall be included in all
+* copies or substantial portions of the Software.
+* 
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+* AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+* OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+* SOFTWARE.
+*/
+#ifndef _ARENA_HH_
+#define _ARENA_HH_
+#include <cstdlib>
+#include "assert.hh"
+
+/**
+@file  arena.hh
+@brief Arena and slab allocators for the model elements
+The model produces and drops hundreds of thousands of small objects per frame. Instead of a malloc/free pair per object
+we use a bump arena for the transient objects, released at once by Reset(), and a slab pool of fixed-size blocks
+for the long-living cached objects.
+@note The allocators hand out raw memory; the caller constructs the objects with placement new. The destructors
+are never called by the allocators, so only objects without meaningful destructors should be placed there.
+*/
+
+namespace utl
+{
+    //////////////////////////////////////////////////
+    /// \brief gnAllocAlign - the alignment of every allocation unit
+    /// 16 bytes suffice for the scalars and SIMD tuples we place in the arenas
+    const size_t gnAllocAlign = 16;
+
+    //////////////////////////////////////////////////
+    /// \brief The cArena class
+    /// implements a bump allocator over a chain of memory blocks. Reset() rewinds the arena in O(1) and keeps the
+    /// blocks for the next round, so in steady state no system allocations are made at all
+    class cArena
+    {
+        protected:
+            struct Block
+            {
+                Block*  m_pNext;    //!< the next block in the chain
+                size_t  m_nSize;    //!< the usable size of the block in bytes
+            };
+            Block*  m_pFirst;       //!< the first block of the chain
+            Block*  m_pCurrent;     //!< the block we are currently allocating from
+            char*   m_pCursor;      //!< the first free byte in the current block
+            char*   m_pEnd;         //!< the end of the current block
+            size_t  m_nBlockSize;   //!< the default block size
+            size_t  m_nReserved;    //!< the total bytes reserved from the system
+        public:
+            cArena( size_t nBlockSize = 1 << 20 ); //!< Constructs an empty arena; nothing is allocated until the first request
+            ~cArena();                             //!< Returns all blocks to the system
+            #ifndef _NO_CXX_11_
+            cArena( const cArena& ) = delete;      //!< Prevent direct copy
+            #endif
+            // operations
+            void*  Allocate( size_t nBytes ); //!< Allocates nBytes aligned to gnAllocAlign
+            void   Reset();                   //!< Rewinds the arena, keeping the blocks. All allocations are invalidated
+            void   Release();                 //!< Returns all blocks to the system
+            size_t GetReservedBytes() const;  //!< Retrieves the memory reserved by the arena
+            bool   IsEmpty() const;           //!< Checks if nothing was allocated since the last Reset()
+        protected:
+            void   Advance( size_t nBytes );  //!< Moves to the next block, big enough for nBytes, allocating it if needed
+            static char* BlockData( Block* ); //!< Retrieves the usable data start of the block
+    };
+
+    //////////////////////////////////////////////////
+    /// \brief The cSlabPool class
+    /// implements a pool of fixed-size objects allocated in slabs of many objects, with a free list for reuse.
+    /// Release() returns all the slabs at once, without visiting the objects
+    class cSlabPool
+    {
+        protected:
+            struct Slab
+            {
+                Slab*   m_pNext;    //!< the next slab in the chain
+            };
+            struct FreeItem
+            {
+                FreeItem* m_pNext;  //!< the next free object
+            };
+            Slab*       m_pSlabs;           //!< the allocated slabs chain
+            FreeItem*   m_pFree;            //!< the free objects list
+            size_t      m_nObjectSize;      //!< the object size, rounded up to the alignment
+            size_t      m_nObjectsPerSlab;  //!< how many objects a slab holds
+            size_t      m_nInUse;           //!< objects currently handed out
+            size_t      m_nReserved;        //!< the total bytes reserved from the system
+        public:
+            cSlabPool( size_t nObjectSize, size_t nObjectsPerSlab = 256 ); //!< Constructs an empty pool for objects of nObjectSize bytes
+            ~cSlabPool();                                                  //!< Returns all slabs to the system
+            #ifndef _NO_CXX_11_
+            cSlabPool( const cSlabPool& ) = delete; //!< Prevent direct copy
+            #endif
+            // operations
+            void*  Allocate();         //!< Allocates a single object
+            void   Free( void* );      //!< Returns a single object to the pool
+            void   Release();          //!< Returns all slabs to the system. All allocations are invalidated
+            size_t GetInUse() const;   //!< Retrieves the number of objects handed out
+            size_t GetReservedBytes() const;  //!< Retrieves the memory reserved by the pool
+        protected:
+            void   Grow();             //!< Allocates a new slab and threads its objects on the free list
+    };
+}
+
+#endif
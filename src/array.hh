@@ -0,0 +1,291 @@
+/*
+* MIT License
+* 
+* Copyright (c) 2020 ibaylov@gmail.com
+* 
+* Permission is hereby granted, free of charge, to any person obtaining a copy
+* of this software and associated documentation files (the "Software"), to deal
+* in the Software without restriction, including without limitation the rights
+* to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+* copies of the Software, and to permit persons to whom the Software is
+* furnished to do so, subject to the following conditions:
+* 
+* The above copyright notice and this permission notice shall be included in all
+* copies or substantial portions of the Software.
+* 
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+* AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+* OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+* SOFTWARE.
+*/
+#ifndef _ARRAY_HH_
+#define _ARRAY_HH_
+#include <cstddef>
+#include "assert.hh"
+
+/**
+@file  array.hh
+@brief Template-based contiguous arrays
+The traversal stacks and queues grow and shrink at the tail by the hundred thousand elements per frame. A contiguous
+array does that without an allocation per element, and kept across the frames it reaches its working capacity once
+and allocates nothing afterwards. The small array keeps its first elements inline, so the short lists cost no
+allocation at all.
+*/
+
+namespace utl
+{
+    //////////////////////////////////////////////////
+    /// \brief The cArray template
+    /// implements a contiguous array growing at the tail by doubling. The data type must be default constructible and
+    /// assignable; the removed elements are not destroyed until the array is
+    template<typename Data> class cArray
+    {
+        protected:
+            Data*   m_parrData;     //!< the elements
+            size_t  m_nCount;       //!< the elements in use
+            size_t  m_nCapacity;    //!< the elements allocated
+            Data*   m_parrInline;   //!< the inline buffer of a small array, nullptr for none
+            size_t  m_nInline;      //!< the capacity of the inline buffer
+
+            //////////////////////////////////////////////////
+            /// \brief cArray::cArray
+            /// Constructs an empty array over an inline buffer, see cSmallArray
+            /// \param parrInline - the inline buffer
+            /// \param nInline - its capacity
+            cArray( Data* parrInline, size_t nInline )
+                : m_parrData( parrInline ), m_nCount( 0 ), m_nCapacity( nInline ), m_parrInline( parrInline ), m_nInline( nInline )
+            {
+            }
+
+            #ifndef _NO_CXX_11_
+            //////////////////////////////////////////////////
+            /// \brief cArray::MoveFrom
+            /// Takes the elements of an empty array over, unless they are inline; the other array is left empty, over
+            /// its own inline buffer if it has one
+            /// \param rOther - the array we are moving from
+            void MoveFrom( cArray& rOther )
+            {
+                _ASSERT( ! m_nCount );
+                if( rOther.m_parrData == rOther.m_parrInline )
+                {
+                    CopyFrom( rOther );
+                    rOther.m_nCount = 0;
+                    return;
+                }
+                if( m_parrData != m_parrInline )
+                    delete [] m_parrData;
+                m_parrData = rOther.m_parrData;
+                m_nCount = rOther.m_nCount;
+                m_nCapacity = rOther.m_nCapacity;
+                rOther.m_parrData = rOther.m_parrInline;
+                rOther.m_nCapacity = rOther.m_nInline;
+                rOther.m_nCount = 0;
+            }
+            #endif
+
+        public:
+            //////////////////////////////////////////////////
+            /// \brief cArray::cArray
+            /// The default empty array constructor; nothing is allocated until the first element
+            cArray()
+                : m_parrData( nullptr ), m_nCount( 0 ), m_nCapacity( 0 ), m_parrInline( nullptr ), m_nInline( 0 )
+            {
+            }
+
+            //////////////////////////////////////////////////
+            /// \brief cArray::~cArray
+            /// Frees the elements unless they are inline
+            ~cArray()
+            {
+                if( m_parrData != m_parrInline )
+                    delete [] m_parrData;
+            }
+
+            //////////////////////////////////////////////////
+            /// \brief cArray::cArray
+            /// The copy constructor
+            cArray( const cArray& rOther )
+                : m_parrData( nullptr ), m_nCount( 0 ), m_nCapacity( 0 ), m_parrInline( nullptr ), m_nInline( 0 )
+            {
+                CopyFrom( rOther );
+            }
+
+            #ifndef _NO_CXX_11_
+            //////////////////////////////////////////////////
+            /// \brief cArray::cArray
+            /// The rvalue constructor, takes the elements over unless they are inline
+            cArray( cArray&& rOther )
+                : m_parrData( nullptr ), m_nCount( 0 ), m_nCapacity( 0 ), m_parrInline( nullptr ), m_nInline( 0 )
+            {
+                MoveFrom( rOther );
+            }
+            #endif
+
+            //////////////////////////////////////////////////
+            /// \brief cArray::CopyFrom
+            /// The explicit copy function, in the same order
+            /// \param rOther - the array we are copying from
+            const cArray& CopyFrom( const cArray& rOther )
+            {
+                if( &rOther == this )
+                    return *this;
+                m_nCount = 0;
+                Reserve( rOther.m_nCount );
+                size_t cElem;
+                for( cElem = 0; cElem < rOther.m_nCount; cElem ++ )
+                    m_parrData[ cElem ] = rOther.m_parrData[ cElem ];
+                m_nCount = rOther.m_nCount;
+                return *this;
+            }
+
+            //////////////////////////////////////////////////
+            /// \brief cArray::Reserve
+            /// Makes room for nCapacity elements, so that adding up to them allocates nothing
+            /// \param nCapacity - the elements to make room for
+            void Reserve( size_t nCapacity )
+            {
+                if( nCapacity <= m_nCapacity )
+                    return;
+                Data* parrData = new Data[ nCapacity ];
+                size_t cElem;
+                for( cElem = 0; cElem < m_nCount; cElem ++ )
+                    parrData[ cElem ] = m_parrData[ cElem ];
+                if( m_parrData != m_parrInline )
+                    delete [] m_parrData;
+                m_parrData = parrData;
+                m_nCapacity = nCapacity;
+            }
+
+            //////////////////////////////////////////////////
+            /// \brief cArray::Add
+            /// Appends an element, doubling the capacity if needed
+            /// \param dataIn - the data to be added
+            void Add( const Data& dataIn )
+            {
+                if( m_nCount == m_nCapacity )
+                {
+                    // the element may live in the array itself, so it is copied before the array moves
+                    Data dataCopy = dataIn;
+                    Reserve( m_nCapacity ? 2 * m_nCapacity : 16 );
+                    m_parrData[ m_nCount ++ ] = dataCopy;
+                    return;
+                }
+                m_parrData[ m_nCount ++ ] = dataIn;
+            }
+
+            //////////////////////////////////////////////////
+            /// \brief cArray::PullTail
+            /// Removes the last element
+            /// \returns the removed element
+            Data PullTail()
+            {
+                _ASSERT( m_nCount ); // make sure we are pulling off elements only if the array is not empty
+                return m_parrData[ -- m_nCount ];
+            }
+
+            //////////////////////////////////////////////////
+            /// \brief cArray::Clear
+            /// Removes all the elements, keeping the capacity
+            void Clear()
+            {
+                m_nCount = 0;
+            }
+
+            //////////////////////////////////////////////////
+            /// \brief cArray::Truncate
+            /// Removes the elements past the first ones, keeping the capacity
+            /// \param nCount - the elements to keep
+            void Truncate( size_t nCount )
+            {
+                _ASSERT( nCount <= m_nCount );
+                m_nCount = nCount;
+            }
+
+            //////////////////////////////////////////////////
+            /// \brief cArray::HasData
+            /// Predicate for non-empty array
+            bool HasData() const
+            {
+                return m_nCount != 0;
+            }
+
+            //////////////////////////////////////////////////
+            /// \brief cArray::GetCount
+            /// Retrieves the number of elements
+            size_t GetCount() const
+            {
+                return m_nCount;
+            }
+
+            //////////////////////////////////////////////////
+            /// \brief cArray::GetCapacity
+            /// Retrieves the number of elements the array holds without growing
+            size_t GetCapacity() const
+            {
+                return m_nCapacity;
+            }
+
+            //////////////////////////////////////////////////
+            /// \brief cArray::operator []
+            /// Read-write element access
+            Data& operator [] ( size_t nPos )
+            {
+                _ASSERT( nPos < m_nCount );
+                return m_parrData[ nPos ];
+            }
+
+            //////////////////////////////////////////////////
+            /// \brief cArray::operator []
+            /// Read-only element access
+            const Data& operator [] ( size_t nPos ) const
+            {
+                _ASSERT( nPos < m_nCount );
+                return m_parrData[ nPos ];
+            }
+
+        private:
+            const cArray& operator = ( const cArray& ); //!< use CopyFrom()
+    };
+
+    //////////////////////////////////////////////////
+    /// \brief The cSmallArray template
+    /// implements a cArray with room for nInline elements inside the object; it allocates only when it outgrows them
+    template<typename Data, size_t nInline> class cSmallArray : public cArray<Data>
+    {
+        protected:
+            Data    m_arrInline[ nInline ]; //!< the inline elements
+        public:
+            //////////////////////////////////////////////////
+            /// \brief cSmallArray::cSmallArray
+            /// The default empty array constructor
+            cSmallArray()
+                : cArray<Data>( m_arrInline, nInline )
+            {
+            }
+
+            //////////////////////////////////////////////////
+            /// \brief cSmallArray::cSmallArray
+            /// The copy constructor
+            cSmallArray( const cSmallArray& rOther )
+                : cArray<Data>( m_arrInline, nInline )
+            {
+                this->CopyFrom( rOther );
+            }
+
+            #ifndef _NO_CXX_11_
+            //////////////////////////////////////////////////
+            /// \brief cSmallArray::cSmallArray
+            /// The rvalue constructor, takes the elements over unless they are inline
+            cSmallArray( cSmallArray&& rOther )
+                : cArray<Data>( m_arrInline, nInline )
+            {
+                this->MoveFrom( rOther );
+            }
+            #endif
+    };
+}
+
+#endif
@@ -0,0 +1,223 @@
+/*
+* MIT License
+* 
+* Copyright (c) 2020 ibaylov@gmail.com
+* 
+* Permission is hereby granted, free of charge, to any person obtaining a copy
+* of this software and associated documentation files (the "Software"), to deal
+* in the Software without restriction, including without limitation the rights
+* to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+* copies of the Software, and to permit persons to whom the Software is
+* furnished to do so, subject to the following conditions:
+* 
+* The above copyright notice and this permission notice shall be included in all
+* copies or substantial portions of the Software.
+* 
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+* AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+* OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+* SOFTWARE.
+*/
+#include "epoch.hh"
+#include <cstring>
+
+namespace utl
+{
+
+////////////////////////////////////////////////////
+/// \brief gnReclaimBatch - the items taken out of the retired list under a single lock
+///
+const size_t gnReclaimBatch = 64;
+
+///////////////////////////////////////////////////////////////////////////////
+// cEpochDomain implementation
+
+cEpochDomain::cEpochDomain()
+    : m_nEpoch( 1 ), m_pRetired( nullptr ), m_nFirstRetired( 0 ), m_nRetired( 0 ), m_nRetiredCapacity( 0 )
+{
+    size_t cReader;
+    for( cReader = 0; cReader < gnEpochReaders; cReader ++ )
+    {
+        m_arrReaders[ cReader ].m_nPinned = 0;
+        m_arrReaders[ cReader ].m_bUsed = false;
+    }
+    // the constructing thread reads without registering
+    m_arrReaders[ 0 ].m_bUsed = true;
+    pthread_mutex_init( &m_mutex, nullptr );
+}
+
+cEpochDomain::~cEpochDomain()
+{
+    // the structures the items belong to are being destroyed as well and release their memory as a whole
+    delete [] m_pRetired;
+    pthread_mutex_destroy( &m_mutex );
+}
+
+int
+cEpochDomain::Register()
+{
+    int nReader = -1;
+    size_t cReader;
+    pthread_mutex_lock( &m_mutex );
+    for( cReader = 0; cReader < gnEpochReaders && nReader < 0; cReader ++ )
+        if( ! m_arrReaders[ cReader ].m_bUsed )
+        {
+            m_arrReaders[ cReader ].m_bUsed = true;
+            nReader = static_cast<int>( cReader );
+        }
+    pthread_mutex_unlock( &m_mutex );
+    return nReader;
+}
+
+void
+cEpochDomain::Unregister( size_t nReader )
+{
+    _ASSERT( nReader < gnEpochReaders && ! IsPinned( nReader ));
+    pthread_mutex_lock( &m_mutex );
+    m_arrReaders[ nReader ].m_bUsed = false;
+    pthread_mutex_unlock( &m_mutex );
+}
+
+void
+cEpochDomain::Pin( size_t nReader )
+{
+    _ASSERT( nReader < gnEpochReaders && m_arrReaders[ nReader ].m_bUsed && ! IsPinned( nReader ));
+    // the global epoch may be stale by now, which only holds the advance back till we unpin
+    __atomic_store_n( &m_arrReaders[ nReader ].m_nPinned, __atomic_load_n( &m_nEpoch, __ATOMIC_RELAXED ), __ATOMIC_SEQ_CST );
+    // a store alone doesn't keep the reads that follow after it; the fence does, and it pairs with the one in
+    // TryAdvance(), so that either the advance sees us pinned or we see what it retired unlinked
+    __atomic_thread_fence( __ATOMIC_SEQ_CST );
+}
+
+void
+cEpochDomain::Unpin( size_t nReader )
+{
+    _ASSERT( nReader < gnEpochReaders );
+    __atomic_store_n( &m_arrReaders[ nReader ].m_nPinned, 0ull, __ATOMIC_RELEASE );
+}
+
+void
+cEpochDomain::Retire( reclaimproc pfnReclaim, void* pContext, size_t nItem )
+{
+    pthread_mutex_lock( &m_mutex );
+    if( m_nRetired == m_nRetiredCapacity )
+    {
+        // the reclaimed head is dropped on the way, so the array grows only if it is more than half full
+        size_t nWaiting = m_nRetired - m_nFirstRetired;
+        if( ! m_nRetiredCapacity )
+            m_nRetiredCapacity = 256;
+        else
+        if( nWaiting * 2 > m_nRetiredCapacity )
+            m_nRetiredCapacity *= 2;
+        Retired* pRetired = new Retired[ m_nRetiredCapacity ];
+        if( nWaiting )
+            memcpy( pRetired, m_pRetired + m_nFirstRetired, nWaiting * sizeof( Retired ));
+        delete [] m_pRetired;
+        m_pRetired = pRetired;
+        m_nFirstRetired = 0;
+        m_nRetired = nWaiting;
+    }
+    Retired& rItem = m_pRetired[ m_nRetired ++ ];
+    rItem.m_pfnReclaim = pfnReclaim;
+    rItem.m_pContext = pContext;
+    rItem.m_nItem = nItem;
+    rItem.m_nEpoch = m_nEpoch;
+    pthread_mutex_unlock( &m_mutex );
+}
+
+size_t
+cEpochDomain::Reclaim()
+{
+    pthread_mutex_lock( &m_mutex );
+    // with no reader pinned the epoch moves twice, and what was retired till now is freed right away
+    if( TryAdvance() )
+        TryAdvance();
+    unsigned long long nSafe = m_nEpoch > 2 ? m_nEpoch - 2 : 0;
+    pthread_mutex_unlock( &m_mutex );
+
+    Retired arrReady[ gnReclaimBatch ];
+    size_t nReclaimed = 0, nReady, cReady;
+    do
+    {
+        pthread_mutex_lock( &m_mutex );
+        nReady = TakeReady( nSafe, arrReady, gnReclaimBatch );
+        pthread_mutex_unlock( &m_mutex );
+        for( cReady = 0; cReady < nReady; cReady ++ )
+            arrReady[ cReady ].m_pfnReclaim( arrReady[ cReady ].m_pContext, arrReady[ cReady ].m_nItem );
+        nReclaimed += nReady;
+    }
+    while( nReady == gnReclaimBatch );
+    return nReclaimed;
+}
+
+size_t
+cEpochDomain::ReclaimAll()
+{
+    Retired arrReady[ gnReclaimBatch ];
+    size_t nReclaimed = 0, nReady, cReady;
+    do
+    {
+        pthread_mutex_lock( &m_mutex );
+        nReady = TakeReady( m_nEpoch, arrReady, gnReclaimBatch );
+        pthread_mutex_unlock( &m_mutex );
+        for( cReady = 0; cReady < nReady; cReady ++ )
+            arrReady[ cReady ].m_pfnReclaim( arrReady[ cReady ].m_pContext, arrReady[ cReady ].m_nItem );
+        nReclaimed += nReady;
+    }
+    while( nReady == gnReclaimBatch );
+    return nReclaimed;
+}
+
+bool
+cEpochDomain::TryAdvance()
+{
+    // pairs with the store in Pin(): a reader we see outside has not read anything yet
+    __atomic_thread_fence( __ATOMIC_SEQ_CST );
+    size_t cReader;
+    for( cReader = 0; cReader < gnEpochReaders; cReader ++ )
+    {
+        unsigned long long nPinned = __atomic_load_n( &m_arrReaders[ cReader ].m_nPinned, __ATOMIC_SEQ_CST );
+        if( nPinned && nPinned != m_nEpoch )
+            return false;
+    }
+    __atomic_store_n( &m_nEpoch, m_nEpoch + 1, __ATOMIC_SEQ_CST );
+    return true;
+}
+
+size_t
+cEpochDomain::TakeReady( unsigned long long nSafe, Retired* pOut, size_t nOut )
+{
+    size_t nTaken = 0;
+    while( nTaken < nOut && m_nFirstRetired < m_nRetired && m_pRetired[ m_nFirstRetired ].m_nEpoch <= nSafe )
+        pOut[ nTaken ++ ] = m_pRetired[ m_nFirstRetired ++ ];
+    if( m_nFirstRetired == m_nRetired )
+        m_nFirstRetired = m_nRetired = 0;
+    return nTaken;
+}
+
+bool
+cEpochDomain::IsPinned( size_t nReader ) const
+{
+    _ASSERT( nReader < gnEpochReaders );
+    return __atomic_load_n( &m_arrReaders[ nReader ].m_nPinned, __ATOMIC_RELAXED ) != 0;
+}
+
+unsigned long long
+cEpochDomain::GetEpoch() const
+{
+    return __atomic_load_n( &m_nEpoch, __ATOMIC_RELAXED );
+}
+
+size_t
+cEpochDomain::GetRetired()
+{
+    pthread_mutex_lock( &m_mutex );
+    size_t nRetired = m_nRetired - m_nFirstRetired;
+    pthread_mutex_unlock( &m_mutex );
+    return nRetired;
+}
+
+} // NS end
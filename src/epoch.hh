@@ -0,0 +1,105 @@
+/*
+* MIT License
+* 
+* Copyright (c) 2020 ibaylov@gmail.com
+* 
+* Permission is hereby granted, free of charge, to any person obtaining a copy
+* of this software and associated documentation files (the "Software"), to deal
+* in the Software without restriction, including without limitation the rights
+* to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+* copies of the Software, and to permit persons to whom the Software is
+* furnished to do so, subject to the following conditions:
+* 
+* The above copyright notice and this permission notice shall be included in all
+* copies or substantial portions of the Software.
+* 
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+* AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+* OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+* SOFTWARE.
+*/
+#ifndef _EPOCH_HH_
+#define _EPOCH_HH_
+#include <cstdlib>
+#include <pthread.h>
+#include "assert.hh"
+
+/**
+@file  epoch.hh
+@brief Epoch-based reclamation of the memory shared between the reader threads
+A reader pins the current global epoch before it touches the shared structures and unpins it when it holds no
+references into them any more. A writer unlinks an object first and retires it after; the object is reclaimed once
+the global epoch is two steps past the one it was retired in. The epoch advances only when every pinned reader has
+seen the current one, so by then no reader can still hold a reference obtained before the unlink.
+The readers never lock anything: pinning is a single store. The retired list and the advance are guarded by a mutex,
+taken by the writers and the reclaimers only.
+@note The reclaim procedures run outside the domain lock, in the thread that calls Reclaim(), and synchronize
+with the structure they free on their own.
+*/
+
+namespace utl
+{
+    //////////////////////////////////////////////////
+    /// \brief gnEpochReaders - the reader slots of a domain
+    /// the slot 0 is taken by the thread that constructs the domain
+    const size_t gnEpochReaders = 32;
+
+    //////////////////////////////////////////////////
+    /// \brief reclaimproc - frees a retired item, with the context and the item number it was retired with
+    ///
+    typedef void ( *reclaimproc )( void* pContext, size_t nItem );
+
+    //////////////////////////////////////////////////
+    /// \brief The cEpochDomain class
+    /// implements the reader slots, the global epoch and the retired list
+    class cEpochDomain
+    {
+        protected:
+            struct Retired
+            {
+                reclaimproc         m_pfnReclaim;   //!< the procedure that frees the item
+                void*               m_pContext;     //!< the procedure context
+                size_t              m_nItem;        //!< the item number
+                unsigned long long  m_nEpoch;       //!< the epoch the item was retired in
+            };
+            struct Reader
+            {
+                unsigned long long  m_nPinned;      //!< the epoch the reader has pinned, 0 when it is outside
+                bool                m_bUsed;        //!< the slot is registered
+                char                m_arrPad[ 64 - sizeof( unsigned long long ) - sizeof( bool ) ]; //!< keeps the readers on separate cache lines
+            };
+            unsigned long long  m_nEpoch;           //!< the global epoch, starting at 1
+            Reader              m_arrReaders[ gnEpochReaders ]; //!< the reader slots
+            pthread_mutex_t     m_mutex;            //!< guards the registration, the advance and the retired list
+            Retired*            m_pRetired;         //!< the retired items, in retirement order, so the oldest epochs come first
+            size_t              m_nFirstRetired;    //!< the first item still waiting, the ones before are reclaimed
+            size_t              m_nRetired;         //!< the end of the retired items
+            size_t              m_nRetiredCapacity; //!< the retired array capacity
+        public:
+            cEpochDomain();     //!< Constructs a domain with the slot 0 registered
+            ~cEpochDomain();    //!< Drops the retired items without reclaiming them
+            #ifndef _NO_CXX_11_
+            cEpochDomain( const cEpochDomain& ) = delete; //!< Prevent direct copy
+            #endif
+            // operations
+            int    Register();                  //!< Takes a free reader slot, -1 if all are taken
+            void   Unregister( size_t nReader ); //!< Returns an unpinned reader slot
+            void   Pin( size_t nReader );       //!< Enters the read side: the references taken from now on stay valid till Unpin()
+            void   Unpin( size_t nReader );     //!< Leaves the read side: the reader holds no references any more
+            void   Retire( reclaimproc pfnReclaim, void* pContext, size_t nItem ); //!< Schedules an unlinked item for reclamation
+            size_t Reclaim();                   //!< Advances the epoch if possible and frees the items no reader can reach; returns the items freed
+            size_t ReclaimAll();                //!< Frees all the retired items at once; no reader may be pinned
+            // accessors
+            bool   IsPinned( size_t nReader ) const; //!< Checks if the reader is on the read side
+            unsigned long long GetEpoch() const;     //!< Retrieves the global epoch
+            size_t GetRetired();                //!< Retrieves the number of items waiting for reclamation
+        protected:
+            bool   TryAdvance();                //!< Advances the global epoch if all pinned readers have seen it; called locked
+            size_t TakeReady( unsigned long long nSafe, Retired* pOut, size_t nOut ); //!< Takes out up to nOut items retired in nSafe or before; called locked
+    };
+}
+
+#endif
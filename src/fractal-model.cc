@@ -24,7 +24,9 @@
 #include "fractal-model.hh"
 #include "geom-decorator.hh"
 #include <cstring>
+#include <math.h>
 #include <iostream>
+#include <new>
 #include "assert.hh"
 
 namespace mvc
@@ -36,165 +38,563 @@ namespace mvc
 cSphere::cSphere()
 {
     m_sRadius = static_cast<geom::scalar>( 1.0 );
-    m_plistSDescendands = nullptr;
+    m_sDescendantRadius = m_sRadius;
+    m_sDescendantCap = m_sRadius;
+    m_nNode = gnInvalidNode;
+    m_nPath = 0;
 }
 
-cSphere::cSphere( size_t nLevel, const geom::cMatrix3d& matCS, geom::scalar sR )
-    : cElement(nLevel, matCS), m_sRadius( sR ), m_plistSDescendands( nullptr)
+cSphere::cSphere( size_t nLevel, const geom::cMatrix3d& matCS, geom::scalar sR, geom::scalar sDescendantR, geom::scalar sDescendantCap, pathcode nPath, nodeindex nNode )
+    : cElement(nLevel, matCS), m_sRadius( sR ), m_sDescendantRadius( sDescendantR ), m_sDescendantCap( sDescendantCap ), m_nNode( nNode ), m_nPath( nPath )
 {
 }
 
 
 cSphere::~cSphere()
 {
-    if( m_plistSDescendands )
+    // the spheres live in the model's frame arena and are dropped with it
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// cFractalcModel implementation
+
+#ifndef _FV_CACHE_SIZE_
+const int nCacheMax = 80000;
+#else
+const int nCacheMax = (_FV_CACHE_SIZE_);
+#endif
+
+// the default prefill depth: 66430 elements, the deepest complete level under the default budget
+const size_t nCachePrefillDepth = 5;
+
+
+cFractalcModel::cFractalcModel( const cTransformSet& rSet )
+    : cSphereTree( rSet ), m_pRootElem( nullptr ), m_szSnapshot( nullptr ), m_bPrefetch( true ), m_pTopLevels( nullptr )
+{
+    m_pReaders = new cReader[ utl::gnEpochReaders ];
+    size_t cReader, cArena;
+    for( cReader = 0; cReader < utl::gnEpochReaders; cReader ++ )
     {
-        while( m_plistSDescendands->HasData())
-            delete m_plistSDescendands->PullHead();
-        delete m_plistSDescendands;
+        for( cArena = 0; cArena < gnReaderArenas; cArena ++ )
+            m_pReaders[ cReader ].m_arrbFree[ cArena ] = true;
+        m_pReaders[ cReader ].m_nArena = gnReaderArenas;
     }
+    pthread_key_create( &m_keyReader, nullptr );
+    m_cacheNodes.SetEpochDomain( &m_epoch );
+    SetCachePolicy( LeastRecentlyUsed, nCacheMax / gnSphereChildren * cSphereNodeCache::GetBytesPerGroup(), nCachePrefillDepth );
+    m_statsPrefetch = m_prefetcher.GetStats();
 }
 
-geom::scalar
-cSphere::GetBoundingSphereRadius()  const
+cFractalcModel::~cFractalcModel()
 {
-    // the bounding radius of a sphere is, well, the radius of the sphere itself :)
-    return m_sRadius;
+    m_prefetcher.Stop();
+    CollectImpl();
+    if( m_pRootElem )
+        delete m_pRootElem;
+    // the store arrays are released by the store itself, no recursive deletion needed. The arenas still retired
+    // go with the readers, the epoch domain drops its list without calling back
+    delete [] m_pReaders;
+    pthread_key_delete( m_keyReader );
 }
 
-geom::scalar
-cSphere::GetDescendantSphereRadius()  const
+// operations
+cElement*
+cFractalcModel::GetRootElement()
 {
-    //
-    // the maximal radius of all possible descendants for our model is  R * sum( 1 / 3 ^ n ), n = 0..inf
-    // which is R * 3 / 2
-    // maybe this houls be calculated in model?
+    cElement* pRoot = __atomic_load_n( &m_pRootElem, __ATOMIC_ACQUIRE );
+    if( pRoot )
+        return pRoot;
+    // the first reader prefills the cache, the others wait for it on the writer lock
+    m_cacheNodes.Lock();
+    if( ! m_pRootElem )
+    {
+        PrefillCache();
+        cSphere* pElemSphereRoot = new cSphere( 0, m_matRoot, m_sRootRadius, m_sRootRadius * m_set.m_sDescendantRatio, m_sRootRadius * m_set.m_sDescendantCap, 0, GetNodeStore().GetSize() ? 0 : gnInvalidNode );
+        __atomic_store_n( &m_pRootElem, static_cast<cElement*>( pElemSphereRoot ), __ATOMIC_RELEASE );
+    }
+    m_cacheNodes.Unlock();
+    return m_pRootElem;
+}
 
-    return m_sRadius * static_cast<geom::scalar>( 3.0 / 2.0 );
+cSphere*
+cFractalcModel::GetRootSphere()
+{
+    return static_cast<cSphere*>( GetRootElement());
 }
 
+const cSphereNodeStore&
+cFractalcModel::GetNodeStore() const
+{
+    return m_cacheNodes.GetStore();
+}
 
-utl::cObList<cElement*>*
-cSphere::GetDescendandsListPtr()
+const cSphereNodeCache&
+cFractalcModel::GetCache() const
 {
-    return m_plistSDescendands;
+    return m_cacheNodes;
 }
 
-utl::cObList<cElement*>*
-cSphere::MakeDescendandsListPtr()
+void
+cFractalcModel::SetPrefetch( bool bEnable )
 {
-    _ASSERT( m_plistSDescendands == nullptr ); // make sure ti is called only for a n empty cache
-    m_plistSDescendands = new utl::cObList<cElement*>();
-    return m_plistSDescendands;
+    m_bPrefetch = bEnable;
+    if( ! bEnable )
+        m_prefetcher.Stop();
 }
 
-///////////////////////////////////////////////////////////////////////////////
-// cFractalcModel implementation
+bool
+cFractalcModel::IsPrefetching() const
+{
+    return m_bPrefetch;
+}
 
+const cPrefetchStats&
+cFractalcModel::GetPrefetchStats() const
+{
+    return m_statsPrefetch;
+}
 
-cFractalcModel::cFractalcModel()
-    : m_nElementsProduced( 0 ), m_pRootElem( nullptr )
+void
+cFractalcModel::Anticipate( const cCameraState& camState )
 {
+    // only the on-demand policies take groups the traversal hasn't asked for
+    if( ! m_bPrefetch || ! m_cacheNodes.IsOnDemand() )
+        return;
+    if( ! m_prefetcher.IsRunning() && ! m_prefetcher.Start( this ))
+    {
+        m_bPrefetch = false;
+        return;
+    }
+    // never wait for the thread: if it is queueing right now, the groups can wait for the next frame. The same goes
+    // for a reader that is inserting into the cache
+    if( ! m_prefetcher.TryLock() )
+    {
+        m_prefetcher.CountBusy();
+        return;
+    }
+    m_prefetcher.SetCamera( camState );
+    if( m_cacheNodes.TryLock() )
+    {
+        const cPrefetchedGroup* pGroup;
+        size_t cAdopted;
+        for( cAdopted = 0; cAdopted < gnPrefetchAdopt && ( pGroup = m_prefetcher.PeekReady() ); cAdopted ++ )
+            m_prefetcher.PopReady( AdoptGroup( *pGroup ));
+        m_cacheNodes.Unlock();
+    }
+    else
+        m_prefetcher.CountBusy();
+    m_statsPrefetch = m_prefetcher.GetStats();
+    m_prefetcher.Unlock();
+}
 
+bool
+cFractalcModel::AdoptGroup( const cPrefetchedGroup& rGroup )
+{
+    // the groups are queued parents first, so the parent is usually a store leaf by now. The path to it is touched,
+    // which keeps the insertion from evicting the parent itself. We are called with the writer lock
+    nodeindex nParent = FindPathNode( rGroup.m_nParent, true );
+    cSphereNodeStore& rStore = m_cacheNodes.GetStore();
+    if( nParent == gnInvalidNode || rStore.GetFirstChild( nParent ))
+        return false;
+    nodeindex nFirst = m_cacheNodes.Insert( nParent );
+    if( ! nFirst )
+        return false;
+    size_t nDepth = rStore.GetDepth( nParent ) + 1;
+    size_t cChd;
+    for( cChd = 0; cChd < gnSphereChildren; cChd ++ )
+        rStore.SetNode( nFirst + cChd, rGroup.m_arrChildren[ cChd ].m_arrsCenter, rGroup.m_arrChildren[ cChd ].m_arrnOrientation, nDepth );
+    m_cacheNodes.Publish( nParent, nFirst );
+    return true;
 }
 
-cFractalcModel::~cFractalcModel()
+void
+cFractalcModel::SetCachePolicy( CachePolicy policy, size_t nBudgetBytes, size_t nPrefillDepth )
 {
-    CollectImpl();
+    // the evicted groups still waiting for the readers belong to the old store
+    m_epoch.ReclaimAll();
+    m_cacheNodes.Setup( policy, nBudgetBytes, nPrefillDepth );
+    // the root refers to the old store; it is recreated, together with the prefill, on the next request
     if( m_pRootElem )
         delete m_pRootElem;
+    m_pRootElem = nullptr;
 }
 
+void
+cFractalcModel::SetSnapshotPath( const char* szPath )
+{
+    m_szSnapshot = szPath;
+    // the cache is rebuilt so that the next request maps the snapshot or writes it
+    SetCachePolicy( m_cacheNodes.GetPolicy(), m_cacheNodes.GetBudgetBytes(), m_cacheNodes.GetPrefillDepth() );
+}
 
-// operations
-cElement*
-cFractalcModel::GetRootElement()
+bool
+cFractalcModel::SetTopLevels( const cTopLevels* pTable )
 {
-    if( ! m_pRootElem )
-    {
-        // we construct a sphere in the origin of model CS, with a radius of 3 units
-        cSphere* pElemSphereRoot = new cSphere( 0, geom::cMatrix3d() , static_cast<geom::scalar>( 3.0));
-        m_pRootElem = pElemSphereRoot;
-    }
-    return m_pRootElem;
+    // a table of another set or build would misplace the spheres. The records are the ones the model generates,
+    // so whatever the cache holds already stays valid
+    if( pTable && pTable->m_nKey != GetGeneratorKey() )
+        return false;
+    m_pTopLevels = pTable;
+    return true;
 }
 
-#ifndef _FV_CACHE_SIZE_
-const int nCacheMax = 80000;
-#else
-const int nCacheMax = (_FV_CACHE_SIZE_);
-#endif
+snapshotkey
+cFractalcModel::GetSnapshotKey() const
+{
+    // everything the prefill depends on, except the capacity which the snapshot checks by itself
+    unsigned long long nPrefillDepth = m_cacheNodes.GetPrefillDepth();
+    return cNodeSnapshot::Hash( &nPrefillDepth, sizeof( nPrefillDepth ), GetGeneratorKey() );
+}
 
-utl::cObList<cElement*>
-cFractalcModel::GetDescendantElements( cElement* pElem )
+bool
+cFractalcModel::OpenPageFile( const char* szPath, size_t nBudgetBytes )
 {
-    cSphere* pElemSphere = dynamic_cast<cSphere*>( pElem );
+    return m_cachePages.Open( szPath, GetGeneratorKey(), nBudgetBytes, m_set.m_nChildren );
+}
 
-    if( pElemSphere->GetDescendandsListPtr() ) // we have pre-calculated descendands, so return them
+const cPageCache&
+cFractalcModel::GetPageCache() const
+{
+    return m_cachePages;
+}
+
+bool
+cFractalcModel::BuildPageFile( const char* szPath, size_t nLevels ) const
+{
+    size_t nPageLevels = ( nLevels + gnPageLevels - 1 ) / gnPageLevels;
+    if( nPageLevels * gnPageLevels > gnPathMaxDepth )
+        nPageLevels = gnPathMaxDepth / gnPageLevels;
+    cPageFile filePages;
+    if( ! filePages.Create( szPath, GetGeneratorKey(), nPageLevels ))
+        return false;
+    if( ! BuildPage( filePages, 0, m_matRoot, 0, nPageLevels ))
+        return false; // the file discards itself
+    return filePages.Commit();
+}
+
+bool
+cFractalcModel::BuildPage( cPageFile& rFile, pageindex nPage, const geom::cMatrix3d& matRoot, size_t nRootDepth, size_t nPageLevels ) const
+{
+    // the page records are generated level by level from the exact local CS of their parents, the same chain of
+    // products GetPathLocalCS() does, and only then quantized. The exact ones of the last level seed the pages below
+    geom::cMatrix3d* parrmatNodes = new geom::cMatrix3d[ gnPageNodes ];
+    geom::scalar sR = GetPathRadius( static_cast<pathcode>( nRootDepth ) << gnPathDigitBits );
+    GenerateChildCS( matRoot, sR, parrmatNodes );
+    // in the breadth-first layout the children of record i are the records 9 * ( i + 1 ) onwards
+    size_t cLevel, nParent;
+    // a whole level is generated in one batch
+    for( cLevel = 1; cLevel < gnPageLevels; cLevel ++ )
+    {
+        sR *= m_set.m_sRatio;
+        nParent = cPageFile::GetLevelStart( cLevel );
+        GenerateChildCS( parrmatNodes + nParent, cPageFile::GetLevelStart( cLevel + 1 ) - nParent, sR, parrmatNodes + ( nParent + 1 ) * gnSphereChildren );
+    }
+    cPagedNode* pRecords = rFile.GetPageBuffer();
+    size_t cNode;
+    for( cNode = 0; cNode < gnPageNodes; cNode ++ )
     {
-        utl::cObList<cElement*> lstRV;
-        lstRV.CopyFrom( *pElemSphere->GetDescendandsListPtr()); // by-elemt copy invoked
-        return lstRV;
+        const geom::cMatrix3d& rmatNode = parrmatNodes[ cNode ];
+        int cAxis;
+        for( cAxis = geom::X; cAxis < geom::W; cAxis ++ )
+            pRecords[ cNode ].m_arrsCenter[ cAxis ] = rmatNode[ cAxis ][ geom::W ];
+        cSphereNodeStore::QuantizeOrientation( rmatNode, pRecords[ cNode ].m_arrnOrientation );
     }
+    bool bOK = rFile.WritePage( nPage );
+    if( nPageLevels > 1 )
+    {
+        size_t nLeaves = cPageFile::GetLevelStart( gnPageLevels );
+        size_t cLeaf;
+        for( cLeaf = 0; bOK && cLeaf < gnPageFanout; cLeaf ++ )
+            if( IsInSet( cLeaf, gnPageLevels )) // the pages below the slots the set does not use stay holes
+                bOK = BuildPage( rFile, cPageFile::GetChildPage( nPage, cLeaf ), parrmatNodes[ nLeaves + cLeaf ], nRootDepth + gnPageLevels, nPageLevels - 1 );
+    }
+    delete [] parrmatNodes;
+    return bOK;
+}
 
-    // by default we register the new objects in GC map
-    utl::cObList<cElement*>* plstRegister = &m_lstElemetsProduced;
-    if( m_nElementsProduced < nCacheMax ) // if there's a room for chacing, we retarget the allocation destination here
+void
+cFractalcModel::PrefillCache()
+{
+    cSphereNodeStore& rStore = m_cacheNodes.GetStore();
+    rStore.SetRadiusTable( m_sRootRadius, m_set.m_sRatio );
+    if( ! rStore.GetCapacity() )
+        return;
+    if( m_szSnapshot && m_cacheNodes.AttachSnapshot( m_szSnapshot, GetSnapshotKey() ))
     {
-        m_nElementsProduced += 9;
-        plstRegister = pElemSphere->MakeDescendandsListPtr();
+        m_cacheNodes.ResetStats();
+        return;
     }
+    rStore.AddRoot( m_matRoot );
 
-    cSphere* pSphereChild = nullptr;
+    // the store is empty, so the groups are allocated in sequence and the parents can be visited in index order,
+    // which fills the store breadth-first. We keep the paths aside to compute the exact local CS of the parents
+    size_t nPrefill = 1, nLevel = 1, cLevel;
+    for( cLevel = 0; cLevel < m_cacheNodes.GetPrefillDepth() && cLevel < gnPathMaxDepth && nPrefill < rStore.GetCapacity(); cLevel ++ )
+    {
+        // every parent takes a whole group, even if the set uses only a part of it
+        nPrefill += nLevel * gnSphereChildren;
+        nLevel *= m_set.m_nChildren;
+    }
+    if( nPrefill > rStore.GetCapacity() )
+        nPrefill = rStore.GetCapacity();
+    pathcode* parrnPath = static_cast<pathcode*>( AllocateTransient( nPrefill * sizeof( pathcode )));
+    parrnPath[ 0 ] = 0;
+
+    // the parents are taken in batches of the same depth, generated at once. A batch ends before the groups it inserts,
+    // since the depth of a node is known only once it is set
+    geom::cMatrix3d* parrmatParents = new geom::cMatrix3d[ gnPrefillBatch ];
+    geom::cMatrix3d* parrmatChildren = new geom::cMatrix3d[ gnPrefillBatch * gnSphereChildren ];
+    nodeindex arrnFirst[ gnPrefillBatch ];
+    nodeindex arrnParent[ gnPrefillBatch ];
+    nodeindex nParent = 0;
+    bool bFull = false;
+    while( ! bFull && nParent < rStore.GetSize() )
+    {
+        nodeindex nEnd = rStore.GetSize();
+        size_t nBatch = 0, nBatchDepth = 0, cBatch, cChd;
+        for( ; nParent < nEnd && nBatch < gnPrefillBatch; nParent ++ )
+        {
+            size_t nDepth = rStore.GetDepth( nParent );
+            if( nDepth >= m_cacheNodes.GetPrefillDepth() || nDepth >= gnPathMaxDepth || ! rStore.HasFreeGroup() )
+            {
+                bFull = true;
+                break;
+            }
+            if( nParent && ( nParent - 1 ) % gnSphereChildren >= m_set.m_nChildren )
+                continue; // a filler slot of the group, see GenerateChildCS()
+            if( nBatch && nDepth != nBatchDepth )
+                break;
+            nodeindex nFirst = m_cacheNodes.Insert( nParent );
+            _ASSERT( nFirst + gnSphereChildren <= nPrefill );
+            for( cChd = 0; cChd < gnSphereChildren; cChd ++ )
+                parrnPath[ nFirst + cChd ] = cChd < m_set.m_nChildren ? GetChildPath( parrnPath[ nParent ], cChd ) : gnInvalidPath;
+            // the embedded levels are copied rather than generated
+            const cPagedNode* pRecords = GetTopChildren( parrnPath[ nParent ] );
+            if( pRecords )
+            {
+                for( cChd = 0; cChd < gnSphereChildren; cChd ++ )
+                    rStore.SetNode( nFirst + cChd, pRecords[ cChd ].m_arrsCenter, pRecords[ cChd ].m_arrnOrientation, nDepth + 1 );
+                m_cacheNodes.Publish( nParent, nFirst );
+                continue;
+            }
+            GetPathLocalCS( parrnPath[ nParent ], parrmatParents[ nBatch ] );
+            arrnParent[ nBatch ] = nParent;
+            arrnFirst[ nBatch ++ ] = nFirst;
+            nBatchDepth = nDepth;
+        }
+        if( ! nBatch )
+            continue;
+        GenerateChildCS( parrmatParents, nBatch, rStore.GetRadius( nBatchDepth ), parrmatChildren );
+        for( cBatch = 0; cBatch < nBatch; cBatch ++ )
+        {
+            for( cChd = 0; cChd < gnSphereChildren; cChd ++ )
+                rStore.SetNode( arrnFirst[ cBatch ] + cChd, parrmatChildren[ cBatch * gnSphereChildren + cChd ], nBatchDepth + 1 );
+            m_cacheNodes.Publish( arrnParent[ cBatch ], arrnFirst[ cBatch ] );
+        }
+    }
+    delete [] parrmatParents;
+    delete [] parrmatChildren;
+    m_cacheNodes.ResetStats();
+    // the next run maps what we have just generated; failing to write is not an error, just a cold start again
+    if( m_szSnapshot && ! m_cacheNodes.WriteSnapshot( m_szSnapshot, GetSnapshotKey() ))
+        std::cerr << "Can't write the snapshot " << m_szSnapshot << std::endl;
+}
 
-    geom::scalar sR = pElemSphere->GetBoundingSphereRadius();
-    size_t nLevel = pElemSphere->GetHierarchyDepth();
+///////////////////////////////////////////////////////////////////////////////
+// path code addressing
 
-    utl::cObList<cElement*> lsrChildren;
+elementkey
+cFractalcModel::GetElementKey( const cElement* pElem ) const
+{
+    // gnInvalidPath beyond gnPathMaxDepth, which is also the invalid key
+    return GetElementPath( pElem );
+}
 
-    int cChd;
+cElement*
+cFractalcModel::GetKeyElement( elementkey nKey )
+{
+    if( nKey == gnInvalidElementKey )
+        return nullptr;
+    return GetPathElement( nKey );
+}
 
-    geom::cMatrix3d matRotateEquator, matBasisChld = pElemSphere->GetLocalCS();
-    geom::decorator::LoadRotation( matRotateEquator, geom::Z,  60,  geom::decorator::Degrees );
+pathcode
+cFractalcModel::GetElementPath( const cElement* pElem ) const
+{
+    return static_cast<const cSphere*>( pElem )->GetPath();
+}
 
-    // generate the equator child local CS
-    geom::cMatrix3d matTranslateOuter;
-    geom::decorator::LoadTranslation( matTranslateOuter, geom::cVector3d(sR + sR / 3,  0 ,  0));
-    geom::cMatrix3d matRotateNewBasis;
-    geom::decorator::LoadRotation( matRotateNewBasis, geom::Y,  90,  geom::decorator::Degrees );
+cElement*
+cFractalcModel::GetPathElement( pathcode nPath )
+{
+    _ASSERT( nPath != gnInvalidPath );
+    // look the path up in the node store, so that the regenerated element still reaches the cached descendants.
+    // The groups on the way are touched, since the element is now alive and its group must not be evicted
+    nodeindex nNode = FindPathNode( nPath, true );
+    geom::cMatrix3d matCS;
+    GetPathLocalCS( nPath, matCS );
+    return MaterializeSphere( GetPathDepth( nPath ), matCS, GetPathRadius( nPath ), nPath, nNode );
+}
 
-    geom::cMatrix3d matEquator = matTranslateOuter * matRotateNewBasis;
+const cPagedNode*
+cFractalcModel::GetTopChildren( pathcode nPath ) const
+{
+    if( ! m_pTopLevels || nPath == gnInvalidPath || GetPathDepth( nPath ) >= m_pTopLevels->m_nLevels )
+        return nullptr;
+    // the groups of a level follow the levels above, in the digit order of their parents
+    size_t nFirst = 0, nLevel = 1, cLevel;
+    for( cLevel = GetPathDepth( nPath ); cLevel > 0; cLevel -- )
+    {
+        nLevel *= gnSphereChildren;
+        nFirst += nLevel;
+    }
+    return m_pTopLevels->m_pNodes + nFirst + ( nPath & ( ( 1ull << gnPathDigitBits ) - 1 )) * gnSphereChildren;
+}
 
-    for( cChd = 0; cChd < 6; cChd ++ )
+nodeindex
+cFractalcModel::FindPathNode( pathcode nPath, bool bTouch )
+{
+    _ASSERT( nPath != gnInvalidPath );
+    const cSphereNodeStore& rStore = m_cacheNodes.GetStore();
+    nodeindex nNode = rStore.GetSize() ? 0 : gnInvalidNode;
+    size_t nDepth = GetPathDepth( nPath );
+    pathcode nAncestor = nPath;
+    pathcode arrnAncestors[ gnPathMaxDepth ];
+    size_t cLevel;
+    for( cLevel = nDepth; cLevel > 0; cLevel -- )
     {
-        geom::cMatrix3d  matIn = matBasisChld * matEquator;
-        pSphereChild = new cSphere(  nLevel + 1, matIn, sR / 3 );
-        plstRegister->Add(pSphereChild);
-        lsrChildren.Add(pSphereChild);
-        matBasisChld *= matRotateEquator;
+        arrnAncestors[ cLevel - 1 ] = nAncestor;
+        nAncestor = GetParentPath( nAncestor );
     }
+    for( cLevel = 0; cLevel < nDepth && nNode != gnInvalidNode; cLevel ++ )
+    {
+        nodeindex nFirst = rStore.GetFirstChild( nNode );
+        if( nFirst && bTouch )
+            m_cacheNodes.Touch( nFirst );
+        nNode = nFirst ? nFirst + static_cast<nodeindex>( GetPathSlot( arrnAncestors[ cLevel ] )) : gnInvalidNode;
+    }
+    return nNode;
+}
 
-    matBasisChld = pElemSphere->GetLocalCS();
-    geom::decorator::LoadRotation( matRotateEquator, geom::Z,  120,  geom::decorator::Degrees );
+utl::cObList<cElement*>
+cFractalcModel::GetDescendantElements( cElement* pElem )
+{
+    utl::cObList<cElement*> lsrChildren;
+    cChildCollector collector( lsrChildren );
+    EnumerateDescendants( pElem, collector );
+    return lsrChildren;
+}
 
-    // generate the inclined child local CS
-    geom::cMatrix3d matRotateLat;
-    geom::decorator::LoadRotation( matRotateLat, geom::Y,  -60,  geom::decorator::Degrees );
-    geom::cMatrix3d matRotateLon;
-    geom::decorator::LoadRotation( matRotateLon, geom::Z,  30,  geom::decorator::Degrees );
+size_t
+cFractalcModel::EnumerateDescendants( cElement* pElem, cChildVisitor& rVisitor )
+{
+    _ASSERT( dynamic_cast<cSphere*>( pElem ));
+    return EnumerateChildren( static_cast<cSphere*>( pElem ), rVisitor );
+}
 
-    geom::cMatrix3d matInclined = matRotateLon * matRotateLat * matTranslateOuter * matRotateNewBasis;
+cSphere*
+cFractalcModel::MaterializeSphere( size_t nLevel, const geom::cMatrix3d& matCS, geom::scalar sR, pathcode nPath, nodeindex nNode )
+{
+    cSphere* pSphere = static_cast<cSphere*>( AllocateTransient( sizeof( cSphere )));
+    new ( pSphere ) cSphere( nLevel, matCS, sR, sR * m_set.m_sDescendantRatio, sR * m_set.m_sDescendantCap, nPath, nNode );
+    return pSphere;
+}
 
-    for( cChd = 0; cChd < 3; cChd ++ )
+void*
+cFractalcModel::AllocateTransient( size_t nBytes )
+{
+    cReader& rReader = m_pReaders[ GetReaderSlot() ];
+    if( rReader.m_nArena == gnReaderArenas )
     {
-
-        geom::cMatrix3d  matIn = matBasisChld * matInclined;
-        pSphereChild = new cSphere(  nLevel + 1, matIn, sR / 3 );
-        plstRegister->Add(pSphereChild);
-        lsrChildren.Add(pSphereChild);
-        matBasisChld *= matRotateEquator;
+        // the reader took its last arena out of use; the first free generation is taken, so that a single reader
+        // goes back to the same arena and the blocks of the others are never allocated
+        size_t cArena;
+        for( cArena = 0; ! __atomic_load_n( rReader.m_arrbFree + cArena, __ATOMIC_ACQUIRE ); cArena ++ )
+            _ASSERT( cArena + 1 < gnReaderArenas );
+        __atomic_store_n( rReader.m_arrbFree + cArena, false, __ATOMIC_RELAXED );
+        rReader.m_nArena = cArena;
     }
-    return lsrChildren;
+    return rReader.m_arrArenas[ rReader.m_nArena ].Allocate( nBytes );
+}
+
+size_t
+cFractalcModel::GetReaderSlot() const
+{
+    void* pSlot = pthread_getspecific( m_keyReader );
+    return pSlot ? reinterpret_cast<size_t>( pSlot ) - 1 : 0;
+}
+
+bool
+cFractalcModel::IsConcurrent() const
+{
+    return true;
+}
+
+bool
+cFractalcModel::AttachReader()
+{
+    if( pthread_getspecific( m_keyReader ))
+        return true;
+    int nReader = m_epoch.Register();
+    if( nReader < 0 )
+        return false;
+    pthread_setspecific( m_keyReader, reinterpret_cast<void*>( static_cast<size_t>( nReader ) + 1 ));
+    return true;
+}
+
+void
+cFractalcModel::DetachReader()
+{
+    size_t nReader = GetReaderSlot();
+    _ASSERT( nReader && ! m_epoch.IsPinned( nReader ));
+    // the elements go the usual way; a generation that can't be retired now is reused by the next owner of the slot
+    RetireArena( nReader );
+    m_epoch.Unregister( nReader );
+    pthread_setspecific( m_keyReader, nullptr );
+}
+
+void
+cFractalcModel::BeginRead()
+{
+    size_t nReader = GetReaderSlot();
+    __atomic_store_n( &m_pReaders[ nReader ].m_nFrame, m_cacheNodes.GetFrame(), __ATOMIC_RELAXED );
+    m_epoch.Pin( nReader );
+}
+
+void
+cFractalcModel::EndRead()
+{
+    size_t nReader = GetReaderSlot();
+    RetireArena( nReader );
+    m_epoch.Unpin( nReader );
+    m_epoch.Reclaim();
+}
+
+void
+cFractalcModel::RetireArena( size_t nReader )
+{
+    cReader& rReader = m_pReaders[ nReader ];
+    size_t nArena = rReader.m_nArena;
+    if( nArena == gnReaderArenas || rReader.m_arrArenas[ nArena ].IsEmpty() )
+        return;
+    // without a free generation to go on with, the reader keeps allocating from this one and retires it later
+    size_t cArena;
+    for( cArena = 0; cArena < gnReaderArenas; cArena ++ )
+        if( cArena != nArena && __atomic_load_n( rReader.m_arrbFree + cArena, __ATOMIC_ACQUIRE ))
+            break;
+    if( cArena == gnReaderArenas )
+        return;
+    rReader.m_nArena = gnReaderArenas;
+    m_epoch.Retire( ReclaimArena, this, nReader * gnReaderArenas + nArena );
+}
+
+void
+cFractalcModel::ReclaimArena( void* pModel, size_t nItem )
+{
+    // the spheres have trivial destruction, so we just rewind the arena
+    cReader& rReader = static_cast<cFractalcModel*>( pModel )->m_pReaders[ nItem / gnReaderArenas ];
+    rReader.m_arrArenas[ nItem % gnReaderArenas ].Reset();
+    __atomic_store_n( rReader.m_arrbFree + nItem % gnReaderArenas, true, __ATOMIC_RELEASE );
 }
 
 
@@ -207,8 +607,42 @@ cFractalcModel::Collect()
 void
 cFractalcModel::CollectImpl()
 {
-    while( m_lstElemetsProduced.HasData() )
-        delete m_lstElemetsProduced.PullHead();
+#ifdef _DEBUG_DUMP_
+    const cCacheStats& rStats = m_cacheNodes.GetStats();
+    std::cerr << "Cache hits: " << rStats.m_nHits << ", misses: " << rStats.m_nMisses << ", inserted: " << rStats.m_nInserted
+              << ", evicted: " << rStats.m_nEvicted << ", rejected: " << rStats.m_nRejected
+              << ", nodes: " << m_cacheNodes.GetStore().GetSize() << std::endl;
+    if( m_cachePages.IsOpen() )
+    {
+        const cPageStats& rPageStats = m_cachePages.GetStats();
+        std::cerr << "Page hits: " << rPageStats.m_nHits << ", misses: " << rPageStats.m_nMisses << ", requested: " << rPageStats.m_nRequested
+                  << ", arrived: " << rPageStats.m_nArrived << ", evicted: " << rPageStats.m_nEvicted << ", rejected: " << rPageStats.m_nRejected
+                  << ", resident: " << m_cachePages.GetResidentPages() << std::endl;
+    }
+    if( m_prefetcher.IsRunning() )
+        std::cerr << "Prefetch predicted: " << m_statsPrefetch.m_nPredicted << ", queued: " << m_statsPrefetch.m_nQueued
+                  << ", adopted: " << m_statsPrefetch.m_nAdopted << ", stale: " << m_statsPrefetch.m_nStale
+                  << ", busy: " << m_statsPrefetch.m_nBusy << std::endl;
+#endif
+    // a reader still inside goes on in the next frame, so the groups it has passed must stay till it is done
+    unsigned nFrame = m_cacheNodes.GetFrame();
+    unsigned nAlive = 1;
+    size_t cReader;
+    for( cReader = 0; cReader < utl::gnEpochReaders; cReader ++ )
+        if( m_epoch.IsPinned( cReader ) && nFrame - __atomic_load_n( &m_pReaders[ cReader ].m_nFrame, __ATOMIC_RELAXED ) + 2 > nAlive )
+            nAlive = nFrame - __atomic_load_n( &m_pReaders[ cReader ].m_nFrame, __ATOMIC_RELAXED ) + 2;
+    m_cacheNodes.SetAliveFrames( nAlive );
+    m_cacheNodes.NextFrame();
+    if( m_cachePages.IsOpen() )
+    {
+        m_cachePages.Lock();
+        m_cachePages.NextFrame();
+        m_cachePages.Unlock();
+    }
+    // the elements of the calling thread go as well, if it doesn't bracket its traversals. They are rewound
+    // right away unless another reader is inside a traversal
+    RetireArena( GetReaderSlot() );
+    m_epoch.Reclaim();
 }
 
 
@@ -24,59 +24,106 @@
 #ifndef _MVC_FRACTAL_MODEL_
 #define _MVC_FRACTAL_MODEL_
 #include "model.hh"
+#include "sphere-tree.hh"
+#include "arena.hh"
+#include "epoch.hh"
+#include "node-cache.hh"
+#include "page-cache.hh"
+#include "top-levels.hh"
+#include "prefetch.hh"
 
 /**
 @file  fractal-model.hh
 @brief Fractal model implements the cModel and exports a lazy-evaluated infinite-depth sphere tree
-The tree is generated by recursively applying set of transformations to an element;s local CS.
-We use caching of the first several thousand elements generated. Although not the major bottleneck, the tree
-is explored breadth-first, so these elements are referenced in every new tree generation
-Define _FV_CACHE_SIZE_ to override the default or set it to 0 to disable the cache
+The tree is generated by recursively applying set of transformations to an element;s local CS. The set is described
+by a cTransformSet, so that any self-similar sphere set of up to gnSphereChildren children fits; see ifs-model.hh
+for the descriptors and the models built on them, and sphere-tree.hh for the geometry the model inherits.
+We cache several thousand elements of the tree in the compact cSphereNodeStore. By default the top levels are
+prefilled breadth-first, and the rest of the budget follows the camera, see cSphereNodeCache for the policies.
+Define _FV_CACHE_SIZE_ to override the default budget in elements or set it to 0 to disable the cache;
+SetCachePolicy() changes the policy and the budget in bytes at runtime. With SetSnapshotPath() the prefilled levels
+are saved on the first run and mapped from the file on the next ones, see cNodeSnapshot
+SetTopLevels() takes the top levels from a table embedded at build time instead of generating them, see top-levels.hh
+Below the cached levels the children may come from a precomputed page file, see cPageCache; BuildPageFile() creates it
+and OpenPageFile() attaches it. The pages are used only once they are in memory, till then the children are generated
+With an on-demand cache policy a background thread pre-generates the groups the moving camera is about to expose,
+see cPrefetcher; SetPrefetch() turns it off
+The elements are never allocated one by one: they live in an arena that EndRead() or Collect() rewinds. The cached
+ones are materialized from the node store on each visit, which is cheaper than generating them
+Several threads may traverse the model at once, each one attached with AttachReader() and bracketing its traversal
+with BeginRead() and EndRead(). Every reader has its own arenas; the one it used is retired by EndRead() and rewound
+only when no other reader can hold its elements any more, see utl::cEpochDomain, and so are the evicted cache groups.
+The cache hits take no lock; a reader that finds the writer lock taken generates the children without caching them
 */
 
 #ifdef _NO_CXX_11_
 #define override
+#define final
 #endif
 
 namespace mvc
 {
+    const size_t gnPrefillBatch = 256; //!< the parents the prefill generates the children of at once
+    const size_t gnReaderArenas = 3;   //!< the arena generations of a reader: one in use, the others retired or free
+
     ////////////////////////////////////////////////////////////////////
     /// \brief The Sphere Element class
-    /// Represents the sphere model element
+    /// Represents the sphere model element. The class is final and the bounds are inline, so that the calls through
+    /// a cSphere pointer need no virtual dispatch
     ///
-    class cSphere : public cElement
+    class cSphere final : public cElement
     {
     protected:
         /// \brief m_sRadius - the radius of tha sphere
         geom::scalar             m_sRadius;
-        /// \brief m_plistSDescendands - the descendant elements cache
-        utl::cObList<cElement*>* m_plistSDescendands;
+        /// \brief m_sDescendantRadius - the radius of the sphere enclosing all the descendants, set by the model
+        geom::scalar             m_sDescendantRadius;
+        /// \brief m_sDescendantCap - the descendants lie above the plane this far below the center, across the local Z axis
+        geom::scalar             m_sDescendantCap;
+        /// \brief m_nNode - the node store index the sphere was materialized from, gnPagedNode or gnInvalidNode
+        nodeindex                m_nNode;
+        /// \brief m_nPath - the path code of the sphere
+        pathcode                 m_nPath;
     public:
         cSphere(); //!< Default
-        virtual ~cSphere() override;    //!< Performs cache cleanup
+        virtual ~cSphere() override;    //!< The spheres are placed in model-owned memory; nothing to clean up
         // specific constructors
-        cSphere( size_t nLevel, const geom::cMatrix3d& matCS, geom::scalar sR );//!< Constructs a sphere with a specific radius
+        cSphere( size_t nLevel, const geom::cMatrix3d& matCS, geom::scalar sR, geom::scalar sDescendantR, geom::scalar sDescendantCap, pathcode nPath, nodeindex nNode = gnInvalidNode );//!< Constructs a sphere with a specific radius
         // overrided operations
 
         virtual geom::scalar GetBoundingSphereRadius()  const override ;
         virtual geom::scalar GetDescendantSphereRadius()  const override;
+        virtual geom::scalar GetDescendantCapDistance()  const override;
         // implementation - specific
-        utl::cObList<cElement*>* GetDescendandsListPtr() ;  //!< Retrieves the descendants list. Nay return NULL result
-        utl::cObList<cElement*>* MakeDescendandsListPtr() ; //!< Allocates and returns a new list
+        nodeindex GetNodeIndex() const; //!< Retrieves the node store index, gnPagedNode for the paged and gnInvalidNode for the generated spheres
+        pathcode  GetPath() const;      //!< Retrieves the path code, gnInvalidPath beyond gnPathMaxDepth
     };
 
     ////////////////////////////////////////////////////////////////////
     /// \brief The cFractalcModel class
-    /// The fractal lazy-evaluated model for our spheres
+    /// The fractal lazy-evaluated model for our spheres, iterating the transform set it is constructed with
     ///
-    class cFractalcModel : public cModel
+    class cFractalcModel : public cModel, public cSphereTree
     {
     protected:
-        size_t      m_nElementsProduced; //!< we cache produced object and keep track on their count
+        ////////////////////////////////////////////////////////////////////
+        /// \brief The cReader struct - the elements memory of a reader thread
+        /// The arena in use is never retired without a free one to go on with
+        struct cReader
+        {
+            utl::cArena m_arrArenas[ gnReaderArenas ];  //!< the arena generations
+            bool        m_arrbFree[ gnReaderArenas ];   //!< the generation is rewound and can be taken
+            size_t      m_nArena;                       //!< the generation in use, gnReaderArenas for none yet
+            unsigned    m_nFrame;                       //!< the cache frame the reader pinned its epoch in
+        };
         cElement*   m_pRootElem;         //!< the root element is cached separately in this member
+        const char*     m_szSnapshot;    //!< the prefill snapshot file, nullptr for none
+        bool            m_bPrefetch;     //!< the prefetch thread is wanted
+        const cTopLevels* m_pTopLevels;  //!< the embedded top levels, nullptr for none
+        cPrefetchStats  m_statsPrefetch; //!< the prefetcher counters, as of the last frame that got the queue lock
     public:
 
-        cFractalcModel();
+        explicit cFractalcModel( const cTransformSet& rSet );
 #ifndef _NO_CXX_11_
         cFractalcModel( const cFractalcModel& ) = delete; //!<< Prevent direct copy
 #endif
@@ -84,16 +131,230 @@ namespace mvc
 // operations
         virtual cElement* GetRootElement() override;
         virtual utl::cObList<cElement*> GetDescendantElements( cElement* ) override;
+        virtual size_t EnumerateDescendants( cElement*, cChildVisitor& ) override;
+        // the statically dispatched interface, see cStaticOGLView
+        typedef cSphere elementtype; //!< the concrete element type
+        cSphere* GetRootSphere();    //!< Retrieves the root element with its concrete type
+        template<typename Visitor> size_t EnumerateChildren( cSphere*, Visitor& ); //!< Same as EnumerateDescendants() for any visitor class with Accept() and Visit(); a final one is called directly
 
         virtual void Collect() override;
+        virtual void Anticipate( const cCameraState& ) override;
+        virtual elementkey GetElementKey( const cElement* ) const override; //!< The path code is the key
+        virtual cElement* GetKeyElement( elementkey ) override;
+        virtual void BeginRead() override; //!< Pins the epoch of the calling reader
+        virtual void EndRead() override;   //!< Retires the elements of the calling reader and reclaims what no reader holds
+        virtual bool IsConcurrent() const override; //!< The readers are attached as below
+        virtual bool AttachReader() override; //!< Takes a reader slot for the calling thread, false if all are taken; the constructing thread has one already
+        virtual void DetachReader() override; //!< Returns the reader slot of the calling thread, outside a traversal
+        const cSphereNodeStore& GetNodeStore() const; //!< Retrieves the cached nodes store
+        const cSphereNodeCache& GetCache() const;     //!< Retrieves the descendant cache, e.g. for the statistics
+        void SetCachePolicy( CachePolicy policy, size_t nBudgetBytes, size_t nPrefillDepth ); //!< Rebuilds the cache; not to be called while traversing
+        void SetSnapshotPath( const char* szPath ); //!< Sets the prefill snapshot file, nullptr for none; the string must outlive the model
+        snapshotkey GetSnapshotKey() const;         //!< Retrieves the signature of the prefilled content
+        bool SetTopLevels( const cTopLevels* pTable ); //!< Takes the top levels from an embedded table, false if it was made for another set; nullptr for none
+        bool OpenPageFile( const char* szPath, size_t nBudgetBytes = gnPageBudgetDefault ); //!< Attaches a page file, keeping up to nBudgetBytes of it resident
+        bool BuildPageFile( const char* szPath, size_t nLevels ) const; //!< Precomputes the tree to nLevels levels, rounded up to whole pages
+        const cPageCache& GetPageCache() const;     //!< Retrieves the page cache, e.g. for the statistics
+        void SetPrefetch( bool bEnable );           //!< Enables the prefetch thread, started with the first camera
+        bool IsPrefetching() const;                 //!< Checks if the prefetch thread is enabled
+        const cPrefetchStats& GetPrefetchStats() const; //!< Retrieves the prefetcher counters
+        // path code addressing
+        pathcode        GetElementPath( const cElement* pElem ) const; //!< Retrieves the path code of an element produced by this model
+        cElement*       GetPathElement( pathcode nPath );              //!< Regenerates the element, valid until Collect()
     protected:
         void CollectImpl();
+        void PrefillCache(); //!< Places the root and fills the cache breadth-first up to the prefill depth
+        bool BuildPage( cPageFile& rFile, pageindex nPage, const geom::cMatrix3d& matRoot, size_t nRootDepth, size_t nPageLevels ) const; //!< Writes a page and the pages below it
+        const cPagedNode* GetTopChildren( pathcode nPath ) const; //!< Retrieves the 9 children records from the embedded table, nullptr below it
+        nodeindex FindPathNode( pathcode nPath, bool bTouch ); //!< Finds the store node of a path, gnInvalidNode if it isn't cached
+        bool AdoptGroup( const cPrefetchedGroup& rGroup );     //!< Moves a prefetched group into the cache
+        cSphere* MaterializeSphere( size_t nLevel, const geom::cMatrix3d& matCS, geom::scalar sR, pathcode nPath, nodeindex nNode ); //!< Places a sphere in the arena of the calling reader
+        void* AllocateTransient( size_t nBytes ); //!< Allocates from the arena of the calling reader
+        size_t GetReaderSlot() const;             //!< Retrieves the reader slot of the calling thread
+        void RetireArena( size_t nReader );       //!< Retires the arena in use if the reader has a free one to go on with
+        static void ReclaimArena( void* pModel, size_t nItem ); //!< Rewinds a retired arena, the epoch domain callback
+        ////////////////////////////////////////////////////////////////////
+        /// \brief m_epoch - the reclamation domain of the readers
+        /// declared before the caches, so that it outlives them
+        utl::cEpochDomain m_epoch;
+        ////////////////////////////////////////////////////////////////////
+        /// \brief m_pReaders - the per reader arenas for the elements, by reader slot
+        /// a whole traversal worth of elements is dropped at once when its arena is rewound
+        cReader*       m_pReaders;
+        pthread_key_t  m_keyReader;     //!< the reader slot of the thread, plus 1; none means the slot 0
+        ////////////////////////////////////////////////////////////////////
+        /// \brief m_cacheNodes - the cached part of the tree
+        /// the cache lives as long as the model does and is released array by array, not element by element
+        cSphereNodeCache m_cacheNodes;
+        ////////////////////////////////////////////////////////////////////
+        /// \brief m_cachePages - the out-of-core deep levels, if a page file is attached
+        cPageCache       m_cachePages;
         ////////////////////////////////////////////////////////////////////
-        /// \brief m_lstElemetsProduced - the generated elements collection
-        /// if we don't do internal memory management, we sill need to store the allocated objects pointers for GC
-        utl::cObList<cElement*> m_lstElemetsProduced;
+        /// \brief m_prefetcher - the background generator; the last member, so that its thread stops first
+        cPrefetcher      m_prefetcher;
 public:
     };
+
+    //////////////////////////////////////////////////
+    // cSphere inline implementation
+
+    inline geom::scalar
+    cSphere::GetBoundingSphereRadius()  const
+    {
+        // the bounding radius of a sphere is, well, the radius of the sphere itself :)
+        return m_sRadius;
+    }
+
+    inline geom::scalar
+    cSphere::GetDescendantSphereRadius()  const
+    {
+        // the descendant radius depends on the transform set, so the model calculates it for us
+        return m_sDescendantRadius;
+    }
+
+    inline geom::scalar
+    cSphere::GetDescendantCapDistance()  const
+    {
+        // the children grow away from the parent, so the subtree hardly reaches below the sphere itself
+        return m_sDescendantCap;
+    }
+
+    inline nodeindex
+    cSphere::GetNodeIndex() const
+    {
+        return m_nNode;
+    }
+
+    inline pathcode
+    cSphere::GetPath() const
+    {
+        return m_nPath;
+    }
+
+    //////////////////////////////////////////////////
+    // cFractalcModel template implementation
+
+    template<typename Visitor> size_t
+    cFractalcModel::EnumerateChildren( cSphere* pElemSphere, Visitor& rVisitor )
+    {
+        geom::scalar sR = pElemSphere->GetBoundingSphereRadius();
+        size_t nLevel = pElemSphere->GetHierarchyDepth();
+        pathcode nPath = pElemSphere->GetPath();
+        nodeindex nNode = pElemSphere->GetNodeIndex();
+
+        cChildBounds bndChild;
+        bndChild.m_sRadius = sR * m_set.m_sRatio;
+        bndChild.m_sDescendantRadius = bndChild.m_sRadius * m_set.m_sDescendantRatio;
+        bndChild.m_nDepth = nLevel + 1;
+        size_t nVisited = 0;
+        size_t cChd;
+        geom::cMatrix3d matCS;
+
+        bool bPaged = nNode == gnPagedNode;
+        nodeindex nFirst = m_cacheNodes.Lookup( bPaged ? gnInvalidNode : nNode );
+        if( nFirst ) // we have pre-calculated descendands, so only the accepted ones are materialized from the store
+        {
+            const cSphereNodeStore& rStore = m_cacheNodes.GetStore();
+            for( cChd = 0; cChd < m_set.m_nChildren; cChd ++ )
+            {
+                bndChild.m_ptCenter = rStore.GetCenter( nFirst + cChd );
+                if( ! rVisitor.Accept( bndChild ))
+                    continue;
+                rStore.LoadLocalCS( nFirst + cChd, matCS );
+                rVisitor.Visit( MaterializeSphere( nLevel + 1, matCS, bndChild.m_sRadius, GetChildPath( nPath, cChd ), nFirst + cChd ));
+                nVisited ++;
+            }
+            return nVisited;
+        }
+
+        // the top levels come from the embedded table, and if the policy allows, the children of a store leaf join
+        // the cache copied from there. The deeper levels may come from the page file, as long as the page is in memory
+        // already. If another reader has the page cache, the page counts as missing
+        const cPagedNode* pRecords = GetTopChildren( nPath );
+        if( pRecords )
+        {
+            if( nNode != gnInvalidNode && ! bPaged && m_cacheNodes.IsOnDemand() && m_cacheNodes.TryLock() )
+            {
+                nFirst = m_cacheNodes.Insert( nNode );
+                if( nFirst )
+                {
+                    cSphereNodeStore& rStore = m_cacheNodes.GetStore();
+                    for( cChd = 0; cChd < gnSphereChildren; cChd ++ )
+                        rStore.SetNode( nFirst + cChd, pRecords[ cChd ].m_arrsCenter, pRecords[ cChd ].m_arrnOrientation, nLevel + 1 );
+                    m_cacheNodes.Publish( nNode, nFirst );
+                }
+                m_cacheNodes.Unlock();
+            }
+        }
+        else if( m_cachePages.IsOpen() && nLevel < m_cachePages.GetLevels() && m_cachePages.TryLock() )
+        {
+            pRecords = m_cachePages.GetChildren( nPath );
+            m_cachePages.Unlock();
+        }
+        if( pRecords )
+        {
+            for( cChd = 0; cChd < m_set.m_nChildren; cChd ++ )
+            {
+                const cPagedNode& rRecord = pRecords[ cChd ];
+                bndChild.m_ptCenter = geom::cPoint3d( rRecord.m_arrsCenter[ geom::X ], rRecord.m_arrsCenter[ geom::Y ], rRecord.m_arrsCenter[ geom::Z ] );
+                if( ! rVisitor.Accept( bndChild ))
+                    continue;
+                cSphereNodeStore::LoadQuantized( rRecord.m_arrnOrientation, bndChild.m_ptCenter, matCS );
+                rVisitor.Visit( MaterializeSphere( nLevel + 1, matCS, bndChild.m_sRadius, GetChildPath( nPath, cChd ), nFirst ? nFirst + cChd : gnPagedNode ));
+                nVisited ++;
+            }
+            return nVisited;
+        }
+
+        geom::cMatrix3d matParent;
+        if( nNode != gnInvalidNode && nPath != gnInvalidPath )
+        {
+            // a store leaf or a paged node carries the quantized orientation, which is fine for drawing but the error
+            // would grow threefold with every generated level; we expand it from the exact local CS instead
+            GetPathLocalCS( nPath, matParent );
+            // and if the policy allows, the children of a store leaf join the cache; the whole group is stored, culled or not.
+            // The writer lock is only tried: if another reader has it, the children are generated as if the cache was full
+            geom::cMatrix3d arrmatChildren[ gnSphereChildren ];
+            if( ! bPaged && m_cacheNodes.IsOnDemand() && nLevel < gnPathMaxDepth && m_cacheNodes.TryLock() )
+            {
+                nFirst = m_cacheNodes.Insert( nNode );
+                if( nFirst )
+                {
+                    cSphereNodeStore& rStore = m_cacheNodes.GetStore();
+                    GenerateChildCS( matParent, sR, arrmatChildren );
+                    for( cChd = 0; cChd < gnSphereChildren; cChd ++ )
+                        rStore.SetNode( nFirst + cChd, arrmatChildren[ cChd ], nLevel + 1 );
+                    m_cacheNodes.Publish( nNode, nFirst );
+                }
+                m_cacheNodes.Unlock();
+            }
+            if( nFirst )
+            {
+                for( cChd = 0; cChd < m_set.m_nChildren; cChd ++ )
+                {
+                    bndChild.m_ptCenter = geom::cPoint3d( arrmatChildren[ cChd ][ geom::X ][ geom::W ], arrmatChildren[ cChd ][ geom::Y ][ geom::W ], arrmatChildren[ cChd ][ geom::Z ][ geom::W ] );
+                    if( ! rVisitor.Accept( bndChild ))
+                        continue;
+                    rVisitor.Visit( MaterializeSphere( nLevel + 1, arrmatChildren[ cChd ], bndChild.m_sRadius, GetChildPath( nPath, cChd ), nFirst + cChd ));
+                    nVisited ++;
+                }
+                return nVisited;
+            }
+        }
+        else
+            matParent = pElemSphere->GetLocalCS();
+        // the generated children: the center costs a fraction of the local CS, so only the accepted ones get the full product
+        for( cChd = 0; cChd < m_set.m_nChildren; cChd ++ )
+        {
+            bndChild.m_ptCenter = GenerateChildCenter( matParent, sR, cChd );
+            if( ! rVisitor.Accept( bndChild ))
+                continue;
+            GenerateChildCS( matParent, sR, cChd, matCS );
+            rVisitor.Visit( MaterializeSphere( nLevel + 1, matCS, bndChild.m_sRadius, GetChildPath( nPath, cChd ), gnInvalidNode ));
+            nVisited ++;
+        }
+        return nVisited;
+    }
 }
 
 
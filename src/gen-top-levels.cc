@@ -0,0 +1,100 @@
+/*
+* MIT License
+* 
+* Copyright (c) 2020 ibaylov@gmail.com
+* 
+* Permission is hereby granted, free of charge, to any person obtaining a copy
+* of this software and associated documentation files (the "Software"), to deal
+* in the Software without restriction, including without limitation the rights
+* to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+* copies of the Software, and to permit persons to whom the Software is
+* furnished to do so, subject to the following conditions:
+* 
+* The above copyright notice and this permission notice shall be included in all
+* copies or substantial portions of the Software.
+* 
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+* AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+* OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+* SOFTWARE.
+*/
+#include "ifs-model.hh"
+#include "top-levels.hh"
+#include <stdio.h>
+
+/**
+@file  gen-top-levels.cc
+@brief The build step writing top-levels.cc, the embedded top levels of the SphereFlake, see top-levels.hh
+The records are computed by the tree geometry of the model, the way PrefillCache() does it, so the table holds exactly what
+the cache would have generated. The scalars are printed with enough digits to be read back unchanged
+*/
+
+/////////////////////////////////////////////////////////
+/// \brief WriteRecord - prints a table record
+/// \param rRecord - the record
+///
+static void WriteRecord( const mvc::cPagedNode& rRecord )
+{
+    printf( "        { { %.17g, %.17g, %.17g }, { %d, %d, %d, %d } },\n",
+            static_cast<double>( rRecord.m_arrsCenter[ geom::X ] ), static_cast<double>( rRecord.m_arrsCenter[ geom::Y ] ),
+            static_cast<double>( rRecord.m_arrsCenter[ geom::Z ] ), rRecord.m_arrnOrientation[ 0 ], rRecord.m_arrnOrientation[ 1 ],
+            rRecord.m_arrnOrientation[ 2 ], rRecord.m_arrnOrientation[ 3 ] );
+}
+
+/////////////////////////////////////////////////////////
+/// \brief main - writes the table source to the standard output
+/// \returns 0 on success
+///
+int main()
+{
+    // the geometry of the model alone, the model itself with its caches and threads isn't linked in
+    mvc::cSphereTree tree( mvc::cSphereFlakeModel::Describe());
+    size_t nChildren = tree.GetTransformSet().m_nChildren;
+
+    printf( "// generated by gen-top-levels, do not edit\n" );
+    printf( "#include \"top-levels.hh\"\n\nnamespace mvc\n{\n" );
+    printf( "    static const cPagedNode garrSphereFlakeTop[ gnTopNodes ] =\n    {\n" );
+
+    // the parents of a level are visited in digit order, which is the breadth-first order of their groups
+    size_t nParents = 1, nRecords = 0, cLevel, cChd;
+    mvc::pathcode cDigits;
+    for( cLevel = 0; cLevel < mvc::gnTopLevels; cLevel ++, nParents *= mvc::gnSphereChildren )
+    {
+        for( cDigits = 0; cDigits < nParents; cDigits ++ )
+        {
+            mvc::pathcode nPath = ( static_cast<mvc::pathcode>( cLevel ) << mvc::gnPathDigitBits ) | cDigits;
+            mvc::cPagedNode arrRecords[ mvc::gnSphereChildren ] = {};
+            // the descendants of a filler slot are never reached, their records stay zero
+            mvc::pathcode nDigits = cDigits;
+            bool bInSet = true;
+            for( cChd = 0; cChd < cLevel; cChd ++, nDigits /= mvc::gnSphereChildren )
+                bInSet = bInSet && nDigits % mvc::gnSphereChildren < nChildren;
+            if( bInSet )
+            {
+                geom::cMatrix3d matParent;
+                geom::cMatrix3d arrmatChildren[ mvc::gnSphereChildren ];
+                tree.GetPathLocalCS( nPath, matParent );
+                tree.GenerateChildCS( &matParent, 1, tree.GetPathRadius( nPath ), arrmatChildren );
+                for( cChd = 0; cChd < mvc::gnSphereChildren; cChd ++ )
+                {
+                    arrRecords[ cChd ].m_arrsCenter[ geom::X ] = arrmatChildren[ cChd ][ geom::X ][ geom::W ];
+                    arrRecords[ cChd ].m_arrsCenter[ geom::Y ] = arrmatChildren[ cChd ][ geom::Y ][ geom::W ];
+                    arrRecords[ cChd ].m_arrsCenter[ geom::Z ] = arrmatChildren[ cChd ][ geom::Z ][ geom::W ];
+                    mvc::cSphereNodeStore::QuantizeOrientation( arrmatChildren[ cChd ], arrRecords[ cChd ].m_arrnOrientation );
+                }
+            }
+            for( cChd = 0; cChd < mvc::gnSphereChildren; cChd ++ )
+                WriteRecord( arrRecords[ cChd ] );
+            nRecords += mvc::gnSphereChildren;
+        }
+    }
+    _ASSERT( nRecords == mvc::gnTopNodes );
+
+    printf( "    };\n\n" );
+    printf( "    const cTopLevels gtopSphereFlake = { %lluull, gnTopLevels, garrSphereFlakeTop };\n}\n",
+            static_cast<unsigned long long>( tree.GetGeneratorKey() ));
+    return nRecords == mvc::gnTopNodes && ! fflush( stdout ) ? 0 : 1;
+}
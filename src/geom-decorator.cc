@@ -173,6 +173,70 @@ cTuple3d ElementSumMul( const cTuple3d& tupleA, scalar sCoefA, const cTuple3d& t
     return tplOut;    
 }
 
+void ExportQuaternion( scalar* psQuat, const cMatrix3d& matIn )
+{
+    // Shepperd's method: we pick the largest quaternion component to divide by, for numerical stability
+    scalar sTrace = matIn[0][0] + matIn[1][1] + matIn[2][2];
+    if( sTrace > 0 )
+    {
+        scalar sS = sqrt( sTrace + 1 ) * 2;
+        psQuat[ W ] = sS / 4;
+        psQuat[ X ] = ( matIn[2][1] - matIn[1][2] ) / sS;
+        psQuat[ Y ] = ( matIn[0][2] - matIn[2][0] ) / sS;
+        psQuat[ Z ] = ( matIn[1][0] - matIn[0][1] ) / sS;
+    }
+    else
+    if( matIn[0][0] > matIn[1][1] && matIn[0][0] > matIn[2][2] )
+    {
+        scalar sS = sqrt( 1 + matIn[0][0] - matIn[1][1] - matIn[2][2] ) * 2;
+        psQuat[ W ] = ( matIn[2][1] - matIn[1][2] ) / sS;
+        psQuat[ X ] = sS / 4;
+        psQuat[ Y ] = ( matIn[0][1] + matIn[1][0] ) / sS;
+        psQuat[ Z ] = ( matIn[0][2] + matIn[2][0] ) / sS;
+    }
+    else
+    if( matIn[1][1] > matIn[2][2] )
+    {
+        scalar sS = sqrt( 1 + matIn[1][1] - matIn[0][0] - matIn[2][2] ) * 2;
+        psQuat[ W ] = ( matIn[0][2] - matIn[2][0] ) / sS;
+        psQuat[ X ] = ( matIn[0][1] + matIn[1][0] ) / sS;
+        psQuat[ Y ] = sS / 4;
+        psQuat[ Z ] = ( matIn[1][2] + matIn[2][1] ) / sS;
+    }
+    else
+    {
+        scalar sS = sqrt( 1 + matIn[2][2] - matIn[0][0] - matIn[1][1] ) * 2;
+        psQuat[ W ] = ( matIn[1][0] - matIn[0][1] ) / sS;
+        psQuat[ X ] = ( matIn[0][2] + matIn[2][0] ) / sS;
+        psQuat[ Y ] = ( matIn[1][2] + matIn[2][1] ) / sS;
+        psQuat[ Z ] = sS / 4;
+    }
+}
+
+void LoadRigidTransform( cMatrix3d& matIn, const scalar* psQuat, const cPoint3d& ptOrigin )
+{
+    scalar sNorm = psQuat[ X ] * psQuat[ X ] + psQuat[ Y ] * psQuat[ Y ] + psQuat[ Z ] * psQuat[ Z ] + psQuat[ W ] * psQuat[ W ];
+    scalar sS = static_cast<scalar>( 2.0 ) / sNorm; // normalizes the quaternion on the fly
+    scalar x = psQuat[ X ], y = psQuat[ Y ], z = psQuat[ Z ], w = psQuat[ W ];
+
+    matIn(0)(0) = 1 - sS * ( y * y + z * z );
+    matIn(0)(1) =     sS * ( x * y - z * w );
+    matIn(0)(2) =     sS * ( x * z + y * w );
+    matIn(0)(3) = ptOrigin[ X ];
+
+    matIn(1)(0) =     sS * ( x * y + z * w );
+    matIn(1)(1) = 1 - sS * ( x * x + z * z );
+    matIn(1)(2) =     sS * ( y * z - x * w );
+    matIn(1)(3) = ptOrigin[ Y ];
+
+    matIn(2)(0) =     sS * ( x * z - y * w );
+    matIn(2)(1) =     sS * ( y * z + x * w );
+    matIn(2)(2) = 1 - sS * ( x * x + y * y );
+    matIn(2)(3) = ptOrigin[ Z ];
+
+    matIn(3) = cTuple3d( 0, 0, 0, 1 );
+}
+
 
 } // NS end
 } // NS end
@@ -116,6 +116,21 @@ namespace geom
         ///
         cTuple3d ElementSumMul( const cTuple3d& tupleA, scalar sCoefA, const cTuple3d& tupleB, scalar sCoefB );
 
+        /////////////////////////////////////////////////
+        /// \brief ExportQuaternion - Exports the rotation part of a rigid transform as a unit quaternion
+        /// \param psQuat         - the quaternion (x, y, z, w) array
+        /// \param matIn          - the rigid transform matrix
+        ///
+        void ExportQuaternion( scalar* psQuat, const cMatrix3d& matIn );
+
+        /////////////////////////////////////////////////
+        /// \brief LoadRigidTransform - loads a rotation given by quaternion followed by translation into the argument matrix
+        /// \param matArg         - the matrix to be loaded
+        /// \param psQuat         - the quaternion (x, y, z, w) array, normalized here
+        /// \param ptOrigin       - the translation, i.e. the image of the CS origin
+        ///
+        void LoadRigidTransform( cMatrix3d& matArg, const scalar* psQuat, const cPoint3d& ptOrigin );
+
     }
 
 }
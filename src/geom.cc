@@ -27,6 +27,10 @@
 #include <cmath>
 #include "geom.hh"
 #include "assert.hh"
+#if defined( __GNUC__ ) && defined( __x86_64__ ) && ! defined( _GEOM_FLOAT_ )
+#define _GEOM_BATCH_SIMD_
+#include <immintrin.h>
+#endif
 namespace geom
 {
 
@@ -402,6 +406,18 @@ cPlane3d::ProjectPoint( const cPoint3d& ptIn )
     return ptIn + m_vecNormal *  - PointDistance( ptIn );
 }
 
+const cVector3d&
+cPlane3d::GetNormal() const
+{
+    return m_vecNormal;
+}
+
+const cPoint3d&
+cPlane3d::GetOrigin() const
+{
+    return m_ptOrigin;
+}
+
 #ifdef _DEBUG_DUMP_
 void 
 cPlane3d::Dump() const
@@ -523,6 +539,100 @@ cMatrix3d  operator + ( const  cMatrix3d& matA, const  cMatrix3d& matB)
 }
 
 
+/////////////////////////////////////////////////////////////////////////////
+// batch operations
+
+#ifdef _GEOM_BATCH_SIMD_
+// Each lane holds an A matrix, so the 16 elements are 16 vectors. The sums run in the order operator * adds the
+// terms, from +0 and without fused multiply-adds, so every lane gets exactly the scalar result. The last lanes of a
+// short batch repeat the last matrix and are not stored
+
+static void BatchProductSSE2( const cMatrix3d* parrmatA, size_t nA, const cMatrix3d* parrmatB, size_t nB, cMatrix3d* parrmatOut, size_t nOutStride )
+{
+    const size_t nLanes = 2;
+    size_t cA, cB, cLane;
+    int cRow, cCol, cProd;
+    for( cA = 0; cA < nA; cA += nLanes )
+    {
+        size_t arrnLane[ nLanes ];
+        for( cLane = 0; cLane < nLanes; cLane ++ )
+            arrnLane[ cLane ] = cA + cLane < nA ? cA + cLane : nA - 1;
+        __m128d arrvecA[ gnDim3d * gnDim3d ];
+        for( cRow = 0; cRow < gnDim3d; cRow ++ )
+            for( cProd = 0; cProd < gnDim3d; cProd ++ )
+                arrvecA[ cRow * gnDim3d + cProd ] = _mm_set_pd( parrmatA[ arrnLane[ 1 ]][ cRow ][ cProd ], parrmatA[ arrnLane[ 0 ]][ cRow ][ cProd ] );
+        for( cB = 0; cB < nB; cB ++ )
+        {
+            const cMatrix3d& matB = parrmatB[ cB ];
+            for( cRow = 0; cRow < gnDim3d; cRow ++ )
+                for( cCol = 0; cCol < gnDim3d; cCol ++ )
+                {
+                    __m128d vecSum = _mm_setzero_pd();
+                    for( cProd = 0; cProd < gnDim3d; cProd ++ )
+                        vecSum = _mm_add_pd( vecSum, _mm_mul_pd( arrvecA[ cRow * gnDim3d + cProd ], _mm_set1_pd( matB[ cProd ][ cCol ] )));
+                    scalar arrsSum[ nLanes ];
+                    _mm_storeu_pd( arrsSum, vecSum );
+                    for( cLane = 0; cLane < nLanes && cA + cLane < nA; cLane ++ )
+                        parrmatOut[ ( cA + cLane ) * nOutStride + cB ]( cRow )( cCol ) = arrsSum[ cLane ];
+                }
+        }
+    }
+}
+
+__attribute__(( target( "avx2" )))
+static void BatchProductAVX2( const cMatrix3d* parrmatA, size_t nA, const cMatrix3d* parrmatB, size_t nB, cMatrix3d* parrmatOut, size_t nOutStride )
+{
+    const size_t nLanes = 4;
+    size_t cA, cB, cLane;
+    int cRow, cCol, cProd;
+    for( cA = 0; cA < nA; cA += nLanes )
+    {
+        size_t arrnLane[ nLanes ];
+        for( cLane = 0; cLane < nLanes; cLane ++ )
+            arrnLane[ cLane ] = cA + cLane < nA ? cA + cLane : nA - 1;
+        __m256d arrvecA[ gnDim3d * gnDim3d ];
+        for( cRow = 0; cRow < gnDim3d; cRow ++ )
+            for( cProd = 0; cProd < gnDim3d; cProd ++ )
+                arrvecA[ cRow * gnDim3d + cProd ] = _mm256_set_pd( parrmatA[ arrnLane[ 3 ]][ cRow ][ cProd ], parrmatA[ arrnLane[ 2 ]][ cRow ][ cProd ],
+                                                                   parrmatA[ arrnLane[ 1 ]][ cRow ][ cProd ], parrmatA[ arrnLane[ 0 ]][ cRow ][ cProd ] );
+        for( cB = 0; cB < nB; cB ++ )
+        {
+            const cMatrix3d& matB = parrmatB[ cB ];
+            for( cRow = 0; cRow < gnDim3d; cRow ++ )
+                for( cCol = 0; cCol < gnDim3d; cCol ++ )
+                {
+                    __m256d vecSum = _mm256_setzero_pd();
+                    for( cProd = 0; cProd < gnDim3d; cProd ++ )
+                        vecSum = _mm256_add_pd( vecSum, _mm256_mul_pd( arrvecA[ cRow * gnDim3d + cProd ], _mm256_set1_pd( matB[ cProd ][ cCol ] )));
+                    scalar arrsSum[ nLanes ];
+                    _mm256_storeu_pd( arrsSum, vecSum );
+                    for( cLane = 0; cLane < nLanes && cA + cLane < nA; cLane ++ )
+                        parrmatOut[ ( cA + cLane ) * nOutStride + cB ]( cRow )( cCol ) = arrsSum[ cLane ];
+                }
+        }
+    }
+}
+#endif
+
+void BatchProduct( const cMatrix3d* parrmatA, size_t nA, const cMatrix3d* parrmatB, size_t nB, cMatrix3d* parrmatOut, size_t nOutStride )
+{
+    if( ! nA || ! nB )
+        return;
+#ifdef _GEOM_BATCH_SIMD_
+    // SSE2 is always there on x86-64, AVX2 is checked at runtime
+    if( __builtin_cpu_supports( "avx2" ))
+        BatchProductAVX2( parrmatA, nA, parrmatB, nB, parrmatOut, nOutStride );
+    else
+        BatchProductSSE2( parrmatA, nA, parrmatB, nB, parrmatOut, nOutStride );
+#else
+    size_t cA, cB;
+    for( cA = 0; cA < nA; cA ++ )
+        for( cB = 0; cB < nB; cB ++ )
+            parrmatOut[ cA * nOutStride + cB ] = parrmatA[ cA ] * parrmatB[ cB ];
+#endif
+}
+
+
 #ifdef _DEBUG_DUMP_
 void 
 cTuple3d::Dump()  const
@@ -223,6 +223,8 @@ class cPlane3d
 
         scalar   PointDistance( const cPoint3d& ); //!< Euclidean norm. Returns positive if point is on the side normal vector points to, ~= 0 on plane, negative o.w.
         cPoint3d ProjectPoint( const cPoint3d& ); //!< Projects the argument onto plane
+        const cVector3d& GetNormal() const;        //!< Retrieves the unit normal vector
+        const cPoint3d&  GetOrigin() const;        //!< Retrieves the point on the plane
 
         ~cPlane3d(); //!< destructor, not virtual
 #ifdef _DEBUG_DUMP_
@@ -249,6 +251,14 @@ cMatrix3d  operator * ( const  cMatrix3d&, const  cMatrix3d& );  //!< Matrix - m
 
 cMatrix3d  operator + ( const  cMatrix3d&, const  cMatrix3d& );  //!< Matrix - matrix  addition
 
+// batch operations
+
+//////////////////////////////////////////////////
+/// \brief BatchProduct - multiplies every matrix of a batch by every matrix of a second batch
+/// parrmatOut[ a * nOutStride + b ] is parrmatA[ a ] * parrmatB[ b ], bit for bit what operator * gives.
+/// The A matrices are taken in SIMD lanes, structure of arrays, when the CPU has them; B is broadcast
+void BatchProduct( const cMatrix3d* parrmatA, size_t nA, const cMatrix3d* parrmatB, size_t nB, cMatrix3d* parrmatOut, size_t nOutStride );
+
 
 } // namespace end
 
@@ -0,0 +1,317 @@
+/*
+* MIT License
+* 
+* Copyright (c) 2020 ibaylov@gmail.com
+* 
+* Permission is hereby granted, free of charge, to any person obtaining a copy
+* of this software and associated documentation files (the "Software"), to deal
+* in the Software without restriction, including without limitation the rights
+* to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+* copies of the Software, and to permit persons to whom the Software is
+* furnished to do so, subject to the following conditions:
+* 
+* The above copyright notice and this permission notice shall be included in all
+* copies or substantial portions of the Software.
+* 
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+* AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+* OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+* SOFTWARE.
+*/
+#ifndef _HASHMAP_HH_
+#define _HASHMAP_HH_
+#include <cstddef>
+#include "assert.hh"
+
+/**
+@file  hashmap.hh
+@brief A template-based open-addressing hash map for integer keys
+The entries are kept in a single power-of-two array, the key next to its value, so a lookup usually costs one cache
+line. The collisions are resolved by linear probing in the Robin Hood order: an entry displaces the ones closer to
+their home bucket than itself, which keeps the probe sequences short and lets a miss stop early. The removals shift
+the following entries back instead of leaving tombstones, so the table never degrades with churn.
+A bounded map holds a fixed number of entries at most and evicts one to make room for a new key, which suits the
+caches and the filters that may forget.
+*/
+
+namespace utl
+{
+    //////////////////////////////////////////////////
+    /// \brief The cHashMap template
+    /// implements the map from an integer Key to a Value. One key value, given to the constructor, marks the empty
+    /// buckets and can't be stored. The Value must be default constructible and assignable
+    template<typename Key, typename Value> class cHashMap
+    {
+        public:
+            struct Entry
+            {
+                Key     m_nKey;     //!< the key, the empty key for a free bucket
+                Value   m_Value;    //!< the value stored with the key
+            };
+        protected:
+            Entry*  m_parrEntries;  //!< the buckets
+            size_t  m_nCapacity;    //!< the number of buckets, a power of 2
+            size_t  m_nShift;       //!< the hash shift, 64 - log2( m_nCapacity )
+            size_t  m_nCount;       //!< the entries stored
+            size_t  m_nBound;       //!< the entries stored at most, 0 if the map grows
+            Key     m_nEmpty;       //!< the key of the free buckets
+        public:
+            //////////////////////////////////////////////////
+            /// \brief cHashMap::cHashMap
+            /// Constructs an empty map; nothing is allocated until the first insertion or Reserve()
+            /// \param nEmpty - the key that marks the free buckets
+            cHashMap( Key nEmpty )
+                : m_parrEntries( nullptr ), m_nCapacity( 0 ), m_nShift( 0 ), m_nCount( 0 ), m_nBound( 0 ), m_nEmpty( nEmpty )
+            {
+            }
+
+            //////////////////////////////////////////////////
+            /// \brief cHashMap::~cHashMap
+            /// Frees the buckets; the values are destroyed with them
+            ~cHashMap()
+            {
+                delete [] m_parrEntries;
+            }
+
+            #ifndef _NO_CXX_11_
+            cHashMap( const cHashMap& ) = delete; //!< Prevent direct copy
+            #endif
+
+            //////////////////////////////////////////////////
+            /// \brief cHashMap::Reserve
+            /// Sizes the buckets for nEntries at the load factor of one half, dropping the content
+            /// \param nEntries - the entries expected
+            /// \param bBounded - if set, the map holds nEntries at most and evicts to insert more
+            void Reserve( size_t nEntries, bool bBounded = false )
+            {
+                Allocate( nEntries );
+                m_nBound = bBounded ? ( nEntries ? nEntries : 1 ) : 0;
+            }
+
+            //////////////////////////////////////////////////
+            /// \brief cHashMap::Release
+            /// Frees the buckets, the map is empty and unbounded afterwards
+            void Release()
+            {
+                delete [] m_parrEntries;
+                m_parrEntries = nullptr;
+                m_nCapacity = m_nShift = m_nCount = m_nBound = 0;
+            }
+
+            //////////////////////////////////////////////////
+            /// \brief cHashMap::Clear
+            /// Removes all the entries, keeping the buckets
+            void Clear()
+            {
+                size_t cBucket;
+                for( cBucket = 0; cBucket < m_nCapacity; cBucket ++ )
+                    m_parrEntries[ cBucket ].m_nKey = m_nEmpty;
+                m_nCount = 0;
+            }
+
+            //////////////////////////////////////////////////
+            /// \brief cHashMap::Find
+            /// Looks a key up
+            /// \param nKey - the key
+            /// \returns the value stored with the key, nullptr if there is none
+            Value* Find( Key nKey )
+            {
+                size_t nBucket = FindBucket( nKey );
+                return nBucket == m_nCapacity ? nullptr : &m_parrEntries[ nBucket ].m_Value;
+            }
+
+            //////////////////////////////////////////////////
+            /// \brief cHashMap::Find
+            /// The read-only lookup, see above
+            const Value* Find( Key nKey ) const
+            {
+                size_t nBucket = FindBucket( nKey );
+                return nBucket == m_nCapacity ? nullptr : &m_parrEntries[ nBucket ].m_Value;
+            }
+
+            //////////////////////////////////////////////////
+            /// \brief cHashMap::Insert
+            /// Stores a value with a key, replacing the one stored before. A full bounded map first evicts the entry
+            /// nearest to the home of the key, which costs no more than the insertion itself
+            /// \param nKey - the key, not the empty one
+            /// \param valueIn - the value
+            /// \param pEvicted - receives the evicted entry if not nullptr; its key is the empty one if none was
+            /// \returns the stored value, valid until the next insertion or removal
+            Value* Insert( Key nKey, const Value& valueIn, Entry* pEvicted = nullptr )
+            {
+                _ASSERT( nKey != m_nEmpty );
+                if( pEvicted )
+                    pEvicted->m_nKey = m_nEmpty;
+                if( ! m_nCapacity )
+                    Allocate( m_nBound ? m_nBound : 8 );
+                size_t nFound = FindBucket( nKey );
+                if( nFound != m_nCapacity )
+                {
+                    m_parrEntries[ nFound ].m_Value = valueIn;
+                    return &m_parrEntries[ nFound ].m_Value;
+                }
+                if( m_nBound && m_nCount >= m_nBound )
+                {
+                    size_t nVictim = Home( nKey );
+                    while( m_parrEntries[ nVictim ].m_nKey == m_nEmpty )
+                        nVictim = ( nVictim + 1 ) & ( m_nCapacity - 1 );
+                    if( pEvicted )
+                        *pEvicted = m_parrEntries[ nVictim ];
+                    RemoveBucket( nVictim );
+                }
+                else
+                if( ! m_nBound && 2 * ( m_nCount + 1 ) > m_nCapacity )
+                    Grow();
+                return Place( nKey, valueIn );
+            }
+
+            //////////////////////////////////////////////////
+            /// \brief cHashMap::Remove
+            /// Removes a key
+            /// \param nKey - the key
+            /// \returns true if the key was there
+            bool Remove( Key nKey )
+            {
+                size_t nBucket = FindBucket( nKey );
+                if( nBucket == m_nCapacity )
+                    return false;
+                RemoveBucket( nBucket );
+                return true;
+            }
+
+            //////////////////////////////////////////////////
+            /// \brief cHashMap::GetCount
+            /// Retrieves the number of entries
+            size_t GetCount() const
+            {
+                return m_nCount;
+            }
+
+            //////////////////////////////////////////////////
+            /// \brief cHashMap::GetCapacity
+            /// Retrieves the number of buckets
+            size_t GetCapacity() const
+            {
+                return m_nCapacity;
+            }
+
+        protected:
+            //////////////////////////////////////////////////
+            /// \brief cHashMap::Home
+            /// The Fibonacci hash: the top bits of the key times 2^64 over the golden ratio
+            size_t Home( Key nKey ) const
+            {
+                return static_cast<size_t>( ( static_cast<unsigned long long>( nKey ) * 0x9E3779B97F4A7C15ull ) >> m_nShift );
+            }
+
+            //////////////////////////////////////////////////
+            /// \brief cHashMap::Distance
+            /// The probe distance of the entry in a bucket from its home
+            size_t Distance( size_t nBucket ) const
+            {
+                return ( nBucket - Home( m_parrEntries[ nBucket ].m_nKey )) & ( m_nCapacity - 1 );
+            }
+
+            //////////////////////////////////////////////////
+            /// \brief cHashMap::FindBucket
+            /// Finds the bucket of a key; the probe stops at the first entry closer to its home than the key would be
+            /// \returns the bucket, m_nCapacity if the key isn't there
+            size_t FindBucket( Key nKey ) const
+            {
+                if( ! m_nCount )
+                    return m_nCapacity;
+                size_t nBucket = Home( nKey ), nDistance = 0;
+                for( ;; nBucket = ( nBucket + 1 ) & ( m_nCapacity - 1 ), nDistance ++ )
+                {
+                    const Key& nOccupant = m_parrEntries[ nBucket ].m_nKey;
+                    if( nOccupant == nKey )
+                        return nBucket;
+                    if( nOccupant == m_nEmpty || Distance( nBucket ) < nDistance )
+                        return m_nCapacity;
+                }
+            }
+
+            //////////////////////////////////////////////////
+            /// \brief cHashMap::Place
+            /// Places a key known to be missing, displacing the entries closer to their homes
+            /// \returns the stored value
+            Value* Place( Key nKey, const Value& valueIn )
+            {
+                Entry entryCarried;
+                entryCarried.m_nKey = nKey;
+                entryCarried.m_Value = valueIn;
+                Value* pPlaced = nullptr;
+                size_t nBucket = Home( nKey ), nDistance = 0;
+                for( ;; nBucket = ( nBucket + 1 ) & ( m_nCapacity - 1 ), nDistance ++ )
+                {
+                    Entry& rEntry = m_parrEntries[ nBucket ];
+                    if( rEntry.m_nKey == m_nEmpty )
+                    {
+                        rEntry = entryCarried;
+                        m_nCount ++;
+                        return pPlaced ? pPlaced : &rEntry.m_Value;
+                    }
+                    size_t nOccupant = Distance( nBucket );
+                    if( nOccupant < nDistance )
+                    {
+                        // the richer entry yields the bucket and goes on probing in place of the carried one
+                        Entry entrySwap = rEntry;
+                        rEntry = entryCarried;
+                        entryCarried = entrySwap;
+                        if( ! pPlaced )
+                            pPlaced = &rEntry.m_Value;
+                        nDistance = nOccupant;
+                    }
+                }
+            }
+
+            //////////////////////////////////////////////////
+            /// \brief cHashMap::RemoveBucket
+            /// Empties a bucket, shifting the following displaced entries one bucket back
+            void RemoveBucket( size_t nBucket )
+            {
+                size_t nNext = ( nBucket + 1 ) & ( m_nCapacity - 1 );
+                while( m_parrEntries[ nNext ].m_nKey != m_nEmpty && Distance( nNext ))
+                {
+                    m_parrEntries[ nBucket ] = m_parrEntries[ nNext ];
+                    nBucket = nNext;
+                    nNext = ( nNext + 1 ) & ( m_nCapacity - 1 );
+                }
+                m_parrEntries[ nBucket ].m_nKey = m_nEmpty;
+                m_nCount --;
+            }
+
+            //////////////////////////////////////////////////
+            /// \brief cHashMap::Allocate
+            /// Allocates empty buckets for nEntries at the load factor of one half
+            void Allocate( size_t nEntries )
+            {
+                delete [] m_parrEntries;
+                for( m_nCapacity = 8, m_nShift = 61; m_nCapacity < 2 * nEntries; m_nCapacity <<= 1, m_nShift -- )
+                    ;
+                m_parrEntries = new Entry[ m_nCapacity ];
+                m_nCount = 0;
+                Clear();
+            }
+
+            //////////////////////////////////////////////////
+            /// \brief cHashMap::Grow
+            /// Doubles the buckets, placing the entries again
+            void Grow()
+            {
+                Entry* parrOld = m_parrEntries;
+                size_t nOld = m_nCapacity, cBucket;
+                m_parrEntries = nullptr;
+                Allocate( m_nCapacity );
+                for( cBucket = 0; cBucket < nOld; cBucket ++ )
+                    if( parrOld[ cBucket ].m_nKey != m_nEmpty )
+                        Place( parrOld[ cBucket ].m_nKey, parrOld[ cBucket ].m_Value );
+                delete [] parrOld;
+            }
+    };
+}
+
+#endif
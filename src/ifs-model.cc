@@ -0,0 +1,89 @@
+/*
+* MIT License
+* 
+* Copyright (c) 2020 ibaylov@gmail.com
+* 
+* Permission is hereby granted, free of charge, to any person obtaining a copy
+* of this software and associated documentation files (the "Software"), to deal
+* in the Software without restriction, including without limitation the rights
+* to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+* copies of the Software, and to permit persons to whom the Software is
+* furnished to do so, subject to the following conditions:
+* 
+* The above copyright notice and this permission notice shall be included in all
+* copies or substantial portions of the Software.
+* 
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+* AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+* OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+* SOFTWARE.
+*/
+#include "ifs-model.hh"
+#include "geom-decorator.hh"
+
+namespace mvc
+{
+
+///////////////////////////////////////////////////////////////////////////////
+// cSphereFlakeSet implementation
+
+void
+cSphereFlakeSet::SetupTransforms( geom::cMatrix3d* parrmatRel )
+{
+    // the children are placed on the parent sphere at distance R + R / 3 from the center, turned so that their
+    // Z axis (the pole) points away from the parent. Six of them lie on the equator, 60 degrees apart, and three
+    // are inclined at 60 degrees latitude, 120 degrees apart and shifted by 30 degrees in longitude
+    geom::cMatrix3d matTranslateOuter;
+    geom::decorator::LoadTranslation( matTranslateOuter, geom::cVector3d( static_cast<geom::scalar>( 4.0 / 3.0 ),  0 ,  0));
+    geom::cMatrix3d matRotateNewBasis;
+    geom::decorator::LoadRotation( matRotateNewBasis, geom::Y,  90,  geom::decorator::Degrees );
+    geom::cMatrix3d matEquator = matTranslateOuter * matRotateNewBasis;
+
+    geom::cMatrix3d matRotateLat;
+    geom::decorator::LoadRotation( matRotateLat, geom::Y,  -60,  geom::decorator::Degrees );
+    geom::cMatrix3d matRotateLon;
+    geom::decorator::LoadRotation( matRotateLon, geom::Z,  30,  geom::decorator::Degrees );
+    geom::cMatrix3d matInclined = matRotateLon * matRotateLat * matEquator;
+
+    size_t cChd;
+    geom::cMatrix3d matRotate;
+    for( cChd = 0; cChd < 6; cChd ++ )
+    {
+        geom::decorator::LoadRotation( matRotate, geom::Z,  60 * cChd,  geom::decorator::Degrees );
+        parrmatRel[ cChd ] = matRotate * matEquator;
+    }
+    for( cChd = 0; cChd < 3; cChd ++ )
+    {
+        geom::decorator::LoadRotation( matRotate, geom::Z,  120 * cChd,  geom::decorator::Degrees );
+        parrmatRel[ 6 + cChd ] = matRotate * matInclined;
+    }
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// cOctaFlakeSet implementation
+
+void
+cOctaFlakeSet::SetupTransforms( geom::cMatrix3d* parrmatRel )
+{
+    // the children touch the parent at distance R + R / 2 from the center, with the pole pointing away from it;
+    // four lie on the equator, 90 degrees apart, and the fifth one sits on the parent pole
+    geom::cMatrix3d matTranslateOuter;
+    geom::decorator::LoadTranslation( matTranslateOuter, geom::cVector3d( static_cast<geom::scalar>( 3.0 / 2.0 ),  0 ,  0));
+    geom::cMatrix3d matRotateNewBasis;
+    geom::decorator::LoadRotation( matRotateNewBasis, geom::Y,  90,  geom::decorator::Degrees );
+    geom::cMatrix3d matEquator = matTranslateOuter * matRotateNewBasis;
+
+    size_t cChd;
+    geom::cMatrix3d matRotate;
+    for( cChd = 0; cChd < 4; cChd ++ )
+    {
+        geom::decorator::LoadRotation( matRotate, geom::Z,  90 * cChd,  geom::decorator::Degrees );
+        parrmatRel[ cChd ] = matRotate * matEquator;
+    }
+    geom::decorator::LoadTranslation( parrmatRel[ 4 ], geom::cVector3d( 0,  0 ,  static_cast<geom::scalar>( 3.0 / 2.0 )));
+}
+
+}// NS end
@@ -0,0 +1,111 @@
+/*
+* MIT License
+* 
+* Copyright (c) 2020 ibaylov@gmail.com
+* 
+* Permission is hereby granted, free of charge, to any person obtaining a copy
+* of this software and associated documentation files (the "Software"), to deal
+* in the Software without restriction, including without limitation the rights
+* to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+* copies of the Software, and to permit persons to whom the Software is
+* furnished to do so, subject to the following conditions:
+* 
+* The above copyright notice and this permission notice shall be included in all
+* copies or substantial portions of the Software.
+* 
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+* AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+* OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+* SOFTWARE.
+*/
+#ifndef _MVC_IFS_MODEL_
+#define _MVC_IFS_MODEL_
+#include "fractal-model.hh"
+
+/**
+@file  ifs-model.hh
+@brief The iterated function system models: cFractalcModel instances for specific self-similar sphere sets
+A transform-set descriptor is a class with the static members
+    gnChildren           - the children of every element, 1 to gnSphereChildren
+    GetRatio()           - the child radius to the parent radius
+    SetupTransforms()    - fills the child local CS relative to a unit radius parent
+cIFSModel evaluates the descriptor once per set, deriving the descendant bounds from the transforms, so generating a child costs a single product of the parent CS
+with a constant. The model and the view see only the resulting cTransformSet, so a new set needs no other changes
+*/
+
+#ifdef _NO_CXX_11_
+#define constexpr
+#endif
+
+namespace mvc
+{
+    ////////////////////////////////////////////////////////////////////
+    /// \brief The cSphereFlakeSet descriptor
+    /// The classic SphereFlake: nine children of a third of the radius, six on the equator and three inclined
+    struct cSphereFlakeSet
+    {
+        static const size_t gnChildren = 9;
+        static constexpr geom::scalar GetRatio() { return static_cast<geom::scalar>( 1.0 / 3.0 ); }
+        static void SetupTransforms( geom::cMatrix3d* parrmatRel ); //!< Computes the nine child relative transforms
+    };
+
+    ////////////////////////////////////////////////////////////////////
+    /// \brief The cOctaFlakeSet descriptor
+    /// An octahedral flake: five children of half the radius, on the octahedron vertices except the parent's one
+    struct cOctaFlakeSet
+    {
+        static const size_t gnChildren = 5;
+        static constexpr geom::scalar GetRatio() { return static_cast<geom::scalar>( 1.0 / 2.0 ); }
+        static void SetupTransforms( geom::cMatrix3d* parrmatRel ); //!< Computes the five child relative transforms
+    };
+
+    ////////////////////////////////////////////////////////////////////
+    /// \brief The cIFSModel template
+    /// The fractal model of the TransformSet descriptor
+    template<typename TransformSet> class cIFSModel : public cFractalcModel
+    {
+        #ifndef _NO_CXX_11_
+        static_assert( TransformSet::gnChildren > 0 && TransformSet::gnChildren <= gnSphereChildren, "the set doesn't fit the store groups" );
+        #endif
+        public:
+            //////////////////////////////////////////////////
+            /// \brief cIFSModel::cIFSModel
+            /// Constructs the model of the shared transform set
+            cIFSModel()
+                : cFractalcModel( Describe() )
+            {
+
+            }
+
+            //////////////////////////////////////////////////
+            /// \brief cIFSModel::Describe
+            /// Evaluates the descriptor on the first call
+            /// \returns the transform set shared by all the models of the descriptor
+            static const cTransformSet& Describe()
+            {
+                static const cTransformSet setShared = Evaluate();
+                return setShared;
+            }
+        protected:
+            //////////////////////////////////////////////////
+            /// \brief cIFSModel::Evaluate
+            /// Fills a transform set from the descriptor
+            static cTransformSet Evaluate()
+            {
+                cTransformSet set;
+                set.m_nChildren = TransformSet::gnChildren;
+                set.m_sRatio = TransformSet::GetRatio();
+                TransformSet::SetupTransforms( set.m_arrmatRel );
+                set.DeriveBounds();
+                return set;
+            }
+    };
+
+    typedef cIFSModel<cSphereFlakeSet> cSphereFlakeModel; //!< The SphereFlake model
+    typedef cIFSModel<cOctaFlakeSet>   cOctaFlakeModel;   //!< The octahedral flake model
+}
+
+#endif
@@ -24,6 +24,9 @@
 #include <GL/glu.h>
 #include <GL/glut.h>
 #include <math.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
 #include <iostream>
 
 #include "geom.hh"
@@ -31,8 +34,10 @@
 #include "viewport.hh"
 #include "view.hh"
 #include "model.hh"
-#include "fractal-model.hh"
+#include "ifs-model.hh"
+#include "scene.hh"
 #include "oglview.hh"
+#include "static-view.hh"
 #include <assert.h>
 
 /**
@@ -57,6 +62,19 @@ mvc::cView *    gpView = nullptr;
 /// \brief gpModel - the cModel singleton pointer
 ///
 mvc::cModel*    gpModel = nullptr;
+/////////////////////////////////////////////////
+/// \brief gpFractal - the fractal model singleton pointer, the one gpModel shows or instances
+///
+mvc::cFractalcModel* gpFractal = nullptr;
+/////////////////////////////////////////////////
+/// \brief gpPool - the worker threads singleton pointer
+///
+utl::cTaskPool* gpPool = nullptr;
+
+/////////////////////////////////////////////////
+/// \brief cSphereView - the view instantiated on the fractal model
+///
+typedef mvc::cStaticOGLView<mvc::cFractalcModel> cSphereView;
 
 ////////////////////////////////////////////////
 /// \brief ReshapeProc - called on window resize
@@ -132,6 +150,19 @@ public:
     }
 } gcVitroStencil;
 
+////////////////////////////////////////////////////
+/// \brief SelectStencil - sets the stencil, instantiating the drawing on it if the view allows
+/// \param pStencil - the stencil singleton
+///
+template<typename Stencil> void SelectStencil( Stencil* pStencil )
+{
+    cSphereView* pSphereView = dynamic_cast<cSphereView*>( gpView );
+    if( pSphereView )
+        pSphereView->SetTypedStencil( pStencil );
+    else
+        gpView->SetStencil( pStencil );
+}
+
 ////////////////////////////////////////////////////
 /// \brief KbdProc - the keyboard processing GLUT callback
 /// \param key     - the arhument holds the ASCII value
@@ -145,13 +176,13 @@ void KbdProc(unsigned char key, int x, int y)
     switch( key )
     {
         case '1':
-            gpView->SetStencil( &gcGoldStencil );
+            SelectStencil( &gcGoldStencil );
         break;
         case '2':
-            gpView->SetStencil( &gcPierotStencil );
+            SelectStencil( &gcPierotStencil );
         break;
         case '3':
-            gpView->SetStencil( &gcVitroStencil);
+            SelectStencil( &gcVitroStencil);
         break;
         case 'a':
             gpVP->OrbitHorz( sC , geom::decorator::Degrees );
@@ -189,6 +220,58 @@ void KbdProc(unsigned char key, int x, int y)
         case 'S':
             gpVP->Pitch( -sC, geom::decorator::Degrees );
         break;
+        case 'c':
+            {
+                // cycle through the descendant cache policies, keeping the budget
+                const mvc::cSphereNodeCache& rCache = gpFractal->GetCache();
+                mvc::CachePolicy policyNext = static_cast<mvc::CachePolicy>( ( rCache.GetPolicy() + 1 ) % mvc::CachePolicies );
+                gpFractal->SetCachePolicy( policyNext, rCache.GetBudgetBytes(), rCache.GetPrefillDepth() );
+                static const char* arrszPolicies[ mvc::CachePolicies ] = { "breadth-first", "least recently used", "visibility weighted" };
+                std::cout << "Cache policy: " << arrszPolicies[ policyNext ] << std::endl;
+            }
+        break;
+        case 'f':
+            {
+                // toggle the background prefetch
+                gpFractal->SetPrefetch( ! gpFractal->IsPrefetching() );
+                std::cout << "Prefetch: " << ( gpFractal->IsPrefetching() ? "on" : "off" ) << std::endl;
+            }
+        break;
+        case 'r':
+            // toggle the camera-relative float classification and drawing
+            gpVP->SetRelative( ! gpVP->IsRelative() );
+            std::cout << "Camera-relative: " << ( gpVP->IsRelative() ? "on" : "off" ) << std::endl;
+        break;
+        case 'o':
+            {
+                // toggle the reuse of the previous frame traversal
+                mvc::cOGLView* pOGLView = dynamic_cast<mvc::cOGLView*>( gpView );
+                if( ! pOGLView )
+                    return;
+                pOGLView->SetCoherent( ! pOGLView->IsCoherent() );
+                std::cout << "Coherent traversal: " << ( pOGLView->IsCoherent() ? "on" : "off" ) << std::endl;
+            }
+        break;
+        case 'p':
+            {
+                // toggle the parallel full traversal; it's used when the coherent one is off
+                mvc::cOGLView* pOGLView = dynamic_cast<mvc::cOGLView*>( gpView );
+                if( ! pOGLView )
+                    return;
+                pOGLView->SetParallel( ! pOGLView->IsParallel() );
+                std::cout << "Parallel traversal: " << ( pOGLView->IsParallel() ? "on" : "off" ) << std::endl;
+            }
+        break;
+        case 'v':
+            {
+                // toggle the statically dispatched traversal, e.g. to compare it with the virtual one
+                cSphereView* pSphereView = dynamic_cast<cSphereView*>( gpView );
+                if( ! pSphereView )
+                    return;
+                pSphereView->SetStatic( ! pSphereView->IsStatic() );
+                std::cout << "Static dispatch: " << ( pSphereView->IsStatic() ? "on" : "off" ) << std::endl;
+            }
+        break;
         case ' ':
             gpVP ->Reset(geom::cPoint3d( 12, 0, 0 ), geom::cVector3d( -1, 0, 0), geom::cVector3d( 0,  0, 1 ),45, geom::decorator::Degrees );
         break;
@@ -196,7 +279,10 @@ void KbdProc(unsigned char key, int x, int y)
             // clear the singletons and quit
             // there should be better way to do this, though
             delete gpView;
-            delete gpModel;
+            if( gpModel != gpFractal )
+                delete gpModel;
+            delete gpFractal;
+            delete gpPool;
             delete gpVP;
             exit( 0);
         default:
@@ -206,12 +292,64 @@ void KbdProc(unsigned char key, int x, int y)
     DisplayProc();
 }
 
+/////////////////////////////////////////////////////////
+/// \brief CreateModel - the model factory proc
+/// \param szSet - the sphere set name, "sphereflake" or "octaflake"
+/// \returns the new model, nullptr for an unknown set
+///
+mvc::cFractalcModel* CreateModel( const char* szSet )
+{
+    if( ! strcmp( szSet, "sphereflake" ))
+    {
+        // the top levels of the SphereFlake are embedded at build time, so the first frames need no generation
+        mvc::cFractalcModel* pModel = new mvc::cSphereFlakeModel();
+        if( ! pModel->SetTopLevels( &mvc::gtopSphereFlake ))
+            std::cerr << "The embedded top levels were made for another build, they will be generated" << std::endl;
+        return pModel;
+    }
+    if( ! strcmp( szSet, "octaflake" ))
+        return new mvc::cOctaFlakeModel();
+    return nullptr;
+}
+
+/////////////////////////////////////////////////////////
+/// \brief CreateScene - places instances of a model on a grid around the origin
+/// \param pModel - the instanced model
+/// \param nInstances - the number of instances
+/// \returns the new scene, built
+///
+mvc::cScene* CreateScene( mvc::cFractalcModel* pModel, int nInstances )
+{
+    // the instances differ in scale, turn and depth, so that the grid is not too regular
+    const geom::scalar sSpacing = 5;
+    int nSide = static_cast<int>( ceil( sqrt( static_cast<double>( nInstances ))));
+    mvc::cScene* pScene = new mvc::cScene();
+    int cInstance;
+    for( cInstance = 0; cInstance < nInstances; cInstance ++ )
+    {
+        geom::scalar sX = ( cInstance % nSide - ( nSide - 1 ) / 2.0 ) * sSpacing;
+        geom::scalar sY = ( cInstance / nSide - ( nSide - 1 ) / 2.0 ) * sSpacing;
+        geom::scalar sTurn = cInstance * 2.39996; // the golden angle
+        geom::scalar sScale = 0.25 + 0.75 * ( ( cInstance * 7 ) % 10 ) / 9.0;
+        geom::cMatrix3d matWorld( cos( sTurn ), -sin( sTurn ), 0, sX,
+                                  sin( sTurn ),  cos( sTurn ), 0, sY,
+                                  0,             0,            1, 0,
+                                  0,             0,            0, 1 );
+        pScene->AddInstance( pModel, matWorld, sScale, 5 + cInstance % 4 );
+    }
+    pScene->Build();
+    return pScene;
+}
+
 /////////////////////////////////////////////////////////
 /// \brief init - the initialization, called by us inmain
 /// \param nW   - the window wdth
 /// \param nH   - the window height
+/// \param pFractal - the fractal model
+/// \param nInstances - the number of fractal instances to place in a scene, 0 to show the fractal alone
+/// \param nThreads - the worker threads of the traversal, the calling one included; 0 for one per processor
 ///
-void init(int nW, int nH)
+void init(int nW, int nH, mvc::cFractalcModel* pFractal, int nInstances, int nThreads )
 {
     glClearColor(0, 0 ,0, 0);
     glPointSize(1.0f);
@@ -222,13 +360,28 @@ void init(int nW, int nH)
                                     geom::cVector3d( 0,  0, 1 ),
                                     45, geom::decorator::Degrees,
                                     nW, nH  );
-    // this should be implemented in factory method/proc
-    gpModel = new mvc::cFractalcModel();
-    mvc::cOGLView* pvOGL  = new mvc::cOGLView();
+    gpFractal = pFractal;
+    cSphereView* pvOGL  = new cSphereView();
     pvOGL->AssociateViewport( gpVP );
-    pvOGL->AssociateModel( gpModel );
+    // the pool is started here, so the GLUT thread is its worker 0
+    gpPool = new utl::cTaskPool();
+    if( gpPool->Start( static_cast<size_t>( nThreads )))
+        pvOGL->SetTaskPool( gpPool );
+    else
+        std::cerr << "Can't start the worker threads, the traversal will run in a single one" << std::endl;
+    if( nInstances > 0 )
+    {
+        // the scene is traversed by the virtual calls only
+        gpModel = CreateScene( pFractal, nInstances );
+        pvOGL->AssociateModel( gpModel );
+    }
+    else
+    {
+        gpModel = pFractal;
+        pvOGL->AssociateTypedModel( pFractal );
+    }
     gpView = pvOGL;
-    gpView->SetStencil( &gcGoldStencil ); // we associate the first stencil instance with the view
+    SelectStencil( &gcGoldStencil ); // we associate the first stencil instance with the view
 }
 
 ///////////////////////////////////////////////////
@@ -258,8 +411,59 @@ int main( int argc, char** argv )
     glutDisplayFunc(DisplayProc);
     glutReshapeFunc(ReshapeProc);
     glutKeyboardFunc( KbdProc );
+    // the rest of the command line: [-s set] [-i instances] [-t threads] [-p pagefile [-b levels]] [snapshot]
+    const char* szSet = "sphereflake";
+    const char* szPages = nullptr;
+    int nBuildLevels = 0;
+    int nInstances = 0;
+    int nThreads = 0;
+    int nOpt;
+    while( ( nOpt = getopt( argc, argv, "s:i:t:p:b:" )) != -1 )
+        switch( nOpt )
+        {
+            case 's':
+                szSet = optarg;
+            break;
+            case 'i':
+                nInstances = atoi( optarg );
+            break;
+            case 't':
+                nThreads = atoi( optarg );
+            break;
+            case 'p':
+                szPages = optarg;
+            break;
+            case 'b':
+                nBuildLevels = atoi( optarg );
+            break;
+            default:
+                std::cerr << "Usage: " << argv[ 0 ] << " [-s sphereflake|octaflake] [-i instances] [-t threads] [-p pagefile [-b levels]] [snapshot]" << std::endl;
+                return 1;
+        }
+    mvc::cFractalcModel* pFractal = CreateModel( szSet );
+    if( ! pFractal )
+    {
+        std::cerr << "Unknown sphere set " << szSet << std::endl;
+        return 1;
+    }
     // and do our initialization
-    init(800, 600);
+    init( 800, 600, pFractal, nInstances, nThreads < 0 ? 0 : nThreads );
+
+    // the snapshot of the prefilled tree is written on the first run and mapped on the next ones
+    if( optind < argc )
+        pFractal->SetSnapshotPath( argv[ optind ] );
+    // the page file holds the deeper levels; it is built once with -b, which may take a while for many levels
+    if( szPages )
+    {
+        if( nBuildLevels > 0 )
+        {
+            std::cout << "Building " << szPages << " to " << nBuildLevels << " levels" << std::endl;
+            if( ! pFractal->BuildPageFile( szPages, nBuildLevels ))
+                std::cerr << "Can't build the page file " << szPages << std::endl;
+        }
+        if( ! pFractal->OpenPageFile( szPages ))
+            std::cerr << "Can't open the page file " << szPages << ", the deep levels will be generated" << std::endl;
+    }
     // begin event processing loop
     glutMainLoop();
 
@@ -53,12 +53,71 @@ cElement::GetLocalCS() const
     return m_matLCS;
 }
 
+geom::cPoint3d
+cElement::GetCenter() const
+{
+    // the local CS is affine, so the origin image is simply the translation column
+    return geom::cPoint3d( m_matLCS[ geom::X ][ geom::W ], m_matLCS[ geom::Y ][ geom::W ], m_matLCS[ geom::Z ][ geom::W ] );
+}
+
 size_t
 cElement::GetHierarchyDepth() const
 {
     return m_nHierarchyDepth;
 }
 
+geom::scalar
+cElement::GetDescendantCapDistance() const
+{
+    // with nothing known about the shape of the subtree, the cap is the bounding sphere bottom
+    return GetDescendantSphereRadius();
+}
+
+bool
+cElement::IsProxy() const
+{
+    return false;
+}
+
+
+///////////////////////////////////////////////////////////////
+// cChildVisitor implementation
+
+cChildVisitor::cChildVisitor()
+{
+
+}
+
+cChildVisitor::~cChildVisitor()
+{
+
+}
+
+///////////////////////////////////////////////////////////////
+// cChildCollector implementation
+
+cChildCollector::cChildCollector( utl::cObList<cElement*>& rlstChildren )
+    : m_rlstChildren( rlstChildren )
+{
+
+}
+
+cChildCollector::~cChildCollector()
+{
+
+}
+
+bool
+cChildCollector::Accept( const cChildBounds& )
+{
+    return true;
+}
+
+void
+cChildCollector::Visit( cElement* pElem )
+{
+    m_rlstChildren.Add( pElem );
+}
 
 ///////////////////////////////////////////////////////////////
 // cModel implementation
@@ -73,4 +132,74 @@ cModel::~cModel()
 
 }
 
+size_t
+cModel::EnumerateDescendants( cElement* pElem, cChildVisitor& rVisitor )
+{
+    // the generic fallback: the children are already materialized, but the visitor still sees the bounds first.
+    // The models override this to skip materializing the rejected children
+    utl::cObList<cElement*> lstDesc = GetDescendantElements( pElem );
+    size_t nVisited = 0;
+    cChildBounds bndChild;
+    while( lstDesc.HasData() )
+    {
+        cElement* pelemChild = lstDesc.PullHead();
+        bndChild.m_ptCenter = pelemChild->GetCenter();
+        bndChild.m_sRadius = pelemChild->GetBoundingSphereRadius();
+        bndChild.m_sDescendantRadius = pelemChild->GetDescendantSphereRadius();
+        bndChild.m_nDepth = pelemChild->GetHierarchyDepth();
+        if( ! rVisitor.Accept( bndChild ))
+            continue;
+        rVisitor.Visit( pelemChild );
+        nVisited ++;
+    }
+    return nVisited;
+}
+
+void
+cModel::Anticipate( const cCameraState& )
+{
+    // the models that don't look ahead have nothing to do with the camera
+}
+
+elementkey
+cModel::GetElementKey( const cElement* ) const
+{
+    // without the keys the views can't keep the elements between the frames
+    return gnInvalidElementKey;
+}
+
+cElement*
+cModel::GetKeyElement( elementkey )
+{
+    return nullptr;
+}
+
+void
+cModel::BeginRead()
+{
+    // a model that isn't shared between threads needs no bracketing of its traversals
+}
+
+void
+cModel::EndRead()
+{
+}
+
+bool
+cModel::IsConcurrent() const
+{
+    return false;
+}
+
+bool
+cModel::AttachReader()
+{
+    return false;
+}
+
+void
+cModel::DetachReader()
+{
+}
+
 } // NS end
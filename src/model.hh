@@ -34,6 +34,9 @@ Our model exports a tree of elements, statring with the root element
 */
 namespace mvc
 {
+    typedef unsigned long long elementkey;            //!< identifies an element of the model tree across the frames
+    const elementkey gnInvalidElementKey = ~0ull;     //!< the element can't be found again by a key
+
     ////////////////////////////////////////////////////////////////////
     /// \brief The cElement class
     /// Represents the abstract model element
@@ -55,10 +58,67 @@ namespace mvc
         virtual ~cElement(); //!< It will be inherited with overloaded methods, so the virtual destructor
         // operations
         const geom::cMatrix3d& GetLocalCS() const; //!< Rerurns the local CS in model space
+                geom::cPoint3d GetCenter() const;  //!< Returns the local CS origin in model space, without a full matrix product
                         size_t GetHierarchyDepth() const; //!< Reeturns the level of hierarchy of the element in the model tree
 
         virtual geom::scalar GetBoundingSphereRadius() const = 0; //!< Retrieves the bounding sphere of the element
         virtual geom::scalar GetDescendantSphereRadius() const = 0; //!< Retrieves the bounding sphere of the element and all its descendants
+        virtual geom::scalar GetDescendantCapDistance() const;      //!< Retrieves how far below the center, along the local Z axis, the element and its descendants reach
+        virtual bool IsProxy() const;                               //!< Checks if the element only groups others; the views expand it but never draw it
+    };
+
+    ////////////////////////////////////////////////////////////////////
+    /// \brief The cChildBounds struct
+    /// The bounds of a child element, known to the model before the element itself is materialized
+    struct cChildBounds
+    {
+        geom::cPoint3d m_ptCenter;          //!< the child center in model space
+        geom::scalar   m_sRadius;           //!< the child bounding sphere radius
+        geom::scalar   m_sDescendantRadius; //!< the bounding sphere radius of the child and all its descendants
+        size_t         m_nDepth;            //!< the level of hierarchy of the child
+    };
+
+    ////////////////////////////////////////////////////////////////////
+    /// \brief The cChildVisitor class
+    /// Receives the children during cModel::EnumerateDescendants. Accept() sees only the child bounds,
+    /// and the model materializes the child and passes it to Visit() only if it was accepted
+    class cChildVisitor
+    {
+    public:
+        cChildVisitor();
+        virtual ~cChildVisitor();
+        virtual bool Accept( const cChildBounds& ) = 0; //!< Decides if the child is to be materialized
+        virtual void Visit( cElement* ) = 0;            //!< Receives the materialized child
+    };
+
+    ////////////////////////////////////////////////////////////////////
+    /// \brief The cChildCollector class
+    /// Accepts all children and adds them to a list; the models may implement GetDescendantElements with it
+    class cChildCollector : public cChildVisitor
+    {
+    protected:
+        utl::cObList<cElement*>& m_rlstChildren; //!< the list the children are added to
+    public:
+        cChildCollector( utl::cObList<cElement*>& );
+        virtual ~cChildCollector();
+        virtual bool Accept( const cChildBounds& );
+        virtual void Visit( cElement* );
+    };
+
+    ////////////////////////////////////////////////////////////////////
+    /// \brief The cCameraState struct
+    /// The camera the view is about to draw with, for the models that look ahead of the traversal
+    struct cCameraState
+    {
+        geom::cPoint3d  m_ptEye;    //!< the eye point
+        geom::cVector3d m_vecView;  //!< the unit view direction
+        geom::cVector3d m_vecUp;    //!< the up vector
+        geom::scalar    m_sFOV;     //!< the vertical field of view in radians
+        geom::scalar    m_sAspect;  //!< the width to height ratio
+        geom::scalar    m_sNear;    //!< the near clip plane distance
+        geom::scalar    m_sFar;     //!< the far clip plane distance
+        geom::scalar    m_sHeight;  //!< the viewport height in pixels
+        geom::scalar    m_sDetailPixels; //!< the projected radius in pixels the view drops the elements below
     };
 
     ////////////////////////////////////////////////////////////////////
@@ -78,6 +138,15 @@ namespace mvc
 // operations
         virtual cElement* GetRootElement() = 0; //!< Retrieves the root element ot the model
         virtual utl::cObList<cElement*> GetDescendantElements( cElement* ) = 0; //!< Retrieves the direct descendant elements
+        virtual size_t EnumerateDescendants( cElement*, cChildVisitor& ); //!< Passes the direct descendants to the visitor, returns the number materialized
+        virtual void Anticipate( const cCameraState& ); //!< Receives the camera before the traversal of each frame; ignored by default
+        virtual elementkey GetElementKey( const cElement* ) const; //!< Retrieves the key of an element; by default there are no keys
+        virtual cElement* GetKeyElement( elementkey );             //!< Materializes the element of a key again, valid until Collect(); nullptr if there is none
+        virtual void BeginRead();  //!< Enters a traversal in the calling thread; the elements handed out stay valid till EndRead(). Ignored by default
+        virtual void EndRead();    //!< Leaves the traversal of the calling thread; ignored by default
+        virtual bool IsConcurrent() const; //!< Checks if other threads may traverse the model along with the one it was made in; false by default
+        virtual bool AttachReader();       //!< Lets the calling thread traverse the model, false if it can't; see IsConcurrent()
+        virtual void DetachReader();       //!< Ends what AttachReader() started, outside a traversal
         // since we will generate a dynamic se of elemets lazy evaluating the model, we will have to clean up the temporary results after that
         virtual void Collect() = 0; //!< Collects the intermediate results produced by the model enymeration
     };
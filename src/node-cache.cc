@@ -0,0 +1,483 @@
+/*
+* MIT License
+* 
+* Copyright (c) 2020 ibaylov@gmail.com
+* 
+* Permission is hereby granted, free of charge, to any person obtaining a copy
+* of this software and associated documentation files (the "Software"), to deal
+* in the Software without restriction, including without limitation the rights
+* to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+* copies of the Software, and to permit persons to whom the Software is
+* furnished to do so, subject to the following conditions:
+* 
+* The above copyright notice and this permission notice shall be included in all
+* copies or substantial portions of the Software.
+* 
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+* AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+* OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+* SOFTWARE.
+*/
+#include "node-cache.hh"
+#include "assert.hh"
+#include <cmath>
+
+namespace mvc
+{
+
+////////////////////////////////////////////////////
+/// \brief gnNoGroup - the recency list terminator
+///
+const unsigned gnNoGroup = ~0u;
+
+////////////////////////////////////////////////////
+/// \brief gsWeightDecay - the per-frame decay of the visibility weight
+/// with 0.9 a group visited in every frame settles at weight 10, and loses half of it in ~7 frames out of view
+const float gsWeightDecay = 0.9f;
+
+////////////////////////////////////////////////////
+/// \brief gnEvictionSample - how many of the least recent groups the visibility weighted policy chooses from
+///
+const int gnEvictionSample = 16;
+
+////////////////////////////////////////////////////
+/// \brief gnEvictionScan - how many groups of the alive frames the eviction walks past before it gives up
+///
+const int gnEvictionScan = 64;
+
+////////////////////////////////////////////////////
+/// \brief Count - increments a performance counter
+/// the readers count without a lock: a concurrent increment may get lost, but the counter never tears
+inline void Count( size_t& rnCounter )
+{
+    __atomic_store_n( &rnCounter, __atomic_load_n( &rnCounter, __ATOMIC_RELAXED ) + 1, __ATOMIC_RELAXED );
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// cSphereNodeCache implementation
+
+cSphereNodeCache::cSphereNodeCache()
+    : m_policy( BreadthFirst ), m_nBudgetBytes( 0 ), m_nPrefillDepth( 0 ), m_nFrame( 0 ), m_nAliveFrames( 1 ), m_pEpoch( nullptr ), m_nRetiredGroups( 0 ), m_nFrameDemand( 0 ),
+      m_pnGroupParent( nullptr ), m_pnGroupFrame( nullptr ), m_pnLinkFrame( nullptr ), m_psGroupWeight( nullptr ),
+      m_pnLRUPrev( nullptr ), m_pnLRUNext( nullptr ), m_nLRUHead( gnNoGroup ), m_nLRUTail( gnNoGroup )
+{
+    pthread_mutex_init( &m_mutex, nullptr );
+    ResetStats();
+}
+
+cSphereNodeCache::~cSphereNodeCache()
+{
+    Release();
+    pthread_mutex_destroy( &m_mutex );
+}
+
+void
+cSphereNodeCache::Release()
+{
+    delete [] m_pnGroupParent;
+    delete [] m_pnGroupFrame;
+    delete [] m_pnLinkFrame;
+    delete [] m_psGroupWeight;
+    delete [] m_pnLRUPrev;
+    delete [] m_pnLRUNext;
+    m_pnGroupParent = nullptr;
+    m_pnGroupFrame = m_pnLinkFrame = nullptr;
+    m_psGroupWeight = nullptr;
+    m_pnLRUPrev = m_pnLRUNext = nullptr;
+    m_nLRUHead = m_nLRUTail = gnNoGroup;
+    m_storeNodes.Clear();
+    m_snapshot.Unmap();
+}
+
+void
+cSphereNodeCache::Setup( CachePolicy policy, size_t nBudgetBytes, size_t nPrefillDepth )
+{
+    Release();
+    m_policy = policy;
+    m_nBudgetBytes = nBudgetBytes;
+    m_nPrefillDepth = nPrefillDepth;
+    m_nFrame = 0;
+    m_nRetiredGroups = m_nFrameDemand = 0;
+    ResetStats();
+
+    // the root node is paid for by the first group, it isn't worth a separate account
+    size_t nGroups = nBudgetBytes / GetBytesPerGroup();
+    if( ! nGroups )
+        return;
+    m_storeNodes.Reserve( 1 + nGroups * gnSphereChildren );
+    m_pnGroupParent = new nodeindex[ nGroups ];
+    m_pnGroupFrame = new unsigned[ nGroups ];
+    m_pnLinkFrame = new unsigned[ nGroups ];
+    m_psGroupWeight = new float[ nGroups ];
+    m_pnLRUPrev = new unsigned[ nGroups ];
+    m_pnLRUNext = new unsigned[ nGroups ];
+}
+
+nodeindex
+cSphereNodeCache::Lookup( nodeindex nParent )
+{
+    nodeindex nFirst = nParent != gnInvalidNode ? m_storeNodes.GetFirstChild( nParent ) : 0;
+    if( nFirst )
+    {
+        Count( m_stats.m_nHits );
+        Touch( nFirst );
+    }
+    else
+        Count( m_stats.m_nMisses );
+    return nFirst;
+}
+
+nodeindex
+cSphereNodeCache::Insert( nodeindex nParent )
+{
+    _ASSERT( nParent != gnInvalidNode );
+    // another thread may have inserted the group since our lookup, or evicted the parent itself
+    if( m_storeNodes.GetFirstChild( nParent ) || IsRetired( nParent ))
+        return 0;
+    m_nFrameDemand ++;
+    if( ! m_storeNodes.HasFreeGroup() )
+    {
+        // a retired group comes back only once it is reclaimed, so the first insertions after an eviction may fail.
+        // The parent is safe from the eviction only as long as its frame stamp is, so we check it again
+        if( ! IsOnDemand() || ! Evict() || ! m_storeNodes.HasFreeGroup() || IsRetired( nParent ))
+        {
+            m_stats.m_nRejected ++;
+            return 0;
+        }
+    }
+    nodeindex nFirst = m_storeNodes.AllocateGroup();
+    _ASSERT( nFirst );
+    unsigned nGroup = static_cast<unsigned>( cSphereNodeStore::GetGroup( nFirst ));
+    unsigned nFrame = __atomic_load_n( &m_nFrame, __ATOMIC_RELAXED );
+    m_pnGroupParent[ nGroup ] = nParent;
+    __atomic_store_n( m_pnGroupFrame + nGroup, nFrame, __ATOMIC_RELAXED );
+    m_pnLinkFrame[ nGroup ] = nFrame;
+    float sWeight = 1.0f;
+    __atomic_store( m_psGroupWeight + nGroup, &sWeight, __ATOMIC_RELAXED );
+    LinkFront( nGroup );
+    m_stats.m_nInserted ++;
+    return nFirst;
+}
+
+void
+cSphereNodeCache::Publish( nodeindex nParent, nodeindex nFirst )
+{
+    // the readers of other threads see the group complete from the moment they see the link
+    m_storeNodes.SetFirstChild( nParent, nFirst );
+}
+
+void
+cSphereNodeCache::Touch( nodeindex nFirst )
+{
+    unsigned nGroup = static_cast<unsigned>( cSphereNodeStore::GetGroup( nFirst ));
+    unsigned nFrame = __atomic_load_n( &m_nFrame, __ATOMIC_RELAXED );
+    unsigned nVisited = __atomic_load_n( m_pnGroupFrame + nGroup, __ATOMIC_RELAXED );
+    // the weight counts frames, not visits, so only the thread that stamps the frame adds to it
+    if( nVisited != nFrame && __atomic_compare_exchange_n( m_pnGroupFrame + nGroup, &nVisited, nFrame, false, __ATOMIC_RELAXED, __ATOMIC_RELAXED ))
+    {
+        float sWeight;
+        __atomic_load( m_psGroupWeight + nGroup, &sWeight, __ATOMIC_RELAXED );
+        sWeight = sWeight * powf( gsWeightDecay, static_cast<float>( nFrame - nVisited )) + 1.0f;
+        __atomic_store( m_psGroupWeight + nGroup, &sWeight, __ATOMIC_RELAXED );
+    }
+}
+
+void
+cSphereNodeCache::NextFrame()
+{
+    // the groups evicted now are reclaimed by the time the next frame starts, unless a reader is still inside;
+    // the ending frame is still the current one, so its groups are safe. The demand varies from frame to frame,
+    // so we make room for twice the last one, but never for more than a quarter of the cache
+    Lock();
+    size_t nDemand = 2 * m_nFrameDemand;
+    if( nDemand > m_storeNodes.GetGroupCapacity() / 4 )
+        nDemand = m_storeNodes.GetGroupCapacity() / 4;
+    while( IsOnDemand() && GetFreeGroups() < nDemand && Evict() )
+        ;
+    m_nFrameDemand = 0;
+    Unlock();
+    __atomic_store_n( &m_nFrame, m_nFrame + 1, __ATOMIC_RELAXED );
+}
+
+bool
+cSphereNodeCache::TryLock()
+{
+    return pthread_mutex_trylock( &m_mutex ) == 0;
+}
+
+void
+cSphereNodeCache::Lock()
+{
+    pthread_mutex_lock( &m_mutex );
+}
+
+void
+cSphereNodeCache::Unlock()
+{
+    pthread_mutex_unlock( &m_mutex );
+}
+
+void
+cSphereNodeCache::SetEpochDomain( utl::cEpochDomain* pEpoch )
+{
+    m_pEpoch = pEpoch;
+}
+
+void
+cSphereNodeCache::SetAliveFrames( unsigned nFrames )
+{
+    _ASSERT( nFrames > 0 );
+    Lock();
+    m_nAliveFrames = nFrames;
+    Unlock();
+}
+
+void
+cSphereNodeCache::ResetStats()
+{
+    m_stats.m_nHits = 0;
+    m_stats.m_nMisses = 0;
+    m_stats.m_nInserted = 0;
+    m_stats.m_nEvicted = 0;
+    m_stats.m_nRejected = 0;
+}
+
+bool
+cSphereNodeCache::AttachSnapshot( const char* szPath, snapshotkey nKey )
+{
+    // the bookkeeping is sized by Setup(), so the snapshot must come from a cache of the same capacity
+    size_t nCapacity = m_storeNodes.GetCapacity();
+    if( ! nCapacity || m_storeNodes.GetSize() || ! m_snapshot.Map( szPath, nKey, nCapacity, IsOnDemand() ))
+        return false;
+    const cSnapshotHeader* pHeader = m_snapshot.GetHeader();
+    m_storeNodes.Attach( m_snapshot.GetBlock(), nCapacity, static_cast<size_t>( pHeader->m_nTop ), static_cast<size_t>( pHeader->m_nNodes ), 0 );
+
+    // the prefill allocated the groups in the order of their parents, so the n-th link met in index order must
+    // point to the n-th group. We check it on the way, since a damaged file must not send the traversal astray
+    nodeindex nTop = static_cast<nodeindex>( m_storeNodes.GetTop() );
+    unsigned nLinked = 0;
+    nodeindex nNode;
+    for( nNode = 0; nNode < nTop; nNode ++ )
+    {
+        nodeindex nFirst = m_storeNodes.GetFirstChild( nNode );
+        if( ! nFirst )
+            continue;
+        if( nFirst != 1 + nLinked * gnSphereChildren || nFirst + gnSphereChildren > nTop )
+            break;
+        unsigned nGroup = nLinked ++;
+        m_pnGroupParent[ nGroup ] = nNode;
+        m_pnGroupFrame[ nGroup ] = m_pnLinkFrame[ nGroup ] = m_nFrame;
+        m_psGroupWeight[ nGroup ] = 1.0f;
+        LinkFront( nGroup );
+    }
+    if( nNode < nTop || 1 + nLinked * gnSphereChildren != nTop )
+    {
+        m_nLRUHead = m_nLRUTail = gnNoGroup;
+        m_storeNodes.Reserve( nCapacity );
+        m_snapshot.Unmap();
+        return false;
+    }
+    return true;
+}
+
+bool
+cSphereNodeCache::WriteSnapshot( const char* szPath, snapshotkey nKey ) const
+{
+    return cNodeSnapshot::Write( szPath, nKey, m_storeNodes );
+}
+
+void
+cSphereNodeCache::LinkFront( unsigned nGroup )
+{
+    m_pnLRUPrev[ nGroup ] = gnNoGroup;
+    m_pnLRUNext[ nGroup ] = m_nLRUHead;
+    if( m_nLRUHead != gnNoGroup )
+        m_pnLRUPrev[ m_nLRUHead ] = nGroup;
+    else
+        m_nLRUTail = nGroup;
+    m_nLRUHead = nGroup;
+}
+
+void
+cSphereNodeCache::Unlink( unsigned nGroup )
+{
+    unsigned nPrev = m_pnLRUPrev[ nGroup ];
+    unsigned nNext = m_pnLRUNext[ nGroup ];
+    if( nPrev != gnNoGroup )
+        m_pnLRUNext[ nPrev ] = nNext;
+    else
+        m_nLRUHead = nNext;
+    if( nNext != gnNoGroup )
+        m_pnLRUPrev[ nNext ] = nPrev;
+    else
+        m_nLRUTail = nPrev;
+}
+
+float
+cSphereNodeCache::GetWeight( unsigned nGroup ) const
+{
+    float sWeight;
+    __atomic_load( m_psGroupWeight + nGroup, &sWeight, __ATOMIC_RELAXED );
+    unsigned nVisited = __atomic_load_n( m_pnGroupFrame + nGroup, __ATOMIC_RELAXED );
+    return sWeight * powf( gsWeightDecay, static_cast<float>( __atomic_load_n( &m_nFrame, __ATOMIC_RELAXED ) - nVisited ));
+}
+
+bool
+cSphereNodeCache::Evict()
+{
+    // the groups visited since they were linked get to the head first, the way Touch() would have placed them.
+    // Then the tail side is ordered by the visit frame, apart from the groups of the alive frames, which are walked
+    // past; with too many of them we give up
+    unsigned nFrame = __atomic_load_n( &m_nFrame, __ATOMIC_RELAXED );
+    unsigned nVictim = gnNoGroup;
+    float sVictim = 0.0f;
+    unsigned nGroup = m_nLRUTail;
+    int cSample = 0, cAlive = 0;
+    while( nGroup != gnNoGroup && cSample < gnEvictionSample && cAlive < gnEvictionScan )
+    {
+        unsigned nPrev = m_pnLRUPrev[ nGroup ];
+        unsigned nVisited = __atomic_load_n( m_pnGroupFrame + nGroup, __ATOMIC_RELAXED );
+        if( nVisited != m_pnLinkFrame[ nGroup ] )
+        {
+            Unlink( nGroup );
+            LinkFront( nGroup );
+            m_pnLinkFrame[ nGroup ] = nVisited;
+        }
+        else
+        if( nFrame - nVisited < m_nAliveFrames )
+            cAlive ++;
+        else
+        {
+            // the least recently used policy takes the first one, the visibility weighted one chooses from a sample
+            float sWeight = m_policy == VisibilityWeighted ? GetWeight( nGroup ) : 0.0f;
+            if( nVictim == gnNoGroup || sWeight < sVictim )
+            {
+                sVictim = sWeight;
+                nVictim = nGroup;
+            }
+            cSample = m_policy == VisibilityWeighted ? cSample + 1 : gnEvictionSample;
+        }
+        nGroup = nPrev;
+    }
+    if( nVictim == gnNoGroup )
+        return false;
+    EvictSubtree( nVictim );
+    return true;
+}
+
+void
+cSphereNodeCache::EvictSubtree( unsigned nGroup )
+{
+    nodeindex nFirst = static_cast<nodeindex>( 1 + nGroup * gnSphereChildren );
+    size_t cChd;
+    for( cChd = 0; cChd < gnSphereChildren; cChd ++ )
+    {
+        nodeindex nGrandChild = m_storeNodes.GetFirstChild( nFirst + cChd );
+        if( nGrandChild )
+            EvictSubtree( static_cast<unsigned>( cSphereNodeStore::GetGroup( nGrandChild )));
+    }
+    // the readers that have the link already may still read the group, so it is only retired here
+    m_storeNodes.SetFirstChild( m_pnGroupParent[ nGroup ], 0 );
+    m_pnGroupParent[ nGroup ] = gnInvalidNode;
+    Unlink( nGroup );
+    if( m_pEpoch )
+    {
+        m_pEpoch->Retire( ReclaimGroup, this, nGroup );
+        m_nRetiredGroups ++;
+    }
+    else
+        m_storeNodes.FreeGroup( nFirst );
+    m_stats.m_nEvicted ++;
+}
+
+bool
+cSphereNodeCache::IsRetired( nodeindex nNode ) const
+{
+    // the root belongs to no group
+    return nNode && m_pnGroupParent[ ( nNode - 1 ) / gnSphereChildren ] == gnInvalidNode;
+}
+
+size_t
+cSphereNodeCache::GetFreeGroups() const
+{
+    // the root node is the only one outside the groups
+    size_t nSize = m_storeNodes.GetSize();
+    size_t nUsed = nSize ? ( nSize - 1 ) / gnSphereChildren : 0;
+    return m_storeNodes.GetGroupCapacity() - nUsed + m_nRetiredGroups;
+}
+
+void
+cSphereNodeCache::ReclaimGroup( void* pCache, size_t nGroup )
+{
+    cSphereNodeCache* pThis = static_cast<cSphereNodeCache*>( pCache );
+    pThis->Lock();
+    pThis->m_storeNodes.FreeGroup( static_cast<nodeindex>( 1 + nGroup * gnSphereChildren ));
+    pThis->m_nRetiredGroups --;
+    pThis->Unlock();
+}
+
+CachePolicy
+cSphereNodeCache::GetPolicy() const
+{
+    return m_policy;
+}
+
+size_t
+cSphereNodeCache::GetBudgetBytes() const
+{
+    return m_nBudgetBytes;
+}
+
+size_t
+cSphereNodeCache::GetPrefillDepth() const
+{
+    return m_nPrefillDepth;
+}
+
+unsigned
+cSphereNodeCache::GetFrame() const
+{
+    return __atomic_load_n( &m_nFrame, __ATOMIC_RELAXED );
+}
+
+bool
+cSphereNodeCache::IsOnDemand() const
+{
+    return m_policy != BreadthFirst;
+}
+
+bool
+cSphereNodeCache::IsMapped() const
+{
+    return m_snapshot.IsMapped();
+}
+
+const cCacheStats&
+cSphereNodeCache::GetStats() const
+{
+    return m_stats;
+}
+
+cSphereNodeStore&
+cSphereNodeCache::GetStore()
+{
+    return m_storeNodes;
+}
+
+const cSphereNodeStore&
+cSphereNodeCache::GetStore() const
+{
+    return m_storeNodes;
+}
+
+size_t
+cSphereNodeCache::GetBytesPerGroup()
+{
+    return gnSphereChildren * cSphereNodeStore::GetBytesPerNode()
+         + sizeof( nodeindex ) + 3 * sizeof( unsigned ) + sizeof( float ) + 2 * sizeof( unsigned );
+}
+
+} // NS end
@@ -0,0 +1,149 @@
+/*
+* MIT License
+* 
+* Copyright (c) 2020 ibaylov@gmail.com
+* 
+* Permission is hereby granted, free of charge, to any person obtaining a copy
+* of this software and associated documentation files (the "Software"), to deal
+* in the Software without restriction, including without limitation the rights
+* to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+* copies of the Software, and to permit persons to whom the Software is
+* furnished to do so, subject to the following conditions:
+* 
+* The above copyright notice and this permission notice shall be included in all
+* copies or substantial portions of the Software.
+* 
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+* AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+* OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+* SOFTWARE.
+*/
+#ifndef _MVC_NODE_CACHE_
+#define _MVC_NODE_CACHE_
+#include "node-store.hh"
+#include "node-snapshot.hh"
+#include "epoch.hh"
+
+/**
+@file  node-cache.hh
+@brief The descendant cache of the fractal model, with replacement policies and a memory budget
+The cache keeps the sibling groups in a cSphereNodeStore sized from a budget in bytes. Its content is decided by the policy:
+a static breadth-first prefill, or an on-demand cache that follows the camera and evicts either the least recently
+visited groups or the ones with the weakest visibility history.
+A frame is the period between two NextFrame() calls. The groups visited in the current frame are never evicted, since
+the elements materialized from them are still alive. Visiting a group implies visiting its ancestors in the same frame,
+so an ancestor is always at least as recent and as visible as its descendants, and evicting a group together with its
+subtree never drops anything more valuable than the group itself.
+Instead of being prefilled the cache can attach a snapshot of an earlier prefill; the bookkeeping is then rebuilt
+from the child links, which takes a single pass over the mapped arrays.
+Several threads may traverse the cache at once. The lookups take no lock: a visit only stamps the group frame, and
+the recency list is brought up to date by Evict(), which moves the groups visited since they were linked to the head
+before it picks a victim; the order is therefore exact to the frame, not to the visit. The insertions and evictions
+are made by a single writer at a time, under TryLock() or Lock(). An evicted group is unlinked at once but freed only
+when the readers that could have reached it are gone, see utl::cEpochDomain, so it is of no use in the frame that
+evicts it. NextFrame() therefore evicts ahead as many groups as the ending frame wanted to insert.
+A reader may still be inside when the frame advances, and its later visits no longer refresh the ancestors it has
+passed already; SetAliveFrames() keeps the groups of the frames such readers started in.
+*/
+
+namespace mvc
+{
+    ////////////////////////////////////////////////////////////////////
+    /// \brief The CachePolicy enum - the descendant cache replacement policies
+    ///
+    enum CachePolicy
+    {
+        BreadthFirst       = 0, //!< the tree is prefilled level by level up to the budget and never changes
+        LeastRecentlyUsed  = 1, //!< the groups are added on demand, the least recently visited are evicted
+        VisibilityWeighted = 2, //!< the groups are added on demand, the ones visited least often lately are evicted
+        CachePolicies      = 3  //!< the number of policies
+    };
+
+    ////////////////////////////////////////////////////////////////////
+    /// \brief The cCacheStats struct - the cache performance counters
+    ///
+    struct cCacheStats
+    {
+        size_t m_nHits;      //!< expansions served from the cache
+        size_t m_nMisses;    //!< expansions that had to generate the children
+        size_t m_nInserted;  //!< groups added on demand
+        size_t m_nEvicted;   //!< groups evicted, including the evicted subtrees
+        size_t m_nRejected;  //!< insertions declined because everything cached was visited in the current frame or the evicted groups aren't reclaimed yet
+    };
+
+    ////////////////////////////////////////////////////////////////////
+    /// \brief The cSphereNodeCache class
+    /// Manages the node store content according to the replacement policy
+    class cSphereNodeCache
+    {
+    protected:
+        cSphereNodeStore m_storeNodes;      //!< the cached nodes
+        cNodeSnapshot    m_snapshot;        //!< the snapshot the store is attached to, if any
+        CachePolicy      m_policy;          //!< the replacement policy
+        size_t           m_nBudgetBytes;    //!< the memory budget
+        size_t           m_nPrefillDepth;   //!< the depth the tree is prefilled to
+        unsigned         m_nFrame;          //!< the current frame number
+        unsigned         m_nAliveFrames;    //!< the groups visited this many frames back, the current one included, are never evicted
+        cCacheStats      m_stats;           //!< the performance counters, approximate if several threads count at once
+        utl::cEpochDomain* m_pEpoch;        //!< the domain the evicted groups are retired to, nullptr to free them at once
+        size_t           m_nRetiredGroups;  //!< the groups retired and not reclaimed yet
+        size_t           m_nFrameDemand;    //!< the groups the current frame wanted to insert
+        pthread_mutex_t  m_mutex;           //!< the writer lock, see TryLock()
+        // per group bookkeeping
+        nodeindex*       m_pnGroupParent;   //!< the node the group descends from
+        unsigned*        m_pnGroupFrame;    //!< the frame the group was last visited in
+        unsigned*        m_pnLinkFrame;     //!< the visit frame the group had when it was placed at the recency list head
+        float*           m_psGroupWeight;   //!< the decayed count of frames the group was visited in
+        unsigned*        m_pnLRUPrev;       //!< the more recently visited neighbour in the recency list
+        unsigned*        m_pnLRUNext;       //!< the less recently visited neighbour in the recency list
+        unsigned         m_nLRUHead;        //!< the most recently visited group
+        unsigned         m_nLRUTail;        //!< the least recently visited group
+    public:
+        cSphereNodeCache();     //!< Constructs an empty cache
+        ~cSphereNodeCache();    //!< Releases the bookkeeping arrays; no group may be waiting in the epoch domain
+        #ifndef _NO_CXX_11_
+        cSphereNodeCache( const cSphereNodeCache& ) = delete; //!< Prevent direct copy
+        #endif
+        // operations
+        void      Setup( CachePolicy policy, size_t nBudgetBytes, size_t nPrefillDepth ); //!< Drops the content and sizes the cache from the budget
+        nodeindex Lookup( nodeindex nParent );   //!< Retrieves the children group of a node, touching it; 0 on miss
+        nodeindex Insert( nodeindex nParent );   //!< Allocates the children group for a store leaf, evicting if the policy allows; 0 if declined. Locked
+        void      Publish( nodeindex nParent, nodeindex nFirst ); //!< Links the inserted group to its parent once it is filled. Locked
+        void      Touch( nodeindex nFirst );     //!< Marks the group as visited in the current frame
+        void      NextFrame();                   //!< Advances the frame counter, evicting ahead the room the frame needed. Takes the lock
+        bool      TryLock();                     //!< Takes the writer lock if it is free; never waits
+        void      Lock();                        //!< Takes the writer lock
+        void      Unlock();                      //!< Releases the writer lock
+        void      SetEpochDomain( utl::cEpochDomain* pEpoch ); //!< Defers freeing the evicted groups to the domain, nullptr frees them at once
+        void      SetAliveFrames( unsigned nFrames ); //!< Keeps the groups visited in the last nFrames frames, 1 for the current only
+        void      ResetStats();                  //!< Zeroes the performance counters
+        bool      AttachSnapshot( const char* szPath, snapshotkey nKey );      //!< Maps a snapshot into the empty cache instead of the prefill, false if it doesn't match
+        bool      WriteSnapshot( const char* szPath, snapshotkey nKey ) const; //!< Saves the cache content, to be called right after the prefill
+        // accessors
+        CachePolicy        GetPolicy() const;        //!< Retrieves the replacement policy
+        size_t             GetBudgetBytes() const;   //!< Retrieves the memory budget
+        size_t             GetPrefillDepth() const;  //!< Retrieves the prefill depth
+        unsigned           GetFrame() const;         //!< Retrieves the current frame number
+        bool               IsOnDemand() const;       //!< Checks if the policy adds groups while traversing
+        bool               IsMapped() const;         //!< Checks if the content comes from a mapped snapshot
+        const cCacheStats& GetStats() const;         //!< Retrieves the performance counters
+        cSphereNodeStore&  GetStore();               //!< Retrieves the node store for filling the inserted groups
+        const cSphereNodeStore& GetStore() const;    //!< Retrieves the node store
+        static size_t      GetBytesPerGroup();       //!< Retrieves the memory a cached group costs, bookkeeping included
+    protected:
+        void      Release();                     //!< Releases the bookkeeping arrays
+        void      LinkFront( unsigned nGroup );  //!< Places the group at the recency list head
+        void      Unlink( unsigned nGroup );     //!< Removes the group from the recency list
+        float     GetWeight( unsigned nGroup ) const; //!< Retrieves the group visibility weight decayed to the current frame
+        bool      Evict();                       //!< Evicts a group with its subtree according to the policy
+        void      EvictSubtree( unsigned nGroup ); //!< Unlinks the group and all groups below it and frees or retires them
+        bool      IsRetired( nodeindex nNode ) const; //!< Checks if the node belongs to an evicted group
+        size_t    GetFreeGroups() const;         //!< Retrieves the number of groups free or waiting for reclamation
+        static void ReclaimGroup( void* pCache, size_t nGroup ); //!< Frees a retired group, the epoch domain callback
+    };
+}
+
+#endif
@@ -0,0 +1,183 @@
+/*
+* MIT License
+* 
+* Copyright (c) 2020 ibaylov@gmail.com
+* 
+* Permission is hereby granted, free of charge, to any person obtaining a copy
+* of this software and associated documentation files (the "Software"), to deal
+* in the Software without restriction, including without limitation the rights
+* to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+* copies of the Software, and to permit persons to whom the Software is
+* furnished to do so, subject to the following conditions:
+* 
+* The above copyright notice and this permission notice shall be included in all
+* copies or substantial portions of the Software.
+* 
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+* AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+* OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+* SOFTWARE.
+*/
+#include "node-snapshot.hh"
+#include "assert.hh"
+#include <cstring>
+#include <cstdio>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+namespace mvc
+{
+
+////////////////////////////////////////////////////
+/// \brief gszSnapshotMagic - the snapshot file signature
+///
+const char gszSnapshotMagic[ 8 ] = { 'F', 'S', 'P', 'H', 'S', 'N', 'A', 'P' };
+
+////////////////////////////////////////////////////
+/// \brief gnByteOrderProbe - reads back differently on a machine with another byte order
+///
+const unsigned gnByteOrderProbe = 0x01020304;
+
+////////////////////////////////////////////////////
+/// \brief gnSnapshotBlockOffset - the block is placed at the first page boundary after the header
+///
+const size_t gnSnapshotBlockOffset = 4096;
+
+///////////////////////////////////////////////////////////////////////////////
+// cNodeSnapshot implementation
+
+cNodeSnapshot::cNodeSnapshot()
+    : m_pMapping( nullptr ), m_nMappedBytes( 0 ), m_pHeader( nullptr )
+{
+}
+
+cNodeSnapshot::~cNodeSnapshot()
+{
+    Unmap();
+}
+
+bool
+cNodeSnapshot::Map( const char* szPath, snapshotkey nKey, size_t nCapacity, bool bWritable )
+{
+    Unmap();
+    int hFile = open( szPath, O_RDONLY );
+    if( hFile < 0 )
+        return false;
+    struct stat statFile;
+    if( fstat( hFile, &statFile ) != 0 || static_cast<size_t>( statFile.st_size ) < sizeof( cSnapshotHeader ))
+    {
+        close( hFile );
+        return false;
+    }
+    // a private mapping keeps the pages shared with the other processes until written; the static cache never
+    // writes, so it gets a read-only mapping, and the on-demand caches copy on write the few pages they change
+    size_t nBytes = static_cast<size_t>( statFile.st_size );
+    void* pMapping = mmap( nullptr, nBytes, bWritable ? PROT_READ | PROT_WRITE : PROT_READ, MAP_PRIVATE, hFile, 0 );
+    close( hFile ); // the mapping holds its own reference to the file
+    if( pMapping == MAP_FAILED )
+        return false;
+    m_pMapping = pMapping;
+    m_nMappedBytes = nBytes;
+    m_pHeader = static_cast<const cSnapshotHeader*>( pMapping );
+
+    const cSnapshotHeader& rHeader = *m_pHeader;
+    if( memcmp( rHeader.m_szMagic, gszSnapshotMagic, sizeof( gszSnapshotMagic )) != 0
+        || rHeader.m_nVersion != gnSnapshotVersion
+        || rHeader.m_nByteOrder != gnByteOrderProbe
+        || rHeader.m_nScalarBytes != sizeof( geom::scalar )
+        || rHeader.m_nNodeBytes != cSphereNodeStore::GetBytesPerNode()
+        || rHeader.m_nKey != nKey
+        || rHeader.m_nCapacity != nCapacity
+        || rHeader.m_nTop > rHeader.m_nCapacity || rHeader.m_nNodes != rHeader.m_nTop
+        || rHeader.m_nBlockOffset != gnSnapshotBlockOffset
+        || rHeader.m_nBlockBytes != cSphereNodeStore::GetBlockLayout( nCapacity, nullptr )
+        || rHeader.m_nBlockOffset + rHeader.m_nBlockBytes > nBytes )
+    {
+        Unmap();
+        return false;
+    }
+    return true;
+}
+
+void
+cNodeSnapshot::Unmap()
+{
+    if( m_pMapping )
+        munmap( m_pMapping, m_nMappedBytes );
+    m_pMapping = nullptr;
+    m_nMappedBytes = 0;
+    m_pHeader = nullptr;
+}
+
+bool
+cNodeSnapshot::Write( const char* szPath, snapshotkey nKey, const cSphereNodeStore& rStore )
+{
+    // the cache bookkeeping is rebuilt from the child links on load, which a free groups list would break
+    if( ! rStore.GetCapacity() || rStore.GetFreeGroups() || rStore.GetSize() != rStore.GetTop() )
+        return false;
+
+    cSnapshotHeader header;
+    memset( &header, 0, sizeof( header ));
+    memcpy( header.m_szMagic, gszSnapshotMagic, sizeof( gszSnapshotMagic ));
+    header.m_nVersion = gnSnapshotVersion;
+    header.m_nByteOrder = gnByteOrderProbe;
+    header.m_nScalarBytes = sizeof( geom::scalar );
+    header.m_nNodeBytes = static_cast<unsigned>( cSphereNodeStore::GetBytesPerNode());
+    header.m_nKey = nKey;
+    header.m_nCapacity = rStore.GetCapacity();
+    header.m_nTop = rStore.GetTop();
+    header.m_nNodes = rStore.GetSize();
+    header.m_nBlockOffset = gnSnapshotBlockOffset;
+    size_t arrnOffsets[ cSphereNodeStore::StoreArrays ];
+    header.m_nBlockBytes = cSphereNodeStore::GetBlockLayout( rStore.GetCapacity(), arrnOffsets );
+
+    // we write to a temporary file and rename it, so a process starting meanwhile never maps a partial snapshot
+    char szTemp[ 4096 ];
+    if( snprintf( szTemp, sizeof( szTemp ), "%s.%ld.tmp", szPath, static_cast<long>( getpid())) >= static_cast<int>( sizeof( szTemp )))
+        return false;
+    int hFile = open( szTemp, O_WRONLY | O_CREAT | O_TRUNC, 0644 );
+    if( hFile < 0 )
+        return false;
+
+    bool bOK = pwrite( hFile, &header, sizeof( header ), 0 ) == static_cast<ssize_t>( sizeof( header ));
+    // only the used part of each array is written, the rest stays a hole
+    const char* pBlock = static_cast<const char*>( rStore.GetBlock());
+    int cArray;
+    for( cArray = 0; bOK && cArray < cSphereNodeStore::StoreArrays; cArray ++ )
+    {
+        size_t nBytes = rStore.GetTop() * cSphereNodeStore::GetElementBytes( static_cast<cSphereNodeStore::StoreArray>( cArray ));
+        bOK = pwrite( hFile, pBlock + arrnOffsets[ cArray ], nBytes, gnSnapshotBlockOffset + arrnOffsets[ cArray ] ) == static_cast<ssize_t>( nBytes );
+    }
+    bOK = bOK && ftruncate( hFile, gnSnapshotBlockOffset + header.m_nBlockBytes ) == 0;
+    bOK = ( close( hFile ) == 0 ) && bOK;
+    bOK = bOK && rename( szTemp, szPath ) == 0;
+    if( ! bOK )
+        unlink( szTemp );
+    return bOK;
+}
+
+bool
+cNodeSnapshot::IsMapped() const
+{
+    return m_pMapping != nullptr;
+}
+
+void*
+cNodeSnapshot::GetBlock() const
+{
+    _ASSERT( m_pMapping );
+    return static_cast<char*>( m_pMapping ) + m_pHeader->m_nBlockOffset;
+}
+
+const cSnapshotHeader*
+cNodeSnapshot::GetHeader() const
+{
+    return m_pHeader;
+}
+
+} // NS end
@@ -0,0 +1,113 @@
+/*
+* MIT License
+* 
+* Copyright (c) 2020 ibaylov@gmail.com
+* 
+* Permission is hereby granted, free of charge, to any person obtaining a copy
+* of this software and associated documentation files (the "Software"), to deal
+* in the Software without restriction, including without limitation the rights
+* to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+* copies of the Software, and to permit persons to whom the Software is
+* furnished to do so, subject to the following conditions:
+* 
+* The above copyright notice and this permission notice shall be included in all
+* copies or substantial portions of the Software.
+* 
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+* AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+* OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+* SOFTWARE.
+*/
+#ifndef _MVC_NODE_SNAPSHOT_
+#define _MVC_NODE_SNAPSHOT_
+#include "node-store.hh"
+
+/**
+@file  node-snapshot.hh
+@brief The on-disk snapshot of the node store for a warm start
+The snapshot is a fixed header followed by the store block exactly as it is laid out in memory, so loading it is a
+single read-only mmap: no parsing, no allocation, and the processes mapping the same file share the page cache.
+The header holds offsets only, never pointers, and is validated by the format version, the binary layout and the
+key of the model that wrote it; a snapshot that doesn't match is simply ignored and the tree is generated anew.
+The unused tail of the arrays is not written, so the file is sparse.
+*/
+
+namespace mvc
+{
+    ////////////////////////////////////////////////////////////////////
+    /// \brief snapshotkey - the signature of the model content a snapshot was taken from
+    ///
+    typedef unsigned long long snapshotkey;
+
+    ////////////////////////////////////////////////////////////////////
+    /// \brief gnSnapshotVersion - bump this with every change of the header or the store layout
+    ///
+    const unsigned gnSnapshotVersion = 1;
+
+    ////////////////////////////////////////////////////////////////////
+    /// \brief The cSnapshotHeader struct - the snapshot file header
+    /// The fields are fixed-size and 8-byte aligned, so the struct has the same layout on all our targets
+    struct cSnapshotHeader
+    {
+        char               m_szMagic[ 8 ];     //!< "FSPHSNAP"
+        unsigned           m_nVersion;         //!< gnSnapshotVersion
+        unsigned           m_nByteOrder;       //!< a probe value, catching files from a different byte order
+        unsigned           m_nScalarBytes;     //!< sizeof( geom::scalar ), the _GEOM_FLOAT_ builds can't share snapshots
+        unsigned           m_nNodeBytes;       //!< cSphereNodeStore::GetBytesPerNode(), catches layout changes
+        snapshotkey        m_nKey;             //!< the model signature
+        unsigned long long m_nCapacity;        //!< the store capacity in nodes
+        unsigned long long m_nTop;             //!< the used part of the arrays
+        unsigned long long m_nNodes;           //!< the nodes in use
+        unsigned long long m_nBlockOffset;     //!< the block offset from the file start
+        unsigned long long m_nBlockBytes;      //!< the block size
+    };
+
+    ////////////////////////////////////////////////////////////////////
+    /// \brief The cNodeSnapshot class
+    /// Writes the node store snapshots and maps them back
+    class cNodeSnapshot
+    {
+    protected:
+        void*                   m_pMapping;     //!< the mapped file, nullptr if none
+        size_t                  m_nMappedBytes; //!< the mapping size
+        const cSnapshotHeader*  m_pHeader;      //!< the header in the mapping
+    public:
+        cNodeSnapshot();    //!< Constructs an unmapped snapshot
+        ~cNodeSnapshot();   //!< Unmaps the file
+        #ifndef _NO_CXX_11_
+        cNodeSnapshot( const cNodeSnapshot& ) = delete; //!< Prevent direct copy
+        #endif
+        // operations
+        bool  Map( const char* szPath, snapshotkey nKey, size_t nCapacity, bool bWritable ); //!< Maps and validates the file, false if it doesn't match
+        void  Unmap();                                                 //!< Unmaps the file; the store must be detached before
+        static bool Write( const char* szPath, snapshotkey nKey, const cSphereNodeStore& rStore ); //!< Writes the store, replacing the file atomically
+        static snapshotkey Hash( const void* pData, size_t nBytes, snapshotkey nSeed ); //!< Accumulates the data into a key
+        // accessors
+        bool  IsMapped() const;         //!< Checks if a snapshot is mapped
+        void* GetBlock() const;         //!< Retrieves the mapped store block
+        const cSnapshotHeader* GetHeader() const; //!< Retrieves the mapped header
+    };
+
+    //////////////////////////////////////////////////
+    // cNodeSnapshot inline implementation, so that the keys can be computed without the snapshot code
+
+    inline snapshotkey
+    cNodeSnapshot::Hash( const void* pData, size_t nBytes, snapshotkey nSeed )
+    {
+        // FNV-1a, we need change detection, not cryptography
+        const unsigned char* pByte = static_cast<const unsigned char*>( pData );
+        snapshotkey nHash = nSeed ? nSeed : 14695981039346656037ull;
+        size_t cByte;
+        for( cByte = 0; cByte < nBytes; cByte ++ )
+        {
+            nHash ^= pByte[ cByte ];
+            nHash *= 1099511628211ull;
+        }
+        return nHash;
+    }
+}
+
+#endif
@@ -0,0 +1,348 @@
+/*
+* MIT License
+* 
+* Copyright (c) 2020 ibaylov@gmail.com
+* 
+* Permission is hereby granted, free of charge, to any person obtaining a copy
+* of this software and associated documentation files (the "Software"), to deal
+* in the Software without restriction, including without limitation the rights
+* to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+* copies of the Software, and to permit persons to whom the Software is
+* furnished to do so, subject to the following conditions:
+* 
+* The above copyright notice and this permission notice shall be included in all
+* copies or substantial portions of the Software.
+* 
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+* AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+* OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+* SOFTWARE.
+*/
+#include "node-store.hh"
+#include "geom-decorator.hh"
+#include "assert.hh"
+#include <cmath>
+#include <cstring>
+
+namespace mvc
+{
+
+///////////////////////////////////////////////////////////////////////////////
+// cSphereNodeStore implementation
+
+////////////////////////////////////////////////////
+/// \brief gsQuatScale - the quaternion components quantization scale
+///
+const geom::scalar gsQuatScale = static_cast<geom::scalar>( 32767.0 );
+
+////////////////////////////////////////////////////
+/// \brief gnArrayAlign - the alignment of the arrays in the block, a cache line
+///
+const size_t gnArrayAlign = 64;
+
+cSphereNodeStore::cSphereNodeStore()
+    : m_psCenterX( nullptr ), m_psCenterY( nullptr ), m_psCenterZ( nullptr ),
+      m_pnOrientation( nullptr ), m_pnFirstChild( nullptr ), m_pnDepth( nullptr ),
+      m_pBlock( nullptr ), m_bOwned( false ), m_nNodes( 0 ), m_nTop( 0 ), m_nCapacity( 0 ), m_nFreeGroups( 0 )
+{
+    SetRadiusTable( static_cast<geom::scalar>( 1.0 ), static_cast<geom::scalar>( 1.0 ));
+}
+
+cSphereNodeStore::~cSphereNodeStore()
+{
+    Clear();
+}
+
+void
+cSphereNodeStore::Clear()
+{
+    if( m_bOwned )
+        delete [] m_pBlock;
+    m_pBlock = nullptr;
+    m_bOwned = false;
+    m_psCenterX = m_psCenterY = m_psCenterZ = nullptr;
+    m_pnOrientation = nullptr;
+    m_pnFirstChild = nullptr;
+    m_pnDepth = nullptr;
+    m_nNodes = m_nTop = m_nCapacity = 0;
+    m_nFreeGroups = 0;
+}
+
+void
+cSphereNodeStore::Reserve( size_t nCapacity )
+{
+    Clear();
+    if( ! nCapacity )
+        return;
+    Bind( new char[ GetBlockLayout( nCapacity, nullptr ) ], nCapacity );
+    m_bOwned = true;
+}
+
+void
+cSphereNodeStore::Attach( void* pBlock, size_t nCapacity, size_t nTop, size_t nNodes, nodeindex nFreeGroups )
+{
+    _ASSERT( pBlock && nTop <= nCapacity && nNodes <= nTop && nFreeGroups < nTop );
+    Clear();
+    Bind( static_cast<char*>( pBlock ), nCapacity );
+    m_nTop = nTop;
+    m_nNodes = nNodes;
+    m_nFreeGroups = nFreeGroups;
+}
+
+void
+cSphereNodeStore::Bind( char* pBlock, size_t nCapacity )
+{
+    size_t arrnOffsets[ StoreArrays ];
+    GetBlockLayout( nCapacity, arrnOffsets );
+    m_pBlock = pBlock;
+    m_psCenterX = reinterpret_cast<geom::scalar*>( pBlock + arrnOffsets[ CenterX ] );
+    m_psCenterY = reinterpret_cast<geom::scalar*>( pBlock + arrnOffsets[ CenterY ] );
+    m_psCenterZ = reinterpret_cast<geom::scalar*>( pBlock + arrnOffsets[ CenterZ ] );
+    m_pnOrientation = reinterpret_cast<short*>( pBlock + arrnOffsets[ Orientation ] );
+    m_pnFirstChild = reinterpret_cast<nodeindex*>( pBlock + arrnOffsets[ FirstChild ] );
+    m_pnDepth = reinterpret_cast<unsigned char*>( pBlock + arrnOffsets[ Depth ] );
+    m_nCapacity = nCapacity;
+}
+
+size_t
+cSphereNodeStore::GetElementBytes( StoreArray nArray )
+{
+    switch( nArray )
+    {
+        case CenterX:
+        case CenterY:
+        case CenterZ:
+            return sizeof( geom::scalar );
+        case Orientation:
+            return 4 * sizeof( short );
+        case FirstChild:
+            return sizeof( nodeindex );
+        case Depth:
+            return sizeof( unsigned char );
+        default:
+            _ASSERT( false );
+    }
+    return 0;
+}
+
+size_t
+cSphereNodeStore::GetBlockLayout( size_t nCapacity, size_t* parrnOffsets )
+{
+    size_t nOffset = 0;
+    int cArray;
+    for( cArray = 0; cArray < StoreArrays; cArray ++ )
+    {
+        if( parrnOffsets )
+            parrnOffsets[ cArray ] = nOffset;
+        nOffset += nCapacity * GetElementBytes( static_cast<StoreArray>( cArray ));
+        nOffset = ( nOffset + gnArrayAlign - 1 ) & ~( gnArrayAlign - 1 );
+    }
+    return nOffset;
+}
+
+void
+cSphereNodeStore::SetRadiusTable( geom::scalar sRootR, geom::scalar sRatio )
+{
+    size_t cDepth;
+    for( cDepth = 0; cDepth < gnStoreMaxDepth; cDepth ++ )
+    {
+        m_arrsRadius[ cDepth ] = sRootR;
+        sRootR *= sRatio;
+    }
+}
+
+nodeindex
+cSphereNodeStore::AddRoot( const geom::cMatrix3d& matCS )
+{
+    _ASSERT( m_nTop == 0 && m_nCapacity > 0 );
+    m_nTop = m_nNodes = 1;
+    SetNode( 0, matCS, 0 );
+    return 0;
+}
+
+nodeindex
+cSphereNodeStore::AllocateGroup()
+{
+    nodeindex nFirst = m_nFreeGroups;
+    if( nFirst ) // reuse a freed group first
+        m_nFreeGroups = m_pnFirstChild[ nFirst ];
+    else
+    if( m_nTop && m_nTop + gnSphereChildren <= m_nCapacity )
+    {
+        nFirst = static_cast<nodeindex>( m_nTop );
+        m_nTop += gnSphereChildren;
+    }
+    else
+        return 0;
+    __atomic_store_n( &m_nNodes, m_nNodes + gnSphereChildren, __ATOMIC_RELAXED ); // the readers only ever check it for the root
+    return nFirst;
+}
+
+void
+cSphereNodeStore::FreeGroup( nodeindex nFirst )
+{
+    _ASSERT( nFirst > 0 && nFirst < m_nTop && GetGroup( nFirst ) * gnSphereChildren + 1 == nFirst );
+    m_pnFirstChild[ nFirst ] = m_nFreeGroups;
+    m_nFreeGroups = nFirst;
+    __atomic_store_n( &m_nNodes, m_nNodes - gnSphereChildren, __ATOMIC_RELAXED );
+}
+
+void
+cSphereNodeStore::SetNode( nodeindex nNode, const geom::cMatrix3d& matCS, size_t nDepth )
+{
+    _ASSERT( nNode < m_nTop );
+    _ASSERT( nDepth < gnStoreMaxDepth );
+
+    m_psCenterX[ nNode ] = matCS[ geom::X ][ geom::W ];
+    m_psCenterY[ nNode ] = matCS[ geom::Y ][ geom::W ];
+    m_psCenterZ[ nNode ] = matCS[ geom::Z ][ geom::W ];
+
+    QuantizeOrientation( matCS, m_pnOrientation + nNode * 4 );
+
+    m_pnFirstChild[ nNode ] = 0;
+    m_pnDepth[ nNode ] = static_cast<unsigned char>( nDepth );
+}
+
+void
+cSphereNodeStore::SetNode( nodeindex nNode, const geom::scalar* psCenter, const short* pnQuat, size_t nDepth )
+{
+    _ASSERT( nNode < m_nTop );
+    _ASSERT( nDepth < gnStoreMaxDepth );
+
+    m_psCenterX[ nNode ] = psCenter[ geom::X ];
+    m_psCenterY[ nNode ] = psCenter[ geom::Y ];
+    m_psCenterZ[ nNode ] = psCenter[ geom::Z ];
+    memcpy( m_pnOrientation + nNode * 4, pnQuat, 4 * sizeof( short ));
+
+    m_pnFirstChild[ nNode ] = 0;
+    m_pnDepth[ nNode ] = static_cast<unsigned char>( nDepth );
+}
+
+void
+cSphereNodeStore::SetFirstChild( nodeindex nNode, nodeindex nFirstChild )
+{
+    _ASSERT( nNode < m_nTop && nFirstChild < m_nTop );
+    // publishes the group filled before to the readers of other threads, see GetFirstChild()
+    __atomic_store_n( m_pnFirstChild + nNode, nFirstChild, __ATOMIC_RELEASE );
+}
+
+size_t
+cSphereNodeStore::GetSize() const
+{
+    return __atomic_load_n( &m_nNodes, __ATOMIC_RELAXED );
+}
+
+size_t
+cSphereNodeStore::GetCapacity() const
+{
+    return m_nCapacity;
+}
+
+size_t
+cSphereNodeStore::GetGroupCapacity() const
+{
+    return m_nCapacity > 0 ? ( m_nCapacity - 1 ) / gnSphereChildren : 0;
+}
+
+bool
+cSphereNodeStore::HasFreeGroup() const
+{
+    return m_nFreeGroups || ( m_nTop && m_nTop + gnSphereChildren <= m_nCapacity );
+}
+
+size_t
+cSphereNodeStore::GetGroup( nodeindex nFirst )
+{
+    return ( nFirst - 1 ) / gnSphereChildren;
+}
+
+size_t
+cSphereNodeStore::GetBytesPerNode()
+{
+    return 3 * sizeof( geom::scalar ) + 4 * sizeof( short ) + sizeof( nodeindex ) + sizeof( unsigned char );
+}
+
+size_t
+cSphereNodeStore::GetResidentBytes() const
+{
+    return m_nCapacity ? GetBlockLayout( m_nCapacity, nullptr ) : 0;
+}
+
+size_t
+cSphereNodeStore::GetTop() const
+{
+    return m_nTop;
+}
+
+nodeindex
+cSphereNodeStore::GetFreeGroups() const
+{
+    return m_nFreeGroups;
+}
+
+const void*
+cSphereNodeStore::GetBlock() const
+{
+    return m_pBlock;
+}
+
+nodeindex
+cSphereNodeStore::GetFirstChild( nodeindex nNode ) const
+{
+    _ASSERT( nNode < m_nTop );
+    // the link may be set by another thread meanwhile; the acquire makes the group it points to complete
+    return __atomic_load_n( m_pnFirstChild + nNode, __ATOMIC_ACQUIRE );
+}
+
+size_t
+cSphereNodeStore::GetDepth( nodeindex nNode ) const
+{
+    _ASSERT( nNode < m_nTop );
+    return m_pnDepth[ nNode ];
+}
+
+geom::scalar
+cSphereNodeStore::GetRadius( size_t nDepth ) const
+{
+    _ASSERT( nDepth < gnStoreMaxDepth );
+    return m_arrsRadius[ nDepth ];
+}
+
+geom::cPoint3d
+cSphereNodeStore::GetCenter( nodeindex nNode ) const
+{
+    _ASSERT( nNode < m_nTop );
+    return geom::cPoint3d( m_psCenterX[ nNode ], m_psCenterY[ nNode ], m_psCenterZ[ nNode ] );
+}
+
+void
+cSphereNodeStore::LoadLocalCS( nodeindex nNode, geom::cMatrix3d& matCS ) const
+{
+    _ASSERT( nNode < m_nTop );
+    LoadQuantized( m_pnOrientation + nNode * 4, GetCenter( nNode ), matCS );
+}
+
+void
+cSphereNodeStore::QuantizeOrientation( const geom::cMatrix3d& matCS, short* pnQuat )
+{
+    geom::scalar arrsQuat[ 4 ];
+    geom::decorator::ExportQuaternion( arrsQuat, matCS );
+    int cComp;
+    for( cComp = 0; cComp < 4; cComp ++ )
+        pnQuat[ cComp ] = static_cast<short>( floor( arrsQuat[ cComp ] * gsQuatScale + 0.5 ));
+}
+
+void
+cSphereNodeStore::LoadQuantized( const short* pnQuat, const geom::cPoint3d& ptCenter, geom::cMatrix3d& matCS )
+{
+    geom::scalar arrsQuat[ 4 ];
+    int cComp;
+    for( cComp = 0; cComp < 4; cComp ++ )
+        arrsQuat[ cComp ] = pnQuat[ cComp ]; // the scale cancels out in the normalization
+    geom::decorator::LoadRigidTransform( matCS, arrsQuat, ptCenter );
+}
+
+} // NS end
@@ -0,0 +1,148 @@
+/*
+* MIT License
+* 
+* Copyright (c) 2020 ibaylov@gmail.com
+* 
+* Permission is hereby granted, free of charge, to any person obtaining a copy
+* of this software and associated documentation files (the "Software"), to deal
+* in the Software without restriction, including without limitation the rights
+* to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+* copies of the Software, and to permit persons to whom the Software is
+* furnished to do so, subject to the following conditions:
+* 
+* The above copyright notice and this permission notice shall be included in all
+* copies or substantial portions of the Software.
+* 
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+* AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+* OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+* SOFTWARE.
+*/
+#ifndef _MVC_NODE_STORE_
+#define _MVC_NODE_STORE_
+#include "geom.hh"
+
+/**
+@file  node-store.hh
+@brief The compact structure-of-arrays store for the cached sphere tree nodes
+A cached cSphere costs a vtable pointer, a full 4x4 matrix, the depth, the radius and the cache pointer, ~160 bytes.
+Here a node keeps only what can't be derived: the center, the orientation as a quantized unit quaternion,
+the depth and the index of its first child, 37 bytes in total. The radius is looked up in a per-depth table.
+The siblings are allocated together as a group; a prefilled store is laid out in breadth-first order, so a traversal
+streams through the arrays. Groups can be freed and reused, so the store can back an evicting cache as well.
+All arrays live in a single block at offsets that depend only on the capacity, so the block can be saved and
+mapped back as it is, see cNodeSnapshot.
+The child links are read and written atomically, so a group linked after it is filled can be read by other threads
+without locking; everything else is written by a single writer at a time, see cSphereNodeCache.
+*/
+
+namespace mvc
+{
+    ////////////////////////////////////////////////////////////////////
+    /// \brief nodeindex - the index of a node in the store
+    ///
+    typedef unsigned int nodeindex;
+
+    ////////////////////////////////////////////////////////////////////
+    /// \brief gnInvalidNode - marks elements that don't come from the store
+    ///
+    const nodeindex gnInvalidNode = ~0u;
+
+    ////////////////////////////////////////////////////////////////////
+    /// \brief pathcode - the stable identity of a tree element
+    /// The child slots along the path from the root are packed as base-9 digits in the low bits, the root-most digit
+    /// being the most significant, and the depth is kept in the top gnPathDepthBits bits. Unlike element pointers
+    /// the code survives Collect(), and the element can be regenerated from it at any time
+    typedef unsigned long long pathcode;
+
+    const int      gnPathDepthBits = 5;   //!< the bits holding the depth
+    const int      gnPathDigitBits = 64 - gnPathDepthBits;  //!< the bits holding the base-9 digits
+    const size_t   gnPathMaxDepth  = 18;  //!< the deepest level addressable, 9^18 < 2^59
+    const pathcode gnInvalidPath   = ~0ull; //!< marks the elements beyond gnPathMaxDepth
+
+    ////////////////////////////////////////////////////////////////////
+    /// \brief gnStoreMaxDepth - the size of the per-depth radius table
+    ///
+    const size_t gnStoreMaxDepth = 64;
+
+    ////////////////////////////////////////////////////////////////////
+    /// \brief gnSphereChildren - the number of direct descendants of every sphere, i.e. the store group size
+    ///
+    const size_t gnSphereChildren = 9;
+
+    ////////////////////////////////////////////////////////////////////
+    /// \brief The cSphereNodeStore class
+    /// Holds the cached tree nodes as parallel arrays. The children of a node are gnSphereChildren adjacent nodes
+    /// (a group) starting at its first child index; index 0 is the root, so first child 0 denotes a leaf.
+    /// Group g occupies the nodes 1 + g * gnSphereChildren onwards
+    class cSphereNodeStore
+    {
+    public:
+        ////////////////////////////////////////////////////////////////////
+        /// \brief The StoreArray enum - the arrays of the block, in the order they are laid out
+        ///
+        enum StoreArray
+        {
+            CenterX = 0, CenterY, CenterZ, Orientation, FirstChild, Depth,
+            StoreArrays
+        };
+    protected:
+        geom::scalar*   m_psCenterX;        //!< the center X coordinates
+        geom::scalar*   m_psCenterY;        //!< the center Y coordinates
+        geom::scalar*   m_psCenterZ;        //!< the center Z coordinates
+        short*          m_pnOrientation;    //!< the unit quaternions (x, y, z, w), quantized to 1/32767
+        nodeindex*      m_pnFirstChild;     //!< the first child indices, 0 for leaves
+        unsigned char*  m_pnDepth;          //!< the hierarchy depth
+        char*           m_pBlock;           //!< the block holding all the arrays
+        bool            m_bOwned;           //!< the block was allocated by the store, not attached
+        size_t          m_nNodes;           //!< the nodes in use
+        size_t          m_nTop;             //!< the nodes ever handed out; the ones above were never used
+        size_t          m_nCapacity;        //!< the nodes the arrays can hold
+        nodeindex       m_nFreeGroups;      //!< the first node of the first free group, linked through the first child field
+        geom::scalar    m_arrsRadius[ gnStoreMaxDepth ]; //!< the radius by hierarchy depth
+    public:
+        cSphereNodeStore();     //!< Constructs an empty store
+        ~cSphereNodeStore();    //!< Releases the arrays
+        #ifndef _NO_CXX_11_
+        cSphereNodeStore( const cSphereNodeStore& ) = delete; //!< Prevent direct copy
+        #endif
+        // operations
+        void      Reserve( size_t nCapacity );    //!< Drops the content and allocates room for nCapacity nodes
+        void      Clear();                        //!< Drops the content and releases the arrays
+        void      Attach( void* pBlock, size_t nCapacity, size_t nTop, size_t nNodes, nodeindex nFreeGroups ); //!< Drops the content and adopts an external block, see GetBlockLayout
+        void      SetRadiusTable( geom::scalar sRootR, geom::scalar sRatio ); //!< Sets up the radius table from root radius and per-level ratio
+        nodeindex AddRoot( const geom::cMatrix3d& matCS );                 //!< Places the root node at index 0 of an empty store
+        nodeindex AllocateGroup();                                        //!< Allocates a sibling group, returns its first node or 0 if the store is full
+        void      FreeGroup( nodeindex nFirst );                          //!< Returns the sibling group for reuse; the caller unlinks it
+        void      SetNode( nodeindex nNode, const geom::cMatrix3d& matCS, size_t nDepth ); //!< Sets an allocated node as a leaf with the given local CS
+        void      SetNode( nodeindex nNode, const geom::scalar* psCenter, const short* pnQuat, size_t nDepth ); //!< Sets an allocated node as a leaf from an already quantized local CS
+        void      SetFirstChild( nodeindex nNode, nodeindex nFirstChild );  //!< Links the node to its children group, 0 unlinks it
+        // accessors
+        size_t         GetSize() const;                       //!< Retrieves the number of nodes stored
+        size_t         GetCapacity() const;                   //!< Retrieves the number of nodes the store can hold
+        size_t         GetGroupCapacity() const;              //!< Retrieves the number of sibling groups the store can hold
+        bool           HasFreeGroup() const;                  //!< Checks if AllocateGroup() would succeed
+        static size_t  GetGroup( nodeindex nFirst );          //!< Retrieves the group index of a group first node
+        size_t         GetResidentBytes() const;              //!< Retrieves the memory occupied by the arrays
+        size_t         GetTop() const;                        //!< Retrieves the number of nodes ever handed out, the used part of the arrays
+        nodeindex      GetFreeGroups() const;                 //!< Retrieves the first node of the free groups list, 0 if empty
+        const void*    GetBlock() const;                      //!< Retrieves the block holding the arrays
+        static size_t  GetBlockLayout( size_t nCapacity, size_t* parrnOffsets ); //!< Computes the array offsets in the block, returns the block size
+        static size_t  GetElementBytes( StoreArray nArray );  //!< Retrieves the per-node size of an array
+        static void    QuantizeOrientation( const geom::cMatrix3d& matCS, short* pnQuat );  //!< Packs the local CS rotation as a quantized quaternion
+        static void    LoadQuantized( const short* pnQuat, const geom::cPoint3d& ptCenter, geom::cMatrix3d& matCS ); //!< Rebuilds a local CS from the packed rotation
+        static size_t  GetBytesPerNode();                     //!< Retrieves the memory occupied by a single node
+        nodeindex      GetFirstChild( nodeindex nNode ) const; //!< Retrieves the first child, 0 for leaves
+        size_t         GetDepth( nodeindex nNode ) const;     //!< Retrieves the node hierarchy depth
+        geom::scalar   GetRadius( size_t nDepth ) const;      //!< Retrieves the radius for nodes at depth
+        geom::cPoint3d GetCenter( nodeindex nNode ) const;    //!< Retrieves the node center in model space
+        void           LoadLocalCS( nodeindex nNode, geom::cMatrix3d& matCS ) const; //!< Reconstructs the node local CS
+    protected:
+        void           Bind( char* pBlock, size_t nCapacity ); //!< Points the arrays into the block
+    };
+}
+
+#endif
@@ -24,11 +24,13 @@
 #ifndef _OBLIST_HH_
 #define _OBLIST_HH_
 #include "assert.hh"
+#include "arena.hh"
 
 /**
 @file  oblist.hh
 @brief A template-based object list
 We are restricted in our STL usage, but necessity is the mother of invention.
+A list may take its elements from a cObListPool instead of the heap; the pool has to outlive the list then.
 */
 
 namespace utl
@@ -44,12 +46,14 @@ namespace utl
                 Data    m_Data;     //!< data member ot template argument type
                 Elem*   m_pNext;    //!< pointer to the next element
             } * m_pList;            //!< the list start element
+            cSlabPool* m_pPool;     //!< the pool of the elements, 0 for the heap
         public:
             //////////////////////////////////////////////////
             /// \brief cObList::cObList
             /// The default ampty list constructor
-            cObList()
-                : m_pList( 0 )
+            /// \param pPool - the pool to take the elements from, 0 for the heap; see cObListPool
+            cObList( cSlabPool* pPool = 0 )
+                : m_pList( 0 ), m_pPool( pPool )
             {
 
             }
@@ -62,7 +66,7 @@ namespace utl
                 while( m_pList ) // enumerating elements
                 {
                     Elem* pNext = m_pList->m_pNext;
-                    delete m_pList;
+                    FreeElem( m_pList );
                     m_pList = pNext;
                 }
             }
@@ -71,6 +75,7 @@ namespace utl
             /// \brief cObList::cObList
             /// The copy constructor
             cObList( const  cObList& rOther )
+                : m_pList( 0 ), m_pPool( rOther.m_pPool )
             {
                 CopyFrom( rOther ); // it's always nice to have an explicit copy on hand
             }
@@ -82,6 +87,7 @@ namespace utl
             cObList( cObList&& rOther)
             {
                 m_pList = rOther.m_pList;
+                m_pPool = rOther.m_pPool;
                 rOther.m_pList = 0;
             }
             #endif
@@ -105,7 +111,7 @@ namespace utl
             /// \param dataIn -  the data to be added to the list
             void Add( Data dataIn )
             {
-                Elem* pElem = new Elem;
+                Elem* pElem = m_pPool ? static_cast<Elem*>( m_pPool->Allocate()) : new Elem;
                 pElem->m_pNext =  m_pList;
                 m_pList = pElem;
                 pElem->m_Data = dataIn;
@@ -128,11 +134,48 @@ namespace utl
                 _ASSERT( m_pList ); // make sure we are pulling off elements only if the list is not empty
                 Data  dRV = m_pList->m_Data;
                 Elem* pNext = m_pList->m_pNext;
-                delete m_pList;
+                FreeElem( m_pList );
                 m_pList = pNext;
                 return dRV;
             }
 
+
+            /////////////////////////////////////////////////
+            /// \brief cObList::GetElemBytes
+            /// Retrieves the size of a list element, for the pools
+            static size_t GetElemBytes()
+            {
+                return sizeof( Elem );
+            }
+
+        protected:
+            /////////////////////////////////////////////////
+            /// \brief cObList::FreeElem
+            /// Returns an element to where it came from
+            void FreeElem( Elem* pElem )
+            {
+                if( m_pPool )
+                    m_pPool->Free( pElem );
+                else
+                    delete pElem;
+            }
+    };
+
+    //////////////////////////////////////////////////
+    /// \brief The cObListPool template
+    /// implements the element pool of the lists of a data type, so that adding to them doesn't allocate one by one.
+    /// The data type must not need construction or destruction, as the pooled elements get neither
+    template<typename Data> class cObListPool : public cSlabPool
+    {
+        public:
+            //////////////////////////////////////////////////
+            /// \brief cObListPool::cObListPool
+            /// Constructs an empty pool
+            /// \param nElemsPerSlab - how many list elements a slab holds
+            cObListPool( size_t nElemsPerSlab = 256 )
+                : cSlabPool( cObList<Data>::GetElemBytes(), nElemsPerSlab )
+            {
+            }
     };
 }
 
@@ -39,7 +39,11 @@ namespace mvc
 // cOGLView implementation
 
 cOGLView::cOGLView ()
-    : m_pVP( nullptr )
+    : m_pVP( nullptr ), m_pPool( nullptr ), m_bParallel( true ), m_parrSlots( nullptr ), m_nSlots( 0 ), m_bCoherent( true ), m_pCutModel( nullptr ),
+      m_parrCut( nullptr ), m_nCut( 0 ), m_nCutCapacity( 0 ),
+      m_parrCutPrev( nullptr ), m_nCutPrev( 0 ), m_nCutPrevCapacity( 0 ), m_sMotion( 0 ),
+      m_sCutFOV( 0 ), m_sCutAspect( 0 ), m_sCutPixelScale( 0 ), m_bCutRelative( false ), m_nCutOccluder( nNoOccluder ),
+      m_nCutClassified( 0 ), m_nCutEnumerated( 0 )
 {
     SetupScene();
 
@@ -48,7 +52,9 @@ cOGLView::cOGLView ()
 cOGLView::~cOGLView ()
 {
     SetupScene();
-
+    delete[] m_parrCut;
+    delete[] m_parrCutPrev;
+    delete[] m_parrSlots;
 }
 
 void
@@ -58,7 +64,55 @@ cOGLView::AssociateViewport( ogl::cViewport* pVP )
     m_pVP = pVP;
 }
 
-const int nDrawQueues = 4;
+const size_t nNoCutNode = ~static_cast<size_t>( 0 ); //!< no node of the previous cut
+const size_t nCutInitialCapacity = 4096;              //!< the cut nodes allocated at first
+
+void
+cOGLView::SetCoherent( bool bCoherent )
+{
+    m_bCoherent = bCoherent;
+    m_pCutModel = nullptr; // the next coherent frame starts over
+}
+
+bool
+cOGLView::IsCoherent() const
+{
+    return m_bCoherent;
+}
+
+////////////////////////////////////////////////////
+/// \brief nSubtreesPerWorker - the subtrees the top levels are expanded to per worker, so that they balance by stealing
+///
+const size_t nSubtreesPerWorker = 16;
+
+////////////////////////////////////////////////////
+/// \brief nRangesPerWorker - the ranges the subtrees are split into per worker; a range is stolen whole
+///
+const size_t nRangesPerWorker = 4;
+
+void
+cOGLView::SetTaskPool( utl::cTaskPool* pPool )
+{
+    m_pPool = pPool;
+}
+
+void
+cOGLView::SetParallel( bool bParallel )
+{
+    m_bParallel = bParallel;
+}
+
+bool
+cOGLView::IsParallel() const
+{
+    return m_bParallel;
+}
+
+bool
+cOGLView::CanTraverseParallel() const
+{
+    return m_bParallel && m_pPool && m_pPool->GetWorkerCount() > 1 && m_pModel->IsConcurrent();
+}
 
 
 void
@@ -160,16 +214,33 @@ cOGLView::SetupScene()
 
 
 void
-cOGLView::DrawElement( const cElement* pElem, LevelOfSDetail lodView )
+cOGLView::PlaceElement( const geom::cMatrix3d& matLCS, geom::scalar sR )
 {
     glPushMatrix();
 
     // because our lists are with sphere size of one, we have to scale the sphere accordingly
-    geom::scalar sR = pElem->GetBoundingSphereRadius();
+    if( m_pVP->IsRelative())
+    {
+        // the rotation scaled by the radius and the center relative to the anchor, column major
+        GLfloat arrfMatGL[16];
+        int cRow, cCol;
+        for( cCol = 0; cCol < geom::gnDim3d - 1; cCol ++ )
+        {
+            for( cRow = 0; cRow < geom::gnDim3d - 1; cRow ++ )
+                arrfMatGL[ cCol * geom::gnDim3d + cRow ] = static_cast<GLfloat>( matLCS[ cRow ][ cCol ] * sR );
+            arrfMatGL[ cCol * geom::gnDim3d + geom::W ] = 0;
+        }
+        m_pVP->ToRelative( geom::cPoint3d( matLCS[ geom::X ][ geom::W ], matLCS[ geom::Y ][ geom::W ], matLCS[ geom::Z ][ geom::W ] ),
+                           arrfMatGL + ( geom::gnDim3d - 1 ) * geom::gnDim3d );
+        arrfMatGL[ 15 ] = 1;
+        glMultMatrixf( arrfMatGL );
+    }
+    else
+    {
     geom::cMatrix3d matScale;
     geom::decorator::LoadScale( matScale, geom::cVector3d( sR, sR, sR ));
 
-    geom::cMatrix3d matCS = pElem ->GetLocalCS() * matScale ;
+    geom::cMatrix3d matCS = matLCS * matScale ;
 
     // place the elemt CS in the GL modelvuew matrix
     geom::scalar sMatGL[16];
@@ -180,6 +251,13 @@ cOGLView::DrawElement( const cElement* pElem, LevelOfSDetail lodView )
 #else
     glMultMatrixd( sMatGL );
 #endif
+    }
+}
+
+void
+cOGLView::DrawElement( const cElement* pElem, LevelOfSDetail lodView )
+{
+    PlaceElement( pElem->GetLocalCS(), pElem->GetBoundingSphereRadius());
 
     if( m_pStencil )
         m_pStencil->Apply( pElem );
@@ -197,115 +275,539 @@ cOGLView::DrawElement( const cElement* pElem, LevelOfSDetail lodView )
 void
 cOGLView::ClassifyElement( const cElement* pElem, ObjectClassifier& ocElem )
 {
-    geom::cPoint3d ptLocalCenter = pElem->GetLocalCS() * geom::cPoint3d( 0, 0, 0 );
-    geom::scalar sViewCosine =   m_pVP->SegmentVisibleCosine( ptLocalCenter, pElem->GetBoundingSphereRadius());
-    geom::scalar sMinDistance = m_pVP->PointMinimalFrustumDistance( ptLocalCenter );
-    geom::scalar sFOVCoef = m_pVP->GetFOV() / ( M_PI / 4 );  // ve take the viewport FOV / ( pi / 4 ) as a reference (neutral) view angle
-    if( sViewCosine > cos( sFOVCoef * 0.15 * M_PI / 180.0) ) // if the object viewing angle corrected for zoom is below 0.15 rad, it's invisible
+    ClassifyBounds( pElem->GetCenter(), pElem->GetBoundingSphereRadius(), pElem->GetDescendantSphereRadius(), pElem->GetDescendantCapDistance(), pElem->GetLocalCS(), ocElem );
+    // a proxy is only expanded, never drawn
+    if( pElem->IsProxy())
+        ocElem.m_bVisible = false;
+}
+
+void
+cOGLView::ClassifyBounds( const geom::cPoint3d& ptLocalCenter, geom::scalar sR, geom::scalar sDescR, geom::scalar sDescCap, const geom::cMatrix3d& matLCS, ObjectClassifier& ocElem, unsigned nPlanes )
+{
+    // the projected radius sR * scale / depth is compared as the depth against sR times the depth per unit of radius
+    // each LOD starts at, see SetupLODThresholds()
+    geom::scalar sDepth = m_pVP->ViewDepth( ptLocalCenter );
+    if( sR * m_arrsLODDepth[ 0 ] < sDepth )
     {
         ocElem.m_LOD = Invisible;
         ocElem.m_bVisible = false;
         ocElem.m_bTreeVisible = false;
         return;
     }
-    // set the LOD according to view angle
-    //   we are using the following heuristic here based on the Object viewing angle corrected for vieport zoom
-    if( sViewCosine > cos( sFOVCoef * 0.5 * M_PI / 180.0))
+    if( sR * m_arrsLODDepth[ 1 ] < sDepth )
         ocElem.m_LOD = Low;
     else
-    if( sViewCosine > cos( sFOVCoef * 1 * M_PI / 180.0))
+    if( sR * m_arrsLODDepth[ 2 ] < sDepth )
         ocElem.m_LOD = Meduim;
     else
-    if( sViewCosine > cos( sFOVCoef * 0.25 * M_PI / 180.0))
+    if( sR * m_arrsLODDepth[ 3 ] < sDepth )
         ocElem.m_LOD = High;
     else
         ocElem.m_LOD = Highest;
+    unsigned nStraddled;
+    geom::scalar sMinDistance = m_pVP->PointMinimalFrustumDistance( ptLocalCenter, nPlanes, sDescR, nStraddled );
     // set the visibility indicators
-    ocElem.m_bVisible =  ( sMinDistance >= - pElem->GetBoundingSphereRadius());
-    ocElem.m_bTreeVisible =(sMinDistance >=  - pElem->GetDescendantSphereRadius());
+    ocElem.m_sMinDistance = sMinDistance;
+    ocElem.m_bVisible =  ( sMinDistance >= - sR );
+    ocElem.m_bTreeVisible =(sMinDistance >=  - sDescR );
+    ocElem.m_nStraddled = static_cast<unsigned char>( nStraddled );
+
+    _ASSERT( nPlanes != ogl::gnAllPlanes || ocElem.m_bVisible == m_pVP->SphereInFrustum(ptLocalCenter, sR ) );
+    _ASSERT( nPlanes != ogl::gnAllPlanes || ocElem.m_bTreeVisible == m_pVP->SphereInFrustum(ptLocalCenter, sDescR ) );
+    // the descendants grow away from the parent; where the sphere is cut off by a plane only farther than the cap,
+    // the planes are checked one by one against the capped sphere
+    if( ocElem.m_bTreeVisible && sMinDistance < - sDescCap )
+        ocElem.m_bTreeVisible = m_pVP->CappedSphereInFrustum( ptLocalCenter, geom::cVector3d( matLCS[ geom::X ][ geom::Z ], matLCS[ geom::Y ][ geom::Z ], matLCS[ geom::Z ][ geom::Z ] ), sDescR, sDescCap );
 
-    _ASSERT( ocElem.m_bVisible == m_pVP->SphereInFrustum(ptLocalCenter, pElem->GetBoundingSphereRadius()) );
-    _ASSERT( ocElem.m_bTreeVisible == m_pVP->SphereInFrustum(ptLocalCenter, pElem->GetDescendantSphereRadius()) );
+}
 
+void
+cOGLView::SetupLODThresholds()
+{
+    // the heuristic viewing angles of the LOD thresholds in the order they are tested, taken at the reference FOV of
+    // pi / 4 and window height; the thresholds are their projected radii in pixels there, so a larger window or a
+    // narrower FOV shows more detail
+    static const geom::scalar arrsDegrees[ nLODThresholds ] = { 0.15, 0.5, 1, 0.25 };
+    static const geom::scalar sReferenceHeight = 600;
+    geom::scalar sReferenceScale = sReferenceHeight / 2 / tan( M_PI / 8 );
+    geom::scalar sPixelScale = m_pVP->GetPixelScale();
+    size_t cLOD;
+    for( cLOD = 0; cLOD < nLODThresholds; cLOD ++ )
+    {
+        geom::scalar sPixels = sReferenceScale * tan( arrsDegrees[ cLOD ] * M_PI / 180.0 );
+        m_arrsLODDepth[ cLOD ] = sPixelScale / sPixels;
+        m_arrfLODDepth[ cLOD ] = static_cast<float>( m_arrsLODDepth[ cLOD ] );
+    }
+}
+
+void
+cOGLView::ClassifyElement( const cElement* pElem, const float* parrfCenter, ObjectClassifier& ocElem )
+{
+    ClassifyBounds( parrfCenter, static_cast<float>( pElem->GetBoundingSphereRadius()), static_cast<float>( pElem->GetDescendantSphereRadius()),
+                    static_cast<float>( pElem->GetDescendantCapDistance()), pElem->GetLocalCS(), ocElem );
+    if( pElem->IsProxy())
+        ocElem.m_bVisible = false;
+}
+
+void
+cOGLView::ClassifyBounds( const float* parrfCenter, float fR, float fDescR, float fDescCap, const geom::cMatrix3d& matLCS, ObjectClassifier& ocElem )
+{
+    float fDepth = m_pVP->RelativeViewDepth( parrfCenter );
+    if( fR * m_arrfLODDepth[ 0 ] < fDepth )
+    {
+        ocElem.m_LOD = Invisible;
+        ocElem.m_bVisible = false;
+        ocElem.m_bTreeVisible = false;
+        return;
+    }
+    if( fR * m_arrfLODDepth[ 1 ] < fDepth )
+        ocElem.m_LOD = Low;
+    else
+    if( fR * m_arrfLODDepth[ 2 ] < fDepth )
+        ocElem.m_LOD = Meduim;
+    else
+    if( fR * m_arrfLODDepth[ 3 ] < fDepth )
+        ocElem.m_LOD = High;
+    else
+        ocElem.m_LOD = Highest;
+    unsigned nStraddled;
+    float fMinDistance = m_pVP->RelativeMinimalFrustumDistance( parrfCenter, ogl::gnAllPlanes, fDescR, nStraddled );
+    ocElem.m_sMinDistance = fMinDistance;
+    ocElem.m_bVisible = ( fMinDistance >= - fR );
+    ocElem.m_bTreeVisible = ( fMinDistance >= - fDescR );
+    ocElem.m_nStraddled = static_cast<unsigned char>( nStraddled );
+    if( ocElem.m_bTreeVisible && fMinDistance < - fDescCap )
+    {
+        float arrfAxis[ geom::gnDim3d - 1 ] = { static_cast<float>( matLCS[ geom::X ][ geom::Z ] ), static_cast<float>( matLCS[ geom::Y ][ geom::Z ] ), static_cast<float>( matLCS[ geom::Z ][ geom::Z ] ) };
+        ocElem.m_bTreeVisible = m_pVP->RelativeCappedSphereInFrustum( parrfCenter, arrfAxis, fDescR, fDescCap );
+    }
+}
+
+void
+cOGLView::SetupOccluder( const geom::cPoint3d& ptCenter, geom::scalar sR, size_t nUp, cOccluder& rOccluder )
+{
+    rOccluder.m_ptCenter = ptCenter;
+    rOccluder.m_sRadius = sR;
+    rOccluder.m_nUp = nUp;
+    rOccluder.m_vecAxis = ptCenter - m_pVP->GetEyePoint();
+    geom::scalar sDistance = rOccluder.m_vecAxis.Normalize();
+    rOccluder.m_bOccludes = sDistance > sR;
+    if( ! rOccluder.m_bOccludes )
+        return;
+    // the silhouette circle is where the tangents from the eye touch the sphere
+    geom::scalar sTangent = sqrt( sDistance * sDistance - sR * sR );
+    rOccluder.m_sSin = sR / sDistance;
+    rOccluder.m_sCos = sTangent / sDistance;
+    rOccluder.m_sSilhouette = sTangent * rOccluder.m_sCos;
+    int cAxis;
+    for( cAxis = geom::X; cAxis < geom::W; cAxis ++ )
+        rOccluder.m_arrfAxis[ cAxis ] = static_cast<float>( rOccluder.m_vecAxis[ cAxis ] );
+    rOccluder.m_fSin = static_cast<float>( rOccluder.m_sSin );
+    rOccluder.m_fCos = static_cast<float>( rOccluder.m_sCos );
+    rOccluder.m_fSilhouette = static_cast<float>( rOccluder.m_sSilhouette );
+}
+
+geom::scalar
+cOGLView::OcclusionMargin( const cOccluder& rOccluder, const geom::cPoint3d& ptInner, geom::scalar sInnerDescR ) const
+{
+    if( ! rOccluder.m_bOccludes )
+        return - HUGE_VAL;
+    // with the inner center at distance A along the axis and B off it, A sin - B cos is its distance inside the
+    // cone surface, and A less the silhouette distance the one behind the silhouette plane
+    geom::cVector3d vecInner = ptInner - m_pVP->GetEyePoint();
+    geom::scalar sAlong = vecInner * rOccluder.m_vecAxis;
+    geom::scalar sOff2 = vecInner * vecInner - sAlong * sAlong;
+    geom::scalar sOff = sOff2 > 0 ? sqrt( sOff2 ) : 0;
+    geom::scalar sCone = sAlong * rOccluder.m_sSin - sOff * rOccluder.m_sCos;
+    geom::scalar sBehind = sAlong - rOccluder.m_sSilhouette;
+    return ( sCone < sBehind ? sCone : sBehind ) - sInnerDescR;
+}
+
+float
+cOGLView::OcclusionMargin( const cOccluder& rOccluder, const float* parrfInner, float fInnerDescR ) const
+{
+    if( ! rOccluder.m_bOccludes )
+        return - HUGE_VALF;
+    const float* parrfEye = m_pVP->GetRelativeEye();
+    float fX = parrfInner[ geom::X ] - parrfEye[ geom::X ];
+    float fY = parrfInner[ geom::Y ] - parrfEye[ geom::Y ];
+    float fZ = parrfInner[ geom::Z ] - parrfEye[ geom::Z ];
+    float fAlong = fX * rOccluder.m_arrfAxis[ geom::X ] + fY * rOccluder.m_arrfAxis[ geom::Y ] + fZ * rOccluder.m_arrfAxis[ geom::Z ];
+    float fOff2 = fX * fX + fY * fY + fZ * fZ - fAlong * fAlong;
+    float fOff = fOff2 > 0 ? sqrtf( fOff2 ) : 0;
+    float fCone = fAlong * rOccluder.m_fSin - fOff * rOccluder.m_fCos;
+    float fBehind = fAlong - rOccluder.m_fSilhouette;
+    return ( fCone < fBehind ? fCone : fBehind ) - fInnerDescR;
+}
+
+geom::scalar
+cOGLView::OcclusionTolerance( const cOccluder& rOccluder, const geom::cPoint3d& ptInner, geom::scalar sInnerDescR, bool bOccluded ) const
+{
+    geom::cVector3d vecOuter = rOccluder.m_ptCenter - m_pVP->GetEyePoint();
+    geom::cVector3d vecInner = ptInner - m_pVP->GetEyePoint();
+    geom::scalar sR = rOccluder.m_sRadius;
+    geom::scalar sOuter = sqrt( vecOuter * vecOuter );
+    geom::scalar sInner = sqrt( vecInner * vecInner );
+    // with the eye inside either sphere nothing is hidden until it leaves it
+    if( sOuter <= sR || sInner <= sInnerDescR )
+    {
+        if( bOccluded )
+            return 0;
+        return sR - sOuter > sInnerDescR - sInner ? sR - sOuter : sInnerDescR - sInner;
+    }
+    // the eye stays outside both spheres within the ball, where the rates below hold at the least distances
+    geom::scalar sBall = ( sOuter - sR < sInner - sInnerDescR ? sOuter - sR : sInner - sInnerDescR ) / 2;
+    geom::scalar sOuterMin = sOuter - sBall;
+    geom::scalar sInnerMin = sInner - sBall;
+    // in the cone is the cone half-angle less the axis angle less the angle the inner sphere subtends; the half-angle
+    // changes at R / ( D sqrt( D^2 - R^2 )) per unit of eye translation, each direction turns at one over its distance
+    geom::scalar sAlong = vecInner * vecOuter / sOuter;
+    geom::scalar sOff2 = vecInner * vecInner - sAlong * sAlong;
+    geom::scalar sAngle = asin( sR / sOuter ) - atan2( sOff2 > 0 ? sqrt( sOff2 ) : 0, sAlong ) - asin( sInnerDescR / sInner );
+    geom::scalar sAngleRate = sR / ( sOuterMin * sqrt( sOuterMin * sOuterMin - sR * sR )) + 1 / sOuterMin + 1 / sInnerMin +
+                              sInnerDescR / ( sInnerMin * sqrt( sInnerMin * sInnerMin - sInnerDescR * sInnerDescR ));
+    // behind the silhouette is the offset from the center along the axis plus R^2 / D
+    geom::cVector3d vecOffset = ptInner - rOccluder.m_ptCenter;
+    geom::scalar sBehind = vecOffset * vecOuter / sOuter + sR * sR / sOuter - sInnerDescR;
+    geom::scalar sBehindRate = sqrt( vecOffset * vecOffset ) / sOuterMin + sR * sR / ( sOuterMin * sOuterMin );
+    geom::scalar sCone = fabs( sAngle ) / sAngleRate;
+    geom::scalar sPlane = fabs( sBehind ) / sBehindRate;
+    geom::scalar sTolerance;
+    // an occluded sphere stays so while both tests pass; a visible one while any failing test still fails
+    if( bOccluded )
+        sTolerance = sCone < sPlane ? sCone : sPlane;
+    else
+    if( sAngle < 0 && sBehind < 0 )
+        sTolerance = sCone > sPlane ? sCone : sPlane;
+    else
+    if( sAngle < 0 )
+        sTolerance = sCone;
+    else
+    if( sBehind < 0 )
+        sTolerance = sPlane;
+    else
+        sTolerance = 0;
+    return sTolerance < sBall ? sTolerance : sBall;
 }
 
 bool
-cOGLView::OccludesCompletely( const cElement* pOuter, const cElement* pInner)
+cOGLView::OccludesChild( const utl::cArray<cOccluder>& rarrOccluders, size_t nOccluder, const cChildBounds& bndChild, geom::scalar* psSlack )
+{
+    if( nOccluder == nNoOccluder )
+        return false;
+    bool bRelative = m_pVP->IsRelative();
+    float arrfChild[ geom::gnDim3d - 1 ];
+    if( bRelative )
+        m_pVP->ToRelative( bndChild.m_ptCenter, arrfChild );
+    // the parent first, then the larger elements above it
+    size_t cLink;
+    for( cLink = nOccluder; cLink != nNoOccluder; cLink = rarrOccluders[ cLink ].m_nUp )
+    {
+        const cOccluder& rOccluder = rarrOccluders[ cLink ];
+        bool bOccluded = bRelative ? OcclusionMargin( rOccluder, arrfChild, static_cast<float>( bndChild.m_sDescendantRadius )) >= 0
+                                   : OcclusionMargin( rOccluder, bndChild.m_ptCenter, bndChild.m_sDescendantRadius ) >= 0;
+        if( psSlack )
+        {
+            geom::scalar sTolerance = OcclusionTolerance( rOccluder, bndChild.m_ptCenter, bndChild.m_sDescendantRadius, bOccluded );
+            if( sTolerance < *psSlack )
+                *psSlack = sTolerance;
+        }
+        if( bOccluded )
+            return true;
+    }
+    return false;
+}
+
+///////////////////////////////////////////////////////////
+// cOGLView::cOpenListVisitor implementation
+
+cOGLView::cOpenListVisitor::cOpenListVisitor( cOGLView* pView, utl::cArray<cElement*>& rarrOpen, utl::cArray<cOccluder>& rarrOccluders, bool bSlack )
+    : m_pView( pView ), m_rarrOpen( rarrOpen ), m_rarrOccluders( rarrOccluders ), m_pParent( nullptr ), m_nOccluder( nNoOccluder ),
+      m_bSlack( bSlack ), m_nOccluded( 0 ), m_sOcclusionSlack( HUGE_VAL )
 {
-    // OK, we are doing a major cheat here
-    // The proper implementation should be using cone/sphere intersection test
-    // To speed up the process we simply place a plane behind the possible occluder and see if the inner object is behind it
-    // This wil not work properly on object hierarchies where the children descendant bounding spheres don't touch the occluders sphere
+}
 
-    geom::cPoint3d ptOuterCenter = pOuter->GetLocalCS() * geom::cPoint3d( 0, 0, 0 );
-    geom::cPoint3d ptInnerCenter = pInner->GetLocalCS() * geom::cPoint3d( 0, 0, 0 );
-    geom::cVector3d vecOuter = (ptOuterCenter - m_pVP->GetEyePoint());
-    geom::scalar sOuter = vecOuter.Normalize();
+cOGLView::cOpenListVisitor::~cOpenListVisitor()
+{
+}
 
-    geom::cPoint3d ptPlane = m_pVP->GetEyePoint() + vecOuter * ( sOuter + /*0.8*/ 0.6 * pOuter->GetBoundingSphereRadius());
-    geom::cPlane3d planeCull( vecOuter, ptPlane );
+void
+cOGLView::cOpenListVisitor::SetParent( const cElement* pParent, size_t nUp )
+{
+    m_pParent = pParent;
+    m_sOcclusionSlack = HUGE_VAL;
+    m_nOccluder = nUp;
+    // a proxy is never drawn, so it hides nothing
+    if( pParent->IsProxy())
+        return;
+    m_nOccluder = m_rarrOccluders.GetCount();
+    m_rarrOccluders.Add( cOccluder());
+    m_pView->SetupOccluder( pParent->GetCenter(), pParent->GetBoundingSphereRadius(), nUp, m_rarrOccluders[ m_nOccluder ] );
+}
 
-    if( planeCull.PointDistance(  ptInnerCenter ) >= pInner->GetDescendantSphereRadius())
+size_t
+cOGLView::cOpenListVisitor::GetOccluder() const
+{
+    return m_nOccluder;
+}
+
+utl::cArray<cElement*>&
+cOGLView::cOpenListVisitor::GetOpen()
+{
+    return m_rarrOpen;
+}
+
+bool
+cOGLView::cOpenListVisitor::Accept( const cChildBounds& bndChild )
+{
+    _ASSERT( m_pParent );
+    if( ! m_pView->OccludesChild( m_rarrOccluders, m_nOccluder, bndChild, m_bSlack ? &m_sOcclusionSlack : nullptr ))
         return true;
+    m_nOccluded ++;
     return false;
 }
 
+void
+cOGLView::cOpenListVisitor::Visit( cElement* pElem )
+{
+    m_rarrOpen.Add( pElem );
+}
+
 void
 cOGLView::DisplayImpl()
+{
+    AnticipateCamera();
+    if( m_bCoherent )
+    {
+        UpdateCut();
+        DrawCut();
+        return;
+    }
+    if( CanTraverseParallel())
+        DisplayParallel();
+    else
+        DisplayTraversal();
+}
+
+void
+cOGLView::AnticipateCamera()
 {
     glMatrixMode(GL_MODELVIEW);
 
+    // let the model prepare for what the camera is going to see
+    cCameraState camState;
+    camState.m_ptEye = m_pVP->GetEyePoint();
+    camState.m_vecView = m_pVP->GetViewDirection();
+    camState.m_vecUp = m_pVP->GetUpDirection();
+    camState.m_sFOV = m_pVP->GetFOV();
+    camState.m_sAspect = m_pVP->GetAspect();
+    camState.m_sNear = ogl::gsNearClip;
+    camState.m_sFar = ogl::gsFarClip;
+    // the thresholds of the frame are set up here, ahead of any traversal
+    SetupLODThresholds();
+    camState.m_sHeight = m_pVP->GetHeight();
+    camState.m_sDetailPixels = m_pVP->GetPixelScale() / m_arrsLODDepth[ 0 ];
+    m_pModel->Anticipate( camState );
+}
 
-    // draw model
-    utl::cObList<cElement*> lstOpen;
-    utl::cObList<const cElement*> alstDraw[nDrawQueues];
+void
+cOGLView::DisplayTraversal()
+{
+    // draw model; the open stack and the queues are empty between the frames, but keep their capacity
     cElement* pElemRoot = m_pModel->GetRootElement();
-    lstOpen.Add( pElemRoot );
+    m_arrOpen.Add( pElemRoot );
+    m_arrOccluders.Clear();
 
     // some stats
-    size_t nProcessed = 0;
-    size_t nCulled = 0;
-    size_t nOcluded = 0;
+    cTraversalStats stats = { 0, 0, 0 };
     // not, the recursive part
-    ObjectClassifier ocElem;
-    while( lstOpen.HasData()  )
+    bool bRelative = m_pVP->IsRelative();
+    ClassifyOpen( m_arrOpen, m_arrOpenState, 0, ogl::gnAllPlanes, nNoOccluder, bRelative, m_arrDraw, stats );
+    cOpenListVisitor visitorOpen( this, m_arrOpen, m_arrOccluders );
+    TraverseOpen( m_arrOpen, m_arrOpenState, bRelative, visitorOpen, m_arrDraw, stats );
+    stats.m_nOccluded = visitorOpen.m_nOccluded;
+    DrawQueues( stats );
+}
+
+void
+cOGLView::DisplayParallel()
+{
+    cElement* pElemRoot = m_pModel->GetRootElement();
+    bool bRelative = m_pVP->IsRelative();
+    size_t nWorkers = m_pPool->GetWorkerCount();
+    if( m_nSlots != nWorkers )
+    {
+        delete[] m_parrSlots;
+        m_parrSlots = new cTraversalSlot[ nWorkers ];
+        m_nSlots = nWorkers;
+    }
+    size_t cSlot;
+    for( cSlot = 0; cSlot < m_nSlots; cSlot ++ )
+    {
+        m_parrSlots[ cSlot ].m_stats.m_nProcessed = 0;
+        m_parrSlots[ cSlot ].m_stats.m_nCulled = 0;
+        m_parrSlots[ cSlot ].m_stats.m_nOccluded = 0;
+        m_parrSlots[ cSlot ].m_bEntered = false;
+        m_parrSlots[ cSlot ].m_bReading = false;
+    }
+    // the open list is used as a queue here: the top levels are expanded breadth-first till the unexpanded tail
+    // holds enough subtrees, the elements of the levels going to the queues of the frame thread
+    cTraversalStats stats = { 0, 0, 0 };
+    cOpenListVisitor visitorOpen( this, m_arrOpen, m_arrOccluders );
+    m_arrOpen.Add( pElemRoot );
+    m_arrOccluders.Clear();
+    ClassifyOpen( m_arrOpen, m_arrOpenState, 0, ogl::gnAllPlanes, nNoOccluder, bRelative, m_arrDraw, stats );
+    size_t nFirst = 0;
+    for( ; nFirst < m_arrOpen.GetCount() && m_arrOpen.GetCount() - nFirst < nWorkers * nSubtreesPerWorker; nFirst ++ )
+        ExpandElement( m_arrOpen[ nFirst ], m_arrOpenState[ nFirst ], bRelative, visitorOpen, m_arrOpenState, m_arrDraw, stats );
+    stats.m_nOccluded = visitorOpen.m_nOccluded;
+    // the tail and the occluders above it aren't added to any more, so the workers read them as they are
+    size_t nGrain = ( m_arrOpen.GetCount() - nFirst ) / ( nWorkers * nRangesPerWorker );
+    m_pPool->ParallelFor( SubtreeTask, this, nFirst, m_arrOpen.GetCount(), nGrain ? nGrain : 1 );
+    m_pPool->RunOnEach( LeaveTask, this );
+    m_arrOpen.Clear();
+    m_arrOpenState.Clear();
+    // the subtrees a worker couldn't read are traversed here, after the others
+    for( cSlot = 0; cSlot < m_nSlots; cSlot ++ )
+    {
+        cTraversalSlot& rSlot = m_parrSlots[ cSlot ];
+        while( rSlot.m_arrDeferred.HasData())
+        {
+            m_arrOpen.Add( rSlot.m_arrDeferred.PullTail());
+            m_arrOpenState.Add( rSlot.m_arrDeferredState.PullTail());
+        }
+        stats.m_nProcessed += rSlot.m_stats.m_nProcessed;
+        stats.m_nCulled += rSlot.m_stats.m_nCulled;
+        stats.m_nOccluded += rSlot.m_stats.m_nOccluded;
+    }
+    if( m_arrOpen.HasData())
     {
-        cElement* pElem = lstOpen.PullHead();
-        nProcessed ++;
-        // classify element
-        ClassifyElement( pElem, ocElem );
-        // if the element and its descendands are ocluded, terminate the recursion
-        nCulled ++;
-        if(  ! ocElem.m_bTreeVisible )
-            continue;
-        nCulled --;
-        // if elemt is not occluded, draw it, placiong on draw queue according to LOD
-        if( ocElem.m_bVisible )
-            alstDraw[ ocElem.m_LOD ].Add( pElem );
-        // get the descendands and push them to the open list
-        utl::cObList<cElement*> lstDesc = m_pModel->GetDescendantElements(pElem);
-        while( lstDesc.HasData() )
+        cOpenListVisitor visitorDeferred( this, m_arrOpen, m_arrOccluders );
+        TraverseOpen( m_arrOpen, m_arrOpenState, bRelative, visitorDeferred, m_arrDraw, stats );
+        stats.m_nOccluded += visitorDeferred.m_nOccluded;
+    }
+    DrawQueues( stats );
+}
+
+void
+cOGLView::SubtreeTask( void* pView, size_t nBegin, size_t nEnd )
+{
+    static_cast<cOGLView*>( pView )->TraverseSubtrees( nBegin, nEnd );
+}
+
+void
+cOGLView::TraverseSubtrees( size_t nBegin, size_t nEnd )
+{
+    size_t nWorker = m_pPool->GetWorkerIndex();
+    cTraversalSlot& rSlot = m_parrSlots[ nWorker ];
+    size_t cOpen;
+    // the frame thread is inside its read already; the other workers enter one with their first range of the frame
+    // and leave it in LeaveTask(). The elements they materialize stay valid till the frame thread leaves its own
+    if( nWorker && ! rSlot.m_bEntered )
+    {
+        rSlot.m_bEntered = true;
+        rSlot.m_bReading = m_pModel->AttachReader();
+        if( rSlot.m_bReading )
+            m_pModel->BeginRead();
+    }
+    if( nWorker && ! rSlot.m_bReading )
+    {
+        for( cOpen = nBegin; cOpen < nEnd; cOpen ++ )
         {
-            cElement* pelemChild = lstDesc.PullHead();
-            if( ! OccludesCompletely( pElem, pelemChild ) )
-                lstOpen.Add(  pelemChild );
-            else
-                nOcluded ++;
+            rSlot.m_arrDeferred.Add( m_arrOpen[ cOpen ] );
+            rSlot.m_arrDeferredState.Add( m_arrOpenState[ cOpen ] );
         }
-        ///
+        return;
+    }
+    bool bRelative = m_pVP->IsRelative();
+    cOpenListVisitor visitorOpen( this, rSlot.m_arrOpen, rSlot.m_arrOccluders );
+    for( cOpen = nBegin; cOpen < nEnd; cOpen ++ )
+    {
+        // the subtree takes a copy of the occluders along its path, the ones of the previous subtree are done with
+        cOpenState stateRoot = m_arrOpenState[ cOpen ];
+        rSlot.m_arrOccluders.Clear();
+        stateRoot.m_nOccluder = CopyOccluders( m_arrOccluders, stateRoot.m_nOccluder, rSlot.m_arrOccluders );
+        rSlot.m_arrOpen.Add( m_arrOpen[ cOpen ] );
+        rSlot.m_arrOpenState.Add( stateRoot );
+        TraverseOpen( rSlot.m_arrOpen, rSlot.m_arrOpenState, bRelative, visitorOpen, rSlot.m_arrDraw, rSlot.m_stats );
     }
+    rSlot.m_stats.m_nOccluded += visitorOpen.m_nOccluded;
+}
+
+void
+cOGLView::LeaveTask( void* pView, size_t nWorker, size_t )
+{
+    cOGLView* pThis = static_cast<cOGLView*>( pView );
+    cTraversalSlot& rSlot = pThis->m_parrSlots[ nWorker ];
+    if( ! rSlot.m_bReading )
+        return;
+    pThis->m_pModel->EndRead();
+    pThis->m_pModel->DetachReader();
+    rSlot.m_bReading = false;
+}
+
+void
+cOGLView::TraverseOpen( utl::cArray<cElement*>& rarrOpen, utl::cArray<cOpenState>& rarrState, bool bRelative, cOpenListVisitor& rVisitor, utl::cArray<const cElement*>* parrDraw, cTraversalStats& rStats )
+{
+    while( rarrOpen.HasData())
+    {
+        cElement* pElem = rarrOpen.PullTail();
+        ExpandElement( pElem, rarrState.PullTail(), bRelative, rVisitor, rarrState, parrDraw, rStats );
+    }
+}
+
+void
+cOGLView::ExpandElement( cElement* pElem, cOpenState stateElem, bool bRelative, cOpenListVisitor& rVisitor, utl::cArray<cOpenState>& rarrState, utl::cArray<const cElement*>* parrDraw, cTraversalStats& rStats )
+{
+    // get the descendands and push them to the open list; the occluded ones are culled by their bounds, the invisible
+    // ones by the classification of all the siblings at once, against the planes the element straddles
+    size_t nFirst = rVisitor.GetOpen().GetCount();
+    rVisitor.SetParent( pElem, stateElem.m_nOccluder );
+    m_pModel->EnumerateDescendants( pElem, rVisitor );
+    ClassifyOpen( rVisitor.GetOpen(), rarrState, nFirst, stateElem.m_nPlanes, rVisitor.GetOccluder(), bRelative, parrDraw, rStats );
+}
+
+size_t
+cOGLView::CopyOccluders( const utl::cArray<cOccluder>& rarrFrom, size_t nOccluder, utl::cArray<cOccluder>& rarrTo )
+{
+    if( nOccluder == nNoOccluder )
+        return nNoOccluder;
+    // the chain is copied from the bottom up, each occluder linking to the next one added
+    size_t nFirst = rarrTo.GetCount();
+    size_t cLink;
+    for( cLink = nOccluder; cLink != nNoOccluder; cLink = rarrFrom[ cLink ].m_nUp )
+    {
+        rarrTo.Add( rarrFrom[ cLink ] );
+        rarrTo[ rarrTo.GetCount() - 1 ].m_nUp = rarrTo.GetCount();
+    }
+    rarrTo[ rarrTo.GetCount() - 1 ].m_nUp = nNoOccluder;
+    return nFirst;
+}
+
+void
+cOGLView::DrawQueues( const cTraversalStats& rStats )
+{
+    (void) rStats; // only the debug dump reads the statistics
 #ifdef _DEBUG_DUMP_
-    std::cerr << "Processed: " << nProcessed << ", Culled:" << nCulled << ", Ocluded: " << nOcluded;
+    std::cerr << "Processed: " << rStats.m_nProcessed << ", Culled:" << rStats.m_nCulled << ", Ocluded: " << rStats.m_nOccluded;
 #endif
     int cQueue;
     for( cQueue = 0; cQueue < nDrawQueues; cQueue ++ )
     {
         size_t nEnq = 0;
-        while( alstDraw [ cQueue ].HasData())
+        while( m_arrDraw[ cQueue ].HasData())
         {
-            DrawElement( alstDraw [ cQueue ].PullHead(), (LevelOfSDetail) cQueue);
+            DrawElement( m_arrDraw[ cQueue ].PullTail(), (LevelOfSDetail) cQueue);
             nEnq ++;
         }
+        // the queues of the workers are empty unless the traversal was parallel
+        size_t cSlot;
+        for( cSlot = 0; cSlot < m_nSlots; cSlot ++ )
+            while( m_parrSlots[ cSlot ].m_arrDraw[ cQueue ].HasData())
+            {
+                DrawElement( m_parrSlots[ cSlot ].m_arrDraw[ cQueue ].PullTail(), (LevelOfSDetail) cQueue);
+                nEnq ++;
+            }
 #ifdef _DEBUG_DUMP_
         std::cerr << ", Queued for drawing in " << cQueue << ":" << nEnq;
 #endif
@@ -315,4 +817,353 @@ cOGLView::DisplayImpl()
 #endif
 }
 
+///////////////////////////////////////////////////////////
+// cOGLView coherent traversal implementation
+
+void
+cOGLView::UpdateCut()
+{
+    // the cut being built last frame is the previous one now
+    cCutNode* parrSwap = m_parrCutPrev;
+    m_parrCutPrev = m_parrCut;
+    m_parrCut = parrSwap;
+    size_t nSwap = m_nCutPrevCapacity;
+    m_nCutPrevCapacity = m_nCutCapacity;
+    m_nCutCapacity = nSwap;
+    m_nCutPrev = m_nCut;
+    m_nCut = 0;
+
+    geom::scalar sStep = 0;
+    bool bKeep = CameraMotion( sStep ) && m_nCutPrev;
+    m_sMotion += sStep;
+    m_nCutClassified = 0;
+    m_nCutEnumerated = 0;
+    m_arrOccluders.Clear();
+    // a node without a key is enumerated again by its ancestors, so only a root gone from the model starts over
+    if( ! bKeep || ! BuildReused( 0, nullptr ))
+    {
+        m_nCut = 0;
+        BuildFresh( m_pModel->GetRootElement() );
+    }
+    m_pCutModel = m_pModel;
+#ifdef _DEBUG_DUMP_
+    std::cerr << "Cut: " << m_nCut << ", Reused:" << ( bKeep ? "yes" : "no" ) << ", Classified: " << m_nCutClassified
+              << ", Enumerated: " << m_nCutEnumerated << ", Motion: " << sStep << std::endl;
+#endif
+}
+
+void
+cOGLView::DrawCut()
+{
+    int cQueue;
+    for( cQueue = 0; cQueue < nDrawQueues; cQueue ++ )
+    {
+        size_t cNode;
+        for( cNode = 0; cNode < m_nCut; cNode ++ )
+        {
+            const cCutNode& rNode = m_parrCut[ cNode ];
+            if( rNode.m_oc.m_bVisible && rNode.m_oc.m_LOD == cQueue )
+                DrawElement( &rNode.m_elem, (LevelOfSDetail) cQueue );
+        }
+    }
+}
+
+bool
+cOGLView::CameraMotion( geom::scalar& rsMotion )
+{
+    geom::cPoint3d ptEye = m_pVP->GetEyePoint();
+    geom::cVector3d arrvecBasis[ geom::gnDim3d - 1 ];
+    arrvecBasis[ 0 ] = m_pVP->GetViewDirection();
+    arrvecBasis[ 1 ] = arrvecBasis[ 0 ] ^ m_pVP->GetUpDirection();
+    arrvecBasis[ 1 ].Normalize();
+    arrvecBasis[ 2 ] = arrvecBasis[ 1 ] ^ arrvecBasis[ 0 ];
+
+    // the FOV, the aspect and the window height move the planes and the LOD thresholds in ways the motion doesn't bound
+    bool bKeep = m_pCutModel == m_pModel && m_sCutFOV == m_pVP->GetFOV() && m_sCutAspect == m_pVP->GetAspect() &&
+                 m_sCutPixelScale == m_pVP->GetPixelScale() && m_bCutRelative == m_pVP->IsRelative();
+    if( bKeep )
+    {
+        // a point moves in the camera CS by no more than the eye translation plus the distance times the norm
+        // of the basis rotation difference, which is the Frobenius norm over sqrt(2) for rotations. We measure the
+        // motion by the larger of the two, so that it adds up over the frames; the distance grows by the translation
+        // meanwhile, so a motion M moves a point at distance D by no more than M * ( 1 + D + M ), see ClassifyCutNode()
+        geom::cVector3d vecEye = ptEye - m_ptCutEye;
+        geom::scalar sRotation2 = 0;
+        size_t cAxis;
+        for( cAxis = 0; cAxis < geom::gnDim3d - 1; cAxis ++ )
+        {
+            geom::cVector3d vecAxis = arrvecBasis[ cAxis ] + m_arrvecCutBasis[ cAxis ] * -1;
+            sRotation2 += vecAxis * vecAxis;
+        }
+        geom::scalar sTranslation = sqrt( vecEye * vecEye );
+        geom::scalar sRotation = sqrt( sRotation2 / 2 );
+        rsMotion = sTranslation > sRotation ? sTranslation : sRotation;
+    }
+    m_ptCutEye = ptEye;
+    size_t cAxis;
+    for( cAxis = 0; cAxis < geom::gnDim3d - 1; cAxis ++ )
+        m_arrvecCutBasis[ cAxis ] = arrvecBasis[ cAxis ];
+    m_sCutFOV = m_pVP->GetFOV();
+    m_sCutAspect = m_pVP->GetAspect();
+    m_sCutPixelScale = m_pVP->GetPixelScale();
+    m_bCutRelative = m_pVP->IsRelative();
+    return bKeep;
+}
+
+size_t
+cOGLView::AddCutNode()
+{
+    if( m_nCut == m_nCutCapacity )
+    {
+        size_t nCapacity = m_nCutCapacity ? m_nCutCapacity * 2 : nCutInitialCapacity;
+        cCutNode* parrCut = new cCutNode[ nCapacity ];
+        size_t cNode;
+        for( cNode = 0; cNode < m_nCut; cNode ++ )
+            parrCut[ cNode ] = m_parrCut[ cNode ];
+        delete[] m_parrCut;
+        m_parrCut = parrCut;
+        m_nCutCapacity = nCapacity;
+    }
+    return m_nCut ++;
+}
+
+void
+cOGLView::ClassifyCutNode( size_t nNode )
+{
+    cCutNode& rNode = m_parrCut[ nNode ];
+    const cCutElement* pElem = &rNode.m_elem;
+    if( m_pVP->IsRelative())
+    {
+        float arrfCenter[ geom::gnDim3d - 1 ];
+        m_pVP->ToRelative( pElem->GetCenter(), arrfCenter );
+        ClassifyElement( pElem, arrfCenter, rNode.m_oc );
+    }
+    else
+        ClassifyElement( pElem, rNode.m_oc );
+    m_nCutClassified ++;
+
+    // the view depth is a camera CS coordinate, the LOD changes at fixed depths
+    geom::cVector3d vecEye = pElem->GetCenter() - m_pVP->GetEyePoint();
+    geom::scalar sDistance = sqrt( vecEye * vecEye );
+    geom::scalar sDepth = m_pVP->ViewDepth( pElem->GetCenter());
+    geom::scalar sR = pElem->GetBoundingSphereRadius();
+    geom::scalar sGap = HUGE_VAL;
+    size_t cLOD;
+    for( cLOD = 0; cLOD < nLODThresholds; cLOD ++ )
+    {
+        geom::scalar sLOD = fabs( sDepth - sR * m_arrsLODDepth[ cLOD ] );
+        if( sLOD < sGap )
+            sGap = sLOD;
+    }
+    // so are the frustum plane distances
+    if( rNode.m_oc.m_LOD != Invisible )
+    {
+        geom::scalar sVisible = fabs( rNode.m_oc.m_sMinDistance + sR );
+        geom::scalar sTreeVisible = fabs( rNode.m_oc.m_sMinDistance + pElem->GetDescendantSphereRadius());
+        // between the cap and the sphere the plane normals decide as well, so such a node is classified again on any motion
+        geom::scalar sCap = pElem->GetDescendantCapDistance();
+        if( rNode.m_oc.m_sMinDistance < - sCap )
+        {
+            if( rNode.m_oc.m_sMinDistance >= - pElem->GetDescendantSphereRadius())
+                sTreeVisible = 0;
+        }
+        else
+        if( fabs( rNode.m_oc.m_sMinDistance + sCap ) < sTreeVisible )
+            sTreeVisible = fabs( rNode.m_oc.m_sMinDistance + sCap );
+        geom::scalar sFrustum = sVisible < sTreeVisible ? sVisible : sTreeVisible;
+        if( sFrustum < sGap )
+            sGap = sFrustum;
+    }
+    // the classification holds while the least gap isn't crossed, that is for the motions M with
+    // M * ( 1 + distance + M ) <= gap, see CameraMotion(); the root is taken in the form that doesn't cancel
+    geom::scalar sLinear = 1 + sDistance;
+    geom::scalar sSlack = 2 * sGap / ( sqrt( sLinear * sLinear + 4 * sGap ) + sLinear );
+    rNode.m_sDeadline = m_sMotion + sSlack;
+}
+
+bool
+cOGLView::BuildFresh( cElement* pElem )
+{
+    size_t nNode = AddCutNode();
+    m_parrCut[ nNode ].m_elem.Assign( pElem );
+    m_parrCut[ nNode ].m_nKey = m_pModel->GetElementKey( pElem );
+    ClassifyCutNode( nNode );
+    m_parrCut[ nNode ].m_sChildDeadline = HUGE_VAL;
+    if( m_parrCut[ nNode ].m_oc.m_bTreeVisible )
+        ExpandCutNode( nNode, pElem, nNoCutNode );
+    CloseCutNode( nNode );
+    return true;
+}
+
+bool
+cOGLView::BuildReused( size_t nPrev, cElement* pElem )
+{
+    const cCutNode& rPrev = m_parrCutPrev[ nPrev ];
+    size_t cNode;
+    if( m_sMotion < rPrev.m_sSubtreeDeadline )
+    {
+        // nothing in the subtree could have changed
+        for( cNode = nPrev; cNode < nPrev + rPrev.m_nSubtree; cNode ++ )
+        {
+            size_t nNode = AddCutNode(); // may move m_parrCut
+            m_parrCut[ nNode ] = m_parrCutPrev[ cNode ];
+        }
+        return true;
+    }
+    size_t nNode = AddCutNode();
+    m_parrCut[ nNode ] = rPrev;
+    if( m_sMotion >= rPrev.m_sDeadline )
+        ClassifyCutNode( nNode );
+    if( ! m_parrCut[ nNode ].m_oc.m_bTreeVisible )
+    {
+        m_parrCut[ nNode ].m_sChildDeadline = HUGE_VAL;
+        CloseCutNode( nNode );
+        return true;
+    }
+    bool bPrevExpanded = rPrev.m_oc.m_bTreeVisible;
+    bool bReused = false;
+    if( bPrevExpanded && m_sMotion < rPrev.m_sChildDeadline )
+    {
+        // the same children survive the occlusion, each of them checks its own subtree, below the element's occluder
+        size_t nUp = m_nCutOccluder;
+        size_t nOccluders = m_arrOccluders.GetCount();
+        PushCutOccluder( &m_parrCut[ nNode ].m_elem );
+        bool bBuilt = true;
+        for( cNode = nPrev + 1; bBuilt && cNode < nPrev + rPrev.m_nSubtree; cNode += m_parrCutPrev[ cNode ].m_nSubtree )
+            bBuilt = BuildReused( cNode, nullptr );
+        m_arrOccluders.Truncate( nOccluders );
+        m_nCutOccluder = nUp;
+        // a node below has no key to get its children by; they are enumerated again from here
+        if( ! bBuilt )
+            m_nCut = nNode + 1;
+        bReused = bBuilt;
+    }
+    if( ! bReused )
+    {
+        if( ! pElem )
+            pElem = m_pModel->GetKeyElement( rPrev.m_nKey );
+        // without a key the nearest ancestor with one enumerates the subtree again
+        if( ! pElem )
+            return false;
+        if( ! ExpandCutNode( nNode, pElem, bPrevExpanded ? nPrev : nNoCutNode ))
+            return false;
+    }
+    CloseCutNode( nNode );
+    return true;
+}
+
+bool
+cOGLView::ExpandCutNode( size_t nNode, cElement* pElem, size_t nPrev )
+{
+    utl::cSmallArray<cElement*, nInlineChildren> arrChildren;
+    cOpenListVisitor visitorChildren( this, arrChildren, m_arrOccluders, true );
+    size_t nUp = m_nCutOccluder;
+    size_t nOccluders = m_arrOccluders.GetCount();
+    visitorChildren.SetParent( pElem, nUp );
+    m_pModel->EnumerateDescendants( pElem, visitorChildren );
+    m_nCutEnumerated ++;
+    // the occlusion of the children holds while the eye moves less than the slack, and it moves less than the motion
+    m_parrCut[ nNode ].m_sChildDeadline = m_sMotion + visitorChildren.m_sOcclusionSlack;
+
+    // the subtrees are tested against the element as well, till they are built
+    m_nCutOccluder = visitorChildren.GetOccluder();
+    bool bBuilt = true;
+    while( bBuilt && arrChildren.HasData())
+    {
+        cElement* pChild = arrChildren.PullTail();
+        // the children visited before keep what is still valid in their subtrees
+        size_t nPrevChild = nNoCutNode;
+        elementkey nKey = nPrev == nNoCutNode ? gnInvalidElementKey : m_pModel->GetElementKey( pChild );
+        if( nKey != gnInvalidElementKey )
+        {
+            size_t cNode;
+            for( cNode = nPrev + 1; cNode < nPrev + m_parrCutPrev[ nPrev ].m_nSubtree; cNode += m_parrCutPrev[ cNode ].m_nSubtree )
+                if( m_parrCutPrev[ cNode ].m_nKey == nKey )
+                {
+                    nPrevChild = cNode;
+                    break;
+                }
+        }
+        if( nPrevChild == nNoCutNode )
+            BuildFresh( pChild );
+        else
+            bBuilt = BuildReused( nPrevChild, pChild );
+    }
+    m_arrOccluders.Truncate( nOccluders );
+    m_nCutOccluder = nUp;
+    return bBuilt;
+}
+
+void
+cOGLView::PushCutOccluder( const cElement* pElem )
+{
+    // a proxy is never drawn, so it hides nothing
+    if( pElem->IsProxy())
+        return;
+    size_t nOccluder = m_arrOccluders.GetCount();
+    m_arrOccluders.Add( cOccluder());
+    SetupOccluder( pElem->GetCenter(), pElem->GetBoundingSphereRadius(), m_nCutOccluder, m_arrOccluders[ nOccluder ] );
+    m_nCutOccluder = nOccluder;
+}
+
+void
+cOGLView::CloseCutNode( size_t nNode )
+{
+    cCutNode& rNode = m_parrCut[ nNode ];
+    rNode.m_nSubtree = m_nCut - nNode;
+    geom::scalar sDeadline = rNode.m_sDeadline < rNode.m_sChildDeadline ? rNode.m_sDeadline : rNode.m_sChildDeadline;
+    size_t cNode;
+    for( cNode = nNode + 1; cNode < m_nCut; cNode += m_parrCut[ cNode ].m_nSubtree )
+        if( m_parrCut[ cNode ].m_sSubtreeDeadline < sDeadline )
+            sDeadline = m_parrCut[ cNode ].m_sSubtreeDeadline;
+    rNode.m_sSubtreeDeadline = sDeadline;
+}
+
+///////////////////////////////////////////////////////////
+// cOGLView::cCutElement implementation
+
+cOGLView::cCutElement::cCutElement()
+    : m_sRadius( 0 ), m_sDescendantRadius( 0 ), m_sDescendantCap( 0 ), m_bProxy( false )
+{
+}
+
+cOGLView::cCutElement::~cCutElement()
+{
+}
+
+void
+cOGLView::cCutElement::Assign( const cElement* pElem )
+{
+    m_matLCS = pElem->GetLocalCS();
+    m_nHierarchyDepth = pElem->GetHierarchyDepth();
+    m_sRadius = pElem->GetBoundingSphereRadius();
+    m_sDescendantRadius = pElem->GetDescendantSphereRadius();
+    m_sDescendantCap = pElem->GetDescendantCapDistance();
+    m_bProxy = pElem->IsProxy();
+}
+
+geom::scalar
+cOGLView::cCutElement::GetBoundingSphereRadius() const
+{
+    return m_sRadius;
+}
+
+geom::scalar
+cOGLView::cCutElement::GetDescendantSphereRadius() const
+{
+    return m_sDescendantRadius;
+}
+
+geom::scalar
+cOGLView::cCutElement::GetDescendantCapDistance() const
+{
+    return m_sDescendantCap;
+}
+
+bool
+cOGLView::cCutElement::IsProxy() const
+{
+    return m_bProxy;
+}
+
 } // NS end
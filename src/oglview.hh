@@ -25,16 +25,32 @@
 #define _MVC_OGLVIEW_
 #include "view.hh"
 #include "viewport.hh"
+#include "array.hh"
+#include "task-pool.hh"
 
 /**
 @file  oglview.hh
 @brief  The cOGLView class implements the cView for OpenGL
 The cOGLView is as much cElement's implementation agnostic as possible
+When the viewport is in the camera-relative mode the classification, the occlusion tests and the drawing run in float
+on the element centers relative to the viewport anchor, see cViewport
+The coherent traversal keeps the cut of the previous frame: the visited elements with their classification and the
+camera motion up to which it holds. Only the elements whose deadline the accumulated motion has passed are classified
+again, and the model is asked for the children only where the expansion or the occlusion could have changed
+The full traversal classifies the children of an element together as they are opened, see ogl::cRelativeBatch, so
+the open stack holds only the elements whose descendants may be visible.
+The cOGLView calls the model and the stencil through their virtual interfaces; see cStaticOGLView for the traversal
+instantiated on the concrete types
+With a task pool and a model that admits several readers, the full traversal runs in parallel: the top levels are
+expanded breadth-first until there are enough subtrees for the workers, then each subtree is traversed by whichever
+worker takes it, into the draw queues of that worker. The queues are drawn after all the subtrees are done, so the GL
+calls stay on the thread of the frame
 */
 
 
 #ifdef _NO_CXX_11_
 #define override
+#define final
 #endif
 
 namespace mvc
@@ -55,6 +71,11 @@ namespace mvc
             #endif
             virtual ~cOGLView () override;
             void AssociateViewport( ogl::cViewport* ); //!< Associates a viewport with the view
+            void SetCoherent( bool bCoherent );        //!< Switches the reuse of the previous frame cut
+            bool IsCoherent() const;                   //!< Checks if the previous frame cut is reused
+            void SetTaskPool( utl::cTaskPool* pPool ); //!< Sets the workers of the parallel traversal, nullptr for none; started by the thread of the frames
+            void SetParallel( bool bParallel );        //!< Switches the parallel full traversal
+            bool IsParallel() const;                   //!< Checks if the full traversal runs in parallel, when there are workers and the model allows
 
         protected:
             virtual void DisplayImpl() override; //!< override this to do specific drawind
@@ -69,8 +90,49 @@ namespace mvc
                 High      = 2 ,
                 Highest   = 3
             };
+            static const size_t nLODThresholds = 4;
+            static const int nDrawQueues = 4; //!< a draw queue per LOD
+            static const size_t nInlineChildren = 16; //!< the children of an element kept without allocation
+            static const size_t nNoOccluder = static_cast<size_t>( -1 ); //!< the end of an occluder chain
+
+            ////////////////////////////////////////////////////////////////////
+            /// \brief The cOccluder struct - an element whose descendants are tested for occlusion, in both precisions
+            /// The eye sees the bounding sphere as a cone. What is inside the cone and behind the plane of the silhouette
+            /// circle is hidden, since the visible cap of the sphere is in front of that plane
+            struct cOccluder
+            {
+                geom::cPoint3d  m_ptCenter;   //!< the center
+                geom::scalar    m_sRadius;    //!< the bounding sphere radius
+                geom::cVector3d m_vecAxis;    //!< the cone axis, the unit direction from the eye to the center
+                geom::scalar    m_sSin;       //!< the sine of the cone half-angle, the radius over the eye distance
+                geom::scalar    m_sCos;       //!< the cosine of the cone half-angle
+                geom::scalar    m_sSilhouette;//!< the distance of the silhouette plane from the eye, along the axis
+                float           m_arrfAxis[ geom::gnDim3d - 1 ]; //!< the axis, for the relative mode
+                float           m_fSin;       //!< the sine, for the relative mode
+                float           m_fCos;       //!< the cosine, for the relative mode
+                float           m_fSilhouette;//!< the silhouette distance, for the relative mode
+                bool            m_bOccludes;  //!< the eye is outside the sphere, otherwise it hides nothing
+                size_t          m_nUp;        //!< the occluder of the parent element, nNoOccluder for none
+            };
+
+            ////////////////////////////////////////////////////////////////////
+            /// \brief The cOpenState struct - what the traversal keeps along with each open element
+            struct cOpenState
+            {
+                unsigned char m_nPlanes;   //!< the clip planes the element straddles, see ogl::cViewport
+                size_t        m_nOccluder; //!< the occluder of its parent, the first of the chain its children are tested against
+            };
+
+            utl::cArray<cElement*>       m_arrOpen;                  //!< the open stack of the traversal, of the classified elements to expand; kept between the frames
+            utl::cArray<cOpenState>      m_arrOpenState;             //!< the state of each open element
+            utl::cArray<cOccluder>       m_arrOccluders;             //!< the elements expanded in the frame, chained along their paths
+            utl::cArray<const cElement*> m_arrDraw[ nDrawQueues ];   //!< the draw queues of the traversal, kept between the frames
 
             void SetupScene(); //!< Set up colors, lights, etc
+            void AnticipateCamera(); //!< Sets up the LOD thresholds of the frame and passes its camera to the model
+            void DisplayTraversal(); //!< Traverses the tree from the root and draws the visible elements
+            void DisplayParallel();  //!< Same, spreading the subtrees over the task pool
+            void PlaceElement( const geom::cMatrix3d& matLCS, geom::scalar sR ); //!< Pushes the GL matrix and places the unit sphere at the element
             void DrawElement( const cElement*, LevelOfSDetail ); //!< Draws a single element
 
 
@@ -79,11 +141,248 @@ namespace mvc
                 LevelOfSDetail m_LOD;           //!< Calculated level of detail
                 bool           m_bVisible;      //!< The element is (potentially) visible
                 bool           m_bTreeVisible;  //!< The element and its thescendants are (potentially) visible
+                unsigned char  m_nStraddled;    //!< The tested clip planes the descendant sphere isn't inside, the only ones to test the children against
+                geom::scalar   m_sMinDistance;  //!< The least distance to the frustum planes, not set for Invisible
+            };
+
+            ////////////////////////////////////////////////////////////////////
+            /// \brief The cTraversalStats struct - the statistics of a full traversal
+            struct cTraversalStats
+            {
+                size_t m_nProcessed;    //!< the elements classified
+                size_t m_nCulled;       //!< the elements culled with their descendants
+                size_t m_nOccluded;     //!< the children culled by the occlusion of their parent or of the larger elements above it
+            };
+
+            ////////////////////////////////////////////////////////////////////
+            /// \brief The cTraversalSlot struct - what a worker of the parallel traversal fills, kept between the frames
+            struct cTraversalSlot
+            {
+                utl::cArray<cElement*>       m_arrOpen;                  //!< the open stack of the subtrees the worker took, classified
+                utl::cArray<cOpenState>      m_arrOpenState;             //!< the state of each open element
+                utl::cArray<cOccluder>       m_arrOccluders;             //!< the elements the worker expanded and the paths of its subtrees
+                utl::cArray<cElement*>       m_arrDeferred;              //!< the subtrees left to the frame thread, when the worker can't read the model
+                utl::cArray<cOpenState>      m_arrDeferredState;         //!< the state of each deferred subtree
+                utl::cArray<const cElement*> m_arrDraw[ nDrawQueues ];   //!< the draw queues of the worker
+                bool                         m_bEntered;                 //!< the worker has taken a subtree this frame
+                bool                         m_bReading;                 //!< the worker is attached to the model and inside a read, till the frame ends
+                cTraversalStats              m_stats;                    //!< the statistics of the worker
+                char                         m_arrPad[ 64 ];             //!< keeps the next worker off the statistics cache line
             };
 
+            utl::cTaskPool* m_pPool;        //!< the workers of the parallel traversal, nullptr for none
+            bool            m_bParallel;    //!< the full traversal runs in parallel if it can
+            cTraversalSlot* m_parrSlots;    //!< a slot per worker
+            size_t          m_nSlots;       //!< the slots in m_parrSlots
+
+            class cOpenListVisitor;
+            bool CanTraverseParallel() const; //!< Checks if the parallel traversal applies to the current model
+            template<typename Element> void ClassifyOpen( utl::cArray<Element*>& rarrOpen, utl::cArray<cOpenState>& rarrState, size_t nFirst, unsigned nPlanes, size_t nOccluder, bool bRelative, utl::cArray<const Element*>* parrDraw, cTraversalStats& ); //!< Classifies the open elements from nFirst on in batches against the planes nPlanes, queues the visible ones for drawing and keeps only the ones to expand
+            void ExpandElement( cElement*, cOpenState, bool bRelative, cOpenListVisitor&, utl::cArray<cOpenState>& rarrState, utl::cArray<const cElement*>* parrDraw, cTraversalStats& ); //!< Opens the children of a classified element and classifies them; the visitor must push to the open stack
+            void TraverseOpen( utl::cArray<cElement*>& rarrOpen, utl::cArray<cOpenState>& rarrState, bool bRelative, cOpenListVisitor&, utl::cArray<const cElement*>* parrDraw, cTraversalStats& ); //!< Expands the open stack until it's empty
+            void TraverseSubtrees( size_t nBegin, size_t nEnd ); //!< Traverses the subtrees of the open list range in the calling worker
+            static size_t CopyOccluders( const utl::cArray<cOccluder>& rarrFrom, size_t nOccluder, utl::cArray<cOccluder>& rarrTo ); //!< Appends a copy of the occluder chain from nOccluder up, returns where it starts
+            static void SubtreeTask( void* pView, size_t nBegin, size_t nEnd ); //!< The task pool entry to TraverseSubtrees()
+            static void LeaveTask( void* pView, size_t nWorker, size_t ); //!< Ends the read the worker entered with its first subtree of the frame
+            void DrawQueues( const cTraversalStats& ); //!< Draws the queues of the frame and of the workers, emptying them
+
             void ClassifyElement( const cElement*, ObjectClassifier& );  //!< Classify visibility against the viewport
-            bool OccludesCompletely( const cElement*, const cElement* ); //!< Checks if an element cooludes the other completely
+            void ClassifyElement( const cElement*, const float* parrfCenter, ObjectClassifier& ); //!< Classify visibility in the relative coordinates
+            void ClassifyBounds( const geom::cPoint3d& ptCenter, geom::scalar sR, geom::scalar sDescR, geom::scalar sDescCap, const geom::cMatrix3d& matLCS, ObjectClassifier&, unsigned nPlanes = ogl::gnAllPlanes ); //!< Classifies the bounds of an element against the clip planes nPlanes
+            void ClassifyBounds( const float* parrfCenter, float fR, float fDescR, float fDescCap, const geom::cMatrix3d& matLCS, ObjectClassifier& ); //!< Same, in the relative coordinates
+            geom::scalar OcclusionMargin( const cOccluder&, const geom::cPoint3d& ptInner, geom::scalar sInnerDescR ) const; //!< How deep a descendant bounding sphere is in the hidden part of the occluder cone, occluded if not negative
+            float OcclusionMargin( const cOccluder&, const float* parrfInner, float fInnerDescR ) const; //!< Same, in the relative coordinates
+            geom::scalar OcclusionTolerance( const cOccluder&, const geom::cPoint3d& ptInner, geom::scalar sInnerDescR, bool bOccluded ) const; //!< The eye translation the outcome of the occlusion test holds for
+            void SetupLODThresholds(); //!< Computes the LOD thresholds for the current FOV and window height
+
+            void SetupOccluder( const geom::cPoint3d& ptCenter, geom::scalar sR, size_t nUp, cOccluder& ); //!< Sets up an occluder for the current eye, chained to the occluder nUp
+            bool OccludesChild( const utl::cArray<cOccluder>&, size_t nOccluder, const cChildBounds&, geom::scalar* psSlack ); //!< Tests a child against the chain of occluders from nOccluder up, optionally lowering the slack to the eye translation the outcome holds for
+
+            ////////////////////////////////////////////////////////////////////
+            /// \brief m_arrsLODDepth - the view depths in radii the LOD thresholds are crossed at, in the order they are tested
+            /// an element is projected below a threshold when its radius times the depth is nearer than its view depth
+            geom::scalar m_arrsLODDepth[ nLODThresholds ];
+            /// \brief m_arrfLODDepth - the float copy of m_arrsLODDepth for the relative mode
+            float m_arrfLODDepth[ nLODThresholds ];
+
+            ////////////////////////////////////////////////////////////////////
+            /// \brief The cCutElement class - the copy of a visited element, kept with the cut between the frames
+            class cCutElement final : public cElement
+            {
+            protected:
+                geom::scalar m_sRadius;           //!< the bounding sphere radius
+                geom::scalar m_sDescendantRadius; //!< the descendant bounding sphere radius
+                geom::scalar m_sDescendantCap;    //!< the descendant cap distance
+                bool         m_bProxy;            //!< the element is a proxy
+            public:
+                cCutElement();
+                virtual ~cCutElement() override;
+                void Assign( const cElement* );   //!< Copies the element geometry
+                virtual geom::scalar GetBoundingSphereRadius() const override;
+                virtual geom::scalar GetDescendantSphereRadius() const override;
+                virtual geom::scalar GetDescendantCapDistance() const override;
+                virtual bool IsProxy() const override;
+            };
+
+            ////////////////////////////////////////////////////////////////////
+            /// \brief The cCutNode struct - a visited element and its classification
+            /// The cut is kept in pre-order, every node followed by its subtree. The deadlines are values of the
+            /// accumulated camera motion m_sMotion, up to which the classification or the children stay valid
+            struct cCutNode
+            {
+                cCutElement      m_elem;             //!< the element copy, drawn and classified without the model
+                elementkey       m_nKey;             //!< the model key, to enumerate the children again
+                ObjectClassifier m_oc;               //!< the classification
+                size_t           m_nSubtree;         //!< the nodes in the subtree, this one included
+                geom::scalar     m_sDeadline;        //!< the motion the classification holds up to
+                geom::scalar     m_sChildDeadline;   //!< the motion the occlusion of the children holds up to
+                geom::scalar     m_sSubtreeDeadline; //!< the least deadline in the subtree
+            };
+
+            bool          m_bCoherent;       //!< the traversal reuses the previous frame cut
+            cModel*       m_pCutModel;       //!< the model the previous cut was built from, nullptr if there is none
+            cCutNode*     m_parrCut;         //!< the cut being built
+            size_t        m_nCut;            //!< the nodes in m_parrCut
+            size_t        m_nCutCapacity;    //!< the allocated nodes in m_parrCut
+            cCutNode*     m_parrCutPrev;     //!< the cut of the previous frame
+            size_t        m_nCutPrev;        //!< the nodes in m_parrCutPrev
+            size_t        m_nCutPrevCapacity;//!< the allocated nodes in m_parrCutPrev
+            geom::scalar  m_sMotion;         //!< the camera motion accumulated over the frames, see CameraMotion()
+            geom::cPoint3d  m_ptCutEye;      //!< the previous frame eye point
+            geom::cVector3d m_arrvecCutBasis[ geom::gnDim3d - 1 ]; //!< the previous frame view, right and up directions
+            geom::scalar  m_sCutFOV;         //!< the previous frame FOV
+            geom::scalar  m_sCutAspect;      //!< the previous frame aspect
+            geom::scalar  m_sCutPixelScale;  //!< the previous frame pixel scale, see ogl::cViewport::GetPixelScale()
+            bool          m_bCutRelative;    //!< the previous frame camera-relative mode
+            size_t        m_nCutOccluder;    //!< the occluder chain of the node being built, on the m_arrOccluders stack
+            size_t        m_nCutClassified;  //!< the statistics: the nodes classified in this frame
+            size_t        m_nCutEnumerated;  //!< the statistics: the nodes whose children were enumerated in this frame
+
+            void UpdateCut();                        //!< Updates the cut to the current camera
+            void DrawCut();                          //!< Draws the visible elements of the cut
+            bool CameraMotion( geom::scalar& rsMotion ); //!< Measures the camera motion since the previous frame, false if the cut can't be kept
+            size_t AddCutNode();                     //!< Appends an uninitialized node to the cut, growing it
+            void ClassifyCutNode( size_t nNode );    //!< Classifies a node and sets its deadline
+            bool BuildFresh( cElement* pElem );      //!< Appends a newly visited element and its subtree
+            bool BuildReused( size_t nPrev, cElement* pElem ); //!< Appends a node of the previous cut and its subtree, checking what the motion could have changed; pElem may be nullptr, false if the node has no element to expand
+            bool ExpandCutNode( size_t nNode, cElement* pElem, size_t nPrev ); //!< Enumerates the children of a node, reusing the previous ones by their keys
+            void CloseCutNode( size_t nNode );       //!< Sets the subtree size and deadline once the children are appended
+            void PushCutOccluder( const cElement* ); //!< Makes the element the first occluder of the nodes built below it
+
+            ////////////////////////////////////////////////////////////////////
+            /// \brief The cOpenListVisitor class
+            /// Culls the children of an element by their bounds and places the survivors on the open list,
+            /// so the occluded ones are never materialized
+            class cOpenListVisitor : public cChildVisitor
+            {
+            protected:
+                cOGLView*                 m_pView;    //!< the view doing the occlusion tests
+                utl::cArray<cElement*>&   m_rarrOpen; //!< the open stack of the traversal
+                utl::cArray<cOccluder>&   m_rarrOccluders; //!< the occluders of the traversal, the parents are added to
+                const cElement*           m_pParent;  //!< the element whose children are visited
+                size_t                    m_nOccluder;//!< the first occluder the children are tested against
+                bool                      m_bSlack;   //!< the occlusion slack is tracked
+            public:
+                size_t                    m_nOccluded; //!< the number of children culled so far
+                geom::scalar              m_sOcclusionSlack; //!< the least eye translation the occlusion of a child of the parent may change by, if tracked
+                cOpenListVisitor( cOGLView*, utl::cArray<cElement*>&, utl::cArray<cOccluder>&, bool bSlack = false );
+                virtual ~cOpenListVisitor() override;
+                void SetParent( const cElement*, size_t nUp ); //!< Sets the element whose children are to be visited and the occluder of its own parent
+                size_t GetOccluder() const;        //!< Retrieves the occluder chain of the children, to pass to their own SetParent()
+                utl::cArray<cElement*>& GetOpen(); //!< Retrieves the open stack the children go to
+                virtual bool Accept( const cChildBounds& ) override;
+                virtual void Visit( cElement* ) override;
+            };
     };
+
+    //////////////////////////////////////////////////
+    /// \brief cOGLView::ClassifyOpen
+    /// Classifies the tail of the open stack, typically the children just opened, and compacts it to the elements
+    /// whose descendants may be visible. The relative mode classifies them in batches, the other one by one.
+    /// The elements are known to be inside the clip planes not in nPlanes; the planes each kept one straddles go to
+    /// the state stack, so that its own children skip the rest; so does the occluder chain they were tested against
+    /// \param rarrOpen - the open stack
+    /// \param rarrState - the state stack, the state of each open element below nFirst
+    /// \param nFirst - the first element to classify
+    /// \param nPlanes - the clip planes to test
+    /// \param nOccluder - the occluder chain the elements passed, see cOpenListVisitor::GetOccluder()
+    /// \param bRelative - the viewport is in the camera-relative mode
+    /// \param parrDraw - the draw queue per LOD
+    /// \param rStats - the statistics to add to
+    template<typename Element> void cOGLView::ClassifyOpen( utl::cArray<Element*>& rarrOpen, utl::cArray<cOpenState>& rarrState, size_t nFirst, unsigned nPlanes, size_t nOccluder, bool bRelative, utl::cArray<const Element*>* parrDraw, cTraversalStats& rStats )
+    {
+        _ASSERT( rarrState.GetCount() == nFirst );
+        size_t nCount = rarrOpen.GetCount();
+        size_t nKept = nFirst;
+        size_t cFirst, cSphere;
+        rStats.m_nProcessed += nCount - nFirst;
+        for( cFirst = nFirst; cFirst < nCount; cFirst += ogl::gnBatchSpheres )
+        {
+            size_t nBatch = nCount - cFirst < ogl::gnBatchSpheres ? nCount - cFirst : ogl::gnBatchSpheres;
+            ObjectClassifier arrocBatch[ ogl::gnBatchSpheres ];
+            if( bRelative )
+            {
+                ogl::cRelativeBatch batch;
+                float arrfDescCap[ ogl::gnBatchSpheres ];
+                for( cSphere = 0; cSphere < nBatch; cSphere ++ )
+                {
+                    const Element* pElem = rarrOpen[ cFirst + cSphere ];
+                    float arrfCenter[ geom::gnDim3d - 1 ];
+                    m_pVP->ToRelative( pElem->GetCenter(), arrfCenter );
+                    batch.m_arrfX[ cSphere ] = arrfCenter[ geom::X ];
+                    batch.m_arrfY[ cSphere ] = arrfCenter[ geom::Y ];
+                    batch.m_arrfZ[ cSphere ] = arrfCenter[ geom::Z ];
+                    batch.m_arrfR[ cSphere ] = static_cast<float>( pElem->GetBoundingSphereRadius());
+                    batch.m_arrfDescR[ cSphere ] = static_cast<float>( pElem->GetDescendantSphereRadius());
+                    arrfDescCap[ cSphere ] = static_cast<float>( pElem->GetDescendantCapDistance());
+                }
+                batch.m_nCount = nBatch;
+                batch.m_nPlanes = nPlanes;
+                m_pVP->ClassifyRelative( batch, m_arrfLODDepth, nLODThresholds );
+                for( cSphere = 0; cSphere < nBatch; cSphere ++ )
+                {
+                    ObjectClassifier& rocElem = arrocBatch[ cSphere ];
+                    rocElem.m_LOD = static_cast<LevelOfSDetail>( batch.m_arrnLOD[ cSphere ] );
+                    rocElem.m_sMinDistance = batch.m_arrfMinDistance[ cSphere ];
+                    rocElem.m_bVisible = ( batch.m_nVisible >> cSphere & 1 ) != 0;
+                    rocElem.m_bTreeVisible = ( batch.m_nTreeVisible >> cSphere & 1 ) != 0;
+                    rocElem.m_nStraddled = batch.m_arrnStraddled[ cSphere ];
+                    // the rare spheres cut off farther than their cap are checked plane by plane, see ClassifyBounds()
+                    if( rocElem.m_bTreeVisible && batch.m_arrfMinDistance[ cSphere ] < - arrfDescCap[ cSphere ] )
+                    {
+                        const geom::cMatrix3d& matLCS = rarrOpen[ cFirst + cSphere ]->GetLocalCS();
+                        float arrfCenter[ geom::gnDim3d - 1 ] = { batch.m_arrfX[ cSphere ], batch.m_arrfY[ cSphere ], batch.m_arrfZ[ cSphere ] };
+                        float arrfAxis[ geom::gnDim3d - 1 ] = { static_cast<float>( matLCS[ geom::X ][ geom::Z ] ), static_cast<float>( matLCS[ geom::Y ][ geom::Z ] ), static_cast<float>( matLCS[ geom::Z ][ geom::Z ] ) };
+                        rocElem.m_bTreeVisible = m_pVP->RelativeCappedSphereInFrustum( arrfCenter, arrfAxis, batch.m_arrfDescR[ cSphere ], arrfDescCap[ cSphere ] );
+                    }
+                }
+            }
+            else
+                for( cSphere = 0; cSphere < nBatch; cSphere ++ )
+                {
+                    const Element* pElem = rarrOpen[ cFirst + cSphere ];
+                    ClassifyBounds( pElem->GetCenter(), pElem->GetBoundingSphereRadius(), pElem->GetDescendantSphereRadius(), pElem->GetDescendantCapDistance(), pElem->GetLocalCS(), arrocBatch[ cSphere ], nPlanes );
+                }
+            // the kept elements move down over the culled ones, never past the one being looked at
+            for( cSphere = 0; cSphere < nBatch; cSphere ++ )
+            {
+                Element* pElem = rarrOpen[ cFirst + cSphere ];
+                const ObjectClassifier& rocElem = arrocBatch[ cSphere ];
+                if( ! rocElem.m_bTreeVisible )
+                {
+                    rStats.m_nCulled ++;
+                    continue;
+                }
+                // a proxy is only expanded, never drawn
+                if( rocElem.m_bVisible && ! pElem->IsProxy())
+                    parrDraw[ rocElem.m_LOD ].Add( pElem );
+                rarrOpen[ nKept ++ ] = pElem;
+                cOpenState stateElem = { rocElem.m_nStraddled, nOccluder };
+                rarrState.Add( stateElem );
+            }
+        }
+        rarrOpen.Truncate( nKept );
+    }
 }
 
 #endif
@@ -0,0 +1,497 @@
+/*
+* MIT License
+* 
+* Copyright (c) 2020 ibaylov@gmail.com
+* 
+* Permission is hereby granted, free of charge, to any person obtaining a copy
+* of this software and associated documentation files (the "Software"), to deal
+* in the Software without restriction, including without limitation the rights
+* to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+* copies of the Software, and to permit persons to whom the Software is
+* furnished to do so, subject to the following conditions:
+* 
+* The above copyright notice and this permission notice shall be included in all
+* copies or substantial portions of the Software.
+* 
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+* AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+* OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+* SOFTWARE.
+*/
+#include "page-cache.hh"
+#include "assert.hh"
+#include <cstring>
+#include <cstdio>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+namespace mvc
+{
+
+////////////////////////////////////////////////////
+/// \brief gszPageFileMagic - the page file signature
+///
+const char gszPageFileMagic[ 8 ] = { 'F', 'S', 'P', 'H', 'P', 'A', 'G', 'E' };
+
+////////////////////////////////////////////////////
+/// \brief gnPageByteOrderProbe - reads back differently on a machine with another byte order
+///
+const unsigned gnPageByteOrderProbe = 0x01020304;
+
+////////////////////////////////////////////////////
+/// \brief gnPageAlign - the page size on disk is rounded to this, which covers the usual system page sizes
+///
+const size_t gnPageAlign = 4096;
+
+////////////////////////////////////////////////////
+/// \brief gnPageRequestsPerFrame - the read-ahead requests issued in a frame at most
+/// this bounds both the syscalls per frame and the evictions a camera jump can cause
+const size_t gnPageRequestsPerFrame = 64;
+
+////////////////////////////////////////////////////
+/// \brief gnPageRetryFrames - how often the read-ahead is repeated for the pages that haven't arrived
+/// the kernel may drop a page read ahead before we got to see it resident
+const unsigned gnPageRetryFrames = 16;
+
+const pageindex gnNoPage = ~0ull;   //!< marks the empty hash buckets
+const unsigned  gnNoSlot = ~0u;     //!< the slot of an absent page
+
+///////////////////////////////////////////////////////////////////////////////
+// cPageFile implementation
+
+cPageFile::cPageFile()
+    : m_hFile( -1 ), m_szPath( nullptr ), m_pPage( nullptr )
+{
+    memset( &m_header, 0, sizeof( m_header ));
+    m_szTemp[ 0 ] = 0;
+}
+
+cPageFile::~cPageFile()
+{
+    Discard();
+}
+
+bool
+cPageFile::Create( const char* szPath, snapshotkey nKey, size_t nPageDepth )
+{
+    Discard();
+    if( ! nPageDepth || snprintf( m_szTemp, sizeof( m_szTemp ), "%s.%ld.tmp", szPath, static_cast<long>( getpid())) >= static_cast<int>( sizeof( m_szTemp )))
+        return false;
+    m_hFile = open( m_szTemp, O_WRONLY | O_CREAT | O_TRUNC, 0644 );
+    if( m_hFile < 0 )
+        return false;
+    m_szPath = szPath;
+    m_pPage = new cPagedNode[ gnPageNodes ];
+
+    memcpy( m_header.m_szMagic, gszPageFileMagic, sizeof( gszPageFileMagic ));
+    m_header.m_nVersion = gnPageFileVersion;
+    m_header.m_nByteOrder = gnPageByteOrderProbe;
+    m_header.m_nRecordBytes = sizeof( cPagedNode );
+    m_header.m_nPageLevels = gnPageLevels;
+    m_header.m_nKey = nKey;
+    m_header.m_nPageDepth = nPageDepth;
+    m_header.m_nPages = GetPageCount( nPageDepth );
+    m_header.m_nPageBytes = GetPageBytes();
+    m_header.m_nDataOffset = gnPageAlign;
+    return true;
+}
+
+cPagedNode*
+cPageFile::GetPageBuffer()
+{
+    _ASSERT( m_pPage );
+    return m_pPage;
+}
+
+bool
+cPageFile::WritePage( pageindex nPage )
+{
+    _ASSERT( m_hFile >= 0 && nPage < m_header.m_nPages );
+    size_t nBytes = gnPageNodes * sizeof( cPagedNode );
+    return pwrite( m_hFile, m_pPage, nBytes, m_header.m_nDataOffset + nPage * m_header.m_nPageBytes ) == static_cast<ssize_t>( nBytes );
+}
+
+bool
+cPageFile::Commit()
+{
+    _ASSERT( m_hFile >= 0 );
+    // the header goes last, so a file cut short by a crash is never taken for a valid one
+    bool bOK = ftruncate( m_hFile, m_header.m_nDataOffset + m_header.m_nPages * m_header.m_nPageBytes ) == 0;
+    bOK = bOK && pwrite( m_hFile, &m_header, sizeof( m_header ), 0 ) == static_cast<ssize_t>( sizeof( m_header ));
+    bOK = ( close( m_hFile ) == 0 ) && bOK;
+    m_hFile = -1;
+    bOK = bOK && rename( m_szTemp, m_szPath ) == 0;
+    if( bOK )
+        m_szTemp[ 0 ] = 0;
+    Discard();
+    return bOK;
+}
+
+void
+cPageFile::Discard()
+{
+    if( m_hFile >= 0 )
+        close( m_hFile );
+    m_hFile = -1;
+    if( m_szTemp[ 0 ] )
+        unlink( m_szTemp );
+    m_szTemp[ 0 ] = 0;
+    delete [] m_pPage;
+    m_pPage = nullptr;
+}
+
+size_t
+cPageFile::GetPageBytes()
+{
+    return ( gnPageNodes * sizeof( cPagedNode ) + gnPageAlign - 1 ) & ~( gnPageAlign - 1 );
+}
+
+pageindex
+cPageFile::GetPageCount( size_t nPageDepth )
+{
+    pageindex nPages = 0, nLevel = 1;
+    size_t cLevel;
+    for( cLevel = 0; cLevel < nPageDepth; cLevel ++ )
+    {
+        nPages += nLevel;
+        nLevel *= gnPageFanout;
+    }
+    return nPages;
+}
+
+pageindex
+cPageFile::GetChildPage( pageindex nPage, size_t nLeaf )
+{
+    _ASSERT( nLeaf < gnPageFanout );
+    return nPage * gnPageFanout + 1 + nLeaf;
+}
+
+size_t
+cPageFile::GetLevelStart( size_t nLevel )
+{
+    _ASSERT( nLevel >= 1 && nLevel <= gnPageLevels + 1 );
+    size_t nStart = 0, nWidth = gnSphereChildren, cLevel;
+    for( cLevel = 1; cLevel < nLevel; cLevel ++ )
+    {
+        nStart += nWidth;
+        nWidth *= gnSphereChildren;
+    }
+    return nStart;
+}
+
+bool
+cPageFile::Locate( pathcode nPath, cPageAddress& addr )
+{
+    if( nPath == gnInvalidPath )
+        return false;
+    size_t nDepth = static_cast<size_t>( nPath >> gnPathDigitBits );
+    pathcode nDigits = nPath & ( ( 1ull << gnPathDigitBits ) - 1 );
+    size_t nPageLevel = nDepth / gnPageLevels;
+    size_t nInPage = nDepth % gnPageLevels;
+
+    // the digits are consumed from the root-most one, gnPageLevels at a time per page level
+    pathcode nDivisor = 1;
+    size_t cDigit;
+    for( cDigit = 0; cDigit < nDepth; cDigit ++ )
+        nDivisor *= gnSphereChildren;
+    pageindex nPage = 0;
+    size_t cLevel;
+    for( cLevel = 0; cLevel < nPageLevel; cLevel ++ )
+    {
+        nDivisor /= gnPageFanout;
+        nPage = GetChildPage( nPage, static_cast<size_t>( ( nDigits / nDivisor ) % gnPageFanout ));
+    }
+    // the rest are the path inside the page, the offset of the node in its level
+    size_t nOffset = static_cast<size_t>( nDigits % ( nDivisor ? nDivisor : 1 ));
+    addr.m_nPage = nPage;
+    addr.m_nFirst = nInPage ? GetLevelStart( nInPage + 1 ) + nOffset * gnSphereChildren : 0;
+    addr.m_bLastLevel = nInPage + 1 == gnPageLevels;
+    return true;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// cPageCache implementation
+
+cPageCache::cPageCache()
+    : m_pMapping( nullptr ), m_nMappedBytes( 0 ), m_pHeader( nullptr ), m_nSysPage( 0 ), m_pnResidency( nullptr ),
+      m_nFrame( 0 ), m_nFrameRequests( 0 ), m_nChildren( gnSphereChildren ), m_nSlots( 0 ), m_nUsed( 0 ), m_pnSlotPage( nullptr ), m_pnSlotState( nullptr ), m_pnSlotFrame( nullptr ),
+      m_hashSlots( gnNoPage )
+{
+    pthread_mutex_init( &m_mutex, nullptr );
+    ResetStats();
+}
+
+cPageCache::~cPageCache()
+{
+    Close();
+    pthread_mutex_destroy( &m_mutex );
+}
+
+bool
+cPageCache::Open( const char* szPath, snapshotkey nKey, size_t nBudgetBytes, size_t nChildren )
+{
+    Close();
+    _ASSERT( nChildren > 0 && nChildren <= gnSphereChildren );
+    m_nChildren = nChildren;
+    int hFile = open( szPath, O_RDONLY );
+    if( hFile < 0 )
+        return false;
+    struct stat statFile;
+    if( fstat( hFile, &statFile ) != 0 || static_cast<size_t>( statFile.st_size ) < sizeof( cPageFileHeader ))
+    {
+        close( hFile );
+        return false;
+    }
+    size_t nBytes = static_cast<size_t>( statFile.st_size );
+    void* pMapping = mmap( nullptr, nBytes, PROT_READ, MAP_SHARED, hFile, 0 );
+    close( hFile );
+    if( pMapping == MAP_FAILED )
+        return false;
+    m_pMapping = static_cast<const char*>( pMapping );
+    m_nMappedBytes = nBytes;
+    m_pHeader = static_cast<const cPageFileHeader*>( pMapping );
+
+    const cPageFileHeader& rHeader = *m_pHeader;
+    m_nSysPage = static_cast<size_t>( sysconf( _SC_PAGESIZE ));
+    m_nSlots = nBudgetBytes / cPageFile::GetPageBytes();
+    if( memcmp( rHeader.m_szMagic, gszPageFileMagic, sizeof( gszPageFileMagic )) != 0
+        || rHeader.m_nVersion != gnPageFileVersion
+        || rHeader.m_nByteOrder != gnPageByteOrderProbe
+        || rHeader.m_nRecordBytes != sizeof( cPagedNode )
+        || rHeader.m_nPageLevels != gnPageLevels
+        || rHeader.m_nKey != nKey
+        || rHeader.m_nPageDepth * gnPageLevels > gnPathMaxDepth
+        || rHeader.m_nPages != cPageFile::GetPageCount( static_cast<size_t>( rHeader.m_nPageDepth ))
+        || rHeader.m_nPageBytes != cPageFile::GetPageBytes()
+        || rHeader.m_nDataOffset % m_nSysPage || rHeader.m_nPageBytes % m_nSysPage
+        || rHeader.m_nDataOffset + rHeader.m_nPages * rHeader.m_nPageBytes > nBytes
+        || ! m_nSlots )
+    {
+        Close();
+        return false;
+    }
+    // the faults must not read ahead on their own, the pages are brought in only by Request()
+    madvise( pMapping, nBytes, MADV_RANDOM );
+
+    m_pnResidency = new unsigned char[ rHeader.m_nPageBytes / m_nSysPage ];
+    m_pnSlotPage = new pageindex[ m_nSlots ];
+    m_pnSlotState = new unsigned char[ m_nSlots ];
+    m_pnSlotFrame = new unsigned[ m_nSlots ];
+    m_hashSlots.Reserve( m_nSlots );
+    m_nUsed = 0;
+    m_nFrame = 0;
+    m_nFrameRequests = 0;
+    ResetStats();
+    return true;
+}
+
+void
+cPageCache::Close()
+{
+    if( m_pMapping )
+        munmap( const_cast<char*>( m_pMapping ), m_nMappedBytes );
+    m_pMapping = nullptr;
+    m_nMappedBytes = 0;
+    m_pHeader = nullptr;
+    delete [] m_pnResidency;
+    delete [] m_pnSlotPage;
+    delete [] m_pnSlotState;
+    delete [] m_pnSlotFrame;
+    m_pnResidency = nullptr;
+    m_pnSlotPage = nullptr;
+    m_pnSlotState = nullptr;
+    m_pnSlotFrame = nullptr;
+    m_hashSlots.Release();
+    m_nSlots = m_nUsed = 0;
+}
+
+const cPagedNode*
+cPageCache::GetChildren( pathcode nPath )
+{
+    _ASSERT( m_pMapping );
+    cPageAddress addr;
+    if( ! cPageFile::Locate( nPath, addr ) || addr.m_nPage >= m_pHeader->m_nPages )
+        return nullptr;
+    unsigned nSlot = FindSlot( addr.m_nPage );
+    if( nSlot == gnNoSlot || m_pnSlotState[ nSlot ] != Resident )
+    {
+        if( nSlot == gnNoSlot )
+            Request( addr.m_nPage );
+        else
+            m_pnSlotFrame[ nSlot ] = m_nFrame; // still wanted, so it must not give way to other requests
+        m_stats.m_nMisses ++;
+        return nullptr;
+    }
+    m_pnSlotFrame[ nSlot ] = m_nFrame;
+    m_stats.m_nHits ++;
+    // the children are the roots of the next page level, which the traversal is going to need soon
+    if( addr.m_bLastLevel )
+    {
+        size_t nLeaf = addr.m_nFirst - cPageFile::GetLevelStart( gnPageLevels );
+        size_t cChd;
+        for( cChd = 0; cChd < m_nChildren; cChd ++ ) // the pages below the unused slots are never built
+        {
+            pageindex nChildPage = cPageFile::GetChildPage( addr.m_nPage, nLeaf + cChd );
+            if( nChildPage < m_pHeader->m_nPages && FindSlot( nChildPage ) == gnNoSlot )
+                Request( nChildPage );
+        }
+    }
+    return GetPage( addr.m_nPage ) + addr.m_nFirst;
+}
+
+void
+cPageCache::NextFrame()
+{
+    // poll the requested pages; the ones that arrived may be used from the next frame on
+    bool bRetry = m_nFrame % gnPageRetryFrames == gnPageRetryFrames - 1;
+    size_t cSlot;
+    for( cSlot = 0; cSlot < m_nUsed; cSlot ++ )
+    {
+        if( m_pnSlotState[ cSlot ] != Requested )
+            continue;
+        if( IsPageResident( m_pnSlotPage[ cSlot ] ))
+        {
+            m_pnSlotState[ cSlot ] = Resident;
+            m_stats.m_nArrived ++;
+        }
+        else
+        if( bRetry )
+            madvise( const_cast<cPagedNode*>( GetPage( m_pnSlotPage[ cSlot ] )), m_pHeader->m_nPageBytes, MADV_WILLNEED );
+    }
+    m_nFrame ++;
+    m_nFrameRequests = 0;
+}
+
+void
+cPageCache::ResetStats()
+{
+    m_stats.m_nHits = 0;
+    m_stats.m_nMisses = 0;
+    m_stats.m_nRequested = 0;
+    m_stats.m_nArrived = 0;
+    m_stats.m_nEvicted = 0;
+    m_stats.m_nRejected = 0;
+}
+
+bool
+cPageCache::TryLock()
+{
+    return pthread_mutex_trylock( &m_mutex ) == 0;
+}
+
+void
+cPageCache::Lock()
+{
+    pthread_mutex_lock( &m_mutex );
+}
+
+void
+cPageCache::Unlock()
+{
+    pthread_mutex_unlock( &m_mutex );
+}
+
+bool
+cPageCache::IsOpen() const
+{
+    return m_pMapping != nullptr;
+}
+
+size_t
+cPageCache::GetLevels() const
+{
+    return m_pHeader ? static_cast<size_t>( m_pHeader->m_nPageDepth ) * gnPageLevels : 0;
+}
+
+size_t
+cPageCache::GetResidentPages() const
+{
+    size_t nResident = 0, cSlot;
+    for( cSlot = 0; cSlot < m_nUsed; cSlot ++ )
+        if( m_pnSlotState[ cSlot ] == Resident )
+            nResident ++;
+    return nResident;
+}
+
+const cPageStats&
+cPageCache::GetStats() const
+{
+    return m_stats;
+}
+
+const cPagedNode*
+cPageCache::GetPage( pageindex nPage ) const
+{
+    return reinterpret_cast<const cPagedNode*>( m_pMapping + m_pHeader->m_nDataOffset + nPage * m_pHeader->m_nPageBytes );
+}
+
+bool
+cPageCache::Request( pageindex nPage )
+{
+    if( m_nFrameRequests >= gnPageRequestsPerFrame )
+        return false; // the allowance of the frame is used up, the page will be asked for again
+    unsigned nSlot;
+    if( m_nUsed < m_nSlots )
+        nSlot = static_cast<unsigned>( m_nUsed ++ );
+    else
+    {
+        // the least recently used page not used in this frame gives way; the budget is small enough to scan it
+        nSlot = gnNoSlot;
+        size_t cSlot;
+        for( cSlot = 0; cSlot < m_nUsed; cSlot ++ )
+            if( m_pnSlotFrame[ cSlot ] != m_nFrame && ( nSlot == gnNoSlot || m_pnSlotFrame[ cSlot ] < m_pnSlotFrame[ nSlot ] ))
+                nSlot = static_cast<unsigned>( cSlot );
+        if( nSlot == gnNoSlot )
+        {
+            m_stats.m_nRejected ++;
+            return false;
+        }
+        Evict( nSlot );
+    }
+    m_pnSlotPage[ nSlot ] = nPage;
+    m_pnSlotState[ nSlot ] = Requested;
+    m_pnSlotFrame[ nSlot ] = m_nFrame;
+    m_hashSlots.Insert( nPage, nSlot );
+    // the kernel starts reading and returns at once
+    madvise( const_cast<cPagedNode*>( GetPage( nPage )), m_pHeader->m_nPageBytes, MADV_WILLNEED );
+    m_stats.m_nRequested ++;
+    m_nFrameRequests ++;
+    return true;
+}
+
+void
+cPageCache::Evict( unsigned nSlot )
+{
+    // the pages are clean file pages, so dropping them costs nothing but a later re-read
+    madvise( const_cast<cPagedNode*>( GetPage( m_pnSlotPage[ nSlot ] )), m_pHeader->m_nPageBytes, MADV_DONTNEED );
+    m_hashSlots.Remove( m_pnSlotPage[ nSlot ] );
+    m_stats.m_nEvicted ++;
+}
+
+unsigned
+cPageCache::FindSlot( pageindex nPage ) const
+{
+    const unsigned* pnSlot = m_hashSlots.Find( nPage );
+    return pnSlot ? *pnSlot : gnNoSlot;
+}
+
+bool
+cPageCache::IsPageResident( pageindex nPage )
+{
+    const char* pPage = reinterpret_cast<const char*>( GetPage( nPage ));
+    size_t nPages = m_pHeader->m_nPageBytes / m_nSysPage;
+    if( mincore( const_cast<char*>( pPage ), m_pHeader->m_nPageBytes, m_pnResidency ) != 0 )
+        return false;
+    size_t cPage;
+    for( cPage = 0; cPage < nPages; cPage ++ )
+        if( ! ( m_pnResidency[ cPage ] & 1 ))
+            return false;
+    return true;
+}
+
+} // NS end
@@ -0,0 +1,196 @@
+/*
+* MIT License
+* 
+* Copyright (c) 2020 ibaylov@gmail.com
+* 
+* Permission is hereby granted, free of charge, to any person obtaining a copy
+* of this software and associated documentation files (the "Software"), to deal
+* in the Software without restriction, including without limitation the rights
+* to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+* copies of the Software, and to permit persons to whom the Software is
+* furnished to do so, subject to the following conditions:
+* 
+* The above copyright notice and this permission notice shall be included in all
+* copies or substantial portions of the Software.
+* 
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+* AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+* OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+* SOFTWARE.
+*/
+#ifndef _MVC_PAGE_CACHE_
+#define _MVC_PAGE_CACHE_
+#include "node-snapshot.hh"
+#include "hashmap.hh"
+#include <pthread.h>
+
+/**
+@file  page-cache.hh
+@brief The out-of-core backing store for the deep levels of the fractal tree
+The page file holds a precomputed tree many levels deep, cut into subtrees of gnPageLevels levels. A page holds
+the descendants of its root node down to gnPageLevels below it, in breadth-first order, so the children of a node
+are 9 adjacent records and no links are stored; the root itself lives in the page above. The pages form a complete
+tree as well and are laid out breadth-first, so a page is found by arithmetic on the path code alone.
+At runtime the file is mapped and the pages are brought in asynchronously: a missing page is queued, the kernel is
+asked to read it ahead, and it is used only once mincore() reports it resident. Until then the traversal generates
+the children as before, so a frame never waits for the disk. The resident pages are kept under a budget and the
+least recently used ones are dropped from the process.
+The traversal threads share the cache under a lock they only try: a thread that finds it taken treats the page as
+missing. The records stay readable after the lock is released, since a dropped page is only read back from the file.
+*/
+
+namespace mvc
+{
+    ////////////////////////////////////////////////////////////////////
+    /// \brief pageindex - the number of a page in the page file
+    ///
+    typedef unsigned long long pageindex;
+
+    const size_t    gnPageLevels    = 2;    //!< the tree levels in a page, 90 records fit a 4 KB page
+    const size_t    gnPageNodes     = 9 + 81; //!< the nodes in a page, gnSphereChildren^1 + ... + gnSphereChildren^gnPageLevels
+    const size_t    gnPageFanout    = 81;   //!< the child pages of a page, gnSphereChildren^gnPageLevels
+    const nodeindex gnPagedNode     = gnInvalidNode - 1; //!< marks the elements materialized from a page
+    const unsigned  gnPageFileVersion = 1;  //!< bump this with every change of the page file layout
+    const size_t    gnPageBudgetDefault = 64 << 20; //!< the default resident pages budget, 16384 pages
+
+    ////////////////////////////////////////////////////////////////////
+    /// \brief The cPagedNode struct - a node record in a page
+    /// The radius and depth follow from the position in the tree
+    struct cPagedNode
+    {
+        geom::scalar    m_arrsCenter[ 3 ];      //!< the center in model space
+        short           m_arrnOrientation[ 4 ]; //!< the quantized quaternion, see cSphereNodeStore::QuantizeOrientation
+    };
+
+    ////////////////////////////////////////////////////////////////////
+    /// \brief The cPageFileHeader struct - the page file header
+    ///
+    struct cPageFileHeader
+    {
+        char               m_szMagic[ 8 ];     //!< "FSPHPAGE"
+        unsigned           m_nVersion;         //!< gnPageFileVersion
+        unsigned           m_nByteOrder;       //!< a probe value, catching files from a different byte order
+        unsigned           m_nRecordBytes;     //!< sizeof( cPagedNode ), catches the _GEOM_FLOAT_ builds
+        unsigned           m_nPageLevels;      //!< gnPageLevels
+        snapshotkey        m_nKey;             //!< the model signature
+        unsigned long long m_nPageDepth;       //!< the depth of the page tree; the file covers m_nPageDepth * gnPageLevels levels
+        unsigned long long m_nPages;           //!< the number of pages
+        unsigned long long m_nPageBytes;       //!< the page size, a multiple of the system page size
+        unsigned long long m_nDataOffset;      //!< the first page offset from the file start
+    };
+
+    ////////////////////////////////////////////////////////////////////
+    /// \brief The cPageAddress struct - where the children of a node are found
+    ///
+    struct cPageAddress
+    {
+        pageindex   m_nPage;        //!< the page holding the children
+        size_t      m_nFirst;       //!< the record of the first child in the page
+        bool        m_bLastLevel;   //!< the children are the page roots of the next page level
+    };
+
+    ////////////////////////////////////////////////////////////////////
+    /// \brief The cPageStats struct - the page cache performance counters
+    ///
+    struct cPageStats
+    {
+        size_t m_nHits;      //!< expansions served from a resident page
+        size_t m_nMisses;    //!< expansions that fell back to generation while the page was on its way
+        size_t m_nRequested; //!< pages queued for reading
+        size_t m_nArrived;   //!< pages that became resident
+        size_t m_nEvicted;   //!< pages dropped under the budget
+        size_t m_nRejected;  //!< requests declined because the budget was taken by the current frame
+    };
+
+    ////////////////////////////////////////////////////////////////////
+    /// \brief The cPageFile class
+    /// Creates the page file; the model fills the pages, since only it knows how to generate them
+    class cPageFile
+    {
+    protected:
+        int             m_hFile;    //!< the file being written
+        cPageFileHeader m_header;   //!< the header to be written
+        char            m_szTemp[ 4096 ]; //!< the temporary file, renamed to the final name on Commit()
+        const char*     m_szPath;   //!< the final file name
+        cPagedNode*     m_pPage;    //!< the page buffer
+    public:
+        cPageFile();    //!< Constructs a closed page file
+        ~cPageFile();   //!< Drops an uncommitted file
+        #ifndef _NO_CXX_11_
+        cPageFile( const cPageFile& ) = delete; //!< Prevent direct copy
+        #endif
+        // operations
+        bool        Create( const char* szPath, snapshotkey nKey, size_t nPageDepth ); //!< Starts a page file for nPageDepth page levels
+        cPagedNode* GetPageBuffer();                //!< Retrieves the buffer to fill a page in
+        bool        WritePage( pageindex nPage );   //!< Writes the page buffer as the given page
+        bool        Commit();                       //!< Writes the header and puts the file in place
+        void        Discard();                      //!< Drops the file
+        // page tree arithmetic, shared with the reader
+        static size_t    GetPageBytes();            //!< Retrieves the page size on disk
+        static pageindex GetPageCount( size_t nPageDepth ); //!< Retrieves the number of pages of a page tree
+        static pageindex GetChildPage( pageindex nPage, size_t nLeaf ); //!< Retrieves the page rooted at a last level record of a page
+        static bool      Locate( pathcode nPath, cPageAddress& addr );  //!< Finds the children of the node, false beyond 64-bit page numbers
+        static size_t    GetLevelStart( size_t nLevel ); //!< Retrieves the first record of a relative level, 1 being the page root children
+    };
+
+    ////////////////////////////////////////////////////////////////////
+    /// \brief The cPageCache class
+    /// Maps a page file and keeps the recently used pages resident
+    class cPageCache
+    {
+    protected:
+        enum PageState
+        {
+            Requested = 0,  //!< the read-ahead was issued, the page isn't known to be resident yet
+            Resident  = 1   //!< the page can be used without blocking
+        };
+        const char*             m_pMapping;     //!< the mapped file, nullptr if none
+        size_t                  m_nMappedBytes; //!< the mapping size
+        const cPageFileHeader*  m_pHeader;      //!< the header in the mapping
+        size_t                  m_nSysPage;     //!< the system page size
+        unsigned char*          m_pnResidency;  //!< the mincore() output for a page
+        unsigned                m_nFrame;       //!< the current frame number
+        size_t                  m_nFrameRequests; //!< the requests issued in the current frame
+        size_t                  m_nChildren;    //!< the children the model uses of every record group, for the read-ahead
+        cPageStats              m_stats;        //!< the performance counters
+        pthread_mutex_t         m_mutex;        //!< guards the frame, the counters, the slots and the hash, see TryLock()
+        // the resident pages
+        size_t                  m_nSlots;       //!< the pages the budget allows
+        size_t                  m_nUsed;        //!< the slots in use
+        pageindex*              m_pnSlotPage;   //!< the page in the slot
+        unsigned char*          m_pnSlotState;  //!< the PageState of the slot
+        unsigned*               m_pnSlotFrame;  //!< the frame the slot was last used or requested in
+        utl::cHashMap<pageindex, unsigned> m_hashSlots; //!< the slot of a resident or requested page
+    public:
+        cPageCache();   //!< Constructs a closed page cache
+        ~cPageCache();  //!< Unmaps the file
+        #ifndef _NO_CXX_11_
+        cPageCache( const cPageCache& ) = delete; //!< Prevent direct copy
+        #endif
+        // operations
+        bool  Open( const char* szPath, snapshotkey nKey, size_t nBudgetBytes, size_t nChildren = gnSphereChildren ); //!< Maps and validates the page file
+        void  Close();                                //!< Unmaps the file
+        const cPagedNode* GetChildren( pathcode nPath ); //!< Retrieves the 9 children records if their page is resident, queueing it otherwise
+        void  NextFrame();                            //!< Checks the queued pages for arrival and advances the frame counter
+        void  ResetStats();                           //!< Zeroes the performance counters
+        bool  TryLock();                              //!< Takes the lock for GetChildren() if it is free; never waits
+        void  Lock();                                 //!< Takes the lock, e.g. for NextFrame()
+        void  Unlock();                               //!< Releases the lock
+        // accessors
+        bool              IsOpen() const;             //!< Checks if a page file is mapped
+        size_t            GetLevels() const;          //!< Retrieves the deepest level the file covers
+        size_t            GetResidentPages() const;   //!< Retrieves the number of resident pages
+        const cPageStats& GetStats() const;           //!< Retrieves the performance counters
+    protected:
+        const cPagedNode* GetPage( pageindex nPage ) const; //!< Retrieves the page records in the mapping
+        bool      Request( pageindex nPage );         //!< Queues the page for reading
+        void      Evict( unsigned nSlot );            //!< Drops the page in the slot
+        unsigned  FindSlot( pageindex nPage ) const;  //!< Retrieves the slot of the page, gnNoSlot if none
+        bool      IsPageResident( pageindex nPage );  //!< Asks the kernel if the whole page is in memory
+    };
+}
+
+#endif
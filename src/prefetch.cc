@@ -0,0 +1,389 @@
+/*
+* MIT License
+* 
+* Copyright (c) 2020 ibaylov@gmail.com
+* 
+* Permission is hereby granted, free of charge, to any person obtaining a copy
+* of this software and associated documentation files (the "Software"), to deal
+* in the Software without restriction, including without limitation the rights
+* to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+* copies of the Software, and to permit persons to whom the Software is
+* furnished to do so, subject to the following conditions:
+* 
+* The above copyright notice and this permission notice shall be included in all
+* copies or substantial portions of the Software.
+* 
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+* AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+* OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+* SOFTWARE.
+*/
+#include "prefetch.hh"
+#include "fractal-model.hh"
+#include "assert.hh"
+#include <cmath>
+
+namespace mvc
+{
+
+///////////////////////////////////////////////////////////////////////////////
+// cPrefetcher::cViewVolume implementation
+
+void
+cPrefetcher::cViewVolume::Setup( const cCameraState& camState )
+{
+    // the frustum of gluPerspective() and gluLookAt(), built from the camera basis rather than read back from GL
+    m_ptEye = camState.m_ptEye;
+    geom::cVector3d vecView = camState.m_vecView;
+    vecView.Normalize();
+    m_vecView = vecView;
+    geom::cVector3d vecRight = vecView ^ camState.m_vecUp;
+    vecRight.Normalize();
+    geom::cVector3d vecUp = vecRight ^ vecView;
+    geom::scalar sTanV = tan( camState.m_sFOV / 2 );
+    geom::scalar sTanH = sTanV * camState.m_sAspect;
+
+    geom::cVector3d arrvecSide[ 4 ] = { vecRight + vecView * sTanH, vecRight * -1 + vecView * sTanH,
+                                        vecUp * -1 + vecView * sTanV, vecUp + vecView * sTanV };
+    int cPlane;
+    for( cPlane = 0; cPlane < 4; cPlane ++ )
+    {
+        arrvecSide[ cPlane ].Normalize();
+        m_arrPlanes[ cPlane ] = geom::cPlane3d( arrvecSide[ cPlane ], m_ptEye );
+    }
+    m_arrPlanes[ 4 ] = geom::cPlane3d( vecView * -1, m_ptEye + vecView * camState.m_sFar );
+    m_arrPlanes[ 5 ] = geom::cPlane3d( vecView, m_ptEye + vecView * camState.m_sNear );
+    // the view drops the elements projected smaller than the detail pixels, see cViewport::GetPixelScale()
+    m_sDetailDepth = camState.m_sHeight / 2 / sTanV / camState.m_sDetailPixels;
+}
+
+bool
+cPrefetcher::cViewVolume::IsExpanded( const geom::cPoint3d& ptCenter, geom::scalar sR, geom::scalar sDescR )
+{
+    int cPlane;
+    for( cPlane = 0; cPlane < 6; cPlane ++ )
+        if( m_arrPlanes[ cPlane ].PointDistance( ptCenter ) < - sDescR )
+            return false;
+    // the projected radius is R over the view depth, times the pixel scale
+    return sR * m_sDetailDepth >= ( ptCenter - m_ptEye ) * m_vecView;
+}
+
+bool
+cPrefetcher::cViewVolume::Occludes( const geom::cPoint3d& ptOuter, geom::scalar sOuterR, const geom::cPoint3d& ptInner, geom::scalar sInnerDescR )
+{
+    // inside the cone the eye sees the outer sphere as, and behind the plane of its silhouette; only the parent is
+    // tested, the walk doesn't keep the larger spheres above it
+    geom::cVector3d vecOuter = ptOuter - m_ptEye;
+    geom::scalar sOuter = vecOuter.Normalize();
+    if( sOuter <= sOuterR )
+        return false;
+    geom::scalar sTangent = sqrt( sOuter * sOuter - sOuterR * sOuterR );
+    geom::cVector3d vecInner = ptInner - m_ptEye;
+    geom::scalar sAlong = vecInner * vecOuter;
+    geom::scalar sOff2 = vecInner * vecInner - sAlong * sAlong;
+    geom::scalar sOff = sOff2 > 0 ? sqrt( sOff2 ) : 0;
+    return ( sAlong * sOuterR - sOff * sTangent ) / sOuter >= sInnerDescR && sAlong - sTangent * sTangent / sOuter >= sInnerDescR;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// cPrefetcher implementation
+
+cPrefetcher::cPrefetcher()
+    : m_pModel( nullptr ), m_bRunning( false ), m_bStop( false ), m_nCameras( 0 ), m_nSerial( 0 ),
+      m_pQueue( nullptr ), m_nHead( 0 ), m_nReady( 0 ), m_nFrame( 0 ),
+      m_pBatch( nullptr ), m_nBatch( 0 ), m_hashSent( gnInvalidPath ), m_pStack( nullptr ),
+      m_pExpand( nullptr ), m_parrmatExpand( nullptr ), m_parrmatChildren( nullptr )
+{
+    pthread_mutex_init( &m_mutex, nullptr );
+    pthread_cond_init( &m_condCamera, nullptr );
+    m_stats.m_nPredicted = m_stats.m_nQueued = m_stats.m_nAdopted = m_stats.m_nStale = m_stats.m_nBusy = 0;
+}
+
+cPrefetcher::~cPrefetcher()
+{
+    Stop();
+    pthread_cond_destroy( &m_condCamera );
+    pthread_mutex_destroy( &m_mutex );
+}
+
+bool
+cPrefetcher::Start( const cFractalcModel* pModel )
+{
+    _ASSERT( pModel && ! m_bRunning );
+    m_pModel = pModel;
+    m_bStop = false;
+    m_nCameras = 0;
+    m_nHead = m_nReady = m_nBatch = 0;
+    m_pQueue = new cPrefetchedGroup[ gnPrefetchGroups ];
+    m_pBatch = new cPrefetchedGroup[ gnPrefetchBatch ];
+    // the set is only a filter against the same groups queued over and over, so once full it may forget any path
+    m_hashSent.Reserve( gnPrefetchSent, true );
+    // a walk stack holds the unvisited siblings on every level and the children of the last batch
+    m_pStack = new cWalkItem[ gnPrefetchStack ];
+    m_pExpand = new cWalkItem[ gnPrefetchExpand ];
+    m_parrmatExpand = new geom::cMatrix3d[ gnPrefetchExpand ];
+    m_parrmatChildren = new geom::cMatrix3d[ gnPrefetchExpand * gnSphereChildren ];
+    m_bRunning = pthread_create( &m_thread, nullptr, ThreadProc, this ) == 0;
+    if( ! m_bRunning )
+        Stop();
+    return m_bRunning;
+}
+
+void
+cPrefetcher::Stop()
+{
+    if( m_bRunning )
+    {
+        pthread_mutex_lock( &m_mutex );
+        m_bStop = true;
+        pthread_cond_signal( &m_condCamera );
+        pthread_mutex_unlock( &m_mutex );
+        pthread_join( m_thread, nullptr );
+        m_bRunning = false;
+    }
+    delete [] m_pQueue;
+    delete [] m_pBatch;
+    delete [] m_pStack;
+    delete [] m_pExpand;
+    delete [] m_parrmatExpand;
+    delete [] m_parrmatChildren;
+    m_pQueue = m_pBatch = nullptr;
+    m_hashSent.Release();
+    m_pStack = m_pExpand = nullptr;
+    m_parrmatExpand = m_parrmatChildren = nullptr;
+    m_nReady = 0;
+}
+
+bool
+cPrefetcher::IsRunning() const
+{
+    return m_bRunning;
+}
+
+bool
+cPrefetcher::TryLock()
+{
+    _ASSERT( m_bRunning );
+    return pthread_mutex_trylock( &m_mutex ) == 0;
+}
+
+void
+cPrefetcher::Unlock()
+{
+    pthread_mutex_unlock( &m_mutex );
+}
+
+void
+cPrefetcher::SetCamera( const cCameraState& camState )
+{
+    if( m_nCameras )
+    {
+        m_arrCamera[ 0 ] = m_arrCamera[ 1 ];
+        m_arrnFrame[ 0 ] = m_arrnFrame[ 1 ];
+    }
+    m_arrCamera[ 1 ] = camState;
+    m_arrnFrame[ 1 ] = m_nFrame ++;
+    if( m_nCameras < 2 )
+        m_nCameras ++;
+    m_nSerial ++;
+    pthread_cond_signal( &m_condCamera );
+}
+
+const cPrefetchedGroup*
+cPrefetcher::PeekReady() const
+{
+    return m_nReady ? m_pQueue + m_nHead : nullptr;
+}
+
+void
+cPrefetcher::PopReady( bool bAdopted )
+{
+    _ASSERT( m_nReady );
+    m_nHead = ( m_nHead + 1 ) % gnPrefetchGroups;
+    m_nReady --;
+    if( bAdopted )
+        m_stats.m_nAdopted ++;
+    else
+        m_stats.m_nStale ++;
+}
+
+void
+cPrefetcher::CountBusy()
+{
+    // the frame still counts, so that the thread sees the right camera velocity
+    m_nFrame ++;
+    m_stats.m_nBusy ++;
+}
+
+const cPrefetchStats&
+cPrefetcher::GetStats() const
+{
+    return m_stats;
+}
+
+void*
+cPrefetcher::ThreadProc( void* pArg )
+{
+    static_cast<cPrefetcher*>( pArg )->Run();
+    return nullptr;
+}
+
+void
+cPrefetcher::Run()
+{
+    unsigned nDone = 0;
+    pthread_mutex_lock( &m_mutex );
+    while( ! m_bStop )
+    {
+        if( m_nCameras < 2 || m_nSerial == nDone )
+        {
+            pthread_cond_wait( &m_condCamera, &m_mutex );
+            continue;
+        }
+        // a camera that arrives during the walk is picked up by the next one
+        cCameraState camPrev = m_arrCamera[ 0 ], camCur = m_arrCamera[ 1 ];
+        unsigned nFrames = m_arrnFrame[ 1 ] - m_arrnFrame[ 0 ];
+        nDone = m_nSerial;
+        pthread_mutex_unlock( &m_mutex );
+        size_t nPredicted = Predict( camPrev, camCur, nFrames );
+        pthread_mutex_lock( &m_mutex );
+        m_stats.m_nPredicted += nPredicted;
+    }
+    pthread_mutex_unlock( &m_mutex );
+}
+
+size_t
+cPrefetcher::Predict( const cCameraState& camPrev, const cCameraState& camCur, unsigned nFrames )
+{
+    // the motion per frame; a still camera exposes nothing new
+    geom::scalar sFrames = static_cast<geom::scalar>( nFrames ? nFrames : 1 );
+    geom::cVector3d vecEyeStep = ( camCur.m_ptEye - camPrev.m_ptEye ) * ( 1 / sFrames );
+    geom::cVector3d vecViewStep = ( camCur.m_vecView + camPrev.m_vecView * -1 ) * ( 1 / sFrames );
+    geom::cVector3d vecUpStep = ( camCur.m_vecUp + camPrev.m_vecUp * -1 ) * ( 1 / sFrames );
+    geom::scalar sFOVStep = ( camCur.m_sFOV - camPrev.m_sFOV ) / sFrames;
+    if( vecEyeStep * vecEyeStep + vecViewStep * vecViewStep + vecUpStep * vecUpStep + sFOVStep * sFOVStep < geom::cTuple3d::gsEps )
+        return 0;
+
+    cViewVolume volCurrent, volPredicted;
+    volCurrent.Setup( camCur );
+    // the nearer frames come first, they are needed sooner. The motion is extrapolated linearly, which is close
+    // enough for the orbits over a few frames
+    cCameraState camPredicted = camCur;
+    size_t cFrame;
+    for( cFrame = 1; cFrame <= gnPrefetchFrames; cFrame ++ )
+    {
+        geom::scalar sAhead = static_cast<geom::scalar>( cFrame );
+        camPredicted.m_ptEye = camCur.m_ptEye + vecEyeStep * sAhead;
+        camPredicted.m_vecView = camCur.m_vecView + vecViewStep * sAhead;
+        camPredicted.m_vecView.Normalize();
+        camPredicted.m_vecUp = camCur.m_vecUp + vecUpStep * sAhead;
+        camPredicted.m_vecUp.Normalize();
+        // clamped as cViewport::AddFOV() does
+        camPredicted.m_sFOV = camCur.m_sFOV + sFOVStep * sAhead;
+        if( camPredicted.m_sFOV > M_PI / 2 )
+            camPredicted.m_sFOV = M_PI / 2;
+        if( camPredicted.m_sFOV < M_PI / 20 )
+            camPredicted.m_sFOV = M_PI / 20;
+        volPredicted.Setup( camPredicted );
+        if( ! Walk( volPredicted, volCurrent ))
+            return cFrame;
+    }
+    return gnPrefetchFrames;
+}
+
+bool
+cPrefetcher::Walk( cViewVolume& volPredicted, cViewVolume& volCurrent )
+{
+    const cTransformSet& rSet = m_pModel->GetTransformSet();
+    size_t nStack = 1, nVisits = 0, cChd, cExpand;
+    m_pModel->GetPathLocalCS( 0, m_pStack[ 0 ].m_matCS );
+    m_pStack[ 0 ].m_sRadius = m_pModel->GetPathRadius( 0 );
+    m_pStack[ 0 ].m_nPath = 0;
+    while( nStack && nVisits < gnPrefetchVisits )
+    {
+        // the expanded elements of the same radius are taken off the stack together, so that their children are
+        // generated in one batch; mostly they are siblings and cousins
+        size_t nExpand = 0;
+        while( nStack && nExpand < gnPrefetchExpand && nVisits < gnPrefetchVisits )
+        {
+            const cWalkItem& rItem = m_pStack[ nStack - 1 ];
+            if( nExpand && rItem.m_sRadius != m_pExpand[ 0 ].m_sRadius )
+                break;
+            nStack --;
+            nVisits ++;
+            geom::cPoint3d ptCenter( rItem.m_matCS[ geom::X ][ geom::W ], rItem.m_matCS[ geom::Y ][ geom::W ], rItem.m_matCS[ geom::Z ][ geom::W ] );
+            if( ! volPredicted.IsExpanded( ptCenter, rItem.m_sRadius, rItem.m_sRadius * rSet.m_sDescendantRatio ))
+                continue;
+            if( cFractalcModel::GetPathDepth( rItem.m_nPath ) >= gnPathMaxDepth )
+                continue; // the cache can't address the deeper levels
+            m_pExpand[ nExpand ] = rItem;
+            m_parrmatExpand[ nExpand ++ ] = rItem.m_matCS;
+        }
+        if( ! nExpand )
+            continue;
+        m_pModel->GenerateChildCS( m_parrmatExpand, nExpand, m_pExpand[ 0 ].m_sRadius, m_parrmatChildren );
+
+        for( cExpand = 0; cExpand < nExpand; cExpand ++ )
+        {
+            const cWalkItem& itemElem = m_pExpand[ cExpand ];
+            const geom::cMatrix3d* parrmatChildren = m_parrmatChildren + cExpand * gnSphereChildren;
+            geom::cPoint3d ptCenter( itemElem.m_matCS[ geom::X ][ geom::W ], itemElem.m_matCS[ geom::Y ][ geom::W ], itemElem.m_matCS[ geom::Z ][ geom::W ] );
+            // the groups the current frame expands are in the cache already, or will be by the end of the frame
+            if( ! volCurrent.IsExpanded( ptCenter, itemElem.m_sRadius, itemElem.m_sRadius * rSet.m_sDescendantRatio ) && ! m_hashSent.Find( itemElem.m_nPath ))
+            {
+                cPrefetchedGroup& rGroup = m_pBatch[ m_nBatch ++ ];
+                rGroup.m_nParent = itemElem.m_nPath;
+                for( cChd = 0; cChd < gnSphereChildren; cChd ++ )
+                {
+                    cPagedNode& rRecord = rGroup.m_arrChildren[ cChd ];
+                    int cAxis;
+                    for( cAxis = geom::X; cAxis < geom::W; cAxis ++ )
+                        rRecord.m_arrsCenter[ cAxis ] = parrmatChildren[ cChd ][ cAxis ][ geom::W ];
+                    cSphereNodeStore::QuantizeOrientation( parrmatChildren[ cChd ], rRecord.m_arrnOrientation );
+                }
+                if( m_nBatch == gnPrefetchBatch && ! Flush() )
+                    return false;
+            }
+
+            // the walk is a best effort, a full stack just drops the rest
+            geom::scalar sChildR = itemElem.m_sRadius * rSet.m_sRatio;
+            for( cChd = 0; cChd < rSet.m_nChildren && nStack < gnPrefetchStack; cChd ++ )
+            {
+                geom::cPoint3d ptChild( parrmatChildren[ cChd ][ geom::X ][ geom::W ], parrmatChildren[ cChd ][ geom::Y ][ geom::W ], parrmatChildren[ cChd ][ geom::Z ][ geom::W ] );
+                if( volPredicted.Occludes( ptCenter, itemElem.m_sRadius, ptChild, sChildR * rSet.m_sDescendantRatio ))
+                    continue;
+                cWalkItem& rChild = m_pStack[ nStack ++ ];
+                rChild.m_matCS = parrmatChildren[ cChd ];
+                rChild.m_sRadius = sChildR;
+                rChild.m_nPath = cFractalcModel::GetChildPath( itemElem.m_nPath, cChd );
+            }
+        }
+    }
+    return Flush();
+}
+
+bool
+cPrefetcher::Flush()
+{
+    size_t cGroup;
+    pthread_mutex_lock( &m_mutex );
+    for( cGroup = 0; cGroup < m_nBatch && m_nReady < gnPrefetchGroups; cGroup ++ )
+    {
+        m_pQueue[ ( m_nHead + m_nReady ) % gnPrefetchGroups ] = m_pBatch[ cGroup ];
+        m_nReady ++;
+        m_stats.m_nQueued ++;
+    }
+    bool bGo = ! m_bStop && cGroup == m_nBatch;
+    pthread_mutex_unlock( &m_mutex );
+    // only the queued groups are remembered; the rest may be tried again by the next walk
+    size_t nQueued = cGroup;
+    for( cGroup = 0; cGroup < nQueued; cGroup ++ )
+        m_hashSent.Insert( m_pBatch[ cGroup ].m_nParent, true );
+    m_nBatch = 0;
+    return bGo;
+}
+
+}// NS end
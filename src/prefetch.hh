@@ -0,0 +1,159 @@
+/*
+* MIT License
+* 
+* Copyright (c) 2020 ibaylov@gmail.com
+* 
+* Permission is hereby granted, free of charge, to any person obtaining a copy
+* of this software and associated documentation files (the "Software"), to deal
+* in the Software without restriction, including without limitation the rights
+* to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+* copies of the Software, and to permit persons to whom the Software is
+* furnished to do so, subject to the following conditions:
+* 
+* The above copyright notice and this permission notice shall be included in all
+* copies or substantial portions of the Software.
+* 
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+* AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+* OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+* SOFTWARE.
+*/
+#ifndef _MVC_PREFETCH_
+#define _MVC_PREFETCH_
+#include "model.hh"
+#include "page-cache.hh"
+#include "hashmap.hh"
+#include <pthread.h>
+
+/**
+@file  prefetch.hh
+@brief The background generator of the subtrees the camera is about to expose
+The view passes the camera to the model before every frame, see cModel::Anticipate(). The prefetcher thread keeps
+the last two cameras, extrapolates the motion a few frames ahead and walks the tree the way the view would in each
+predicted frame. The child groups the view would expand then, but not with the current camera, are generated and
+quantized in the background and queued for the render thread, which moves them into the node cache between frames.
+The render thread only ever tries the queue lock: if the prefetcher holds it, the frame goes on without the groups
+and the traversal generates whatever it needs as before
+*/
+
+namespace mvc
+{
+    class cFractalcModel;
+
+    const size_t gnPrefetchGroups = 1024;     //!< the ready groups queue capacity
+    const size_t gnPrefetchAdopt  = 256;      //!< the ready groups the render thread takes in a frame at most
+    const size_t gnPrefetchFrames = 8;        //!< how many frames ahead the camera motion is extrapolated
+    const size_t gnPrefetchVisits = 1 << 18;  //!< the elements a predicted frame walk visits at most
+    const size_t gnPrefetchBatch  = 16;       //!< the groups the thread queues under a single lock
+    const size_t gnPrefetchSent   = 1 << 13;  //!< the queued paths remembered against duplicates at most
+    const size_t gnPrefetchExpand = 64;       //!< the expanded elements the walk generates the children of at once
+    const size_t gnPrefetchStack  = ( gnPathMaxDepth + 1 ) * gnSphereChildren * gnPrefetchExpand; //!< the walk stack capacity
+
+    ////////////////////////////////////////////////////////////////////
+    /// \brief The cPrefetchedGroup struct - a ready child group
+    /// The records are quantized the same way the node store keeps them
+    struct cPrefetchedGroup
+    {
+        pathcode    m_nParent;                          //!< the path of the parent
+        cPagedNode  m_arrChildren[ gnSphereChildren ];  //!< the children, the unused slots of the set included
+    };
+
+    ////////////////////////////////////////////////////////////////////
+    /// \brief The cPrefetchStats struct - the prefetcher performance counters
+    ///
+    struct cPrefetchStats
+    {
+        size_t m_nPredicted;  //!< predicted frames walked by the thread
+        size_t m_nQueued;     //!< groups the thread queued
+        size_t m_nAdopted;    //!< groups the render thread moved into the cache
+        size_t m_nStale;      //!< groups dropped since the parent was expanded, evicted or the cache declined them
+        size_t m_nBusy;       //!< frames that found the queue or the node cache locked and went on without the groups
+    };
+
+    ////////////////////////////////////////////////////////////////////
+    /// \brief The cPrefetcher class
+    /// Owns the prefetch thread and the queue of ready groups. The thread reads only the immutable geometry of
+    /// the model; the node cache is left to the render thread
+    class cPrefetcher
+    {
+    protected:
+        ////////////////////////////////////////////////////////////////////
+        /// \brief The cViewVolume struct - the visibility tests of the view, for a camera of our own
+        /// Mirrors cOGLView::ClassifyElement() and cOGLView::OcclusionMargin()
+        struct cViewVolume
+        {
+            geom::cPlane3d  m_arrPlanes[ 6 ];   //!< the frustum planes, normals pointing inside
+            geom::cPoint3d  m_ptEye;            //!< the eye point
+            geom::cVector3d m_vecView;          //!< the unit view direction
+            geom::scalar    m_sDetailDepth;     //!< the view depth in radii the view drops the elements past
+
+            void Setup( const cCameraState& camState );                         //!< Builds the volume from a camera
+            bool IsExpanded( const geom::cPoint3d& ptCenter, geom::scalar sR, geom::scalar sDescR ); //!< Checks if the view expands the element
+            bool Occludes( const geom::cPoint3d& ptOuter, geom::scalar sOuterR, const geom::cPoint3d& ptInner, geom::scalar sInnerDescR ); //!< The parent occlusion test
+        };
+        ////////////////////////////////////////////////////////////////////
+        /// \brief The cWalkItem struct - an element on the walk stack
+        ///
+        struct cWalkItem
+        {
+            geom::cMatrix3d m_matCS;    //!< the exact local CS
+            geom::scalar    m_sRadius;  //!< the radius
+            pathcode        m_nPath;    //!< the path code
+        };
+
+        const cFractalcModel*   m_pModel;       //!< the model the groups are generated for
+        pthread_t               m_thread;       //!< the prefetch thread
+        bool                    m_bRunning;     //!< the thread was started
+        // shared with the thread, guarded by m_mutex
+        pthread_mutex_t         m_mutex;        //!< guards the cameras, the queue and the counters
+        pthread_cond_t          m_condCamera;   //!< signalled on a new camera or on stop
+        bool                    m_bStop;        //!< asks the thread to quit
+        cCameraState            m_arrCamera[ 2 ]; //!< the previous and the current camera
+        unsigned                m_arrnFrame[ 2 ]; //!< the frames the cameras came with
+        size_t                  m_nCameras;     //!< the cameras received, up to 2
+        unsigned                m_nSerial;      //!< counts the cameras received
+        cPrefetchedGroup*       m_pQueue;       //!< the ready groups ring
+        size_t                  m_nHead;        //!< the oldest ready group
+        size_t                  m_nReady;       //!< the ready groups in the ring
+        cPrefetchStats          m_stats;        //!< the performance counters
+        // private to the render thread
+        unsigned                m_nFrame;       //!< counts the frames, including the ones that found the queue locked
+        // private to the thread
+        cPrefetchedGroup*       m_pBatch;       //!< the groups waiting for the lock
+        size_t                  m_nBatch;       //!< the groups in the batch
+        utl::cHashMap<pathcode, bool> m_hashSent; //!< the paths queued lately, a bounded map that forgets the older ones
+        cWalkItem*              m_pStack;       //!< the walk stack
+        cWalkItem*              m_pExpand;      //!< the elements of the walk whose children are generated together
+        geom::cMatrix3d*        m_parrmatExpand;   //!< their local CS, in one array for the batch
+        geom::cMatrix3d*        m_parrmatChildren; //!< their children, in groups of gnSphereChildren
+    public:
+        cPrefetcher();  //!< Constructs a stopped prefetcher
+        ~cPrefetcher(); //!< Stops the thread
+        #ifndef _NO_CXX_11_
+        cPrefetcher( const cPrefetcher& ) = delete; //!< Prevent direct copy
+        #endif
+        // operations
+        bool Start( const cFractalcModel* pModel ); //!< Starts the thread for the model
+        void Stop();                                //!< Stops the thread and drops the queue
+        bool IsRunning() const;                     //!< Checks if the thread runs
+        // the render thread side, between TryLock() and Unlock()
+        bool TryLock();                             //!< Locks the queue if it is free; never waits
+        void Unlock();                              //!< Unlocks the queue
+        void SetCamera( const cCameraState& );      //!< Passes the camera of the frame to the thread
+        const cPrefetchedGroup* PeekReady() const;  //!< Retrieves the oldest ready group, nullptr if none
+        void PopReady( bool bAdopted );             //!< Removes the oldest ready group, counting it as adopted or stale
+        void CountBusy();                           //!< Counts a frame that found the queue locked; no lock needed
+        const cPrefetchStats& GetStats() const;     //!< Retrieves the performance counters
+    protected:
+        static void* ThreadProc( void* pArg );      //!< The pthread entry point
+        void Run();                                 //!< The thread loop
+        size_t Predict( const cCameraState& camPrev, const cCameraState& camCur, unsigned nFrames ); //!< Walks the predicted frames, returns how many
+        bool Walk( cViewVolume& volPredicted, cViewVolume& volCurrent ); //!< Queues the groups a predicted frame exposes, false if interrupted
+        bool Flush();                               //!< Moves the batch to the queue, false if it is full or stopping
+    };
+}
+
+#endif
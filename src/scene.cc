@@ -0,0 +1,526 @@
+/*
+* MIT License
+* 
+* Copyright (c) 2020 ibaylov@gmail.com
+* 
+* Permission is hereby granted, free of charge, to any person obtaining a copy
+* of this software and associated documentation files (the "Software"), to deal
+* in the Software without restriction, including without limitation the rights
+* to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+* copies of the Software, and to permit persons to whom the Software is
+* furnished to do so, subject to the following conditions:
+* 
+* The above copyright notice and this permission notice shall be included in all
+* copies or substantial portions of the Software.
+* 
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+* AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+* OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+* SOFTWARE.
+*/
+#include "scene.hh"
+#include <math.h>
+#include <new>
+
+namespace mvc
+{
+
+///////////////////////////////////////////////////////////////////////////////
+// cSceneElement implementation
+
+cSceneElement::cSceneElement( const cSceneNode& rNode, size_t nNode )
+    : m_sRadius( rNode.m_sRadius ), m_sDescendantRadius( rNode.m_sRadius ), m_sDescendantCap( rNode.m_sRadius ), m_pInner( nullptr ), m_nIndex( nNode )
+{
+    m_matLCS( geom::X )( geom::W ) = rNode.m_ptCenter[ geom::X ];
+    m_matLCS( geom::Y )( geom::W ) = rNode.m_ptCenter[ geom::Y ];
+    m_matLCS( geom::Z )( geom::W ) = rNode.m_ptCenter[ geom::Z ];
+}
+
+cSceneElement::cSceneElement( const cInstance& rInstance, size_t nInstance, cElement* pInner )
+    : cElement( pInner->GetHierarchyDepth(), rInstance.m_matWorld ), m_pInner( pInner ), m_nIndex( nInstance )
+{
+    // the local CS stays rigid: only its origin is scaled with the model space
+    geom::cMatrix3d matInner = pInner->GetLocalCS();
+    int cRow;
+    for( cRow = 0; cRow < geom::W; cRow ++ )
+        matInner( cRow )( geom::W ) *= rInstance.m_sScale;
+    m_matLCS = rInstance.m_matWorld * matInner;
+    m_sRadius = pInner->GetBoundingSphereRadius() * rInstance.m_sScale;
+    m_sDescendantRadius = pInner->GetDescendantSphereRadius() * rInstance.m_sScale;
+    m_sDescendantCap = pInner->GetDescendantCapDistance() * rInstance.m_sScale;
+}
+
+cSceneElement::~cSceneElement()
+{
+    // the elements live in the scene arena and are dropped with it
+}
+
+geom::scalar
+cSceneElement::GetBoundingSphereRadius() const
+{
+    return m_sRadius;
+}
+
+geom::scalar
+cSceneElement::GetDescendantSphereRadius() const
+{
+    return m_sDescendantRadius;
+}
+
+geom::scalar
+cSceneElement::GetDescendantCapDistance() const
+{
+    return m_sDescendantCap;
+}
+
+bool
+cSceneElement::IsProxy() const
+{
+    return ! m_pInner;
+}
+
+cElement*
+cSceneElement::GetInnerElement() const
+{
+    return m_pInner;
+}
+
+size_t
+cSceneElement::GetIndex() const
+{
+    return m_nIndex;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// cScene::cWorldVisitor implementation
+
+cScene::cWorldVisitor::cWorldVisitor( cScene* pScene, size_t nInstance, cChildVisitor& rVisitor )
+    : m_pScene( pScene ), m_nInstance( nInstance ), m_rVisitor( rVisitor ), m_nVisited( 0 )
+{
+}
+
+cScene::cWorldVisitor::~cWorldVisitor()
+{
+}
+
+bool
+cScene::cWorldVisitor::Accept( const cChildBounds& bndChild )
+{
+    // the scene visitor judges the bounds in the world
+    const cInstance& rInstance = m_pScene->m_parrInstances[ m_nInstance ];
+    cChildBounds bndWorld;
+    ToWorld( rInstance, bndChild.m_ptCenter, bndWorld.m_ptCenter );
+    bndWorld.m_sRadius = bndChild.m_sRadius * rInstance.m_sScale;
+    bndWorld.m_sDescendantRadius = bndChild.m_sDescendantRadius * rInstance.m_sScale;
+    bndWorld.m_nDepth = bndChild.m_nDepth;
+    return m_rVisitor.Accept( bndWorld );
+}
+
+void
+cScene::cWorldVisitor::Visit( cElement* pElem )
+{
+    m_rVisitor.Visit( m_pScene->PlaceElement( m_nInstance, pElem ));
+    m_nVisited ++;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// cScene implementation
+
+cScene::cScene()
+    : m_parrInstances( nullptr ), m_nInstances( 0 ), m_nCapacity( 0 ), m_parrNodes( nullptr ), m_nNodes( 0 ),
+      m_parrModels( nullptr ), m_nModels( 0 ), m_bBuilt( false ), m_pRootElem( nullptr )
+{
+}
+
+cScene::~cScene()
+{
+    delete [] m_parrInstances;
+    delete [] m_parrNodes;
+    delete [] m_parrModels;
+}
+
+size_t
+cScene::AddInstance( cModel* pModel, const geom::cMatrix3d& matWorld, geom::scalar sScale, size_t nMaxDepth )
+{
+    _ASSERT( pModel && sScale > 0 );
+    if( m_nInstances == m_nCapacity )
+    {
+        size_t nCapacity = m_nCapacity ? m_nCapacity * 2 : 16;
+        cInstance* parrInstances = new cInstance[ nCapacity ];
+        size_t cPlaced;
+        for( cPlaced = 0; cPlaced < m_nInstances; cPlaced ++ )
+            parrInstances[ cPlaced ] = m_parrInstances[ cPlaced ];
+        delete [] m_parrInstances;
+        m_parrInstances = parrInstances;
+        m_nCapacity = nCapacity;
+    }
+    cInstance& rInstance = m_parrInstances[ m_nInstances ];
+    rInstance.m_pModel = pModel;
+    rInstance.m_matWorld = matWorld;
+    rInstance.m_sScale = sScale;
+    rInstance.m_nMaxDepth = nMaxDepth;
+    m_bBuilt = false;
+    return m_nInstances ++;
+}
+
+void
+cScene::Build()
+{
+    // the distinct models, for the calls every model gets once
+    delete [] m_parrModels;
+    m_parrModels = new cModel*[ m_nInstances ? m_nInstances : 1 ];
+    m_nModels = 0;
+    size_t cPlaced, cDistinct;
+    for( cPlaced = 0; cPlaced < m_nInstances; cPlaced ++ )
+    {
+        cInstance& rInstance = m_parrInstances[ cPlaced ];
+        for( cDistinct = 0; cDistinct < m_nModels && m_parrModels[ cDistinct ] != rInstance.m_pModel; cDistinct ++ )
+            ;
+        if( cDistinct == m_nModels )
+            m_parrModels[ m_nModels ++ ] = rInstance.m_pModel;
+    }
+
+    // the instance bounds are the descendant spheres of the model roots, placed in the world
+    BeginRead();
+    for( cPlaced = 0; cPlaced < m_nInstances; cPlaced ++ )
+    {
+        cInstance& rInstance = m_parrInstances[ cPlaced ];
+        cElement* pRoot = rInstance.m_pModel->GetRootElement();
+        ToWorld( rInstance, pRoot->GetCenter(), rInstance.m_ptCenter );
+        rInstance.m_sRadius = pRoot->GetDescendantSphereRadius() * rInstance.m_sScale;
+    }
+    EndRead();
+
+    // a binary tree with a few instances per leaf has less than twice as many nodes as instances
+    delete [] m_parrNodes;
+    m_parrNodes = new cSceneNode[ m_nInstances ? 2 * m_nInstances : 1 ];
+    m_nNodes = 1;
+    BuildNode( 0, 0, m_nInstances );
+    m_bBuilt = true;
+    m_pRootElem = nullptr;
+}
+
+void
+cScene::BuildNode( size_t nNode, size_t nFirst, size_t nCount )
+{
+    cSceneNode& rNode = m_parrNodes[ nNode ];
+    if( nCount <= gnSceneLeafInstances )
+    {
+        rNode.m_nFirst = nFirst;
+        rNode.m_nCount = nCount;
+        if( nCount )
+            EncloseNode( rNode );
+        else
+        {
+            // only an empty scene has an empty leaf, and it stays a point at the origin
+            rNode.m_ptCenter = geom::cPoint3d( 0, 0, 0 );
+            rNode.m_sRadius = 0;
+        }
+        return;
+    }
+    // the instances are split in halves at the median center along the longest extent
+    geom::scalar arrsMin[ geom::W ], arrsMax[ geom::W ];
+    size_t cPlaced;
+    int cAxis, nAxis = geom::X;
+    for( cAxis = geom::X; cAxis < geom::W; cAxis ++ )
+    {
+        arrsMin[ cAxis ] = arrsMax[ cAxis ] = m_parrInstances[ nFirst ].m_ptCenter[ cAxis ];
+        for( cPlaced = nFirst + 1; cPlaced < nFirst + nCount; cPlaced ++ )
+        {
+            geom::scalar sCoord = m_parrInstances[ cPlaced ].m_ptCenter[ cAxis ];
+            if( sCoord < arrsMin[ cAxis ] )
+                arrsMin[ cAxis ] = sCoord;
+            if( sCoord > arrsMax[ cAxis ] )
+                arrsMax[ cAxis ] = sCoord;
+        }
+        if( arrsMax[ cAxis ] - arrsMin[ cAxis ] > arrsMax[ nAxis ] - arrsMin[ nAxis ] )
+            nAxis = cAxis;
+    }
+    // a quickselect of the median; the halves are unordered otherwise
+    size_t nMedian = nFirst + nCount / 2;
+    size_t nLeft = nFirst, nRight = nFirst + nCount - 1;
+    while( nLeft < nRight )
+    {
+        geom::scalar sPivot = m_parrInstances[ ( nLeft + nRight ) / 2 ].m_ptCenter[ nAxis ];
+        size_t cLow = nLeft, cHigh = nRight;
+        while( cLow <= cHigh )
+        {
+            while( m_parrInstances[ cLow ].m_ptCenter[ nAxis ] < sPivot )
+                cLow ++;
+            while( m_parrInstances[ cHigh ].m_ptCenter[ nAxis ] > sPivot )
+                cHigh --;
+            if( cLow <= cHigh )
+            {
+                cInstance instSwap = m_parrInstances[ cLow ];
+                m_parrInstances[ cLow ] = m_parrInstances[ cHigh ];
+                m_parrInstances[ cHigh ] = instSwap;
+                cLow ++;
+                if( ! cHigh )
+                    break;
+                cHigh --;
+            }
+        }
+        if( nMedian <= cHigh )
+            nRight = cHigh;
+        else
+        if( nMedian >= cLow )
+            nLeft = cLow;
+        else
+            break;
+    }
+    // the children are placed next to each other
+    rNode.m_nFirst = m_nNodes;
+    rNode.m_nCount = 0;
+    m_nNodes += 2;
+    BuildNode( rNode.m_nFirst, nFirst, nMedian - nFirst );
+    BuildNode( rNode.m_nFirst + 1, nMedian, nFirst + nCount - nMedian );
+    EncloseNode( m_parrNodes[ nNode ] );
+}
+
+void
+cScene::EncloseNode( cSceneNode& rNode ) const
+{
+    // the spheres are merged one by one: the smallest sphere enclosing two spheres is exact, though the result
+    // for more of them is not the smallest possible
+    size_t nCount = rNode.m_nCount ? rNode.m_nCount : 2;
+    size_t cSphere;
+    for( cSphere = 0; cSphere < nCount; cSphere ++ )
+    {
+        const geom::cPoint3d& ptCenter = rNode.m_nCount ? m_parrInstances[ rNode.m_nFirst + cSphere ].m_ptCenter : m_parrNodes[ rNode.m_nFirst + cSphere ].m_ptCenter;
+        geom::scalar sR = rNode.m_nCount ? m_parrInstances[ rNode.m_nFirst + cSphere ].m_sRadius : m_parrNodes[ rNode.m_nFirst + cSphere ].m_sRadius;
+        if( ! cSphere )
+        {
+            rNode.m_ptCenter = ptCenter;
+            rNode.m_sRadius = sR;
+            continue;
+        }
+        geom::cVector3d vecOffset = ptCenter - rNode.m_ptCenter;
+        geom::scalar sDistance = sqrt( vecOffset * vecOffset );
+        if( sDistance + sR <= rNode.m_sRadius )
+            continue;
+        if( sDistance + rNode.m_sRadius <= sR )
+        {
+            rNode.m_ptCenter = ptCenter;
+            rNode.m_sRadius = sR;
+            continue;
+        }
+        geom::scalar sMerged = ( sDistance + rNode.m_sRadius + sR ) / 2;
+        rNode.m_ptCenter = rNode.m_ptCenter + vecOffset * ( ( sMerged - rNode.m_sRadius ) / sDistance );
+        rNode.m_sRadius = sMerged;
+    }
+}
+
+size_t
+cScene::GetInstanceCount() const
+{
+    return m_nInstances;
+}
+
+const cInstance&
+cScene::GetInstance( size_t nInstance ) const
+{
+    _ASSERT( nInstance < m_nInstances );
+    return m_parrInstances[ nInstance ];
+}
+
+size_t
+cScene::GetNodeCount() const
+{
+    return m_nNodes;
+}
+
+cElement*
+cScene::GetRootElement()
+{
+    // building reads the models, which can't be done within a read of the scene
+    _ASSERT( m_bBuilt );
+    if( ! m_pRootElem )
+        m_pRootElem = new ( m_arenaElems.Allocate( sizeof( cSceneElement ))) cSceneElement( m_parrNodes[ 0 ], 0 );
+    return m_pRootElem;
+}
+
+utl::cObList<cElement*>
+cScene::GetDescendantElements( cElement* pElem )
+{
+    // the scene is read by one thread at a time, so the lists may share a pool
+    utl::cObList<cElement*> lstChildren( &m_poolLinks );
+    cChildCollector collector( lstChildren );
+    EnumerateDescendants( pElem, collector );
+    return lstChildren;
+}
+
+size_t
+cScene::EnumerateDescendants( cElement* pElem, cChildVisitor& rVisitor )
+{
+    cSceneElement* pSceneElem = static_cast<cSceneElement*>( pElem );
+    cElement* pInner = pSceneElem->GetInnerElement();
+    if( pInner )
+    {
+        // an instance element: its model enumerates the children, down to the depth of the instance
+        size_t nInstance = pSceneElem->GetIndex();
+        if( pInner->GetHierarchyDepth() >= m_parrInstances[ nInstance ].m_nMaxDepth )
+            return 0;
+        cWorldVisitor visitorWorld( this, nInstance, rVisitor );
+        m_parrInstances[ nInstance ].m_pModel->EnumerateDescendants( pInner, visitorWorld );
+        return visitorWorld.m_nVisited;
+    }
+
+    if( ! m_nInstances )
+        return 0;
+    const cSceneNode& rNode = m_parrNodes[ pSceneElem->GetIndex() ];
+    cChildBounds bndChild;
+    size_t nVisited = 0, cChild;
+    if( ! rNode.m_nCount )
+    {
+        // an inner node: the child nodes
+        for( cChild = rNode.m_nFirst; cChild < rNode.m_nFirst + 2; cChild ++ )
+        {
+            const cSceneNode& rChild = m_parrNodes[ cChild ];
+            bndChild.m_ptCenter = rChild.m_ptCenter;
+            bndChild.m_sRadius = bndChild.m_sDescendantRadius = rChild.m_sRadius;
+            bndChild.m_nDepth = 0;
+            if( ! rVisitor.Accept( bndChild ))
+                continue;
+            rVisitor.Visit( new ( m_arenaElems.Allocate( sizeof( cSceneElement ))) cSceneElement( rChild, cChild ));
+            nVisited ++;
+        }
+        return nVisited;
+    }
+    // a leaf: the roots of its instances
+    for( cChild = rNode.m_nFirst; cChild < rNode.m_nFirst + rNode.m_nCount; cChild ++ )
+    {
+        const cInstance& rInstance = m_parrInstances[ cChild ];
+        cElement* pRoot = rInstance.m_pModel->GetRootElement();
+        bndChild.m_ptCenter = rInstance.m_ptCenter;
+        bndChild.m_sRadius = pRoot->GetBoundingSphereRadius() * rInstance.m_sScale;
+        bndChild.m_sDescendantRadius = rInstance.m_sRadius;
+        bndChild.m_nDepth = pRoot->GetHierarchyDepth();
+        if( ! rVisitor.Accept( bndChild ))
+            continue;
+        rVisitor.Visit( PlaceElement( cChild, pRoot ));
+        nVisited ++;
+    }
+    return nVisited;
+}
+
+void
+cScene::Anticipate( const cCameraState& camState )
+{
+    // a model may be instanced many times but looks ahead with a single camera, so it gets the one of the
+    // instance closest to the eye
+    size_t cDistinct, cPlaced;
+    for( cDistinct = 0; cDistinct < m_nModels; cDistinct ++ )
+    {
+        size_t nClosest = m_nInstances;
+        geom::scalar sClosest = HUGE_VAL;
+        for( cPlaced = 0; cPlaced < m_nInstances; cPlaced ++ )
+        {
+            const cInstance& rInstance = m_parrInstances[ cPlaced ];
+            if( rInstance.m_pModel != m_parrModels[ cDistinct ] )
+                continue;
+            geom::cVector3d vecEye = rInstance.m_ptCenter - camState.m_ptEye;
+            geom::scalar sDistance = sqrt( vecEye * vecEye ) - rInstance.m_sRadius;
+            if( sDistance < sClosest )
+            {
+                sClosest = sDistance;
+                nClosest = cPlaced;
+            }
+        }
+        if( nClosest == m_nInstances )
+            continue;
+        const cInstance& rInstance = m_parrInstances[ nClosest ];
+        cCameraState camModel = camState;
+        ToModel( rInstance, camState.m_ptEye, camModel.m_ptEye );
+        ToModel( rInstance, camState.m_vecView, camModel.m_vecView );
+        ToModel( rInstance, camState.m_vecUp, camModel.m_vecUp );
+        camModel.m_sNear = camState.m_sNear / rInstance.m_sScale;
+        camModel.m_sFar = camState.m_sFar / rInstance.m_sScale;
+        m_parrModels[ cDistinct ]->Anticipate( camModel );
+    }
+}
+
+void
+cScene::BeginRead()
+{
+    size_t cDistinct;
+    for( cDistinct = 0; cDistinct < m_nModels; cDistinct ++ )
+        m_parrModels[ cDistinct ]->BeginRead();
+}
+
+void
+cScene::EndRead()
+{
+    size_t cDistinct;
+    for( cDistinct = 0; cDistinct < m_nModels; cDistinct ++ )
+        m_parrModels[ cDistinct ]->EndRead();
+}
+
+void
+cScene::Collect()
+{
+    m_arenaElems.Reset();
+    m_pRootElem = nullptr;
+    size_t cDistinct;
+    for( cDistinct = 0; cDistinct < m_nModels; cDistinct ++ )
+        m_parrModels[ cDistinct ]->Collect();
+}
+
+cSceneElement*
+cScene::PlaceElement( size_t nInstance, cElement* pInner )
+{
+    return new ( m_arenaElems.Allocate( sizeof( cSceneElement ))) cSceneElement( m_parrInstances[ nInstance ], nInstance, pInner );
+}
+
+void
+cScene::ToWorld( const cInstance& rInstance, const geom::cPoint3d& ptModel, geom::cPoint3d& ptWorld )
+{
+    const geom::cMatrix3d& matWorld = rInstance.m_matWorld;
+    geom::scalar arrsWorld[ geom::W ];
+    int cRow, cCol;
+    for( cRow = 0; cRow < geom::W; cRow ++ )
+    {
+        geom::scalar sSum = 0;
+        for( cCol = 0; cCol < geom::W; cCol ++ )
+            sSum += matWorld[ cRow ][ cCol ] * ptModel[ cCol ];
+        arrsWorld[ cRow ] = matWorld[ cRow ][ geom::W ] + rInstance.m_sScale * sSum;
+    }
+    ptWorld = geom::cPoint3d( arrsWorld[ geom::X ], arrsWorld[ geom::Y ], arrsWorld[ geom::Z ] );
+}
+
+void
+cScene::ToModel( const cInstance& rInstance, const geom::cPoint3d& ptWorld, geom::cPoint3d& ptModel )
+{
+    // the placement is rigid, so the inverse rotation is the transposed one
+    const geom::cMatrix3d& matWorld = rInstance.m_matWorld;
+    geom::scalar arrsModel[ geom::W ];
+    int cRow, cCol;
+    for( cCol = 0; cCol < geom::W; cCol ++ )
+    {
+        geom::scalar sSum = 0;
+        for( cRow = 0; cRow < geom::W; cRow ++ )
+            sSum += matWorld[ cRow ][ cCol ] * ( ptWorld[ cRow ] - matWorld[ cRow ][ geom::W ] );
+        arrsModel[ cCol ] = sSum / rInstance.m_sScale;
+    }
+    ptModel = geom::cPoint3d( arrsModel[ geom::X ], arrsModel[ geom::Y ], arrsModel[ geom::Z ] );
+}
+
+void
+cScene::ToModel( const cInstance& rInstance, const geom::cVector3d& vecWorld, geom::cVector3d& vecModel )
+{
+    const geom::cMatrix3d& matWorld = rInstance.m_matWorld;
+    geom::scalar arrsModel[ geom::W ];
+    int cRow, cCol;
+    for( cCol = 0; cCol < geom::W; cCol ++ )
+    {
+        geom::scalar sSum = 0;
+        for( cRow = 0; cRow < geom::W; cRow ++ )
+            sSum += matWorld[ cRow ][ cCol ] * vecWorld[ cRow ];
+        arrsModel[ cCol ] = sSum;
+    }
+    vecModel = geom::cVector3d( arrsModel[ geom::X ], arrsModel[ geom::Y ], arrsModel[ geom::Z ] );
+}
+
+} // NS end
@@ -0,0 +1,157 @@
+/*
+* MIT License
+* 
+* Copyright (c) 2020 ibaylov@gmail.com
+* 
+* Permission is hereby granted, free of charge, to any person obtaining a copy
+* of this software and associated documentation files (the "Software"), to deal
+* in the Software without restriction, including without limitation the rights
+* to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+* copies of the Software, and to permit persons to whom the Software is
+* furnished to do so, subject to the following conditions:
+* 
+* The above copyright notice and this permission notice shall be included in all
+* copies or substantial portions of the Software.
+* 
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+* AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+* OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+* SOFTWARE.
+*/
+#ifndef _MVC_SCENE_
+#define _MVC_SCENE_
+#include "model.hh"
+#include "arena.hh"
+
+/**
+@file  scene.hh
+@brief The scene of many model instances under a bounding volume hierarchy
+A scene places models in the world, each instance with its own rigid placement, uniform scale and depth limit; an
+instance shares the tree of its model with all the others of the same model. The scene is a model itself: its tree
+starts with the hierarchy of bounding spheres over the instances, whose nodes are proxy elements that the views
+classify and expand but never draw, see cElement::IsProxy(). The leaves of the hierarchy have the root elements of
+their instances as children, and below those the scene passes the elements of the instanced model, placed in the
+world. So a view culls whole groups of instances before descending into any of them, and the traversal cost follows
+what is visible rather than the number of instances
+The world elements are placed in an arena rewound by Collect(). The scene elements have no keys, so a coherent view
+builds its cut afresh every frame, and it is traversed by a single thread at a time
+*/
+
+namespace mvc
+{
+    const size_t gnSceneLeafInstances = 4; //!< the instances in a hierarchy leaf at most
+
+    ////////////////////////////////////////////////////////////////////
+    /// \brief The cInstance struct - a model placed in the scene
+    /// A model point p is placed at m_matWorld * ( p * m_sScale )
+    struct cInstance
+    {
+        cModel*         m_pModel;    //!< the instanced model, not owned
+        geom::cMatrix3d m_matWorld;  //!< the rigid placement of the model space
+        geom::scalar    m_sScale;    //!< the uniform scale of the model space
+        size_t          m_nMaxDepth; //!< the deepest level of the model shown
+        geom::cPoint3d  m_ptCenter;  //!< the world center of the instance bounds, set by Build()
+        geom::scalar    m_sRadius;   //!< the world radius of the instance bounds, set by Build()
+    };
+
+    ////////////////////////////////////////////////////////////////////
+    /// \brief The cSceneNode struct - a node of the bounding volume hierarchy
+    /// The children of an inner node are the next two nodes from m_nFirst; a leaf refers to m_nCount instances
+    /// from m_nFirst in the hierarchy order
+    struct cSceneNode
+    {
+        geom::cPoint3d  m_ptCenter;  //!< the bounding sphere center
+        geom::scalar    m_sRadius;   //!< the bounding sphere radius
+        size_t          m_nFirst;    //!< the first child node or the first instance
+        size_t          m_nCount;    //!< the instances of a leaf, 0 for an inner node
+    };
+
+    ////////////////////////////////////////////////////////////////////
+    /// \brief The cSceneElement class
+    /// A hierarchy node, which is a proxy, or an element of an instance placed in the world
+    class cSceneElement final : public cElement
+    {
+    protected:
+        geom::scalar m_sRadius;           //!< the bounding sphere radius
+        geom::scalar m_sDescendantRadius; //!< the descendant bounding sphere radius
+        geom::scalar m_sDescendantCap;    //!< the descendant cap distance
+        cElement*    m_pInner;            //!< the element of the instanced model, nullptr for a hierarchy node
+        size_t       m_nIndex;            //!< the hierarchy node or the instance index
+    public:
+        cSceneElement( const cSceneNode& rNode, size_t nNode );                   //!< Constructs a hierarchy node proxy
+        cSceneElement( const cInstance& rInstance, size_t nInstance, cElement* ); //!< Places an instance element in the world
+        virtual ~cSceneElement() override;
+        virtual geom::scalar GetBoundingSphereRadius() const override;
+        virtual geom::scalar GetDescendantSphereRadius() const override;
+        virtual geom::scalar GetDescendantCapDistance() const override;
+        virtual bool IsProxy() const override;
+        cElement* GetInnerElement() const; //!< Retrieves the element of the instanced model, nullptr for a hierarchy node
+        size_t    GetIndex() const;        //!< Retrieves the hierarchy node or the instance index
+    };
+
+    ////////////////////////////////////////////////////////////////////
+    /// \brief The cScene class
+    /// The models placed in the world, see the file description
+    class cScene : public cModel
+    {
+    protected:
+        ////////////////////////////////////////////////////////////////////
+        /// \brief The cWorldVisitor class - passes the children of an instance element placed in the world
+        class cWorldVisitor : public cChildVisitor
+        {
+        protected:
+            cScene*         m_pScene;    //!< the scene
+            size_t          m_nInstance; //!< the instance of the visited element
+            cChildVisitor&  m_rVisitor;  //!< the visitor of the scene children
+        public:
+            size_t          m_nVisited;  //!< the children passed to the visitor
+            cWorldVisitor( cScene*, size_t nInstance, cChildVisitor& );
+            virtual ~cWorldVisitor() override;
+            virtual bool Accept( const cChildBounds& ) override;
+            virtual void Visit( cElement* ) override;
+        };
+
+        cInstance*  m_parrInstances;  //!< the instances, in the hierarchy order once built
+        size_t      m_nInstances;     //!< the number of instances
+        size_t      m_nCapacity;      //!< the instances array capacity
+        cSceneNode* m_parrNodes;      //!< the hierarchy nodes, the root first
+        size_t      m_nNodes;         //!< the number of hierarchy nodes
+        cModel**    m_parrModels;     //!< the distinct instanced models
+        size_t      m_nModels;        //!< the number of distinct models
+        bool        m_bBuilt;         //!< the hierarchy is up to date with the instances
+        cElement*   m_pRootElem;      //!< the root node proxy, valid until Collect()
+        utl::cArena m_arenaElems;     //!< the scene elements memory, rewound by Collect()
+        utl::cObListPool<cElement*> m_poolLinks; //!< the elements of the lists GetDescendantElements() returns
+    public:
+        cScene();
+#ifndef _NO_CXX_11_
+        cScene( const cScene& ) = delete; //!<< Prevent direct copy
+#endif
+        virtual ~cScene() override;
+// operations
+        size_t AddInstance( cModel* pModel, const geom::cMatrix3d& matWorld, geom::scalar sScale, size_t nMaxDepth ); //!< Places a model in the scene; the placement must be rigid
+        void   Build();                     //!< Builds the hierarchy over the instances; due after adding them and before the first read
+        size_t GetInstanceCount() const;    //!< Retrieves the number of instances
+        const cInstance& GetInstance( size_t nInstance ) const; //!< Retrieves an instance, in the hierarchy order once built
+        size_t GetNodeCount() const;        //!< Retrieves the number of hierarchy nodes
+        virtual cElement* GetRootElement() override;
+        virtual utl::cObList<cElement*> GetDescendantElements( cElement* ) override;
+        virtual size_t EnumerateDescendants( cElement*, cChildVisitor& ) override;
+        virtual void Anticipate( const cCameraState& ) override; //!< Passes the camera to every model, in the space of its instance closest to the eye
+        virtual void BeginRead() override;
+        virtual void EndRead() override;
+        virtual void Collect() override;
+    protected:
+        void   BuildNode( size_t nNode, size_t nFirst, size_t nCount ); //!< Builds the subtree of nCount instances from nFirst at the node nNode
+        void   EncloseNode( cSceneNode& rNode ) const;    //!< Computes the bounding sphere of a node from its children or instances
+        cSceneElement* PlaceElement( size_t nInstance, cElement* pInner ); //!< Places an instance element in the world
+        static void ToWorld( const cInstance& rInstance, const geom::cPoint3d& ptModel, geom::cPoint3d& ptWorld ); //!< Maps a model point to the world
+        static void ToModel( const cInstance& rInstance, const geom::cPoint3d& ptWorld, geom::cPoint3d& ptModel ); //!< Maps a world point to the model space
+        static void ToModel( const cInstance& rInstance, const geom::cVector3d& vecWorld, geom::cVector3d& vecModel ); //!< Maps a world direction to the model space
+    };
+}
+
+#endif
@@ -0,0 +1,276 @@
+/*
+* MIT License
+* 
+* Copyright (c) 2020 ibaylov@gmail.com
+* 
+* Permission is hereby granted, free of charge, to any person obtaining a copy
+* of this software and associated documentation files (the "Software"), to deal
+* in the Software without restriction, including without limitation the rights
+* to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+* copies of the Software, and to permit persons to whom the Software is
+* furnished to do so, subject to the following conditions:
+* 
+* The above copyright notice and this permission notice shall be included in all
+* copies or substantial portions of the Software.
+* 
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+* AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+* OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+* SOFTWARE.
+*/
+#include "sphere-tree.hh"
+#include <math.h>
+#include "assert.hh"
+
+namespace mvc
+{
+
+///////////////////////////////////////////////////////////////////////////////
+// cTransformSet implementation
+
+void
+cTransformSet::DeriveBounds()
+{
+    // if the descendants of any element fit D radii around its center, those of a child fit D * m_sRatio parent
+    // radii around the child center, so D = max( |t| + m_sRatio * D ) over the child translations t does, and 1
+    geom::scalar sInvariant = 1;
+    size_t cChd;
+    for( cChd = 0; cChd < m_nChildren; cChd ++ )
+    {
+        geom::cVector3d vecRel( m_arrmatRel[ cChd ][ geom::X ][ geom::W ], m_arrmatRel[ cChd ][ geom::Y ][ geom::W ], m_arrmatRel[ cChd ][ geom::Z ][ geom::W ] );
+        geom::scalar sReach = sqrt( vecRel * vecRel ) / ( 1 - m_sRatio );
+        if( sReach > sInvariant )
+            sInvariant = sReach;
+    }
+
+    // that sphere ignores which way the children grow. The tree of a unit element is expanded a few levels, each
+    // sphere bounding itself and the leaves bounding their subtrees with the invariant sphere, which leaves an
+    // error of the leaf size only. The cap is the deepest point below the center along the Z axis
+    geom::cMatrix3d arrmatStack[ gnBoundLevels * gnSphereChildren + 1 ];
+    geom::scalar arrsStackR[ gnBoundLevels * gnSphereChildren + 1 ];
+    size_t arrnStackDepth[ gnBoundLevels * gnSphereChildren + 1 ];
+    size_t nStack = 1;
+    arrsStackR[ 0 ] = 1;
+    arrnStackDepth[ 0 ] = 0;
+    m_sDescendantRatio = m_sDescendantCap = 1;
+    while( nStack )
+    {
+        nStack --;
+        geom::cMatrix3d matCS = arrmatStack[ nStack ];
+        geom::scalar sR = arrsStackR[ nStack ];
+        size_t nDepth = arrnStackDepth[ nStack ];
+        geom::cVector3d vecCenter( matCS[ geom::X ][ geom::W ], matCS[ geom::Y ][ geom::W ], matCS[ geom::Z ][ geom::W ] );
+        geom::scalar sReach = nDepth < gnBoundLevels ? sR : sR * sInvariant;
+        if( sqrt( vecCenter * vecCenter ) + sReach > m_sDescendantRatio )
+            m_sDescendantRatio = sqrt( vecCenter * vecCenter ) + sReach;
+        if( sReach - vecCenter[ geom::Z ] > m_sDescendantCap )
+            m_sDescendantCap = sReach - vecCenter[ geom::Z ];
+        if( nDepth == gnBoundLevels )
+            continue;
+        for( cChd = 0; cChd < m_nChildren; cChd ++ )
+        {
+            geom::cMatrix3d matRel = m_arrmatRel[ cChd ];
+            int cRow;
+            for( cRow = 0; cRow < geom::W; cRow ++ )
+                matRel( cRow )( geom::W ) *= sR;
+            arrmatStack[ nStack ] = matCS * matRel;
+            arrsStackR[ nStack ] = sR * m_sRatio;
+            arrnStackDepth[ nStack ++ ] = nDepth + 1;
+        }
+    }
+    if( m_sDescendantRatio > sInvariant )
+        m_sDescendantRatio = sInvariant;
+    if( m_sDescendantCap > m_sDescendantRatio )
+        m_sDescendantCap = m_sDescendantRatio;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// cSphereTree implementation
+
+cSphereTree::cSphereTree( const cTransformSet& rSet )
+    : m_sRootRadius( static_cast<geom::scalar>( 3.0 )), m_set( rSet )
+{
+    _ASSERT( m_set.m_nChildren > 0 && m_set.m_nChildren <= gnSphereChildren );
+    _ASSERT( m_set.m_sRatio > 0 && m_set.m_sRatio < 1 );
+}
+
+const cTransformSet&
+cSphereTree::GetTransformSet() const
+{
+    return m_set;
+}
+
+snapshotkey
+cSphereTree::GetGeneratorKey() const
+{
+    geom::scalar arrsRow[ geom::W + 1 ];
+    unsigned long long nChildren = m_set.m_nChildren;
+    snapshotkey nKey = cNodeSnapshot::Hash( &nChildren, sizeof( nChildren ), 0 );
+    nKey = cNodeSnapshot::Hash( &m_set.m_sRatio, sizeof( m_set.m_sRatio ), nKey );
+    size_t cMat;
+    int cRow, cCol;
+    for( cMat = 0; cMat <= m_set.m_nChildren; cMat ++ )
+    {
+        const geom::cMatrix3d& rMat = cMat < m_set.m_nChildren ? m_set.m_arrmatRel[ cMat ] : m_matRoot;
+        for( cRow = 0; cRow <= geom::W; cRow ++ )
+        {
+            for( cCol = 0; cCol <= geom::W; cCol ++ )
+                arrsRow[ cCol ] = rMat[ cRow ][ cCol ];
+            nKey = cNodeSnapshot::Hash( arrsRow, sizeof( arrsRow ), nKey );
+        }
+    }
+    return cNodeSnapshot::Hash( &m_sRootRadius, sizeof( m_sRootRadius ), nKey );
+}
+
+void
+cSphereTree::GenerateChildCS( const geom::cMatrix3d& matParent, geom::scalar sR, size_t nChild, geom::cMatrix3d& matOut ) const
+{
+    // the relative transform is rigid, only its translation column scales with the parent radius
+    _ASSERT( nChild < m_set.m_nChildren );
+    geom::cMatrix3d matRel = m_set.m_arrmatRel[ nChild ];
+    int cRow;
+    for( cRow = 0; cRow < geom::W; cRow ++ )
+        matRel( cRow )( geom::W ) *= sR;
+    matOut = matParent * matRel;
+}
+
+void
+cSphereTree::GenerateChildCS( const geom::cMatrix3d& matParent, geom::scalar sR, geom::cMatrix3d* parrmatOut ) const
+{
+    // the slots the set does not use get the parent CS, so that a whole store group or page level is always defined
+    size_t cChd;
+    for( cChd = 0; cChd < gnSphereChildren; cChd ++ )
+        if( cChd < m_set.m_nChildren )
+            GenerateChildCS( matParent, sR, cChd, parrmatOut[ cChd ] );
+        else
+            parrmatOut[ cChd ] = matParent;
+}
+
+void
+cSphereTree::GenerateChildCS( const geom::cMatrix3d* parrmatParents, size_t nParents, geom::scalar sR, geom::cMatrix3d* parrmatOut ) const
+{
+    // the same scaled relative transforms for all the parents, and the groups laid out one after another
+    geom::cMatrix3d arrmatRel[ gnSphereChildren ];
+    size_t cChd, cParent;
+    for( cChd = 0; cChd < m_set.m_nChildren; cChd ++ )
+    {
+        arrmatRel[ cChd ] = m_set.m_arrmatRel[ cChd ];
+        int cRow;
+        for( cRow = 0; cRow < geom::W; cRow ++ )
+            arrmatRel[ cChd ]( cRow )( geom::W ) *= sR;
+    }
+    geom::BatchProduct( parrmatParents, nParents, arrmatRel, m_set.m_nChildren, parrmatOut, gnSphereChildren );
+    for( cParent = 0; cParent < nParents; cParent ++ )
+        for( cChd = m_set.m_nChildren; cChd < gnSphereChildren; cChd ++ )
+            parrmatOut[ cParent * gnSphereChildren + cChd ] = parrmatParents[ cParent ];
+}
+
+bool
+cSphereTree::IsInSet( size_t nDigits, size_t nLevels ) const
+{
+    size_t cLevel;
+    for( cLevel = 0; cLevel < nLevels; cLevel ++, nDigits /= gnSphereChildren )
+        if( nDigits % gnSphereChildren >= m_set.m_nChildren )
+            return false;
+    return true;
+}
+
+geom::cPoint3d
+cSphereTree::GenerateChildCenter( const geom::cMatrix3d& matParent, geom::scalar sR, size_t nChild ) const
+{
+    // the parent CS applied to the scaled relative translation, without the rotation part of the product
+    const geom::cMatrix3d& matRel = m_set.m_arrmatRel[ nChild ];
+    geom::scalar arrsCenter[ geom::W ];
+    int cRow, cCol;
+    for( cRow = 0; cRow < geom::W; cRow ++ )
+    {
+        geom::scalar sSum = 0;
+        for( cCol = 0; cCol < geom::W; cCol ++ )
+            sSum += matParent[ cRow ][ cCol ] * matRel[ cCol ][ geom::W ];
+        arrsCenter[ cRow ] = matParent[ cRow ][ geom::W ] + sR * sSum;
+    }
+    return geom::cPoint3d( arrsCenter[ geom::X ], arrsCenter[ geom::Y ], arrsCenter[ geom::Z ] );
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// path code addressing
+
+pathcode
+cSphereTree::GetChildPath( pathcode nPath, size_t nChild )
+{
+    _ASSERT( nChild < gnSphereChildren );
+    if( nPath == gnInvalidPath || GetPathDepth( nPath ) >= gnPathMaxDepth )
+        return gnInvalidPath;
+    pathcode nDigits = nPath & ( ( 1ull << gnPathDigitBits ) - 1 );
+    return ( static_cast<pathcode>( GetPathDepth( nPath ) + 1 ) << gnPathDigitBits ) | ( nDigits * gnSphereChildren + nChild );
+}
+
+pathcode
+cSphereTree::GetParentPath( pathcode nPath )
+{
+    if( nPath == gnInvalidPath || GetPathDepth( nPath ) == 0 )
+        return gnInvalidPath;
+    pathcode nDigits = nPath & ( ( 1ull << gnPathDigitBits ) - 1 );
+    return ( static_cast<pathcode>( GetPathDepth( nPath ) - 1 ) << gnPathDigitBits ) | ( nDigits / gnSphereChildren );
+}
+
+size_t
+cSphereTree::GetPathDepth( pathcode nPath )
+{
+    return static_cast<size_t>( nPath >> gnPathDigitBits );
+}
+
+size_t
+cSphereTree::GetPathSlot( pathcode nPath )
+{
+    _ASSERT( nPath != gnInvalidPath && GetPathDepth( nPath ) > 0 );
+    return static_cast<size_t>( ( nPath & ( ( 1ull << gnPathDigitBits ) - 1 ) ) % gnSphereChildren );
+}
+
+void
+cSphereTree::GetPathLocalCS( pathcode nPath, geom::cMatrix3d& matCS ) const
+{
+    _ASSERT( nPath != gnInvalidPath );
+    size_t nDepth = GetPathDepth( nPath );
+    pathcode nDigits = nPath & ( ( 1ull << gnPathDigitBits ) - 1 );
+
+    // the root-most digit is the most significant one
+    pathcode nDivisor = 1;
+    size_t cLevel;
+    for( cLevel = 1; cLevel < nDepth; cLevel ++ )
+        nDivisor *= gnSphereChildren;
+
+    matCS = m_matRoot;
+    geom::scalar sR = m_sRootRadius;
+    for( cLevel = 0; cLevel < nDepth; cLevel ++ )
+    {
+        geom::cMatrix3d matParent = matCS;
+        GenerateChildCS( matParent, sR, static_cast<size_t>( ( nDigits / nDivisor ) % gnSphereChildren ), matCS );
+        nDivisor /= gnSphereChildren;
+        sR *= m_set.m_sRatio;
+    }
+}
+
+geom::cPoint3d
+cSphereTree::GetPathCenter( pathcode nPath ) const
+{
+    geom::cMatrix3d matCS;
+    GetPathLocalCS( nPath, matCS );
+    return geom::cPoint3d( matCS[ geom::X ][ geom::W ], matCS[ geom::Y ][ geom::W ], matCS[ geom::Z ][ geom::W ] );
+}
+
+geom::scalar
+cSphereTree::GetPathRadius( pathcode nPath ) const
+{
+    _ASSERT( nPath != gnInvalidPath );
+    geom::scalar sR = m_sRootRadius;
+    size_t cLevel;
+    for( cLevel = GetPathDepth( nPath ); cLevel > 0; cLevel -- )
+        sR *= m_set.m_sRatio;
+    return sR;
+}
+
+} // NS end
@@ -0,0 +1,92 @@
+/*
+* MIT License
+* 
+* Copyright (c) 2020 ibaylov@gmail.com
+* 
+* Permission is hereby granted, free of charge, to any person obtaining a copy
+* of this software and associated documentation files (the "Software"), to deal
+* in the Software without restriction, including without limitation the rights
+* to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+* copies of the Software, and to permit persons to whom the Software is
+* furnished to do so, subject to the following conditions:
+* 
+* The above copyright notice and this permission notice shall be included in all
+* copies or substantial portions of the Software.
+* 
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+* AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+* OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+* SOFTWARE.
+*/
+#ifndef _MVC_SPHERE_TREE_
+#define _MVC_SPHERE_TREE_
+#include "node-snapshot.hh"
+
+/**
+@file  sphere-tree.hh
+@brief The geometry of the sphere tree: the transform set, the path codes and the generation of the child local CS
+cSphereTree computes where every element of the tree is, without the caches, the arenas and the threads of the model
+around it, so that the build time generator of top-levels.cc needs nothing else. cFractalcModel is a cSphereTree
+*/
+
+namespace mvc
+{
+    const size_t gnBoundLevels  = 5;   //!< the levels DeriveBounds() expands the tree to
+
+    ////////////////////////////////////////////////////////////////////
+    /// \brief The cTransformSet struct
+    /// The self-similar set the model iterates: every element has m_nChildren children, m_sRatio times its radius,
+    /// placed by constant transforms relative to a unit radius parent. The store groups and the path digits keep
+    /// gnSphereChildren slots, of which the set uses the first m_nChildren. The descendant bounds follow from the
+    /// transforms, see DeriveBounds()
+    struct cTransformSet
+    {
+        size_t          m_nChildren;        //!< the children of every element, 1 to gnSphereChildren
+        geom::scalar    m_sRatio;           //!< the child radius to the parent radius
+        geom::scalar    m_sDescendantRatio; //!< the radius enclosing all the descendants to the element radius
+        geom::scalar    m_sDescendantCap;   //!< how far below the center, along the local Z axis, the descendants reach, to the element radius
+        ////////////////////////////////////////////////////////////////////
+        /// \brief m_arrmatRel - the child local CS relative to the parent CS, for a unit radius parent
+        /// the rotation part is constant, the translation column scales with the parent radius
+        geom::cMatrix3d m_arrmatRel[ gnSphereChildren ];
+
+        void DeriveBounds(); //!< Computes the descendant bounds from the transforms
+    };
+
+    ////////////////////////////////////////////////////////////////////
+    /// \brief The cSphereTree class
+    /// The tree a transform set grows from the root: the root is placed in the origin of the model CS, with a radius
+    /// of 3 units, and every element is found from its path code
+    class cSphereTree
+    {
+    protected:
+        geom::cMatrix3d m_matRoot;       //!< the root element local CS
+        geom::scalar    m_sRootRadius;   //!< the root element radius
+        cTransformSet   m_set;           //!< the transform set, copied so that the tree is self-contained
+    public:
+        explicit cSphereTree( const cTransformSet& rSet );
+        // accessors
+        const cTransformSet& GetTransformSet() const; //!< Retrieves the iterated transform set
+        snapshotkey GetGeneratorKey() const;        //!< Retrieves the signature of the tree geometry
+        // path code addressing
+        static pathcode GetChildPath( pathcode nPath, size_t nChild ); //!< Retrieves the path code of a child
+        static pathcode GetParentPath( pathcode nPath );               //!< Retrieves the path code of the parent, gnInvalidPath for the root
+        static size_t   GetPathDepth( pathcode nPath );                //!< Retrieves the depth of the element
+        static size_t   GetPathSlot( pathcode nPath );                 //!< Retrieves the child slot of the element in its parent
+        void            GetPathLocalCS( pathcode nPath, geom::cMatrix3d& matCS ) const; //!< Computes the element local CS from the path code
+        geom::cPoint3d  GetPathCenter( pathcode nPath ) const;         //!< Computes the element center from the path code
+        geom::scalar    GetPathRadius( pathcode nPath ) const;         //!< Computes the element radius from the path code
+        // generation
+        void GenerateChildCS( const geom::cMatrix3d& matParent, geom::scalar sR, geom::cMatrix3d* parrmatOut ) const; //!< Generates the local CS of a whole group
+        void GenerateChildCS( const geom::cMatrix3d* parrmatParents, size_t nParents, geom::scalar sR, geom::cMatrix3d* parrmatOut ) const; //!< Generates the groups of nParents parents of the same radius at once
+    protected:
+        void GenerateChildCS( const geom::cMatrix3d& matParent, geom::scalar sR, size_t nChild, geom::cMatrix3d& matOut ) const; //!< Generates a single child local CS
+        geom::cPoint3d GenerateChildCenter( const geom::cMatrix3d& matParent, geom::scalar sR, size_t nChild ) const; //!< Generates a single child center only
+        bool IsInSet( size_t nDigits, size_t nLevels ) const; //!< Checks if the nLevels low path digits all address children of the set
+    };
+}
+
+#endif
@@ -0,0 +1,268 @@
+/*
+* MIT License
+* 
+* Copyright (c) 2020 ibaylov@gmail.com
+* 
+* Permission is hereby granted, free of charge, to any person obtaining a copy
+* of this software and associated documentation files (the "Software"), to deal
+* in the Software without restriction, including without limitation the rights
+* to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+* copies of the Software, and to permit persons to whom the Software is
+* furnished to do so, subject to the following conditions:
+* 
+* The above copyright notice and this permission notice shall be included in all
+* copies or substantial portions of the Software.
+* 
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+* AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+* OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+* SOFTWARE.
+*/
+#ifndef _MVC_STATIC_VIEW_
+#define _MVC_STATIC_VIEW_
+#include "oglview.hh"
+#include <GL/gl.h>
+
+/**
+@file  static-view.hh
+@brief The cStaticOGLView template: the cOGLView traversal instantiated on the concrete model and stencil types
+The Model class provides
+    elementtype           - the concrete element class, preferably final so that its bounds are inlined
+    GetRootSphere()       - the root element as an elementtype pointer
+    EnumerateChildren()   - a template over the visitor class, passing the children of an elementtype
+The stencils are bound with SetTypedStencil(), which instantiates the drawing loops for the stencil class; its Apply()
+is called qualified, so it is not dispatched and may be inlined. Whenever the associated model or stencil isn't the
+typed one, the view falls back to the virtual cOGLView implementation
+*/
+
+namespace mvc
+{
+    ////////////////////////////////////////////////////////////////////////////
+    /// \brief The cStaticOGLView template - the statically dispatched cOGLView
+    ///
+    template<typename Model> class cStaticOGLView : public cOGLView
+    {
+        public:
+            typedef typename Model::elementtype element; //!< the concrete element type
+        protected:
+            typedef void (*drawqueues)( cStaticOGLView*, utl::cArray<const element*>* ); //!< draws the traversal queues
+            typedef void (*drawcut)( cStaticOGLView* );  //!< draws the visible elements of the cut
+
+            Model*                  m_pTypedModel;    //!< the model the traversal is instantiated on, nullptr for none
+            const cElementStencil*  m_pTypedStencil;  //!< the stencil the drawing is instantiated on, nullptr for none
+            drawqueues              m_pfnDrawQueues;  //!< the drawing of the typed stencil
+            drawcut                 m_pfnDrawCut;     //!< the cut drawing of the typed stencil
+            bool                    m_bStatic;        //!< the statically dispatched traversal is enabled
+            utl::cArray<element*>       m_arrTypedOpen;                //!< the open stack of the typed traversal, kept between the frames
+            utl::cArray<cOpenState>     m_arrTypedOpenState;           //!< the state of each open element
+            utl::cArray<const element*> m_arrTypedDraw[ nDrawQueues ]; //!< the draw queues of the typed traversal, kept between the frames
+
+            ////////////////////////////////////////////////////////////////////
+            /// \brief The cTypedVisitor class
+            /// The open list visitor of the typed traversal; it doesn't derive from cChildVisitor, the model
+            /// calls it directly
+            class cTypedVisitor
+            {
+            protected:
+                cStaticOGLView*           m_pView;     //!< the view doing the occlusion tests
+                utl::cArray<element*>&    m_rarrOpen;  //!< the open stack of the traversal
+                size_t                    m_nOccluder; //!< the occluder of the element whose children are visited
+            public:
+                cTypedVisitor( cStaticOGLView* pView, utl::cArray<element*>& rarrOpen )
+                    : m_pView( pView ), m_rarrOpen( rarrOpen ), m_nOccluder( nNoOccluder )
+                {
+                }
+                //! Sets the element whose children are to be visited and the occluder of its own parent
+                void SetParent( const geom::cPoint3d& ptCenter, geom::scalar sR, size_t nUp )
+                {
+                    m_nOccluder = m_pView->m_arrOccluders.GetCount();
+                    m_pView->m_arrOccluders.Add( cOccluder());
+                    m_pView->SetupOccluder( ptCenter, sR, nUp, m_pView->m_arrOccluders[ m_nOccluder ] );
+                }
+                //! Retrieves the occluder chain of the children
+                size_t GetOccluder() const
+                {
+                    return m_nOccluder;
+                }
+                //! Culls the children occluded by the parent or by the larger elements above it
+                bool Accept( const cChildBounds& bndChild )
+                {
+                    return ! m_pView->OccludesChild( m_pView->m_arrOccluders, m_nOccluder, bndChild, nullptr );
+                }
+                //! Places the accepted children on the open stack
+                void Visit( element* pElem )
+                {
+                    m_rarrOpen.Add( pElem );
+                }
+            };
+
+        public:
+            //////////////////////////////////////////////////
+            /// \brief cStaticOGLView::cStaticOGLView
+            /// The default constructor, no typed model or stencil
+            cStaticOGLView()
+                : m_pTypedModel( nullptr ), m_pTypedStencil( nullptr ), m_pfnDrawQueues( nullptr ), m_pfnDrawCut( nullptr ),
+                  m_bStatic( true )
+            {
+            }
+
+            virtual ~cStaticOGLView() override
+            {
+            }
+
+            //////////////////////////////////////////////////
+            /// \brief cStaticOGLView::AssociateTypedModel
+            /// Associates the model and instantiates the traversal on it
+            /// \param pModel - the model to show
+            void AssociateTypedModel( Model* pModel )
+            {
+                AssociateModel( pModel );
+                m_pTypedModel = pModel;
+            }
+
+            //////////////////////////////////////////////////
+            /// \brief cStaticOGLView::SetTypedStencil
+            /// Sets the stencil and instantiates the drawing on it
+            /// \param pStencil - the stencil, of the concrete class
+            template<typename Stencil> void SetTypedStencil( Stencil* pStencil )
+            {
+                SetStencil( pStencil );
+                m_pTypedStencil = pStencil;
+                m_pfnDrawQueues = &DrawQueues<Stencil>;
+                m_pfnDrawCut = &DrawTypedCut<Stencil>;
+            }
+
+            //////////////////////////////////////////////////
+            /// \brief cStaticOGLView::SetStatic
+            /// Switches between the statically dispatched and the virtual traversal, e.g. to compare them
+            void SetStatic( bool bStatic )
+            {
+                m_bStatic = bStatic;
+            }
+
+            //////////////////////////////////////////////////
+            /// \brief cStaticOGLView::IsStatic
+            /// Checks if the statically dispatched traversal is enabled
+            bool IsStatic() const
+            {
+                return m_bStatic;
+            }
+
+        protected:
+            //////////////////////////////////////////////////
+            /// \brief cStaticOGLView::DisplayImpl
+            /// Runs the typed traversal and drawing where the associated model and stencil allow
+            virtual void DisplayImpl() override
+            {
+                // the parallel traversal goes through the virtual interface
+                if( ! m_bStatic || ! m_pTypedModel || m_pModel != m_pTypedModel || ( ! m_bCoherent && CanTraverseParallel()))
+                {
+                    cOGLView::DisplayImpl();
+                    return;
+                }
+                AnticipateCamera();
+                if( m_bCoherent )
+                {
+                    // the cut is updated through the virtual interface, since only the changed nodes are visited
+                    UpdateCut();
+                    if( IsStencilTyped())
+                        m_pfnDrawCut( this );
+                    else
+                        DrawCut();
+                    return;
+                }
+                DisplayTypedTraversal();
+            }
+
+            //////////////////////////////////////////////////
+            /// \brief cStaticOGLView::IsStencilTyped
+            /// Checks if the drawing may use the typed stencil
+            bool IsStencilTyped() const
+            {
+                return m_pStencil && m_pStencil == m_pTypedStencil;
+            }
+
+            //////////////////////////////////////////////////
+            /// \brief cStaticOGLView::DisplayTypedTraversal
+            /// Same as cOGLView::DisplayTraversal(), with no virtual calls per element
+            void DisplayTypedTraversal()
+            {
+                m_arrTypedOpen.Add( m_pTypedModel->GetRootSphere());
+                m_arrOccluders.Clear();
+
+                bool bRelative = m_pVP->IsRelative();
+                cTraversalStats stats = { 0, 0, 0 };
+                ClassifyOpen( m_arrTypedOpen, m_arrTypedOpenState, 0, ogl::gnAllPlanes, nNoOccluder, bRelative, m_arrTypedDraw, stats );
+                cTypedVisitor visitorOpen( this, m_arrTypedOpen );
+                while( m_arrTypedOpen.HasData())
+                {
+                    // the element is classified already, its children are classified together once they are open
+                    element* pElem = m_arrTypedOpen.PullTail();
+                    cOpenState stateElem = m_arrTypedOpenState.PullTail();
+                    size_t nFirst = m_arrTypedOpen.GetCount();
+                    visitorOpen.SetParent( pElem->GetCenter(), pElem->GetBoundingSphereRadius(), stateElem.m_nOccluder );
+                    m_pTypedModel->EnumerateChildren( pElem, visitorOpen );
+                    ClassifyOpen( m_arrTypedOpen, m_arrTypedOpenState, nFirst, stateElem.m_nPlanes, visitorOpen.GetOccluder(), bRelative, m_arrTypedDraw, stats );
+                }
+
+                if( IsStencilTyped())
+                {
+                    m_pfnDrawQueues( this, m_arrTypedDraw );
+                    return;
+                }
+                int cQueue;
+                for( cQueue = 0; cQueue < nDrawQueues; cQueue ++ )
+                    while( m_arrTypedDraw[ cQueue ].HasData())
+                        DrawElement( m_arrTypedDraw[ cQueue ].PullTail(), (LevelOfSDetail) cQueue );
+            }
+
+            //////////////////////////////////////////////////
+            /// \brief cStaticOGLView::DrawQueues
+            /// Draws and empties the traversal queues with the typed stencil
+            /// \param pView - the view
+            /// \param parrDraw - the queue per LOD
+            template<typename Stencil> static void DrawQueues( cStaticOGLView* pView, utl::cArray<const element*>* parrDraw )
+            {
+                Stencil* pStencil = static_cast<Stencil*>( pView->m_pStencil );
+                int cQueue;
+                for( cQueue = 0; cQueue < nDrawQueues; cQueue ++ )
+                    while( parrDraw[ cQueue ].HasData())
+                    {
+                        const element* pElem = parrDraw[ cQueue ].PullTail();
+                        pView->PlaceElement( pElem->GetLocalCS(), pElem->GetBoundingSphereRadius());
+                        pStencil->Stencil::Apply( pElem );
+                        glCallList( pView->m_uLODDisplayLists + cQueue );
+                        glPopMatrix();
+                    }
+            }
+
+            //////////////////////////////////////////////////
+            /// \brief cStaticOGLView::DrawTypedCut
+            /// Same as cOGLView::DrawCut(), with the typed stencil
+            /// \param pView - the view
+            template<typename Stencil> static void DrawTypedCut( cStaticOGLView* pView )
+            {
+                Stencil* pStencil = static_cast<Stencil*>( pView->m_pStencil );
+                int cQueue;
+                for( cQueue = 0; cQueue < nDrawQueues; cQueue ++ )
+                {
+                    size_t cNode;
+                    for( cNode = 0; cNode < pView->m_nCut; cNode ++ )
+                    {
+                        const cCutNode& rNode = pView->m_parrCut[ cNode ];
+                        if( ! rNode.m_oc.m_bVisible || rNode.m_oc.m_LOD != cQueue )
+                            continue;
+                        pView->PlaceElement( rNode.m_elem.GetLocalCS(), rNode.m_elem.GetBoundingSphereRadius());
+                        pStencil->Stencil::Apply( &rNode.m_elem );
+                        glCallList( pView->m_uLODDisplayLists + cQueue );
+                        glPopMatrix();
+                    }
+                }
+            }
+    };
+}
+
+#endif
@@ -0,0 +1,410 @@
+/*
+* MIT License
+* 
+* Copyright (c) 2020 ibaylov@gmail.com
+* 
+* Permission is hereby granted, free of charge, to any person obtaining a copy
+* of this software and associated documentation files (the "Software"), to deal
+* in the Software without restriction, including without limitation the rights
+* to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+* copies of the Software, and to permit persons to whom the Software is
+* furnished to do so, subject to the following conditions:
+* 
+* The above copyright notice and this permission notice shall be included in all
+* copies or substantial portions of the Software.
+* 
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+* AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+* OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+* SOFTWARE.
+*/
+#include "task-pool.hh"
+#include <sched.h>
+#include <unistd.h>
+
+namespace utl
+{
+
+////////////////////////////////////////////////////
+/// \brief gnIdleRounds - the rounds over the other deques an idle worker makes before it sleeps
+///
+const size_t gnIdleRounds = 64;
+
+///////////////////////////////////////////////////////////////////////////////
+// cTaskGroup implementation
+
+cTaskGroup::cTaskGroup()
+    : m_nPending( 0 )
+{
+}
+
+cTaskGroup::~cTaskGroup()
+{
+    _ASSERT( IsDone());
+}
+
+bool
+cTaskGroup::IsDone() const
+{
+    return __atomic_load_n( &m_nPending, __ATOMIC_ACQUIRE ) == 0;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// cTaskPool implementation
+
+cTaskPool::cTaskPool()
+    : m_parrDeques( nullptr ), m_parrWorkers( nullptr ), m_nWorkers( 0 ), m_bStop( false ), m_nSignals( 0 ), m_nSleeping( 0 )
+{
+    pthread_key_create( &m_keyWorker, nullptr );
+    pthread_mutex_init( &m_mutex, nullptr );
+    pthread_cond_init( &m_condWork, nullptr );
+}
+
+cTaskPool::~cTaskPool()
+{
+    Stop();
+    pthread_cond_destroy( &m_condWork );
+    pthread_mutex_destroy( &m_mutex );
+    pthread_key_delete( m_keyWorker );
+}
+
+bool
+cTaskPool::Start( size_t nWorkers )
+{
+    _ASSERT( ! IsRunning());
+    if( ! nWorkers )
+    {
+        long nProcessors = sysconf( _SC_NPROCESSORS_ONLN );
+        nWorkers = nProcessors > 0 ? static_cast<size_t>( nProcessors ) : 1;
+    }
+    if( nWorkers > gnTaskWorkers )
+        nWorkers = gnTaskWorkers;
+    m_parrDeques = new Deque[ nWorkers ];
+    m_parrWorkers = new Worker[ nWorkers ];
+    m_bStop = false;
+    size_t cWorker;
+    for( cWorker = 0; cWorker < nWorkers; cWorker ++ )
+    {
+        m_parrDeques[ cWorker ].m_nTop = 0;
+        m_parrDeques[ cWorker ].m_nBottom = 0;
+        m_parrDeques[ cWorker ].m_nSeed = static_cast<unsigned>( cWorker * 2654435769u + 1 );
+        m_parrWorkers[ cWorker ].m_pPool = this;
+        m_parrWorkers[ cWorker ].m_nIndex = cWorker;
+        m_parrWorkers[ cWorker ].m_bOwn = false;
+    }
+    // the starting thread is the worker 0
+    pthread_setspecific( m_keyWorker, reinterpret_cast<void*>( 1 ));
+    // the workers read the count as they steal, so it is set in advance and cut back on failure
+    m_nWorkers = nWorkers;
+    for( cWorker = 1; cWorker < nWorkers; cWorker ++ )
+        if( pthread_create( &m_parrWorkers[ cWorker ].m_thread, nullptr, ThreadProc, m_parrWorkers + cWorker ))
+        {
+            Shutdown( cWorker ); // no task has been submitted yet, so the running ones only need stopping
+            return false;
+        }
+    return true;
+}
+
+void
+cTaskPool::Stop()
+{
+    if( IsRunning())
+        Shutdown( m_nWorkers );
+}
+
+void
+cTaskPool::Submit( cTaskGroup& rGroup, taskproc pfnTask, void* pContext, size_t nBegin, size_t nEnd )
+{
+    if( ! IsRunning())
+    {
+        pfnTask( pContext, nBegin, nEnd );
+        return;
+    }
+    Task task = { pfnTask, pContext, nBegin, nEnd, 0, &rGroup };
+    __atomic_add_fetch( &rGroup.m_nPending, 1, __ATOMIC_RELAXED );
+    Push( GetWorkerIndex(), task );
+}
+
+void
+cTaskPool::ParallelFor( taskproc pfnTask, void* pContext, size_t nBegin, size_t nEnd, size_t nGrain )
+{
+    if( nBegin >= nEnd )
+        return;
+    if( ! IsRunning())
+    {
+        pfnTask( pContext, nBegin, nEnd );
+        return;
+    }
+    if( ! nGrain )
+        nGrain = 1;
+    cTaskGroup group;
+    Task task = { pfnTask, pContext, nBegin, nEnd, nGrain, &group };
+    __atomic_add_fetch( &group.m_nPending, 1, __ATOMIC_RELAXED );
+    // the calling thread starts on the range right away, the others steal the upper halves it pushes
+    Execute( GetWorkerIndex(), task );
+    Wait( group );
+}
+
+void
+cTaskPool::Wait( cTaskGroup& rGroup )
+{
+    if( ! IsRunning())
+        return; // the tasks have run on submission
+    size_t nWorker = GetWorkerIndex();
+    Task task;
+    while( ! rGroup.IsDone())
+        if( FindTask( nWorker, task ))
+            Execute( nWorker, task );
+        else
+            sched_yield(); // the rest of the group is running elsewhere
+}
+
+void
+cTaskPool::RunOnEach( taskproc pfnTask, void* pContext )
+{
+    if( ! IsRunning())
+    {
+        pfnTask( pContext, 0, 1 );
+        return;
+    }
+    size_t nSelf = GetWorkerIndex();
+    cTaskGroup group;
+    __atomic_add_fetch( &group.m_nPending, m_nWorkers, __ATOMIC_RELAXED );
+    size_t cWorker;
+    for( cWorker = 0; cWorker < m_nWorkers; cWorker ++ )
+        if( cWorker != nSelf )
+        {
+            Worker& rWorker = m_parrWorkers[ cWorker ];
+            _ASSERT( ! __atomic_load_n( &rWorker.m_bOwn, __ATOMIC_ACQUIRE ));
+            Task task = { pfnTask, pContext, cWorker, cWorker + 1, 0, &group };
+            StoreTask( rWorker.m_taskOwn, task );
+            __atomic_store_n( &rWorker.m_bOwn, true, __ATOMIC_RELEASE );
+        }
+    // the sleepers are all woken, each of them has a task
+    __atomic_add_fetch( &m_nSignals, 1, __ATOMIC_SEQ_CST );
+    if( __atomic_load_n( &m_nSleeping, __ATOMIC_SEQ_CST ))
+    {
+        pthread_mutex_lock( &m_mutex );
+        pthread_cond_broadcast( &m_condWork );
+        pthread_mutex_unlock( &m_mutex );
+    }
+    Task task = { pfnTask, pContext, nSelf, nSelf + 1, 0, &group };
+    Execute( nSelf, task );
+    Wait( group );
+}
+
+bool
+cTaskPool::IsRunning() const
+{
+    return m_nWorkers != 0;
+}
+
+size_t
+cTaskPool::GetWorkerCount() const
+{
+    return m_nWorkers;
+}
+
+size_t
+cTaskPool::GetWorkerIndex() const
+{
+    size_t nWorker = reinterpret_cast<size_t>( pthread_getspecific( m_keyWorker ));
+    _ASSERT( nWorker && nWorker <= m_nWorkers ); // only the workers may submit or wait
+    return nWorker - 1;
+}
+
+void
+cTaskPool::Shutdown( size_t nThreads )
+{
+    pthread_mutex_lock( &m_mutex );
+    __atomic_store_n( &m_bStop, true, __ATOMIC_SEQ_CST );
+    pthread_cond_broadcast( &m_condWork );
+    pthread_mutex_unlock( &m_mutex );
+    size_t cWorker;
+    for( cWorker = 1; cWorker < nThreads; cWorker ++ )
+        pthread_join( m_parrWorkers[ cWorker ].m_thread, nullptr );
+    for( cWorker = 0; cWorker < m_nWorkers; cWorker ++ )
+        _ASSERT( m_parrDeques[ cWorker ].m_nTop == m_parrDeques[ cWorker ].m_nBottom );
+    pthread_setspecific( m_keyWorker, nullptr );
+    delete [] m_parrWorkers;
+    delete [] m_parrDeques;
+    m_parrWorkers = nullptr;
+    m_parrDeques = nullptr;
+    m_nWorkers = 0;
+}
+
+void*
+cTaskPool::ThreadProc( void* pArg )
+{
+    Worker* pWorker = static_cast<Worker*>( pArg );
+    pthread_setspecific( pWorker->m_pPool->m_keyWorker, reinterpret_cast<void*>( pWorker->m_nIndex + 1 ));
+    pWorker->m_pPool->Run( pWorker->m_nIndex );
+    return nullptr;
+}
+
+void
+cTaskPool::Run( size_t nWorker )
+{
+    Task task;
+    size_t nIdle = 0;
+    while( ! __atomic_load_n( &m_bStop, __ATOMIC_ACQUIRE ))
+    {
+        unsigned nSignals = __atomic_load_n( &m_nSignals, __ATOMIC_SEQ_CST );
+        if( FindTask( nWorker, task ))
+        {
+            Execute( nWorker, task );
+            nIdle = 0;
+            continue;
+        }
+        if( ++ nIdle < gnIdleRounds )
+        {
+            sched_yield();
+            continue;
+        }
+        // a submission after the signal count was read either shows in it now or finds us counted as sleeping
+        pthread_mutex_lock( &m_mutex );
+        __atomic_add_fetch( &m_nSleeping, 1, __ATOMIC_SEQ_CST );
+        if( __atomic_load_n( &m_nSignals, __ATOMIC_SEQ_CST ) == nSignals && ! m_bStop )
+            pthread_cond_wait( &m_condWork, &m_mutex );
+        __atomic_sub_fetch( &m_nSleeping, 1, __ATOMIC_SEQ_CST );
+        pthread_mutex_unlock( &m_mutex );
+        nIdle = 0;
+    }
+}
+
+void
+cTaskPool::Push( size_t nWorker, const Task& rTask )
+{
+    Deque& rDeque = m_parrDeques[ nWorker ];
+    long long nBottom = __atomic_load_n( &rDeque.m_nBottom, __ATOMIC_RELAXED );
+    long long nTop = __atomic_load_n( &rDeque.m_nTop, __ATOMIC_ACQUIRE );
+    if( nBottom - nTop >= static_cast<long long>( gnTaskDeque ))
+    {
+        // the deque is full, which means there's plenty for the others already
+        Task task = rTask;
+        Execute( nWorker, task );
+        return;
+    }
+    StoreTask( rDeque.m_arrTasks[ nBottom & ( gnTaskDeque - 1 )], rTask );
+    __atomic_store_n( &rDeque.m_nBottom, nBottom + 1, __ATOMIC_RELEASE );
+    // wake a sleeper, if any
+    __atomic_add_fetch( &m_nSignals, 1, __ATOMIC_SEQ_CST );
+    if( __atomic_load_n( &m_nSleeping, __ATOMIC_SEQ_CST ))
+    {
+        pthread_mutex_lock( &m_mutex );
+        pthread_cond_signal( &m_condWork );
+        pthread_mutex_unlock( &m_mutex );
+    }
+}
+
+bool
+cTaskPool::Pop( size_t nWorker, Task& rTask )
+{
+    Deque& rDeque = m_parrDeques[ nWorker ];
+    long long nBottom = __atomic_load_n( &rDeque.m_nBottom, __ATOMIC_RELAXED ) - 1;
+    __atomic_store_n( &rDeque.m_nBottom, nBottom, __ATOMIC_RELAXED );
+    // the bottom store has to be seen by the thieves before we look at the top
+    __atomic_thread_fence( __ATOMIC_SEQ_CST );
+    long long nTop = __atomic_load_n( &rDeque.m_nTop, __ATOMIC_RELAXED );
+    if( nTop > nBottom )
+    {
+        // empty
+        __atomic_store_n( &rDeque.m_nBottom, nBottom + 1, __ATOMIC_RELAXED );
+        return false;
+    }
+    LoadTask( rDeque.m_arrTasks[ nBottom & ( gnTaskDeque - 1 )], rTask );
+    if( nTop < nBottom )
+        return true;
+    // the last task, the thieves may be after it as well
+    bool bWon = __atomic_compare_exchange_n( &rDeque.m_nTop, &nTop, nTop + 1, false, __ATOMIC_SEQ_CST, __ATOMIC_RELAXED );
+    __atomic_store_n( &rDeque.m_nBottom, nBottom + 1, __ATOMIC_RELAXED );
+    return bWon;
+}
+
+bool
+cTaskPool::Steal( size_t nVictim, Task& rTask )
+{
+    Deque& rDeque = m_parrDeques[ nVictim ];
+    long long nTop = __atomic_load_n( &rDeque.m_nTop, __ATOMIC_ACQUIRE );
+    __atomic_thread_fence( __ATOMIC_SEQ_CST );
+    long long nBottom = __atomic_load_n( &rDeque.m_nBottom, __ATOMIC_ACQUIRE );
+    if( nTop >= nBottom )
+        return false;
+    // the slot may be overwritten while we read it only once the top has moved past it, so the copy is good if the
+    // exchange succeeds
+    LoadTask( rDeque.m_arrTasks[ nTop & ( gnTaskDeque - 1 )], rTask );
+    return __atomic_compare_exchange_n( &rDeque.m_nTop, &nTop, nTop + 1, false, __ATOMIC_SEQ_CST, __ATOMIC_RELAXED );
+}
+
+bool
+cTaskPool::FindTask( size_t nWorker, Task& rTask )
+{
+    // the task sent to this worker alone can't be taken by the others, so it goes first
+    Worker& rWorker = m_parrWorkers[ nWorker ];
+    if( __atomic_load_n( &rWorker.m_bOwn, __ATOMIC_ACQUIRE ))
+    {
+        LoadTask( rWorker.m_taskOwn, rTask );
+        __atomic_store_n( &rWorker.m_bOwn, false, __ATOMIC_RELAXED );
+        return true;
+    }
+    if( Pop( nWorker, rTask ))
+        return true;
+    if( m_nWorkers < 2 )
+        return false;
+    // a round over the others from a random victim on
+    unsigned& rSeed = m_parrDeques[ nWorker ].m_nSeed;
+    rSeed ^= rSeed << 13;
+    rSeed ^= rSeed >> 17;
+    rSeed ^= rSeed << 5;
+    size_t nVictim = rSeed % m_nWorkers;
+    size_t cVictim;
+    for( cVictim = 0; cVictim < m_nWorkers; cVictim ++, nVictim = ( nVictim + 1 ) % m_nWorkers )
+        if( nVictim != nWorker && Steal( nVictim, rTask ))
+            return true;
+    return false;
+}
+
+void
+cTaskPool::Execute( size_t nWorker, Task& rTask )
+{
+    // keeping the lower half, which is run next, and offering the upper one
+    while( rTask.m_nGrain && rTask.m_nEnd - rTask.m_nBegin > rTask.m_nGrain )
+    {
+        size_t nMiddle = rTask.m_nBegin + ( rTask.m_nEnd - rTask.m_nBegin ) / 2;
+        Task taskUpper = rTask;
+        taskUpper.m_nBegin = nMiddle;
+        rTask.m_nEnd = nMiddle;
+        __atomic_add_fetch( &rTask.m_pGroup->m_nPending, 1, __ATOMIC_RELAXED );
+        Push( nWorker, taskUpper );
+    }
+    rTask.m_pfnTask( rTask.m_pContext, rTask.m_nBegin, rTask.m_nEnd );
+    // the release makes the task's work visible to the waiter that sees the count drop
+    __atomic_sub_fetch( &rTask.m_pGroup->m_nPending, 1, __ATOMIC_RELEASE );
+}
+
+void
+cTaskPool::StoreTask( Task& rSlot, const Task& rTask )
+{
+    __atomic_store_n( &rSlot.m_pfnTask, rTask.m_pfnTask, __ATOMIC_RELAXED );
+    __atomic_store_n( &rSlot.m_pContext, rTask.m_pContext, __ATOMIC_RELAXED );
+    __atomic_store_n( &rSlot.m_nBegin, rTask.m_nBegin, __ATOMIC_RELAXED );
+    __atomic_store_n( &rSlot.m_nEnd, rTask.m_nEnd, __ATOMIC_RELAXED );
+    __atomic_store_n( &rSlot.m_nGrain, rTask.m_nGrain, __ATOMIC_RELAXED );
+    __atomic_store_n( &rSlot.m_pGroup, rTask.m_pGroup, __ATOMIC_RELAXED );
+}
+
+void
+cTaskPool::LoadTask( const Task& rSlot, Task& rTask )
+{
+    rTask.m_pfnTask = __atomic_load_n( &rSlot.m_pfnTask, __ATOMIC_RELAXED );
+    rTask.m_pContext = __atomic_load_n( &rSlot.m_pContext, __ATOMIC_RELAXED );
+    rTask.m_nBegin = __atomic_load_n( &rSlot.m_nBegin, __ATOMIC_RELAXED );
+    rTask.m_nEnd = __atomic_load_n( &rSlot.m_nEnd, __ATOMIC_RELAXED );
+    rTask.m_nGrain = __atomic_load_n( &rSlot.m_nGrain, __ATOMIC_RELAXED );
+    rTask.m_pGroup = __atomic_load_n( &rSlot.m_pGroup, __ATOMIC_RELAXED );
+}
+
+} // namespace utl
@@ -0,0 +1,154 @@
+/*
+* MIT License
+* 
+* Copyright (c) 2020 ibaylov@gmail.com
+* 
+* Permission is hereby granted, free of charge, to any person obtaining a copy
+* of this software and associated documentation files (the "Software"), to deal
+* in the Software without restriction, including without limitation the rights
+* to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+* copies of the Software, and to permit persons to whom the Software is
+* furnished to do so, subject to the following conditions:
+* 
+* The above copyright notice and this permission notice shall be included in all
+* copies or substantial portions of the Software.
+* 
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+* AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+* OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+* SOFTWARE.
+*/
+#ifndef _TASK_POOL_HH_
+#define _TASK_POOL_HH_
+#include <cstdlib>
+#include <pthread.h>
+#include "assert.hh"
+
+/**
+@file  task-pool.hh
+@brief The pool of worker threads sharing the work by stealing
+Every worker owns a deque of tasks. It pushes and pops at the bottom end, without contention, while the idle workers
+steal from the top end of the others, taking the oldest and thus usually the largest pieces of work; this is the
+Chase-Lev deque, whose owner operations are a few plain stores and a fence, and whose thieves race by a single
+compare-and-swap on the top index. The thread that starts the pool is a worker too: it submits the work and helps
+with it while it waits.
+A task runs a procedure over a range of indices. A parallel-for range is split in halves down to a grain, the upper
+half pushed for the others to steal and the lower half kept, so the work spreads with a logarithmic number of pushes
+and the pieces that stay home are run in the order of the indices. Tasks belong to groups, a group counts its pending
+tasks and Wait() returns once it drops to zero. RunOnEach() hands a task to every worker in particular, for the work
+that has to be done in each thread, like the per-thread state a task leaves behind.
+The idle workers spin for a while, then sleep until new work is submitted.
+@note Only the workers may submit, the starting thread included. A full deque runs the task in place instead, and so
+does a pool that isn't started.
+*/
+
+namespace utl
+{
+    //////////////////////////////////////////////////
+    /// \brief gnTaskWorkers - the workers of a pool at most, the starting thread included
+    ///
+    const size_t gnTaskWorkers = 64;
+
+    //////////////////////////////////////////////////
+    /// \brief gnTaskDeque - the tasks a worker deque holds, a power of 2
+    ///
+    const size_t gnTaskDeque = 4096;
+
+    //////////////////////////////////////////////////
+    /// \brief taskproc - runs a task over the indices from nBegin to nEnd, with the context it was submitted with
+    ///
+    typedef void ( *taskproc )( void* pContext, size_t nBegin, size_t nEnd );
+
+    //////////////////////////////////////////////////
+    /// \brief The cTaskGroup class
+    /// counts the pending tasks submitted with it, see cTaskPool::Wait()
+    class cTaskGroup
+    {
+        protected:
+            size_t  m_nPending;     //!< the tasks submitted and not finished yet
+            friend class cTaskPool;
+        public:
+            cTaskGroup();
+            ~cTaskGroup();
+            #ifndef _NO_CXX_11_
+            cTaskGroup( const cTaskGroup& ) = delete; //!< Prevent direct copy
+            #endif
+            bool IsDone() const;    //!< Checks if all the tasks of the group have finished
+    };
+
+    //////////////////////////////////////////////////
+    /// \brief The cTaskPool class
+    /// implements the workers and their deques, see the file description
+    class cTaskPool
+    {
+        protected:
+            struct Task
+            {
+                taskproc    m_pfnTask;      //!< the procedure
+                void*       m_pContext;     //!< the procedure context
+                size_t      m_nBegin;       //!< the first index
+                size_t      m_nEnd;         //!< the index past the last one
+                size_t      m_nGrain;       //!< the range is split down to this many indices, 0 to run it whole
+                cTaskGroup* m_pGroup;       //!< the group the task counts in
+            };
+            struct Deque
+            {
+                long long   m_nTop;         //!< the index thieves steal from
+                char        m_arrPadTop[ 64 - sizeof( long long ) ]; //!< keeps the thieves off the owner cache line
+                long long   m_nBottom;      //!< the index the owner pushes at
+                unsigned    m_nSeed;        //!< the owner's victim choice state
+                char        m_arrPadBottom[ 64 - sizeof( long long ) - sizeof( unsigned ) ]; //!< keeps the next deque off
+                Task        m_arrTasks[ gnTaskDeque ]; //!< the ring of tasks, indexed modulo gnTaskDeque
+            };
+            struct Worker
+            {
+                cTaskPool*  m_pPool;        //!< the pool
+                size_t      m_nIndex;       //!< the worker index
+                pthread_t   m_thread;       //!< the thread, unused for the worker 0
+                Task        m_taskOwn;      //!< the task sent to this worker alone, see RunOnEach()
+                bool        m_bOwn;         //!< m_taskOwn is there to run
+            };
+            Deque*          m_parrDeques;   //!< the deque of every worker
+            Worker*         m_parrWorkers;  //!< the workers
+            size_t          m_nWorkers;     //!< the number of workers, the starting thread included
+            pthread_key_t   m_keyWorker;    //!< the worker index + 1 of the calling thread, 0 outside the pool
+            bool            m_bStop;        //!< the workers are to exit
+            unsigned        m_nSignals;     //!< counts the submissions, for the sleepers to see they missed none
+            unsigned        m_nSleeping;    //!< the workers sleeping on m_condWork
+            pthread_mutex_t m_mutex;        //!< guards the sleep
+            pthread_cond_t  m_condWork;     //!< signalled on submission and on stop
+        public:
+            cTaskPool();    //!< Constructs a stopped pool
+            ~cTaskPool();   //!< Stops the pool
+            #ifndef _NO_CXX_11_
+            cTaskPool( const cTaskPool& ) = delete; //!< Prevent direct copy
+            #endif
+            // operations
+            bool   Start( size_t nWorkers = 0 ); //!< Starts the workers, the calling thread being the worker 0; 0 for one per processor
+            void   Stop();                      //!< Stops the workers; no task may be pending
+            void   Submit( cTaskGroup& rGroup, taskproc pfnTask, void* pContext, size_t nBegin, size_t nEnd ); //!< Submits a task over a range, run whole
+            void   ParallelFor( taskproc pfnTask, void* pContext, size_t nBegin, size_t nEnd, size_t nGrain ); //!< Runs a task over a range split down to the grain and waits for it
+            void   Wait( cTaskGroup& rGroup );  //!< Runs the tasks of the pool until the group is done
+            void   RunOnEach( taskproc pfnTask, void* pContext ); //!< Runs a task once in every worker, the worker index being its range, and waits for it
+            // accessors
+            bool   IsRunning() const;           //!< Checks if the pool is started
+            size_t GetWorkerCount() const;      //!< Retrieves the number of workers, the starting thread included
+            size_t GetWorkerIndex() const;      //!< Retrieves the worker index of the calling thread
+        protected:
+            static void* ThreadProc( void* pArg ); //!< The pthread entry point
+            void   Run( size_t nWorker );       //!< The worker loop
+            void   Shutdown( size_t nThreads ); //!< Stops and joins the threads started so far, releases the deques
+            void   Push( size_t nWorker, const Task& rTask );   //!< Pushes a task at the bottom of the worker deque, runs it if the deque is full
+            bool   Pop( size_t nWorker, Task& rTask );          //!< Pops a task from the bottom of the worker deque
+            bool   Steal( size_t nVictim, Task& rTask );        //!< Steals a task from the top of a deque
+            bool   FindTask( size_t nWorker, Task& rTask );     //!< Pops a task or steals one from the other workers
+            void   Execute( size_t nWorker, Task& rTask );      //!< Splits the range of a task down to the grain and runs it
+            static void StoreTask( Task& rSlot, const Task& rTask ); //!< Writes a deque slot, field by field
+            static void LoadTask( const Task& rSlot, Task& rTask );  //!< Reads a deque slot, field by field
+    };
+}
+
+#endif
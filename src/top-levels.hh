@@ -0,0 +1,58 @@
+/*
+* MIT License
+* 
+* Copyright (c) 2020 ibaylov@gmail.com
+* 
+* Permission is hereby granted, free of charge, to any person obtaining a copy
+* of this software and associated documentation files (the "Software"), to deal
+* in the Software without restriction, including without limitation the rights
+* to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+* copies of the Software, and to permit persons to whom the Software is
+* furnished to do so, subject to the following conditions:
+* 
+* The above copyright notice and this permission notice shall be included in all
+* copies or substantial portions of the Software.
+* 
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+* AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+* OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+* SOFTWARE.
+*/
+#ifndef _MVC_TOP_LEVELS_
+#define _MVC_TOP_LEVELS_
+#include "page-cache.hh"
+
+/**
+@file  top-levels.hh
+@brief The top levels of the SphereFlake, embedded in the binary
+The first levels below the root are the same in every run, so the build computes them once: gen-top-levels runs
+the tree geometry of the model, see sphere-tree.hh, and writes the records to top-levels.cc, which is compiled in
+as constant data. The table lives in the read-only pages of the binary, shared by all the running instances, and
+the model copies or visits its records instead of generating them, see cFractalcModel::SetTopLevels()
+The levels are complete and breadth-first, 9 records per parent including the filler slots of the set, so the
+children of a node are found by arithmetic on the path code, as in a page. The radius and depth follow from the
+position in the tree; the orientation is quantized the same way the node store does it
+*/
+
+namespace mvc
+{
+    const size_t gnTopLevels = 4;                   //!< the levels below the root in the table
+    const size_t gnTopNodes  = 9 + 81 + 729 + 6561; //!< the records in the table, gnSphereChildren^1 + ... + gnSphereChildren^gnTopLevels
+
+    ////////////////////////////////////////////////////////////////////
+    /// \brief The cTopLevels struct - an embedded table of the top levels
+    /// The key ties the table to the transform set and the build it was generated with; a model of another set ignores it
+    struct cTopLevels
+    {
+        snapshotkey         m_nKey;     //!< the model signature, see cFractalcModel::GetGeneratorKey()
+        size_t              m_nLevels;  //!< the levels below the root
+        const cPagedNode*   m_pNodes;   //!< the records, level by level
+    };
+
+    extern const cTopLevels gtopSphereFlake; //!< the SphereFlake table, generated at build time
+}
+
+#endif
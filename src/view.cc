@@ -48,7 +48,9 @@ cView::AssociateModel( cModel* pModel )
 void
 cView::Display()
 {
+    m_pModel->BeginRead();
     DisplayImpl();
+    m_pModel->EndRead();
     m_pModel->Collect();
 }
 
@@ -26,19 +26,43 @@
 #include <GL/glut.h>
 #include <math.h>
 #include <iostream>
+#include "assert.hh"
+#if defined( __GNUC__ ) && defined( __x86_64__ )
+#define _OGL_BATCH_SIMD_
+#include <immintrin.h>
+#endif
 
 namespace ogl
 {
 using namespace geom;
 
+//! Normalizes a GL plane equation row into a clip plane and moves it by the GL origin vecGLOrigin to the WCS
+static void SetClipPlane( cClipPlane& rPlane, const cTuple3d& tplRow, const cVector3d& vecGLOrigin )
+{
+    scalar sN = sqrt( tplRow[ X ] * tplRow[ X ] + tplRow[ Y ] * tplRow[ Y ] + tplRow[ Z ] * tplRow[ Z ] );
+    rPlane.m_arrsNormal[ X ] = tplRow[ X ] / sN;
+    rPlane.m_arrsNormal[ Y ] = tplRow[ Y ] / sN;
+    rPlane.m_arrsNormal[ Z ] = tplRow[ Z ] / sN;
+    rPlane.m_sDistance = tplRow[ W ] / sN - ( rPlane.m_arrsNormal[ X ] * vecGLOrigin[ X ] + rPlane.m_arrsNormal[ Y ] * vecGLOrigin[ Y ] +
+                                             rPlane.m_arrsNormal[ Z ] * vecGLOrigin[ Z ] );
+}
+
+//! The signed distance of a point to a clip plane, positive on the side the normal points to
+static inline scalar PlaneDistance( const cClipPlane& rPlane, const cPoint3d& ptIn )
+{
+    return rPlane.m_arrsNormal[ X ] * ptIn[ X ] + rPlane.m_arrsNormal[ Y ] * ptIn[ Y ] + rPlane.m_arrsNormal[ Z ] * ptIn[ Z ] + rPlane.m_sDistance;
+}
+
 cViewport::cViewport()
+: m_bRelative( true ), m_ptAnchor( 0, 0, 0 )
 {
 
 }
 
 cViewport::cViewport( const geom::cPoint3d& ptEye, const geom::cVector3d& vecView, const geom::cVector3d& vecUp, 
                       scalar sFOV,  geom::decorator::AngleUnit unitFOV, int nPortWidth, int nPortHeight )
-: m_ptEye( ptEye), m_vecView( vecView ), m_vecUp( vecUp ), m_nW( nPortWidth ), m_nH( nPortHeight ) 
+: m_ptEye( ptEye), m_vecView( vecView ), m_vecUp( vecUp ), m_nW( nPortWidth ), m_nH( nPortHeight ),
+  m_bRelative( true ), m_ptAnchor( ptEye )
 {
     m_sFOV = decorator::ScalarToRadians( sFOV,  unitFOV );
     m_vecView.Normalize();
@@ -55,6 +79,7 @@ cViewport::Reset ( const geom::cPoint3d& ptEye, const geom::cVector3d& vecView,
     m_vecUp  = vecUp ;
     m_sFOV = decorator::ScalarToRadians( sFOV,  unitFOV );
     m_vecView.Normalize();
+    m_ptAnchor = ptEye;
 
     SetupOGLViev( );
 }
@@ -73,6 +98,13 @@ cViewport::SetExtents( int nPortWidth, int nPortHeight )
     SetupOGLViev( );
 }
 
+void
+cViewport::SetRelative( bool bRelative )
+{
+    m_bRelative = bRelative;
+    SetupOGLViev( );
+}
+
 void 
 cViewport::TransformBasis( const cMatrix3d& matTrans )
 {
@@ -160,6 +192,55 @@ cViewport::GetFOV() const
     return  m_sFOV;
 }
 
+const geom::cVector3d&
+cViewport::GetViewDirection() const
+{
+    return m_vecView;
+}
+
+const geom::cVector3d&
+cViewport::GetUpDirection() const
+{
+    return m_vecUp;
+}
+
+geom::scalar
+cViewport::GetAspect() const
+{
+    return static_cast<scalar>( m_nW ) / static_cast<scalar>( m_nH );
+}
+
+int
+cViewport::GetHeight() const
+{
+    return m_nH;
+}
+
+geom::scalar
+cViewport::GetPixelScale() const
+{
+    // gluPerspective takes the FOV vertically
+    return static_cast<scalar>( m_nH ) / 2 / tan( m_sFOV / 2 );
+}
+
+bool
+cViewport::IsRelative() const
+{
+    return m_bRelative;
+}
+
+const geom::cPoint3d&
+cViewport::GetAnchor() const
+{
+    return m_ptAnchor;
+}
+
+const float*
+cViewport::GetRelativeEye() const
+{
+    return m_arrfEye;
+}
+
 void 
 cViewport::SetupOGLViev( )
 {
@@ -169,13 +250,22 @@ cViewport::SetupOGLViev( )
     // the projection
     glMatrixMode(GL_PROJECTION);
     glLoadIdentity();     
-    gluPerspective( decorator::RadiansToScalar( m_sFOV, decorator::Degrees ), sAspect, 0.1, 30.0);
+    gluPerspective( decorator::RadiansToScalar( m_sFOV, decorator::Degrees ), sAspect, gsNearClip, gsFarClip );
     // the viewport
     glMatrixMode(GL_MODELVIEW);
     glLoadIdentity();
 
-    cPoint3d ptDir = m_ptEye + m_vecView;    
-    gluLookAt(	m_ptEye[X], m_ptEye[Y], m_ptEye[Z],
+    // rebase the relative coordinates once the eye is far enough from the anchor for the float error to show
+    cVector3d vecAnchor = m_ptEye - m_ptAnchor;
+    if( vecAnchor * vecAnchor > gsRebaseDistance * gsRebaseDistance )
+        m_ptAnchor = m_ptEye;
+    // in the relative mode the GL coordinates have their origin at the anchor
+    cPoint3d ptOrigin( 0, 0, 0 );
+    cPoint3d ptGLOrigin = m_bRelative ? m_ptAnchor : ptOrigin;
+    cPoint3d ptGLEye = ptOrigin + ( m_ptEye - ptGLOrigin );
+
+    cPoint3d ptDir = ptGLEye + m_vecView;
+    gluLookAt(	ptGLEye[X], ptGLEye[Y], ptGLEye[Z],
                 ptDir[X], ptDir[Y], ptDir[Z],
                 m_vecUp[X], m_vecUp[Y], m_vecUp[Z]);
 
@@ -199,60 +289,323 @@ cViewport::SetupOGLViev( )
 
     cMatrix3d matOut =  matProjection * matView   ;
 
-    cTuple3d tplRowSum;
-    tplRowSum = decorator::ElementSumMul( matOut[ 0 ], 1, matOut[ 3 ], 1 );
-    m_arrPlanesClip[  Left ]  = cPlane3d( tplRowSum[ X ], tplRowSum[ Y ], tplRowSum[ Z ], tplRowSum[ W ]);
+    // the planes are extracted in the GL coordinates and moved to the WCS by the GL origin
+    cVector3d vecGLOrigin = ptGLOrigin - ptOrigin;
+    SetClipPlane( m_arrPlanesClip[ Left ], decorator::ElementSumMul( matOut[ 0 ], 1, matOut[ 3 ], 1 ), vecGLOrigin );
+    SetClipPlane( m_arrPlanesClip[ Right ], decorator::ElementSumMul( matOut[ 0 ], -1, matOut[ 3 ], 1 ), vecGLOrigin );
+    SetClipPlane( m_arrPlanesClip[ Bottom ], decorator::ElementSumMul( matOut[ 1 ], 1, matOut[ 3 ], 1 ), vecGLOrigin );
+    SetClipPlane( m_arrPlanesClip[ Top ], decorator::ElementSumMul( matOut[ 1 ], -1, matOut[ 3 ], 1 ), vecGLOrigin );
+    SetClipPlane( m_arrPlanesClip[ Near ], decorator::ElementSumMul( matOut[ 2 ], 1, matOut[ 3 ], 1 ), vecGLOrigin );
+    SetClipPlane( m_arrPlanesClip[ Far ], decorator::ElementSumMul( matOut[ 2 ], -1, matOut[ 3 ], 1 ), vecGLOrigin );
+
+    // the float relative copy
+    size_t cPlane;
+    for( cPlane = 0; cPlane < gnClipPlanes ; cPlane ++ )
+    {
+        const cClipPlane& rPlane = m_arrPlanesClip[ cPlane ];
+        cRelativePlane& rPlaneRel = m_arrPlanesRel[ cPlane ];
+        rPlaneRel.m_arrfNormal[ X ] = static_cast<float>( rPlane.m_arrsNormal[ X ] );
+        rPlaneRel.m_arrfNormal[ Y ] = static_cast<float>( rPlane.m_arrsNormal[ Y ] );
+        rPlaneRel.m_arrfNormal[ Z ] = static_cast<float>( rPlane.m_arrsNormal[ Z ] );
+        rPlaneRel.m_fDistance = static_cast<float>( PlaneDistance( rPlane, m_ptAnchor ));
+    }
 
-    tplRowSum = decorator::ElementSumMul( matOut[ 0 ], -1, matOut[ 3 ], 1 );
-    m_arrPlanesClip[  Right ]  = cPlane3d( tplRowSum[ X ], tplRowSum[ Y ], tplRowSum[ Z ], tplRowSum[ W ]);
+    // the view plane, for the view depths
+    m_planeView.m_arrsNormal[ X ] = m_vecView[ X ];
+    m_planeView.m_arrsNormal[ Y ] = m_vecView[ Y ];
+    m_planeView.m_arrsNormal[ Z ] = m_vecView[ Z ];
+    m_planeView.m_sDistance = - ( m_vecView[ X ] * m_ptEye[ X ] + m_vecView[ Y ] * m_ptEye[ Y ] + m_vecView[ Z ] * m_ptEye[ Z ] );
+    m_planeViewRel.m_arrfNormal[ X ] = static_cast<float>( m_vecView[ X ] );
+    m_planeViewRel.m_arrfNormal[ Y ] = static_cast<float>( m_vecView[ Y ] );
+    m_planeViewRel.m_arrfNormal[ Z ] = static_cast<float>( m_vecView[ Z ] );
+    m_planeViewRel.m_fDistance = static_cast<float>( PlaneDistance( m_planeView, m_ptAnchor ));
+    ToRelative( m_ptEye, m_arrfEye );
+}
 
-    tplRowSum = decorator::ElementSumMul( matOut[ 1 ],  1, matOut[ 3 ], 1 );
-    m_arrPlanesClip[  Bottom ]  = cPlane3d( tplRowSum[ X ], tplRowSum[ Y ], tplRowSum[ Z ], tplRowSum[ W ]);
+void
+cViewport::ToRelative( const geom::cPoint3d& ptIn, float* parrfOut ) const
+{
+    // the subtraction is done in double, only the small difference is rounded to float
+    parrfOut[ X ] = static_cast<float>( ptIn[ X ] - m_ptAnchor[ X ] );
+    parrfOut[ Y ] = static_cast<float>( ptIn[ Y ] - m_ptAnchor[ Y ] );
+    parrfOut[ Z ] = static_cast<float>( ptIn[ Z ] - m_ptAnchor[ Z ] );
+}
 
-    tplRowSum = decorator::ElementSumMul( matOut[ 1 ],  -1, matOut[ 3 ], 1 );
-    m_arrPlanesClip[  Top ]  = cPlane3d( tplRowSum[ X ], tplRowSum[ Y ], tplRowSum[ Z ], tplRowSum[ W ]);
+float
+cViewport::RelativeMinimalFrustumDistance( const float* parrfPt ) const
+{
+    unsigned nStraddled;
+    return RelativeMinimalFrustumDistance( parrfPt, gnAllPlanes, 0.0f, nStraddled );
+}
 
-    tplRowSum = decorator::ElementSumMul( matOut[ 2 ],  1, matOut[ 3 ], 1 );
-    m_arrPlanesClip[  Near ]  = cPlane3d( tplRowSum[ X ], tplRowSum[ Y ], tplRowSum[ Z ], tplRowSum[ W ]);
+float
+cViewport::RelativeMinimalFrustumDistance( const float* parrfPt, unsigned nPlanes, float fInside, unsigned& rnStraddled ) const
+{
+    float fDist = 1.0f;
+    rnStraddled = 0;
+    size_t cPlane;
+    for( cPlane = 0; cPlane < gnClipPlanes ; cPlane ++ )
+    {
+        if( ! ( nPlanes >> cPlane & 1 ))
+            continue;
+        const cRelativePlane& rPlane = m_arrPlanesRel[ cPlane ];
+        float fR = rPlane.m_arrfNormal[ X ] * parrfPt[ X ] + rPlane.m_arrfNormal[ Y ] * parrfPt[ Y ] +
+                   rPlane.m_arrfNormal[ Z ] * parrfPt[ Z ] + rPlane.m_fDistance;
+        if( fR < fInside )
+            rnStraddled |= 1u << cPlane;
+        if( fR < fDist )
+            fDist = fR;
+    }
+    return fDist;
+}
+
+float
+cViewport::RelativeViewDepth( const float* parrfPt ) const
+{
+    return m_planeViewRel.m_arrfNormal[ X ] * parrfPt[ X ] + m_planeViewRel.m_arrfNormal[ Y ] * parrfPt[ Y ] +
+           m_planeViewRel.m_arrfNormal[ Z ] * parrfPt[ Z ] + m_planeViewRel.m_fDistance;
+}
+
+bool
+cViewport::RelativeCappedSphereInFrustum( const float* parrfPt, const float* parrfAxis, float fR, float fCap ) const
+{
+    // see CappedSphereInFrustum()
+    float fRim = fR > fCap ? sqrtf( fR * fR - fCap * fCap ) : 0.0f;
+    size_t cPlane;
+    for( cPlane = 0; cPlane < gnClipPlanes ; cPlane ++ )
+    {
+        const cRelativePlane& rPlane = m_arrPlanesRel[ cPlane ];
+        float fAxial = rPlane.m_arrfNormal[ X ] * parrfAxis[ X ] + rPlane.m_arrfNormal[ Y ] * parrfAxis[ Y ] + rPlane.m_arrfNormal[ Z ] * parrfAxis[ Z ];
+        float fSupport = fR;
+        if( fAxial * fR < - fCap )
+            fSupport = fRim * sqrtf( fAxial * fAxial < 1.0f ? 1.0f - fAxial * fAxial : 0.0f ) - fCap * fAxial;
+        float fDist = rPlane.m_arrfNormal[ X ] * parrfPt[ X ] + rPlane.m_arrfNormal[ Y ] * parrfPt[ Y ] +
+                      rPlane.m_arrfNormal[ Z ] * parrfPt[ Z ] + rPlane.m_fDistance;
+        if( fDist < - fSupport )
+            return false;
+    }
+    return true;
+}
+
+/////////////////////////////////////////////////////////////////////////////
+// batch classification
+
+#ifdef _OGL_BATCH_SIMD_
+// Each lane holds a sphere. The terms are added in the order the scalar tests add them and without fused
+// multiply-adds, and the comparisons are the same, so every lane gets exactly the scalar result. The batch is padded
+// to the lanes by the caller
+
+static void ClassifyRelativeSSE( cRelativeBatch& rBatch, const cRelativePlane& rView, const cRelativePlane* parrPlanes,
+                                 const float* parrfDepth, size_t nThresholds, unsigned* parrnBelow, unsigned* parrnStraddling )
+{
+    const size_t nLanes = 4;
+    const __m128 vecSign = _mm_set1_ps( -0.0f );
+    size_t cFirst, cPlane, cThreshold;
+    for( cFirst = 0; cFirst < rBatch.m_nCount; cFirst += nLanes )
+    {
+        __m128 vecX = _mm_loadu_ps( rBatch.m_arrfX + cFirst );
+        __m128 vecY = _mm_loadu_ps( rBatch.m_arrfY + cFirst );
+        __m128 vecZ = _mm_loadu_ps( rBatch.m_arrfZ + cFirst );
+        __m128 vecR = _mm_loadu_ps( rBatch.m_arrfR + cFirst );
+        __m128 vecDescR = _mm_loadu_ps( rBatch.m_arrfDescR + cFirst );
+        // the view depth against the LOD depths of the radius
+        __m128 vecDepth = _mm_add_ps( _mm_add_ps( _mm_add_ps( _mm_mul_ps( _mm_set1_ps( rView.m_arrfNormal[ X ] ), vecX ),
+                                                              _mm_mul_ps( _mm_set1_ps( rView.m_arrfNormal[ Y ] ), vecY )),
+                                                  _mm_mul_ps( _mm_set1_ps( rView.m_arrfNormal[ Z ] ), vecZ )),
+                                      _mm_set1_ps( rView.m_fDistance ));
+        for( cThreshold = 0; cThreshold < nThresholds; cThreshold ++ )
+            parrnBelow[ cThreshold ] |= static_cast<unsigned>( _mm_movemask_ps( _mm_cmplt_ps( _mm_mul_ps( vecR, _mm_set1_ps( parrfDepth[ cThreshold ] )), vecDepth ))) << cFirst;
+        // the frustum planes
+        __m128 vecDist = _mm_set1_ps( 1.0f );
+        for( cPlane = 0; cPlane < gnClipPlanes; cPlane ++ )
+        {
+            if( ! ( rBatch.m_nPlanes >> cPlane & 1 ))
+                continue;
+            const cRelativePlane& rPlane = parrPlanes[ cPlane ];
+            __m128 vecPlane = _mm_add_ps( _mm_add_ps( _mm_add_ps( _mm_mul_ps( _mm_set1_ps( rPlane.m_arrfNormal[ X ] ), vecX ),
+                                                                  _mm_mul_ps( _mm_set1_ps( rPlane.m_arrfNormal[ Y ] ), vecY )),
+                                                      _mm_mul_ps( _mm_set1_ps( rPlane.m_arrfNormal[ Z ] ), vecZ )),
+                                          _mm_set1_ps( rPlane.m_fDistance ));
+            parrnStraddling[ cPlane ] |= static_cast<unsigned>( _mm_movemask_ps( _mm_cmplt_ps( vecPlane, vecDescR ))) << cFirst;
+            vecDist = _mm_min_ps( vecPlane, vecDist );
+        }
+        _mm_storeu_ps( rBatch.m_arrfMinDistance + cFirst, vecDist );
+        rBatch.m_nVisible |= static_cast<unsigned>( _mm_movemask_ps( _mm_cmpge_ps( vecDist, _mm_xor_ps( vecR, vecSign )))) << cFirst;
+        rBatch.m_nTreeVisible |= static_cast<unsigned>( _mm_movemask_ps( _mm_cmpge_ps( vecDist, _mm_xor_ps( vecDescR, vecSign )))) << cFirst;
+    }
+}
+
+__attribute__(( target( "avx2" )))
+static void ClassifyRelativeAVX2( cRelativeBatch& rBatch, const cRelativePlane& rView, const cRelativePlane* parrPlanes,
+                                  const float* parrfDepth, size_t nThresholds, unsigned* parrnBelow, unsigned* parrnStraddling )
+{
+    const size_t nLanes = 8;
+    const __m256 vecSign = _mm256_set1_ps( -0.0f );
+    size_t cFirst, cPlane, cThreshold;
+    for( cFirst = 0; cFirst < rBatch.m_nCount; cFirst += nLanes )
+    {
+        __m256 vecX = _mm256_loadu_ps( rBatch.m_arrfX + cFirst );
+        __m256 vecY = _mm256_loadu_ps( rBatch.m_arrfY + cFirst );
+        __m256 vecZ = _mm256_loadu_ps( rBatch.m_arrfZ + cFirst );
+        __m256 vecR = _mm256_loadu_ps( rBatch.m_arrfR + cFirst );
+        __m256 vecDescR = _mm256_loadu_ps( rBatch.m_arrfDescR + cFirst );
+        __m256 vecDepth = _mm256_add_ps( _mm256_add_ps( _mm256_add_ps( _mm256_mul_ps( _mm256_set1_ps( rView.m_arrfNormal[ X ] ), vecX ),
+                                                                       _mm256_mul_ps( _mm256_set1_ps( rView.m_arrfNormal[ Y ] ), vecY )),
+                                                        _mm256_mul_ps( _mm256_set1_ps( rView.m_arrfNormal[ Z ] ), vecZ )),
+                                         _mm256_set1_ps( rView.m_fDistance ));
+        for( cThreshold = 0; cThreshold < nThresholds; cThreshold ++ )
+            parrnBelow[ cThreshold ] |= static_cast<unsigned>( _mm256_movemask_ps( _mm256_cmp_ps( _mm256_mul_ps( vecR, _mm256_set1_ps( parrfDepth[ cThreshold ] )), vecDepth, _CMP_LT_OQ ))) << cFirst;
+        __m256 vecDist = _mm256_set1_ps( 1.0f );
+        for( cPlane = 0; cPlane < gnClipPlanes; cPlane ++ )
+        {
+            if( ! ( rBatch.m_nPlanes >> cPlane & 1 ))
+                continue;
+            const cRelativePlane& rPlane = parrPlanes[ cPlane ];
+            __m256 vecPlane = _mm256_add_ps( _mm256_add_ps( _mm256_add_ps( _mm256_mul_ps( _mm256_set1_ps( rPlane.m_arrfNormal[ X ] ), vecX ),
+                                                                           _mm256_mul_ps( _mm256_set1_ps( rPlane.m_arrfNormal[ Y ] ), vecY )),
+                                                            _mm256_mul_ps( _mm256_set1_ps( rPlane.m_arrfNormal[ Z ] ), vecZ )),
+                                             _mm256_set1_ps( rPlane.m_fDistance ));
+            parrnStraddling[ cPlane ] |= static_cast<unsigned>( _mm256_movemask_ps( _mm256_cmp_ps( vecPlane, vecDescR, _CMP_LT_OQ ))) << cFirst;
+            vecDist = _mm256_min_ps( vecPlane, vecDist );
+        }
+        _mm256_storeu_ps( rBatch.m_arrfMinDistance + cFirst, vecDist );
+        rBatch.m_nVisible |= static_cast<unsigned>( _mm256_movemask_ps( _mm256_cmp_ps( vecDist, _mm256_xor_ps( vecR, vecSign ), _CMP_GE_OQ ))) << cFirst;
+        rBatch.m_nTreeVisible |= static_cast<unsigned>( _mm256_movemask_ps( _mm256_cmp_ps( vecDist, _mm256_xor_ps( vecDescR, vecSign ), _CMP_GE_OQ ))) << cFirst;
+    }
+}
+#endif
 
-    tplRowSum = decorator::ElementSumMul( matOut[ 2 ], -1, matOut[ 3 ], 1 );
-    m_arrPlanesClip[  Far ]  = cPlane3d( tplRowSum[ X ], tplRowSum[ Y ], tplRowSum[ Z ], tplRowSum[ W ]);
+void
+cViewport::ClassifyRelative( cRelativeBatch& rBatch, const float* parrfDepth, size_t nThresholds ) const
+{
+    _ASSERT( rBatch.m_nCount <= gnBatchSpheres && nThresholds && nThresholds <= gnBatchThresholds );
+    unsigned arrnBelow[ gnBatchThresholds ] = { 0 }; // the spheres past the depth of each threshold, i.e. projected smaller
+    unsigned arrnStraddling[ gnClipPlanes ] = { 0 };  // the descendant spheres not inside each plane
+    rBatch.m_nVisible = 0;
+    rBatch.m_nTreeVisible = 0;
+    size_t cSphere, cThreshold, cPlane;
+#ifdef _OGL_BATCH_SIMD_
+    // the lanes past the count take whatever is harmless and are masked off below
+    const size_t nPadLanes = 8;
+    for( cSphere = rBatch.m_nCount; cSphere % nPadLanes; cSphere ++ )
+    {
+        rBatch.m_arrfX[ cSphere ] = rBatch.m_arrfY[ cSphere ] = rBatch.m_arrfZ[ cSphere ] = 0;
+        rBatch.m_arrfR[ cSphere ] = rBatch.m_arrfDescR[ cSphere ] = 1;
+    }
+    // SSE is always there on x86-64, AVX2 is checked at runtime
+    if( __builtin_cpu_supports( "avx2" ))
+        ClassifyRelativeAVX2( rBatch, m_planeViewRel, m_arrPlanesRel, parrfDepth, nThresholds, arrnBelow, arrnStraddling );
+    else
+        ClassifyRelativeSSE( rBatch, m_planeViewRel, m_arrPlanesRel, parrfDepth, nThresholds, arrnBelow, arrnStraddling );
+#else
+    for( cSphere = 0; cSphere < rBatch.m_nCount; cSphere ++ )
+    {
+        float arrfPt[ gnDim3d - 1 ] = { rBatch.m_arrfX[ cSphere ], rBatch.m_arrfY[ cSphere ], rBatch.m_arrfZ[ cSphere ] };
+        float fDepth = RelativeViewDepth( arrfPt );
+        for( cThreshold = 0; cThreshold < nThresholds; cThreshold ++ )
+            if( rBatch.m_arrfR[ cSphere ] * parrfDepth[ cThreshold ] < fDepth )
+                arrnBelow[ cThreshold ] |= 1u << cSphere;
+        unsigned nStraddled;
+        float fDist = RelativeMinimalFrustumDistance( arrfPt, rBatch.m_nPlanes, rBatch.m_arrfDescR[ cSphere ], nStraddled );
+        rBatch.m_arrfMinDistance[ cSphere ] = fDist;
+        for( cPlane = 0; cPlane < gnClipPlanes; cPlane ++ )
+            arrnStraddling[ cPlane ] |= ( nStraddled >> cPlane & 1 ) << cSphere;
+        if( fDist >= - rBatch.m_arrfR[ cSphere ] )
+            rBatch.m_nVisible |= 1u << cSphere;
+        if( fDist >= - rBatch.m_arrfDescR[ cSphere ] )
+            rBatch.m_nTreeVisible |= 1u << cSphere;
+    }
+#endif
+    // the first threshold a sphere is projected below sets its LOD; below the first one it isn't seen, nor its descendants
+    for( cSphere = 0; cSphere < rBatch.m_nCount; cSphere ++ )
+    {
+        signed char nLOD = static_cast<signed char>( nThresholds - 1 );
+        for( cThreshold = nThresholds; cThreshold -- > 0; )
+            if( arrnBelow[ cThreshold ] >> cSphere & 1 )
+                nLOD = static_cast<signed char>( cThreshold ) - 1;
+        rBatch.m_arrnLOD[ cSphere ] = nLOD;
+        unsigned nStraddled = 0;
+        for( cPlane = 0; cPlane < gnClipPlanes; cPlane ++ )
+            nStraddled |= ( arrnStraddling[ cPlane ] >> cSphere & 1 ) << cPlane;
+        rBatch.m_arrnStraddled[ cSphere ] = static_cast<unsigned char>( nStraddled );
+    }
+    unsigned nSeen = ( ( 1u << rBatch.m_nCount ) - 1 ) & ~ arrnBelow[ 0 ];
+    rBatch.m_nVisible &= nSeen;
+    rBatch.m_nTreeVisible &= nSeen;
 }
 
 bool     
-cViewport::PointInFrustum( const cPoint3d&  ptTest )
+cViewport::PointInFrustum( const cPoint3d&  ptTest ) const
 {
     int cPlane;
     for( cPlane = 0; cPlane < gnClipPlanes ; cPlane ++ )
-        if( m_arrPlanesClip[ cPlane ].PointDistance( ptTest ) < static_cast<scalar>(0.0))
+        if( PlaneDistance( m_arrPlanesClip[ cPlane ], ptTest ) < static_cast<scalar>(0.0))
             return false;
     return true;        
 }
 
 bool 
-cViewport::SphereInFrustum( const cPoint3d& ptTest, scalar sR )
+cViewport::SphereInFrustum( const cPoint3d& ptTest, scalar sR ) const
 {
     int cPlane;
     for( cPlane = 0; cPlane < gnClipPlanes ; cPlane ++ )
-        if( m_arrPlanesClip[ cPlane ].PointDistance( ptTest ) < - sR )
+        if( PlaneDistance( m_arrPlanesClip[ cPlane ], ptTest ) < - sR )
             return false;
     return true;        
 } 
 
 scalar
-cViewport::PointMinimalFrustumDistance( const cPoint3d& ptTest)
+cViewport::PointMinimalFrustumDistance( const cPoint3d& ptTest) const
+{
+    unsigned nStraddled;
+    return PointMinimalFrustumDistance( ptTest, gnAllPlanes, 0, nStraddled );
+}
+
+scalar
+cViewport::PointMinimalFrustumDistance( const cPoint3d& ptTest, unsigned nPlanes, scalar sInside, unsigned& rnStraddled ) const
 {
     geom::scalar sDist = static_cast<scalar>(1.0);
+    rnStraddled = 0;
     int cPlane;
     for( cPlane = 0; cPlane < gnClipPlanes ; cPlane ++ )
     {
-        scalar sR = m_arrPlanesClip[ cPlane ].PointDistance( ptTest );
+        if( ! ( nPlanes >> cPlane & 1 ))
+            continue;
+        scalar sR = PlaneDistance( m_arrPlanesClip[ cPlane ], ptTest );
+        if( sR < sInside )
+            rnStraddled |= 1u << cPlane;
         if( sR < sDist )
             sDist =sR;
     }
     return sDist;
 }
 
+bool
+cViewport::CappedSphereInFrustum( const cPoint3d& ptTest, const cVector3d& vecAxis, scalar sR, scalar sCap ) const
+{
+    // the capped sphere reaches sR along a plane normal, unless the normal points below the cap rim; then the
+    // farthest point lies on the rim circle, sqrt( sR^2 - sCap^2 ) off the axis and sCap below the center
+    scalar sRim = sR > sCap ? sqrt( sR * sR - sCap * sCap ) : static_cast<scalar>( 0.0 );
+    size_t cPlane;
+    for( cPlane = 0; cPlane < gnClipPlanes ; cPlane ++ )
+    {
+        const cClipPlane& rPlane = m_arrPlanesClip[ cPlane ];
+        scalar sAxial = rPlane.m_arrsNormal[ X ] * vecAxis[ X ] + rPlane.m_arrsNormal[ Y ] * vecAxis[ Y ] + rPlane.m_arrsNormal[ Z ] * vecAxis[ Z ];
+        scalar sSupport = sR;
+        if( sAxial * sR < - sCap )
+            sSupport = sRim * sqrt( sAxial * sAxial < 1 ? 1 - sAxial * sAxial : static_cast<scalar>( 0.0 )) - sCap * sAxial;
+        if( PlaneDistance( rPlane, ptTest ) < - sSupport )
+            return false;
+    }
+    return true;
+}
+
+
+scalar
+cViewport::ViewDepth( const cPoint3d& ptTest ) const
+{
+    return PlaneDistance( m_planeView, ptTest );
+}
 
 const geom::cPoint3d 
 cViewport::GetEyePoint()
@@ -29,6 +29,17 @@
 /**
 @file viewport.hh
 @brief The viewport sets up the OpenGL Projection and View matrices and exports visibility functions
+In the camera-relative mode the GL view matrix and a float copy of the clip planes are expressed relative to an
+anchor point kept near the eye, so that the per-element math can run in float without losing the deep zoom precision:
+only the anchor is double. The anchor is rebased to the eye when the camera moves gsRebaseDistance away from it
+The relative spheres may be classified in batches, e.g. the children of an element, in SIMD lanes when the CPU has
+them; a batch gets bit for bit the results of the tests one by one
+The clip planes are kept in the Hessian normal form, so a plane test is one dot product. The tests may be limited to
+a mask of planes: a sphere whose parent's descendant bound is inside a plane is inside it too, so a traversal passes
+the children only the planes the parent straddles, and none at all once a subtree is inside the whole frustum
+The level of detail is chosen by the projected radius, the radius over the view depth times the pixel scale. The
+view depth is the distance to the view plane through the eye, one dot product; since the scale is fixed for a frame,
+the LOD thresholds are kept as the view depths per unit of radius they are crossed at
 */
 
 
@@ -36,6 +47,53 @@ namespace ogl
 {
 
 const size_t gnClipPlanes = 6;
+const unsigned gnAllPlanes = ( 1u << gnClipPlanes ) - 1; //!< the plane mask of the whole frustum
+const geom::scalar gsNearClip = 0.1;   //!< the near clip plane distance
+const geom::scalar gsFarClip  = 30.0;  //!< the far clip plane distance
+const geom::scalar gsRebaseDistance = 1.0; //!< the eye to anchor distance that rebases the relative coordinates
+
+////////////////////////////////////////////////////////////////////////////
+/// \brief The cClipPlane struct - a clip plane in the Hessian normal form
+/// the distance of a point is m_arrsNormal * pt + m_sDistance
+struct cClipPlane
+{
+    geom::scalar m_arrsNormal[ geom::gnDim3d - 1 ]; //!< the unit normal
+    geom::scalar m_sDistance;                       //!< the signed distance of the WCS origin to the plane
+};
+
+////////////////////////////////////////////////////////////////////////////
+/// \brief The cRelativePlane struct - a clip plane in the anchor-relative float coordinates
+/// the distance of a relative point is m_arrfNormal * pt + m_fDistance
+struct cRelativePlane
+{
+    float m_arrfNormal[ geom::gnDim3d - 1 ]; //!< the unit normal
+    float m_fDistance;                       //!< the signed distance of the anchor to the plane
+};
+
+const size_t gnBatchSpheres = 16;    //!< the spheres a cRelativeBatch holds, a multiple of the SIMD lanes
+const size_t gnBatchThresholds = 8;  //!< the LOD thresholds a batch is classified against at most
+
+////////////////////////////////////////////////////////////////////////////
+/// \brief The cRelativeBatch struct - a group of spheres classified at once, in the anchor-relative float coordinates
+/// The spheres are kept as a structure of arrays, so that they are taken in SIMD lanes. A sphere of index n is
+/// visible if the bit n of m_nVisible is set, and so on
+struct cRelativeBatch
+{
+    float         m_arrfX[ gnBatchSpheres ];            //!< the center X coordinates
+    float         m_arrfY[ gnBatchSpheres ];            //!< the center Y coordinates
+    float         m_arrfZ[ gnBatchSpheres ];            //!< the center Z coordinates
+    float         m_arrfR[ gnBatchSpheres ];            //!< the radii
+    float         m_arrfDescR[ gnBatchSpheres ];        //!< the descendant bounding sphere radii
+    size_t        m_nCount;                             //!< the spheres in the batch
+    unsigned      m_nPlanes;                            //!< the planes to test, the spheres are known to be inside the others
+    // the results
+    float         m_arrfMinDistance[ gnBatchSpheres ];  //!< the least distances to the tested planes, 1 if closer to none
+    unsigned char m_arrnStraddled[ gnBatchSpheres ];    //!< the tested planes each descendant sphere isn't inside
+    signed char   m_arrnLOD[ gnBatchSpheres ];          //!< the index of the first threshold the view depth is past, less one; the last index if none
+    unsigned      m_nVisible;                           //!< the spheres inside the frustum and above the first threshold
+    unsigned      m_nTreeVisible;                       //!< the descendant spheres inside the frustum and the spheres above the first threshold
+};
+
 class cViewport
 {
     public:
@@ -58,7 +116,14 @@ class cViewport
         int                 m_nW;           //!< Rendering surface width in pixels
         int                 m_nH;           //!< Rendering surface height in pixels
 
-        geom::cPlane3d      m_arrPlanesClip[ gnClipPlanes ]; //!< The clip planes array
+        cClipPlane          m_arrPlanesClip[ gnClipPlanes ]; //!< The clip planes array
+        cClipPlane          m_planeView;    //!< the plane through the eye across the view direction, the view depth is the distance to it
+
+        bool                m_bRelative;    //!< the GL view matrix is relative to the anchor
+        geom::cPoint3d      m_ptAnchor;     //!< the origin of the relative coordinates, near the eye
+        float               m_arrfEye[ geom::gnDim3d - 1 ]; //!< the eye point relative to the anchor
+        cRelativePlane      m_arrPlanesRel[ gnClipPlanes ]; //!< The clip planes relative to the anchor
+        cRelativePlane      m_planeViewRel; //!< The view plane relative to the anchor
 
     public:
 
@@ -71,6 +136,14 @@ class cViewport
     // accessors
         const geom::cPoint3d GetEyePoint(); //!< retrieves the virtual camera's eye point
         geom::scalar GetFOV() const;        //!<  retrieves the virtual camera's field of view in radians
+        const geom::cVector3d& GetViewDirection() const; //!< retrieves the virtual camera's unit view direction
+        const geom::cVector3d& GetUpDirection() const;   //!< retrieves the virtual camera's up vector
+        geom::scalar GetAspect() const;     //!< retrieves the rendering surface width to height ratio
+        int GetHeight() const;              //!< retrieves the rendering surface height in pixels
+        geom::scalar GetPixelScale() const; //!< retrieves the pixels a unit of size spans at a unit of view depth
+        bool IsRelative() const;            //!< checks if the GL view matrix is relative to the anchor
+        const geom::cPoint3d& GetAnchor() const; //!< retrieves the origin of the relative coordinates
+        const float* GetRelativeEye() const;     //!< retrieves the eye point relative to the anchor
     // scene operations
         void Reset ( const geom::cPoint3d& ptEye, const geom::cVector3d& vecView, const geom::cVector3d& vecUp,
                      geom::scalar sFOV, geom::decorator::AngleUnit );       //!< reinitializes the virtual camera
@@ -81,12 +154,23 @@ class cViewport
         void MoveInViewDir( geom::scalar sMove );                           //!< Moves the camera's LCS into camera View direction
         void AddFOV( geom::scalar sAngle, geom::decorator::AngleUnit );     //!< Increments the camrea's FOV
         void SetExtents( int nPortWidth, int nPortHeight );                 //!< Changes viewport ectents and recomputes the aspect
+        void SetRelative( bool bRelative );                                 //!< Switches the camera-relative mode
     // visibility operations
         geom::scalar SegmentVisibleAngle( const geom::cPoint3d& ptOrg, geom::scalar sLen ); //!< Claculates the viewing angle of a segment of line sLen prependicular to view dirtvion to ptOrg
         geom::scalar SegmentVisibleCosine( const geom::cPoint3d& ptOrg, geom::scalar sLen ); //!< Claculates the cosine value of viewing angle of a segment of line sLen prependicular to view dirtvion to ptOrg
-        bool PointInFrustum( const geom::cPoint3d& );                                        //!< Chexks if a point is inside the frustim planes
-        bool SphereInFrustum( const geom::cPoint3d&, geom::scalar sR );                      //!<  Chexks if a sphere is inside the frustim planes
-        geom::scalar PointMinimalFrustumDistance( const geom::cPoint3d& );                   //!<  Calculates the minimum distance of a point to all frustum planes
+        bool PointInFrustum( const geom::cPoint3d& ) const;                                  //!< Chexks if a point is inside the frustim planes
+        bool SphereInFrustum( const geom::cPoint3d&, geom::scalar sR ) const;                //!<  Chexks if a sphere is inside the frustim planes
+        geom::scalar PointMinimalFrustumDistance( const geom::cPoint3d& ) const;             //!<  Calculates the minimum distance of a point to all frustum planes
+        geom::scalar PointMinimalFrustumDistance( const geom::cPoint3d&, unsigned nPlanes, geom::scalar sInside, unsigned& rnStraddled ) const; //!< Same for the planes of the mask nPlanes, also finding the ones a sphere of radius sInside isn't inside
+        bool CappedSphereInFrustum( const geom::cPoint3d&, const geom::cVector3d& vecAxis, geom::scalar sR, geom::scalar sCap ) const; //!< Checks if the part of a sphere above the plane sCap below the center, across vecAxis, is inside the frustum planes
+        geom::scalar ViewDepth( const geom::cPoint3d& ) const;                               //!< Calculates the depth of a point along the view direction, from the eye
+    // relative visibility operations
+        void ToRelative( const geom::cPoint3d& ptIn, float* parrfOut ) const;                //!< Converts a point to the anchor-relative float coordinates
+        float RelativeMinimalFrustumDistance( const float* parrfPt ) const;                  //!< Calculates the minimum distance of a relative point to all frustum planes
+        float RelativeViewDepth( const float* parrfPt ) const;                               //!< Same as ViewDepth() for a relative point
+        float RelativeMinimalFrustumDistance( const float* parrfPt, unsigned nPlanes, float fInside, unsigned& rnStraddled ) const; //!< Same for the planes of the mask nPlanes, also finding the ones a sphere of radius fInside isn't inside
+        bool RelativeCappedSphereInFrustum( const float* parrfPt, const float* parrfAxis, float fR, float fCap ) const; //!< Same as CappedSphereInFrustum() for a relative point
+        void ClassifyRelative( cRelativeBatch&, const float* parrfDepth, size_t nThresholds ) const; //!< Classifies a batch against the masked frustum planes and the LOD view depths per unit of radius
     protected:
         void SetupOGLViev( ); //!< recreates the internal objects and sets up the OGL matrices
         void TransformBasis( const geom::cMatrix3d& ); //!< Transforms the LCS bu the argument matrix